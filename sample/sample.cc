@@ -17,9 +17,8 @@ int main(int argc, char const *argv[]) {
         std::cout << "load failed as file corrupted." << std::endl;
     }
 
-    auto target = ree::io::Source::SourceByPath("./test/lena_xx.ppm");
     try {
-        img.WriteTo(target.get());
+        img.WriteTo("./test/lena_xx.ppm");
     } catch (std::ios_base::failure ioe) {
         std::cout << "write failed as io failure." << std::endl;
     }
@@ -0,0 +1,129 @@
+#include "allocator.hpp"
+
+#include <atomic>
+#include <cstdlib>
+
+#ifdef WIN32
+#include <malloc.h>
+#endif
+
+namespace ree {
+namespace image {
+
+static size_t AlignUp(size_t size) {
+    return (size + kPixelAlignment - 1) / kPixelAlignment * kPixelAlignment;
+}
+
+void *AlignedPixelAllocator::Allocate(size_t size) {
+    size = AlignUp(size == 0 ? 1 : size);
+#ifdef WIN32
+    void *ptr = _aligned_malloc(size, kPixelAlignment);
+#else
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, kPixelAlignment, size) != 0) {
+        ptr = nullptr;
+    }
+#endif
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void AlignedPixelAllocator::Deallocate(void *ptr, size_t) {
+#ifdef WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+PoolPixelAllocator::PoolPixelAllocator(size_t maxCachedBytes)
+    : maxCachedBytes_(maxCachedBytes) {
+}
+
+PoolPixelAllocator::~PoolPixelAllocator() {
+    Trim();
+}
+
+void *PoolPixelAllocator::Allocate(size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto find = free_.find(size);
+        if (find != free_.end() && !find->second.empty()) {
+            void *ptr = find->second.back();
+            find->second.pop_back();
+            cachedBytes_ -= size;
+            return ptr;
+        }
+    }
+    return upstream_.Allocate(size);
+}
+
+void PoolPixelAllocator::Deallocate(void *ptr, size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cachedBytes_ + size <= maxCachedBytes_) {
+            free_[size].push_back(ptr);
+            cachedBytes_ += size;
+            return;
+        }
+    }
+    upstream_.Deallocate(ptr, size);
+}
+
+void PoolPixelAllocator::Trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &buffers : free_) {
+        for (auto ptr : buffers.second) {
+            upstream_.Deallocate(ptr, buffers.first);
+        }
+    }
+    free_.clear();
+    cachedBytes_ = 0;
+}
+
+ArenaPixelAllocator::ArenaPixelAllocator(void *memory, size_t size)
+    : memory_(static_cast<uint8_t *>(memory)), size_(size) {
+}
+
+void *ArenaPixelAllocator::Allocate(size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // align the address rather than the offset, the arena may be unaligned
+    auto base = reinterpret_cast<uintptr_t>(memory_);
+    size_t offset = AlignUp(base + used_) - base;
+    if (offset > size_ || size > size_ - offset) {
+        throw std::bad_alloc();
+    }
+    last_ = used_;
+    used_ = offset + size;
+    return memory_ + offset;
+}
+
+void ArenaPixelAllocator::Deallocate(void *ptr, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (static_cast<uint8_t *>(ptr) + size == memory_ + used_) {
+        used_ = last_;
+    }
+}
+
+void ArenaPixelAllocator::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    used_ = 0;
+    last_ = 0;
+}
+
+static AlignedPixelAllocator kAlignedAllocator;
+static std::atomic<PixelAllocator *> gDefaultAllocator(&kAlignedAllocator);
+
+PixelAllocator *DefaultPixelAllocator() {
+    return gDefaultAllocator.load(std::memory_order_acquire);
+}
+
+void SetDefaultPixelAllocator(PixelAllocator *allocator) {
+    gDefaultAllocator.store(allocator ? allocator : &kAlignedAllocator,
+        std::memory_order_release);
+}
+
+}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace ree {
+namespace image {
+
+/// alignment of every pixel buffer, a cache line and a full AVX-512 register
+static constexpr size_t kPixelAlignment = 64;
+
+/**
+ * @brief where the pixel memory of io::Image and process::Image comes from.
+ *
+ * Implementations must be thread safe and outlive every buffer they handed
+ * out. Memory is returned uninitialized and aligned to kPixelAlignment.
+ */
+class PixelAllocator {
+public:
+    virtual ~PixelAllocator() = default;
+
+    virtual void *Allocate(size_t size) = 0;
+    virtual void Deallocate(void *ptr, size_t size) = 0;
+};
+
+/// plain aligned heap memory, the default allocator
+class AlignedPixelAllocator : public PixelAllocator {
+public:
+    void *Allocate(size_t size) override;
+    void Deallocate(void *ptr, size_t size) override;
+};
+
+/**
+ * @brief keeps freed buffers around and hands them out again for requests of
+ * the same size, up to maxCachedBytes in total.
+ */
+class PoolPixelAllocator : public PixelAllocator {
+public:
+    explicit PoolPixelAllocator(size_t maxCachedBytes = 256 << 20);
+    ~PoolPixelAllocator() override;
+
+    void *Allocate(size_t size) override;
+    void Deallocate(void *ptr, size_t size) override;
+
+    /// free every cached buffer
+    void Trim();
+
+private:
+    AlignedPixelAllocator upstream_;
+    size_t maxCachedBytes_;
+    size_t cachedBytes_ = 0;
+    std::mutex mutex_;
+    std::map<size_t, std::vector<void *>> free_;
+};
+
+/**
+ * @brief bump allocation from memory owned by the caller. Only the most
+ * recent allocation is given back on Deallocate, Reset() rewinds everything.
+ * Throws std::bad_alloc once the arena is exhausted.
+ */
+class ArenaPixelAllocator : public PixelAllocator {
+public:
+    ArenaPixelAllocator(void *memory, size_t size);
+
+    void *Allocate(size_t size) override;
+    void Deallocate(void *ptr, size_t size) override;
+
+    void Reset();
+    size_t Used() const { return used_; }
+
+private:
+    uint8_t *memory_;
+    size_t size_;
+    size_t used_ = 0;
+    size_t last_ = 0;
+    std::mutex mutex_;
+};
+
+/// the allocator new pixel buffers use, nullptr restores the builtin one
+PixelAllocator *DefaultPixelAllocator();
+void SetDefaultPixelAllocator(PixelAllocator *allocator);
+
+}
+}
@@ -0,0 +1,39 @@
+#include "byte_shuffle.hpp"
+
+#include <stdexcept>
+
+namespace ree {
+namespace image {
+
+constexpr int ChunkShuffle::kMaxChunks;
+
+ChunkShuffle ChunkShuffle::Build(int inChunks, int outChunks,
+    const std::function<int(int)> &source) {
+    if (inChunks > kMaxChunks || outChunks > kMaxChunks) {
+        throw std::invalid_argument("too many chunks to shuffle.");
+    }
+    ChunkShuffle shuffle;
+    shuffle.inChunks = inChunks;
+    shuffle.outChunks = outChunks;
+    for (int j = 0; j < outChunks; ++j) {
+        for (int k = 0; k < inChunks; ++k) {
+            ByteMask mask;
+            mask.fill(0x80);
+            bool used = false;
+            for (int i = 0; i < 16; ++i) {
+                int from = source(j * 16 + i);
+                if (from >= 0 && from / 16 == k) {
+                    mask[i] = static_cast<uint8_t>(from % 16);
+                    used = true;
+                }
+            }
+            if (used) {
+                shuffle.parts[j].push_back(std::make_pair(k, mask));
+            }
+        }
+    }
+    return shuffle;
+}
+
+}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <ree/image/simd.hpp>
+
+#ifdef REE_IMAGE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace ree {
+namespace image {
+
+/// picks bytes of a 16 byte chunk for pshufb, 0x80 gives a zero byte
+using ByteMask = std::array<uint8_t, 16>;
+
+/**
+ * @brief moves bytes between up to 8 chunks of 16 bytes each way, e.g. to
+ * interleave or split pixels. Output chunk j is the OR of the pshufb of the
+ * input chunks in parts[j] with their masks, outputs left without parts are
+ * zero.
+ */
+struct ChunkShuffle {
+    static constexpr int kMaxChunks = 8;
+
+    int inChunks = 0;
+    int outChunks = 0;
+    std::vector<std::pair<int, ByteMask>> parts[kMaxChunks];
+
+    /// source(i) is the input byte output byte i comes from, -1 for a zero
+    static ChunkShuffle Build(int inChunks, int outChunks,
+        const std::function<int(int)> &source);
+};
+
+#ifdef REE_IMAGE_SIMD_X86
+
+REE_TARGET("ssse3")
+inline void ApplyShuffle(const ChunkShuffle &shuffle, const __m128i *in,
+    __m128i *out) {
+    for (int j = 0; j < shuffle.outChunks; ++j) {
+        __m128i chunk = _mm_setzero_si128();
+        for (const auto &part : shuffle.parts[j]) {
+            chunk = _mm_or_si128(chunk, _mm_shuffle_epi8(in[part.first],
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                part.second.data()))));
+        }
+        out[j] = chunk;
+    }
+}
+
+#endif
+
+}
+}
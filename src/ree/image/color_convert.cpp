@@ -0,0 +1,819 @@
+#include "color_convert.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+#include <vector>
+
+#include <ree/image/byte_shuffle.hpp>
+#include <ree/image/pixel_format.hpp>
+#include <ree/image/simd.hpp>
+
+#ifdef REE_IMAGE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace ree {
+namespace image {
+
+namespace {
+
+/// a pixel on its way between two color spaces
+struct Rgba {
+    int64_t r;
+    int64_t g;
+    int64_t b;
+    int64_t a;
+};
+
+/// fixed point factors, 16 fraction bits
+constexpr int64_t kHalf = 1 << 15;
+
+inline int64_t Luma(int64_t r, int64_t g, int64_t b) {
+    return (19595 * r + 38470 * g + 7471 * b + kHalf) >> 16;
+}
+
+/// a float pixel on its way, samples are in [0, 1] but for those out of it
+/// which are kept, so HDR values pass through
+struct RgbaF {
+    float r;
+    float g;
+    float b;
+    float a;
+};
+
+inline float Luma(float r, float g, float b) {
+    return 0.299f * r + 0.587f * g + 0.114f * b;
+}
+
+/// the reader and writer of every color space, maxValue is the largest
+/// sample and mid the zero of the chroma channels
+struct Gray {
+    static constexpr int kComponents = 1;
+    template <typename ValueT>
+    static Rgba Read(const ValueT *p, int64_t maxValue, int64_t) {
+        return Rgba{p[0], p[0], p[0], maxValue};
+    }
+    template <typename ValueT>
+    static void Write(const Rgba &c, ValueT *p, int64_t, int64_t) {
+        p[0] = static_cast<ValueT>(Luma(c.r, c.g, c.b));
+    }
+    static RgbaF Read(const float *p) {
+        return RgbaF{p[0], p[0], p[0], 1.0f};
+    }
+    static void Write(const RgbaF &c, float *p) {
+        p[0] = Luma(c.r, c.g, c.b);
+    }
+};
+
+struct GrayAlpha {
+    static constexpr int kComponents = 2;
+    template <typename ValueT>
+    static Rgba Read(const ValueT *p, int64_t, int64_t) {
+        return Rgba{p[0], p[0], p[0], p[1]};
+    }
+    template <typename ValueT>
+    static void Write(const Rgba &c, ValueT *p, int64_t, int64_t) {
+        p[0] = static_cast<ValueT>(Luma(c.r, c.g, c.b));
+        p[1] = static_cast<ValueT>(c.a);
+    }
+    static RgbaF Read(const float *p) {
+        return RgbaF{p[0], p[0], p[0], p[1]};
+    }
+    static void Write(const RgbaF &c, float *p) {
+        p[0] = Luma(c.r, c.g, c.b);
+        p[1] = c.a;
+    }
+};
+
+struct Rgb {
+    static constexpr int kComponents = 3;
+    template <typename ValueT>
+    static Rgba Read(const ValueT *p, int64_t maxValue, int64_t) {
+        return Rgba{p[0], p[1], p[2], maxValue};
+    }
+    template <typename ValueT>
+    static void Write(const Rgba &c, ValueT *p, int64_t, int64_t) {
+        p[0] = static_cast<ValueT>(c.r);
+        p[1] = static_cast<ValueT>(c.g);
+        p[2] = static_cast<ValueT>(c.b);
+    }
+    static RgbaF Read(const float *p) {
+        return RgbaF{p[0], p[1], p[2], 1.0f};
+    }
+    static void Write(const RgbaF &c, float *p) {
+        p[0] = c.r;
+        p[1] = c.g;
+        p[2] = c.b;
+    }
+};
+
+struct RgbAlpha {
+    static constexpr int kComponents = 4;
+    template <typename ValueT>
+    static Rgba Read(const ValueT *p, int64_t, int64_t) {
+        return Rgba{p[0], p[1], p[2], p[3]};
+    }
+    template <typename ValueT>
+    static void Write(const Rgba &c, ValueT *p, int64_t, int64_t) {
+        p[0] = static_cast<ValueT>(c.r);
+        p[1] = static_cast<ValueT>(c.g);
+        p[2] = static_cast<ValueT>(c.b);
+        p[3] = static_cast<ValueT>(c.a);
+    }
+    static RgbaF Read(const float *p) {
+        return RgbaF{p[0], p[1], p[2], p[3]};
+    }
+    static void Write(const RgbaF &c, float *p) {
+        p[0] = c.r;
+        p[1] = c.g;
+        p[2] = c.b;
+        p[3] = c.a;
+    }
+};
+
+struct YCbCr {
+    static constexpr int kComponents = 3;
+    template <typename ValueT>
+    static Rgba Read(const ValueT *p, int64_t maxValue, int64_t mid) {
+        int64_t y = static_cast<int64_t>(p[0]) << 16;
+        int64_t cb = p[1] - mid;
+        int64_t cr = p[2] - mid;
+        auto clamp = [maxValue](int64_t v) {
+            return std::min(std::max(v, int64_t(0)), maxValue);
+        };
+        return Rgba{clamp((y + 91881 * cr + kHalf) >> 16),
+            clamp((y - 22554 * cb - 46802 * cr + kHalf) >> 16),
+            clamp((y + 116130 * cb + kHalf) >> 16), maxValue};
+    }
+    template <typename ValueT>
+    static void Write(const Rgba &c, ValueT *p, int64_t maxValue,
+        int64_t mid) {
+        auto clamp = [maxValue](int64_t v) {
+            return std::min(std::max(v, int64_t(0)), maxValue);
+        };
+        int64_t cb = (-11059 * c.r - 21709 * c.g + 32768 * c.b + kHalf) >> 16;
+        int64_t cr = (32768 * c.r - 27439 * c.g - 5329 * c.b + kHalf) >> 16;
+        p[0] = static_cast<ValueT>(Luma(c.r, c.g, c.b));
+        p[1] = static_cast<ValueT>(clamp(cb + mid));
+        p[2] = static_cast<ValueT>(clamp(cr + mid));
+    }
+    /// the factors of the fixed point ones, unclamped, chroma zero at 0.5
+    static RgbaF Read(const float *p) {
+        float cb = p[1] - 0.5f;
+        float cr = p[2] - 0.5f;
+        return RgbaF{p[0] + 1.402f * cr,
+            p[0] - 0.344136f * cb - 0.714136f * cr, p[0] + 1.772f * cb, 1.0f};
+    }
+    static void Write(const RgbaF &c, float *p) {
+        p[0] = Luma(c.r, c.g, c.b);
+        p[1] = -0.168736f * c.r - 0.331264f * c.g + 0.5f * c.b + 0.5f;
+        p[2] = 0.5f * c.r - 0.418688f * c.g - 0.081312f * c.b + 0.5f;
+    }
+};
+
+/// the reader and writer of the pixels of a format
+template <ColorSpace::Value CS>
+struct Codec;
+template <>
+struct Codec<ColorSpace::Gray> {
+    using Type = Gray;
+};
+template <>
+struct Codec<ColorSpace::GrayAlpha> {
+    using Type = GrayAlpha;
+};
+template <>
+struct Codec<ColorSpace::RGB> {
+    using Type = Rgb;
+};
+template <>
+struct Codec<ColorSpace::RGBA> {
+    using Type = RgbAlpha;
+};
+template <>
+struct Codec<ColorSpace::YCbCr> {
+    using Type = YCbCr;
+};
+
+/// From and To are the PixelFormat of the pixels, the depth is constant
+/// but for formats of depth 0
+template <typename From, typename To, typename ValueT>
+void ConvertLoop(const ValueT *src, ValueT *dst, size_t count,
+    uint8_t depth) {
+    using Reader = typename Codec<From::kColorSpace>::Type;
+    using Writer = typename Codec<To::kColorSpace>::Type;
+    const int64_t maxValue = From::MaxValue(depth);
+    const int64_t mid = From::MidValue(depth);
+    for (size_t i = 0; i < count; ++i) {
+        Rgba c = Reader::Read(src + i * From::kComponents, maxValue, mid);
+        Writer::Write(c, dst + i * To::kComponents, maxValue, mid);
+    }
+}
+
+template <typename From, typename To>
+void ConvertLoop(const float *src, float *dst, size_t count, uint8_t) {
+    using Reader = typename Codec<From::kColorSpace>::Type;
+    using Writer = typename Codec<To::kColorSpace>::Type;
+    for (size_t i = 0; i < count; ++i) {
+        Writer::Write(Reader::Read(src + i * From::kComponents),
+            dst + i * To::kComponents);
+    }
+}
+
+#ifdef REE_IMAGE_SIMD_X86
+
+/// the position of cs in the kernel tables
+int IndexOf(ColorSpace cs) {
+    static const ColorSpace kOrder[] = {
+        ColorSpace::RGB, ColorSpace::RGBA, ColorSpace::Gray,
+        ColorSpace::GrayAlpha, ColorSpace::YCbCr,
+    };
+    for (int i = 0; i < 5; ++i) {
+        if (kOrder[i] == cs) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/// sources of the samples a conversion which only moves samples adds,
+/// besides the components of the pixel converted
+constexpr int kMaxSample = -1;
+constexpr int kMidSample = -2;
+
+/// whether converting from into to only moves samples, map then tells where
+/// every component of to comes from
+bool ShuffleMap(ColorSpace from, ColorSpace to, int *map) {
+    // YCbCr of gray has Y the gray value and no chroma
+    struct Entry {
+        ColorSpace from;
+        ColorSpace to;
+        int map[4];
+    };
+    static const Entry kEntries[] = {
+        {ColorSpace::Gray, ColorSpace::GrayAlpha, {0, kMaxSample}},
+        {ColorSpace::Gray, ColorSpace::RGB, {0, 0, 0}},
+        {ColorSpace::Gray, ColorSpace::RGBA, {0, 0, 0, kMaxSample}},
+        {ColorSpace::Gray, ColorSpace::YCbCr, {0, kMidSample, kMidSample}},
+        {ColorSpace::GrayAlpha, ColorSpace::Gray, {0}},
+        {ColorSpace::GrayAlpha, ColorSpace::RGB, {0, 0, 0}},
+        {ColorSpace::GrayAlpha, ColorSpace::RGBA, {0, 0, 0, 1}},
+        {ColorSpace::GrayAlpha, ColorSpace::YCbCr,
+            {0, kMidSample, kMidSample}},
+        {ColorSpace::RGB, ColorSpace::RGBA, {0, 1, 2, kMaxSample}},
+        {ColorSpace::RGBA, ColorSpace::RGB, {0, 1, 2}},
+    };
+    for (const auto &entry : kEntries) {
+        if (entry.from == from && entry.to == to) {
+            std::copy(entry.map, entry.map + 4, map);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief a conversion which only moves samples, done 16 pixels at a time so
+ * both sides are whole 16 byte chunks.
+ */
+struct ShuffleKernel {
+    int fromComponents = 0;
+    int toComponents = 0;
+    int bytes = 0;
+    int map[4];
+    ChunkShuffle chunks;
+};
+
+ShuffleKernel BuildShuffle(int fromComponents, int toComponents,
+    const int *map, int bytes) {
+    ShuffleKernel kernel;
+    kernel.fromComponents = fromComponents;
+    kernel.toComponents = toComponents;
+    kernel.bytes = bytes;
+    std::copy(map, map + 4, kernel.map);
+    kernel.chunks = ChunkShuffle::Build(fromComponents * bytes,
+        toComponents * bytes, [&](int pos) {
+        int component = map[pos / bytes % toComponents];
+        if (component < 0) {
+            return -1;
+        }
+        int pixel = pos / (toComponents * bytes);
+        return (pixel * fromComponents + component) * bytes + pos % bytes;
+    });
+    return kernel;
+}
+
+/// the shuffle kernels of every pair of color spaces and sample size
+class ShuffleTable {
+public:
+    static const ShuffleTable &Instance() {
+        static const ShuffleTable table;
+        return table;
+    }
+
+    const ShuffleKernel *Find(ColorSpace from, ColorSpace to,
+        int bytes) const {
+        int i = IndexOf(from);
+        int j = IndexOf(to);
+        if (i < 0 || j < 0) {
+            return nullptr;
+        }
+        const Slot &slot = slots_[i][j][bytes - 1];
+        return slot.valid ? &slot.kernel : nullptr;
+    }
+
+private:
+    struct Slot {
+        bool valid = false;
+        ShuffleKernel kernel;
+    };
+
+    ShuffleTable() {
+        static const ColorSpace kSpaces[] = {
+            ColorSpace::RGB, ColorSpace::RGBA, ColorSpace::Gray,
+            ColorSpace::GrayAlpha, ColorSpace::YCbCr,
+        };
+        // in the order of IndexOf
+        for (int i = 0; i < 5; ++i) {
+            for (int j = 0; j < 5; ++j) {
+                ColorSpace from = kSpaces[i];
+                ColorSpace to = kSpaces[j];
+                int map[4];
+                if (!ShuffleMap(from, to, map)) {
+                    continue;
+                }
+                for (int bytes = 1; bytes <= 2; ++bytes) {
+                    Slot &slot = slots_[i][j][bytes - 1];
+                    slot.valid = true;
+                    slot.kernel = BuildShuffle(from.Components(),
+                        to.Components(), map, bytes);
+                }
+            }
+        }
+    }
+
+    Slot slots_[5][5][2];
+};
+
+REE_TARGET("ssse3")
+void ShuffleSsse3(const uint8_t *src, uint8_t *dst, size_t blocks,
+    const ShuffleKernel &kernel, const ByteMask *constants) {
+    int inChunks = kernel.chunks.inChunks;
+    int outChunks = kernel.chunks.outChunks;
+    __m128i in[8];
+    __m128i out[8];
+    for (size_t block = 0; block < blocks; ++block) {
+        for (int i = 0; i < inChunks; ++i) {
+            in[i] = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(src) + i);
+        }
+        ApplyShuffle(kernel.chunks, in, out);
+        for (int o = 0; o < outChunks; ++o) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst) + o,
+                _mm_or_si128(out[o], _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(constants[o].data()))));
+        }
+        src += 16 * inChunks;
+        dst += 16 * outChunks;
+    }
+}
+
+/// convert whole blocks of 16 pixels with kernel, returns the pixels done
+size_t Shuffle(const uint8_t *src, uint8_t *dst, size_t count,
+    const ShuffleKernel &kernel, int64_t maxValue, int64_t mid) {
+    // the samples added, little endian as the pixels are
+    ByteMask constants[8];
+    for (int o = 0; o < kernel.toComponents * kernel.bytes; ++o) {
+        for (int i = 0; i < 16; ++i) {
+            int pos = o * 16 + i;
+            int component = kernel.map[pos / kernel.bytes %
+                kernel.toComponents];
+            int64_t value = component == kMaxSample ? maxValue :
+                component == kMidSample ? mid : 0;
+            constants[o][i] = static_cast<uint8_t>(
+                value >> (8 * (pos % kernel.bytes)));
+        }
+    }
+    size_t blocks = count / 16;
+    ShuffleSsse3(src, dst, blocks, kernel, constants);
+    return blocks * 16;
+}
+
+/**
+ * @brief how 8 interleaved pixels split into one chunk per component, with
+ * the samples of the pixels in order, and join again.
+ */
+struct PlaneMasks {
+    /// split[component][input chunk]
+    ByteMask split[4][4];
+    /// join[output chunk][component]
+    ByteMask join[4][4];
+};
+
+PlaneMasks BuildPlaneMasks(int components, int bytes) {
+    PlaneMasks masks;
+    int blockBytes = 8 * components * bytes;
+    for (int c = 0; c < components; ++c) {
+        for (int chunk = 0; chunk < 4; ++chunk) {
+            ByteMask &split = masks.split[c][chunk];
+            ByteMask &join = masks.join[chunk][c];
+            split.fill(0x80);
+            join.fill(0x80);
+            for (int i = 0; i < 16; ++i) {
+                int from = (i / bytes * components + c) * bytes + i % bytes;
+                if (i < 8 * bytes && from / 16 == chunk) {
+                    split[i] = static_cast<uint8_t>(from % 16);
+                }
+                int pos = chunk * 16 + i;
+                if (pos < blockBytes && pos / bytes % components == c) {
+                    join[i] = static_cast<uint8_t>(
+                        pos / (components * bytes) * bytes + pos % bytes);
+                }
+            }
+        }
+    }
+    return masks;
+}
+
+const PlaneMasks &PlaneMasksOf(int components, int bytes) {
+    struct Table {
+        Table() {
+            for (int c = 1; c <= 4; ++c) {
+                for (int b = 1; b <= 2; ++b) {
+                    masks[c - 1][b - 1] = BuildPlaneMasks(c, b);
+                }
+            }
+        }
+        PlaneMasks masks[4][2];
+    };
+    static const Table table;
+    return table.masks[components - 1][bytes - 1];
+}
+
+namespace avx2 {
+
+/// 8 pixels on their way between two color spaces, a 32 bit lane each
+struct Rgba {
+    __m256i r;
+    __m256i g;
+    __m256i b;
+    __m256i a;
+};
+
+struct Constants {
+    __m256i maxValue;
+    __m256i mid;
+};
+
+REE_TARGET("avx2")
+inline __m256i Clamp(__m256i v, const Constants &k) {
+    return _mm256_min_epi32(_mm256_max_epi32(v, _mm256_setzero_si256()),
+        k.maxValue);
+}
+
+REE_TARGET("avx2")
+inline __m256i Mul(__m256i v, int32_t factor) {
+    return _mm256_mullo_epi32(v, _mm256_set1_epi32(factor));
+}
+
+/// the scalar factors, 16 bit samples overflow 32 bits but not their sum
+/// taken unsigned
+REE_TARGET("avx2")
+inline __m256i Luma(const Rgba &c) {
+    __m256i sum = _mm256_add_epi32(_mm256_add_epi32(Mul(c.r, 19595),
+        Mul(c.g, 38470)), _mm256_add_epi32(Mul(c.b, 7471),
+        _mm256_set1_epi32(kHalf)));
+    return _mm256_srli_epi32(sum, 16);
+}
+
+/// (v << 16 + factor * v + rest) >> 16 as v + (factor * v + rest) >> 16,
+/// which stays in 32 bits
+REE_TARGET("avx2")
+inline __m256i AddFraction(__m256i v, __m256i fraction) {
+    return _mm256_add_epi32(v, _mm256_srai_epi32(
+        _mm256_add_epi32(fraction, _mm256_set1_epi32(kHalf)), 16));
+}
+
+struct Gray {
+    static constexpr int kComponents = 1;
+    REE_TARGET("avx2")
+    static Rgba Read(const __m256i *p, const Constants &k) {
+        return Rgba{p[0], p[0], p[0], k.maxValue};
+    }
+    REE_TARGET("avx2")
+    static void Write(const Rgba &c, __m256i *p, const Constants &) {
+        p[0] = Luma(c);
+    }
+};
+
+struct GrayAlpha {
+    static constexpr int kComponents = 2;
+    REE_TARGET("avx2")
+    static Rgba Read(const __m256i *p, const Constants &) {
+        return Rgba{p[0], p[0], p[0], p[1]};
+    }
+    REE_TARGET("avx2")
+    static void Write(const Rgba &c, __m256i *p, const Constants &) {
+        p[0] = Luma(c);
+        p[1] = c.a;
+    }
+};
+
+struct Rgb {
+    static constexpr int kComponents = 3;
+    REE_TARGET("avx2")
+    static Rgba Read(const __m256i *p, const Constants &k) {
+        return Rgba{p[0], p[1], p[2], k.maxValue};
+    }
+    REE_TARGET("avx2")
+    static void Write(const Rgba &c, __m256i *p, const Constants &) {
+        p[0] = c.r;
+        p[1] = c.g;
+        p[2] = c.b;
+    }
+};
+
+struct RgbAlpha {
+    static constexpr int kComponents = 4;
+    REE_TARGET("avx2")
+    static Rgba Read(const __m256i *p, const Constants &) {
+        return Rgba{p[0], p[1], p[2], p[3]};
+    }
+    REE_TARGET("avx2")
+    static void Write(const Rgba &c, __m256i *p, const Constants &) {
+        p[0] = c.r;
+        p[1] = c.g;
+        p[2] = c.b;
+        p[3] = c.a;
+    }
+};
+
+/// the scalar factors split into a whole and a fraction part, the results
+/// are the same
+struct YCbCr {
+    static constexpr int kComponents = 3;
+    REE_TARGET("avx2")
+    static Rgba Read(const __m256i *p, const Constants &k) {
+        __m256i y = p[0];
+        __m256i cb = _mm256_sub_epi32(p[1], k.mid);
+        __m256i cr = _mm256_sub_epi32(p[2], k.mid);
+        // 91881 = 65536 + 26345, 46802 = 65536 - 18734, 116130 = 65536 + 50594
+        __m256i r = AddFraction(_mm256_add_epi32(y, cr), Mul(cr, 26345));
+        __m256i g = AddFraction(_mm256_sub_epi32(y, cr),
+            _mm256_sub_epi32(Mul(cr, 18734), Mul(cb, 22554)));
+        __m256i b = AddFraction(_mm256_add_epi32(y, cb), Mul(cb, 50594));
+        return Rgba{Clamp(r, k), Clamp(g, k), Clamp(b, k), k.maxValue};
+    }
+    REE_TARGET("avx2")
+    static void Write(const Rgba &c, __m256i *p, const Constants &k) {
+        // 32768 * v = 65536 * (v >> 1) + 32768 * (v & 1)
+        __m256i one = _mm256_set1_epi32(1);
+        __m256i cb = AddFraction(_mm256_srli_epi32(c.b, 1), _mm256_sub_epi32(
+            _mm256_slli_epi32(_mm256_and_si256(c.b, one), 15),
+            _mm256_add_epi32(Mul(c.r, 11059), Mul(c.g, 21709))));
+        __m256i cr = AddFraction(_mm256_srli_epi32(c.r, 1), _mm256_sub_epi32(
+            _mm256_slli_epi32(_mm256_and_si256(c.r, one), 15),
+            _mm256_add_epi32(Mul(c.g, 27439), Mul(c.b, 5329))));
+        p[0] = Luma(c);
+        p[1] = Clamp(_mm256_add_epi32(cb, k.mid), k);
+        p[2] = Clamp(_mm256_add_epi32(cr, k.mid), k);
+    }
+};
+
+/// the components of 8 pixels, Bytes per sample, widened to 32 bit lanes
+template <int Components, int Bytes>
+REE_TARGET("avx2")
+inline void LoadPlanes(const uint8_t *src, const __m128i (*split)[4],
+    __m256i *planes) {
+    constexpr int kBlockBytes = 8 * Components * Bytes;
+    __m128i chunks[4];
+    for (int i = 0; i * 16 < kBlockBytes; ++i) {
+        auto p = reinterpret_cast<const __m128i *>(src + 16 * i);
+        chunks[i] = i * 16 + 16 <= kBlockBytes ? _mm_loadu_si128(p) :
+            _mm_loadl_epi64(p);
+    }
+    for (int c = 0; c < Components; ++c) {
+        __m128i samples = _mm_setzero_si128();
+        for (int i = 0; i * 16 < kBlockBytes; ++i) {
+            samples = _mm_or_si128(samples,
+                _mm_shuffle_epi8(chunks[i], split[c][i]));
+        }
+        planes[c] = Bytes == 1 ? _mm256_cvtepu8_epi32(samples) :
+            _mm256_cvtepu16_epi32(samples);
+    }
+}
+
+/// the reverse of LoadPlanes, the lanes must hold valid samples
+template <int Components, int Bytes>
+REE_TARGET("avx2")
+inline void StorePlanes(const __m256i *planes, const __m128i (*join)[4],
+    uint8_t *dst) {
+    constexpr int kBlockBytes = 8 * Components * Bytes;
+    __m128i samples[4];
+    for (int c = 0; c < Components; ++c) {
+        __m256i packed = _mm256_packus_epi32(planes[c], planes[c]);
+        if (Bytes == 1) {
+            packed = _mm256_packus_epi16(packed, packed);
+            packed = _mm256_permutevar8x32_epi32(packed,
+                _mm256_setr_epi32(0, 4, 0, 4, 0, 4, 0, 4));
+        } else {
+            packed = _mm256_permute4x64_epi64(packed, 0x08);
+        }
+        samples[c] = _mm256_castsi256_si128(packed);
+    }
+    for (int i = 0; i * 16 < kBlockBytes; ++i) {
+        __m128i chunk = _mm_setzero_si128();
+        for (int c = 0; c < Components; ++c) {
+            chunk = _mm_or_si128(chunk,
+                _mm_shuffle_epi8(samples[c], join[i][c]));
+        }
+        auto p = reinterpret_cast<__m128i *>(dst + 16 * i);
+        if (i * 16 + 16 <= kBlockBytes) {
+            _mm_storeu_si128(p, chunk);
+        } else {
+            _mm_storel_epi64(p, chunk);
+        }
+    }
+}
+
+template <typename From, typename To, int Bytes>
+REE_TARGET("avx2")
+void ConvertBlocks(const uint8_t *src, uint8_t *dst, size_t blocks,
+    int64_t maxValue, int64_t mid) {
+    const PlaneMasks &fromMasks = PlaneMasksOf(From::kComponents, Bytes);
+    const PlaneMasks &toMasks = PlaneMasksOf(To::kComponents, Bytes);
+    __m128i split[4][4];
+    __m128i join[4][4];
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            split[i][j] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                fromMasks.split[i][j].data()));
+            join[i][j] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+                toMasks.join[i][j].data()));
+        }
+    }
+    Constants k{_mm256_set1_epi32(static_cast<int32_t>(maxValue)),
+        _mm256_set1_epi32(static_cast<int32_t>(mid))};
+
+    __m256i in[4];
+    __m256i out[4];
+    for (size_t block = 0; block < blocks; ++block) {
+        LoadPlanes<From::kComponents, Bytes>(src, split, in);
+        To::Write(From::Read(in, k), out, k);
+        StorePlanes<To::kComponents, Bytes>(out, join, dst);
+        src += 8 * From::kComponents * Bytes;
+        dst += 8 * To::kComponents * Bytes;
+    }
+}
+
+template <typename From, int Bytes>
+void ConvertFrom(const uint8_t *src, uint8_t *dst, ColorSpace to,
+    size_t blocks, int64_t maxValue, int64_t mid) {
+    if (to == ColorSpace::Gray) {
+        ConvertBlocks<From, Gray, Bytes>(src, dst, blocks, maxValue, mid);
+    } else if (to == ColorSpace::GrayAlpha) {
+        ConvertBlocks<From, GrayAlpha, Bytes>(src, dst, blocks, maxValue,
+            mid);
+    } else if (to == ColorSpace::RGB) {
+        ConvertBlocks<From, Rgb, Bytes>(src, dst, blocks, maxValue, mid);
+    } else if (to == ColorSpace::RGBA) {
+        ConvertBlocks<From, RgbAlpha, Bytes>(src, dst, blocks, maxValue, mid);
+    } else {
+        ConvertBlocks<From, YCbCr, Bytes>(src, dst, blocks, maxValue, mid);
+    }
+}
+
+/// the conversions that take arithmetic, all of them start from RGB, RGBA
+/// or YCbCr
+template <int Bytes>
+void Convert(const uint8_t *src, ColorSpace from, uint8_t *dst,
+    ColorSpace to, size_t blocks, int64_t maxValue, int64_t mid) {
+    if (from == ColorSpace::RGB) {
+        ConvertFrom<Rgb, Bytes>(src, dst, to, blocks, maxValue, mid);
+    } else if (from == ColorSpace::RGBA) {
+        ConvertFrom<RgbAlpha, Bytes>(src, dst, to, blocks, maxValue, mid);
+    } else {
+        ConvertFrom<YCbCr, Bytes>(src, dst, to, blocks, maxValue, mid);
+    }
+}
+
+}
+
+#endif
+
+/**
+ * @brief convert the leading pixels the kernels of this CPU take whole
+ * blocks of, returns how many that are. Conversions only moving samples
+ * take SSSE3 shuffles, the others AVX2. Both give what the loops give.
+ */
+template <typename ValueT>
+size_t ConvertPixelsSimd(const ValueT *src, ColorSpace from, ValueT *dst,
+    ColorSpace to, size_t count, int64_t maxValue, int64_t mid) {
+#ifdef REE_IMAGE_SIMD_X86
+    constexpr int kBytes = sizeof(ValueT);
+    SimdLevel level = ActiveSimdLevel();
+    auto in = reinterpret_cast<const uint8_t *>(src);
+    auto out = reinterpret_cast<uint8_t *>(dst);
+    const ShuffleKernel *shuffle =
+        ShuffleTable::Instance().Find(from, to, kBytes);
+    if (shuffle && level >= SimdLevel::Ssse3) {
+        return Shuffle(in, out, count, *shuffle, maxValue, mid);
+    }
+    if (!shuffle && level >= SimdLevel::Avx2) {
+        avx2::Convert<kBytes>(in, from, out, to, count / 8, maxValue, mid);
+        return count / 8 * 8;
+    }
+#endif
+    return 0;
+}
+
+/// float pixels have no kernels yet
+size_t ConvertPixelsSimd(const float *, ColorSpace, float *, ColorSpace,
+    size_t, int64_t, int64_t) {
+    return 0;
+}
+
+template <typename Format, typename ValueT>
+void CopyPixels(const ValueT *src, ValueT *dst, size_t count, uint8_t) {
+    if (src != dst) {
+        std::copy(src, src + count * Format::kComponents, dst);
+    }
+}
+
+/// the whole blocks through the kernels, the pixels past them through the
+/// loop made for the formats
+template <typename From, typename To, typename ValueT>
+void ConvertFormats(const ValueT *src, ValueT *dst, size_t count,
+    uint8_t depth) {
+    int64_t maxValue = From::MaxValue(depth);
+    int64_t mid = From::MidValue(depth);
+    size_t done = ConvertPixelsSimd(src, From::kColorSpace, dst,
+        To::kColorSpace, count, maxValue, mid);
+    ConvertLoop<From, To>(src + done * From::kComponents,
+        dst + done * To::kComponents, count - done, depth);
+}
+
+template <typename ValueT, typename From>
+struct PickTo {
+    PixelConverter<ValueT> *converter;
+
+    template <typename To>
+    void operator()(To) {
+        *converter = From::kColorSpace == To::kColorSpace ?
+            CopyPixels<From, ValueT> : ConvertFormats<From, To, ValueT>;
+    }
+};
+
+template <typename ValueT>
+struct PickFrom {
+    ColorSpace to;
+    PixelConverter<ValueT> *converter;
+
+    template <typename From>
+    void operator()(From) {
+        PickTo<ValueT, From> pick{converter};
+        DispatchColorSpace<From::kDepth>(to, pick);
+    }
+};
+
+}
+
+bool CanConvert(ColorSpace from, ColorSpace to) {
+    return from != ColorSpace::Unknown && to != ColorSpace::Unknown;
+}
+
+template <typename ValueT>
+PixelConverter<ValueT> FindConverter(ColorSpace from, ColorSpace to,
+    uint8_t depth) {
+    if (!CanConvert(from, to)) {
+        throw std::invalid_argument("can not convert from " +
+            from.ToString() + " to " + to.ToString() + ".");
+    }
+    PixelConverter<ValueT> converter = nullptr;
+    DispatchPixelFormat<ValueT>(from, depth,
+        PickFrom<ValueT>{to, &converter});
+    return converter;
+}
+
+template <typename ValueT>
+void ConvertPixels(const ValueT *src, ColorSpace from, ValueT *dst,
+    ColorSpace to, size_t count, uint8_t depth) {
+    FindConverter<ValueT>(from, to, depth)(src, dst, count, depth);
+}
+
+template PixelConverter<uint8_t> FindConverter<uint8_t>(ColorSpace from,
+    ColorSpace to, uint8_t depth);
+template PixelConverter<uint16_t> FindConverter<uint16_t>(ColorSpace from,
+    ColorSpace to, uint8_t depth);
+template PixelConverter<float> FindConverter<float>(ColorSpace from,
+    ColorSpace to, uint8_t depth);
+template void ConvertPixels<uint8_t>(const uint8_t *src, ColorSpace from,
+    uint8_t *dst, ColorSpace to, size_t count, uint8_t depth);
+template void ConvertPixels<uint16_t>(const uint16_t *src, ColorSpace from,
+    uint16_t *dst, ColorSpace to, size_t count, uint8_t depth);
+template void ConvertPixels<float>(const float *src, ColorSpace from,
+    float *dst, ColorSpace to, size_t count, uint8_t depth);
+
+}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <ree/image/types.hpp>
+
+namespace ree {
+namespace image {
+
+/// whether ConvertPixels can turn pixels of from into pixels of to
+bool CanConvert(ColorSpace from, ColorSpace to);
+
+/// converts count pixels of depth bits between the color spaces it was
+/// found for
+template <typename ValueT>
+using PixelConverter = void (*)(const ValueT *src, ValueT *dst, size_t count,
+    uint8_t depth);
+
+/**
+ * @brief the conversion ConvertPixels does from one color space to another,
+ * made for that pair of PixelFormat, to look up once for a whole image.
+ * Throws std::invalid_argument when CanConvert is false.
+ */
+template <typename ValueT>
+PixelConverter<ValueT> FindConverter(ColorSpace from, ColorSpace to,
+    uint8_t depth);
+
+/**
+ * @brief convert count interleaved pixels of depth bits from one color space
+ * to another. Alpha is dropped or added as opaque, gray is taken as BT.601
+ * luma and YCbCr is full range as in JFIF. float samples range over [0, 1]
+ * and are not clamped. src and dst may only overlap when from and to are the
+ * same. Throws std::invalid_argument when CanConvert is
+ * false.
+ *
+ * Whole blocks of pixels go through SSSE3 or AVX2 kernels where the CPU has
+ * them, see ActiveSimdLevel, with results equal to the scalar ones.
+ */
+template <typename ValueT>
+void ConvertPixels(const ValueT *src, ColorSpace from, ValueT *dst,
+    ColorSpace to, size_t count, uint8_t depth);
+
+}
+}
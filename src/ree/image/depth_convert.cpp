@@ -0,0 +1,217 @@
+#include "depth_convert.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+#include <ree/image/rounded_division.hpp>
+#include <ree/image/simd.hpp>
+
+#ifdef REE_IMAGE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace ree {
+namespace image {
+
+namespace {
+
+inline uint32_t MaxOf(uint8_t depth) {
+    return (uint32_t(1) << depth) - 1;
+}
+
+/// v * toMax / fromMax rounded, the products staying below 2^32
+struct Rescale {
+    Rescale(uint8_t fromDepth, uint8_t toDepth)
+        : scale(MaxOf(toDepth)), divide(MaxOf(fromDepth)) {}
+
+    uint32_t operator()(uint32_t v) const {
+        return static_cast<uint32_t>(divide(v * scale));
+    }
+
+    double scale;
+    RoundedDivision divide;
+};
+
+/// a float sample to an integer one of maxValue, in the same steps as the
+/// kernel, which takes NaN to 0 as max and min do
+inline uint32_t FromFloat(float v, float maxValue) {
+    float clamped = v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+    return static_cast<uint32_t>(clamped * maxValue + 0.5f);
+}
+
+template <typename FromT, typename ToT>
+void ConvertLoop(const FromT *src, uint8_t fromDepth, ToT *dst,
+    uint8_t toDepth, size_t first, size_t count, std::false_type,
+    std::false_type) {
+    Rescale rescale(fromDepth, toDepth);
+    for (size_t i = first; i < count; ++i) {
+        dst[i] = static_cast<ToT>(rescale(src[i]));
+    }
+}
+
+template <typename FromT>
+void ConvertLoop(const FromT *src, uint8_t fromDepth, float *dst, uint8_t,
+    size_t first, size_t count, std::false_type, std::true_type) {
+    float scale = 1.0f / MaxOf(fromDepth);
+    for (size_t i = first; i < count; ++i) {
+        dst[i] = static_cast<float>(src[i]) * scale;
+    }
+}
+
+template <typename ToT>
+void ConvertLoop(const float *src, uint8_t, ToT *dst, uint8_t toDepth,
+    size_t first, size_t count, std::true_type, std::false_type) {
+    float maxValue = static_cast<float>(MaxOf(toDepth));
+    for (size_t i = first; i < count; ++i) {
+        dst[i] = static_cast<ToT>(FromFloat(src[i], maxValue));
+    }
+}
+
+void ConvertLoop(const float *src, uint8_t, float *dst, uint8_t,
+    size_t first, size_t count, std::true_type, std::true_type) {
+    std::copy(src + first, src + count, dst + first);
+}
+
+#ifdef REE_IMAGE_SIMD_X86
+
+/// 8 samples widened to 32 bit lanes
+REE_TARGET("avx2")
+inline __m256i Load8(const uint8_t *p) {
+    return _mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)));
+}
+REE_TARGET("avx2")
+inline __m256i Load8(const uint16_t *p) {
+    return _mm256_cvtepu16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+}
+
+/// 8 lanes of 32 bits, each fitting the sample, narrowed and stored
+REE_TARGET("avx2")
+inline void Store8(__m256i v, uint8_t *p) {
+    __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(v),
+        _mm256_extracti128_si256(v, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(p),
+        _mm_packus_epi16(words, words));
+}
+REE_TARGET("avx2")
+inline void Store8(__m256i v, uint16_t *p) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm_packus_epi32(
+        _mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+
+/// Rescale on 4 lanes, the samples are below 2^16 so fit signed lanes
+REE_TARGET("avx2")
+inline __m128i Rescale4(__m128i v, __m256d scale, __m256d half,
+    __m256d reciprocal) {
+    __m256d x = _mm256_add_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(v), scale),
+        half);
+    return _mm256_cvttpd_epi32(_mm256_mul_pd(x, reciprocal));
+}
+
+template <typename FromT, typename ToT>
+REE_TARGET("avx2")
+size_t ConvertAvx2(const FromT *src, uint8_t fromDepth, ToT *dst,
+    uint8_t toDepth, size_t count, std::false_type, std::false_type) {
+    Rescale rescale(fromDepth, toDepth);
+    const __m256d scale = _mm256_set1_pd(rescale.scale);
+    const __m256d half = _mm256_set1_pd(rescale.divide.half);
+    const __m256d reciprocal = _mm256_set1_pd(rescale.divide.reciprocal);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = Load8(src + i);
+        __m128i low = Rescale4(_mm256_castsi256_si128(v), scale, half,
+            reciprocal);
+        __m128i high = Rescale4(_mm256_extracti128_si256(v, 1), scale, half,
+            reciprocal);
+        Store8(_mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1),
+            dst + i);
+    }
+    return i;
+}
+
+template <typename FromT>
+REE_TARGET("avx2")
+size_t ConvertAvx2(const FromT *src, uint8_t fromDepth, float *dst, uint8_t,
+    size_t count, std::false_type, std::true_type) {
+    const __m256 scale = _mm256_set1_ps(1.0f / MaxOf(fromDepth));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(
+            _mm256_cvtepi32_ps(Load8(src + i)), scale));
+    }
+    return i;
+}
+
+template <typename ToT>
+REE_TARGET("avx2")
+size_t ConvertAvx2(const float *src, uint8_t, ToT *dst, uint8_t toDepth,
+    size_t count, std::true_type, std::false_type) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 maxValue = _mm256_set1_ps(static_cast<float>(
+        MaxOf(toDepth)));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        // max gives its second operand for NaN
+        __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i),
+            zero), one);
+        Store8(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, maxValue),
+            half)), dst + i);
+    }
+    return i;
+}
+
+size_t ConvertAvx2(const float *, uint8_t, float *, uint8_t, size_t,
+    std::true_type, std::true_type) {
+    return 0;
+}
+
+#endif
+
+}
+
+template <typename FromT, typename ToT>
+void ConvertSamples(const FromT *src, uint8_t fromDepth, ToT *dst,
+    uint8_t toDepth, size_t count) {
+    typename std::is_floating_point<FromT>::type fromFloat;
+    typename std::is_floating_point<ToT>::type toFloat;
+    if (std::is_same<FromT, ToT>::value &&
+        (fromDepth == toDepth || fromFloat)) {
+        if (static_cast<const void *>(src) != dst) {
+            std::memmove(dst, src, count * sizeof(ToT));
+        }
+        return;
+    }
+    size_t done = 0;
+#ifdef REE_IMAGE_SIMD_X86
+    if (ActiveSimdLevel() >= SimdLevel::Avx2) {
+        done = ConvertAvx2(src, fromDepth, dst, toDepth, count, fromFloat,
+            toFloat);
+    }
+#endif
+    ConvertLoop(src, fromDepth, dst, toDepth, done, count, fromFloat,
+        toFloat);
+}
+
+#define REE_IMAGE_CONVERT_SAMPLES(FromT, ToT) \
+    template void ConvertSamples<FromT, ToT>(const FromT *src, \
+        uint8_t fromDepth, ToT *dst, uint8_t toDepth, size_t count);
+
+REE_IMAGE_CONVERT_SAMPLES(uint8_t, uint8_t)
+REE_IMAGE_CONVERT_SAMPLES(uint8_t, uint16_t)
+REE_IMAGE_CONVERT_SAMPLES(uint8_t, float)
+REE_IMAGE_CONVERT_SAMPLES(uint16_t, uint8_t)
+REE_IMAGE_CONVERT_SAMPLES(uint16_t, uint16_t)
+REE_IMAGE_CONVERT_SAMPLES(uint16_t, float)
+REE_IMAGE_CONVERT_SAMPLES(float, uint8_t)
+REE_IMAGE_CONVERT_SAMPLES(float, uint16_t)
+REE_IMAGE_CONVERT_SAMPLES(float, float)
+
+#undef REE_IMAGE_CONVERT_SAMPLES
+
+}
+}
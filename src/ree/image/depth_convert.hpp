@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ree {
+namespace image {
+
+/**
+ * @brief convert count samples of fromDepth bits into samples of toDepth
+ * bits, rounding to the nearest. float samples range over [0, 1] whatever
+ * their depth, those out of it are clamped when going to integers and NaN
+ * becomes 0.
+ *
+ * Whole blocks go through AVX2 kernels where the CPU has them, see
+ * ActiveSimdLevel, with results equal to the scalar ones.
+ */
+template <typename FromT, typename ToT>
+void ConvertSamples(const FromT *src, uint8_t fromDepth, ToT *dst,
+    uint8_t toDepth, size_t count);
+
+}
+}
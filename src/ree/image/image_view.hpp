@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+#include <ree/image/types.hpp>
+
+namespace ree {
+namespace image {
+
+/**
+ * @brief non-owning, strided window into interleaved pixels.
+ *
+ * Rows are Stride() bytes apart and hold Width() * Components() values each.
+ * Cropping only moves the base pointer, so crops and tiles are free. The
+ * pixels must outlive the view.
+ */
+template <typename ValueT>
+class ImageView {
+public:
+    ImageView() = default;
+    ImageView(ValueT *data, int w, int h, size_t stride, class ColorSpace cs,
+        uint8_t depth)
+        : data_(data), width_(w), height_(h), stride_(stride),
+          colorspace_(cs), depthBits_(depth) {}
+    /// a tightly packed view, rows follow each other without padding
+    ImageView(ValueT *data, int w, int h, class ColorSpace cs, uint8_t depth)
+        : ImageView(data, w, h,
+            static_cast<size_t>(w) * cs.Components() * sizeof(ValueT), cs,
+            depth) {}
+
+    /// a view of mutable pixels is also a view of const pixels
+    template <typename OtherT, typename = typename std::enable_if<
+        std::is_same<const OtherT, ValueT>::value>::type>
+    ImageView(const ImageView<OtherT> &other)
+        : ImageView(other.Data(), other.Width(), other.Height(),
+            other.Stride(), other.ColorSpace(), other.DepthBits()) {}
+
+    int Width() const { return width_; }
+    int Height() const  { return height_; }
+    /// distance between two rows in bytes
+    size_t Stride() const { return stride_; }
+    uint8_t DepthBits() const { return depthBits_; }
+    class ColorSpace ColorSpace() const { return colorspace_; }
+    uint8_t Components() const { return colorspace_.Components(); }
+    bool Empty() const { return data_ == nullptr || width_ <= 0 || height_ <= 0; }
+
+    ValueT *Data() const { return data_; }
+    ValueT *Row(int y) const {
+        using Byte = typename std::conditional<std::is_const<ValueT>::value,
+            const uint8_t, uint8_t>::type;
+        return reinterpret_cast<ValueT *>(
+            reinterpret_cast<Byte *>(data_) + stride_ * y);
+    }
+    ValueT *Pixel(int x, int y) const { return Row(y) + x * Components(); }
+
+    /// values in one row, without the padding up to the stride
+    size_t RowValues() const {
+        return static_cast<size_t>(width_) * Components();
+    }
+    /// true when rows follow each other without padding
+    bool Contiguous() const { return stride_ == RowValues() * sizeof(ValueT); }
+
+    ImageView<ValueT> Crop(int x, int y, int w, int h) const {
+        if (x < 0 || y < 0 || w < 0 || h < 0 || x + w > width_ ||
+            y + h > height_) {
+            throw std::out_of_range("crop out of image.");
+        }
+        return ImageView<ValueT>(Pixel(x, y), w, h, stride_, colorspace_,
+            depthBits_);
+    }
+
+private:
+    ValueT *data_ = nullptr;
+    int width_ = 0;
+    int height_ = 0;
+    size_t stride_ = 0;
+    class ColorSpace colorspace_ { ColorSpace::RGBA };
+    uint8_t depthBits_ = 8;
+};
+
+}
+}
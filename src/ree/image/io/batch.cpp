@@ -0,0 +1,27 @@
+#include "batch.hpp"
+
+namespace ree {
+namespace image {
+namespace io {
+
+std::vector<LoadResult> LoadBatch(const std::vector<ree::io::Source *> &sources,
+    const LoadOptions &options, ThreadPool *pool) {
+    std::vector<LoadResult> results(sources.size());
+    if (!pool) {
+        pool = &ThreadPool::Shared();
+    }
+
+    pool->ParallelFor(sources.size(), [&](size_t i) {
+        try {
+            // Image::Load keeps a decoder per thread
+            results[i].image = Image::Load(sources[i], options);
+        } catch (...) {
+            results[i].error = std::current_exception();
+        }
+    });
+    return results;
+}
+
+}
+}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <vector>
+
+#include <ree/io/source.h>
+#include <ree/image/io/image.hpp>
+#include <ree/image/thread_pool.hpp>
+
+namespace ree {
+namespace image {
+namespace io {
+
+struct LoadResult {
+    Image image;
+    /// set when loading failed, image is empty then
+    std::exception_ptr error;
+
+    bool Ok() const { return !error; }
+};
+
+/**
+ * @brief load many images in parallel.
+ *
+ * Every thread decoding keeps its own decoder as long as the thread lives,
+ * so the parse contexts are reused by later batches on the same pool. The
+ * results are in the order of sources.
+ */
+std::vector<LoadResult> LoadBatch(const std::vector<ree::io::Source *> &sources,
+    const LoadOptions &options = LoadOptions(), ThreadPool *pool = nullptr);
+
+}
+}
+}
@@ -1,18 +1,18 @@
 #include "bmp.hpp"
 
-#include <iostream>
+#include <algorithm>
 
-#include <ree/io/bit_buffer.h>
 #include <ree/image/io/error.hpp>
 
 namespace ree {
 namespace image {
 namespace io {
 
+/// palette entries are stored blue first
 struct Pixel {
-    uint8_t r;
-    uint8_t g;
     uint8_t b;
+    uint8_t g;
+    uint8_t r;
     uint8_t a;
 };
 
@@ -27,15 +27,29 @@ enum DIBHeaderType {
     BITMAPV5HEADER = 124,
 };
 
+enum CompressionMethod {
+    BI_RGB = 0,
+    BI_BITFIELDS = 3,
+};
+
+static constexpr uint32_t kFileHeaderSize = 14;
+/// color space type of a BITMAPV5HEADER whose ICC profile is embedded
+static constexpr uint32_t kProfileEmbedded = 0x4d424544;
+
 struct BmpContext : public LoadContext {
     using LoadContext::LoadContext;
 
+    void Reset(ree::io::Source *src, const LoadOptions &opt) override {
+        LoadContext::Reset(src, opt);
+        color_palette.clear();
+    }
+
     uint32_t data_offset;
     uint32_t file_size;
 
-    DIBHeaderType dib_header_type;
-    uint32_t width;
-    uint32_t height;
+    uint32_t dib_header_size;
+    int32_t width;
+    int32_t height;
     uint16_t planes;
     uint16_t bits_per_pixel;
     uint32_t compression_method;
@@ -44,16 +58,21 @@ struct BmpContext : public LoadContext {
     uint32_t vppm;
     uint32_t color_palettes;
     uint32_t useful_colors;
+    /// red, green, blue and alpha masks, for BI_BITFIELDS
+    uint32_t masks[4];
 
-    std::vector<Pixel> color_palette;
+    /// rows are stored bottom-up unless the height is negative
+    bool top_down;
+    uint32_t linesize;
 
-    std::vector<uint8_t> color;
+    std::vector<Pixel> color_palette;
+    std::vector<uint8_t> line;
 };
 
 static int parse_file_header(ree::io::Source &source, BmpContext &ctx);
 static int parse_dib_header(ree::io::Source &source, BmpContext &ctx);
 static int parse_color_table_header(ree::io::Source &source, BmpContext &ctx);
-static int parse_color_data(ree::io::Source &source, BmpContext &ctx);
+static void convert_line(BmpContext &ctx, uint8_t *dst);
 
 
 std::vector<std::string> Bmp::ValidExtensions() {
@@ -76,19 +95,102 @@ WriteContext *Bmp::CreateComposeContext(ree::io::Source *target,
 }
 
 Image Bmp::LoadImage(LoadContext *contex) {
-    auto ctx = reinterpret_cast<BmpContext *>(contex);
-    auto source = ctx->source;
+    return LoadImageByRows(contex);
+}
 
-	source->OpenToRead();
+void Bmp::BeginRows(LoadContext *contex) {
+    auto ctx = static_cast<BmpContext *>(contex);
+    auto source = ctx->source;
 
-	parse_file_header(*source, *ctx);
+    if (parse_file_header(*source, *ctx) != 0) {
+		throw FileCorruptedException("magic number not match.");
+    }
 	parse_dib_header(*source, *ctx);
 	parse_color_table_header(*source, *ctx);
-    source->Seek(ctx->data_offset);
-	parse_color_data(*source, *ctx);
-    return Image(ctx->width, ctx->height, ColorSpace::RGB, ctx->bits_per_pixel,
-        std::move(ctx->color));
+
+    ctx->info.width = ctx->width;
+    ctx->info.height = ctx->height;
+    ctx->info.depth = 8;
+    // palette and 24 bit images carry no alpha
+    ctx->info.colorspace = ctx->bits_per_pixel == 32 ?
+        ColorSpace::RGBA : ColorSpace::RGB;
+    ctx->nextRow = 0;
+
+    ctx->linesize = (ctx->bits_per_pixel * ctx->width + 31) / 32 * 4;
+    ctx->line.resize(ctx->linesize);
+    if (ctx->top_down) {
+        source->Seek(ctx->data_offset);
+    }
+}
+
+int Bmp::ReadRows(LoadContext *contex, uint8_t *dst, size_t stride, int n) {
+    auto ctx = static_cast<BmpContext *>(contex);
+    auto source = ctx->source;
+
+    int rows = std::max(std::min(n, ctx->info.height - ctx->nextRow), 0);
+    for (int i = 0; i < rows; ++i) {
+        if (!ctx->top_down) {
+            size_t line = ctx->height - 1 - ctx->nextRow;
+            source->Seek(ctx->data_offset + line * ctx->linesize);
+        }
+        source->Read(ctx->line.data(), ctx->linesize);
+        convert_line(*ctx, dst + stride * i);
+        ctx->nextRow++;
+    }
+    return rows;
+}
+
+ProbeInfo Bmp::Probe(LoadContext *contex) {
+    auto ctx = static_cast<BmpContext *>(contex);
+    auto source = ctx->source;
+
+    if (parse_file_header(*source, *ctx) != 0) {
+        throw FileCorruptedException("magic number not match.");
+    }
+    parse_dib_header(*source, *ctx);
+
+    ProbeInfo info;
+    info.format = PreferredExtension();
+    info.width = ctx->width;
+    info.height = ctx->height;
+    info.colorspace = ctx->bits_per_pixel == 32 ?
+        ColorSpace::RGBA : ColorSpace::RGB;
+    return info;
+}
+
+Metadata Bmp::ReadMetadata(LoadContext *contex) {
+    auto ctx = static_cast<BmpContext *>(contex);
+    auto source = ctx->source;
+
+    if (parse_file_header(*source, *ctx) != 0) {
+        throw FileCorruptedException("magic number not match.");
+    }
+    parse_dib_header(*source, *ctx);
+
+    Metadata metadata;
+    if (ctx->dib_header_size >= BITMAPINFOHEADER) {
+        // the resolution is given in pixels per meter
+        metadata.dpiX = ctx->hppm * 0.0254;
+        metadata.dpiY = ctx->vppm * 0.0254;
+    }
+    if (ctx->dib_header_size >= BITMAPV5HEADER) {
+        // the profile offset is relative to the DIB header
+        uint32_t csType;
+        source->Seek(kFileHeaderSize + 56);
+        source->Read(reinterpret_cast<uint8_t *>(&csType), 4);
+        uint32_t profile[2];
+        source->Seek(kFileHeaderSize + 112);
+        source->Read(reinterpret_cast<uint8_t *>(profile), sizeof(profile));
+        if (csType == kProfileEmbedded && profile[1] > 0 &&
+            profile[1] <= ctx->file_size) {
+            metadata.icc.resize(profile[1]);
+            source->Seek(kFileHeaderSize + profile[0]);
+            source->Read(metadata.icc.data(), metadata.icc.size());
+        }
+    }
+    return metadata;
 }
+
 void Bmp::WriteImage(WriteContext *ctx, const Image &image) {
 	throw NotImplementException();
 }
@@ -107,8 +209,20 @@ int parse_file_header(ree::io::Source &source, BmpContext &ctx) {
     return 0;
 }
 int parse_dib_header(ree::io::Source &source, BmpContext &ctx) {
-    source.Read(reinterpret_cast<uint8_t *>(&ctx.dib_header_type), 4);
-    if (ctx.dib_header_type == BITMAPINFOHEADER) { // BITMAPINFOHEADER
+    source.Read(reinterpret_cast<uint8_t *>(&ctx.dib_header_size), 4);
+    ctx.compression_method = BI_RGB;
+    ctx.color_palettes = 0;
+
+    if (ctx.dib_header_size == BITMAPCOREHEADER) {
+        uint16_t width, height;
+        source.Read(reinterpret_cast<uint8_t *>(&width), 2);
+        source.Read(reinterpret_cast<uint8_t *>(&height), 2);
+        source.Read(reinterpret_cast<uint8_t *>(&ctx.planes), 2);
+        source.Read(reinterpret_cast<uint8_t *>(&ctx.bits_per_pixel), 2);
+        ctx.width = width;
+        ctx.height = height;
+    } else if (ctx.dib_header_size >= BITMAPINFOHEADER) {
+        // later headers only append fields to BITMAPINFOHEADER
         source.Read(reinterpret_cast<uint8_t *>(&ctx.width), 4);
         source.Read(reinterpret_cast<uint8_t *>(&ctx.height), 4);
 
@@ -124,57 +238,99 @@ int parse_dib_header(ree::io::Source &source, BmpContext &ctx) {
 
         source.Read(reinterpret_cast<uint8_t *>(&ctx.color_palettes), 4);
         source.Read(reinterpret_cast<uint8_t *>(&ctx.useful_colors), 4);
-        return 0;
+    } else {
+        throw FileCorruptedException("wrong dib header.");
     }
-	throw FileCorruptedException("wrong dib header.");
-}
-int parse_color_table_header(ree::io::Source &source, BmpContext &ctx) {
-    ctx.color_palette.resize(ctx.color_palettes);
-    source.Read(reinterpret_cast<uint8_t *>(ctx.color_palette.data()),
-        sizeof(Pixel) * ctx.color_palettes);
-    return 0;
-}
-uint8_t read_7_bit(const uint8_t *buf, uint32_t pos) {
-    uint32_t byte_index = pos / 8;
-    uint8_t vl = *(buf + byte_index);
 
-    uint32_t l_bits = 8 - pos % 8;
-    if (l_bits == 8) {
-        return vl >> 1;
-    } else if (l_bits == 7) {
-        return vl & 0x7f;
+    ctx.top_down = ctx.height < 0;
+    if (ctx.top_down) {
+        ctx.height = -ctx.height;
+    }
+    if (ctx.width <= 0 || ctx.height == 0) {
+        throw FileCorruptedException("wrong image size.");
     }
-    uint8_t vr = *(buf + byte_index + 1);
-    uint8_t l_shift = 7 - l_bits;
-    uint8_t r_shift = l_bits + 1;
-    return ((vl << l_shift) | (vr >> r_shift)) & 0x7f;
-}
-int parse_color_data(ree::io::Source &source, BmpContext &ctx) {
-    uint32_t linesize = (ctx.bits_per_pixel * ctx.width + 31) / 32 * 4;
-
-    std::vector<uint8_t> line;
-    line.resize(linesize);
-
-    for (uint32_t y = 0; y < ctx.height; ++y) {
-        source.Read(line.data(), linesize);
-        ree::io::RLSBBuffer bitBuf(line.data(), line.size());
-        for (uint32_t x = 0; x < ctx.width; ++x) {
-            uint32_t v = bitBuf.ReadBits(7);
 
-            Pixel p = ctx.color_palette[v];
+    ctx.masks[0] = 0x00ff0000;
+    ctx.masks[1] = 0x0000ff00;
+    ctx.masks[2] = 0x000000ff;
+    ctx.masks[3] = 0;
+    if (ctx.compression_method == BI_BITFIELDS) {
+        // the masks follow BITMAPINFOHEADER, inside the later headers
+        int count = ctx.dib_header_size >= BITMAPV3INFOHEADER ? 4 : 3;
+        source.Seek(kFileHeaderSize + BITMAPINFOHEADER);
+        source.Read(reinterpret_cast<uint8_t *>(ctx.masks), count * 4);
+        if (ctx.bits_per_pixel != 32 || ctx.masks[0] != 0x00ff0000 ||
+            ctx.masks[1] != 0x0000ff00 || ctx.masks[2] != 0x000000ff) {
+            throw NotImplementException();
+        }
+    } else if (ctx.compression_method != BI_RGB) {
+        throw NotImplementException();
+    }
 
-            std::cout << v << ": " << (int)p.r << "," << (int)p.g << ","
-                << (int)p.b << "," << (int)p.a << std::endl;
+    switch (ctx.bits_per_pixel) {
+    case 1: case 4: case 8: case 24: case 32:
+        break;
+    default:
+        throw NotImplementException();
+    }
+    return 0;
+}
+int parse_color_table_header(ree::io::Source &source, BmpContext &ctx) {
+    ctx.color_palette.clear();
+    if (ctx.bits_per_pixel > 8) {
+        return 0;
+    }
+    uint32_t count = ctx.color_palettes;
+    if (count == 0 || count > (1u << ctx.bits_per_pixel)) {
+        count = 1u << ctx.bits_per_pixel;
+    }
+    source.Seek(kFileHeaderSize + ctx.dib_header_size);
 
-            uint32_t idx = (y * ctx.width + x) * 4;
-            ctx.color[idx + 0] = p.r;
-            ctx.color[idx + 1] = p.g;
-            ctx.color[idx + 2] = p.b;
-            ctx.color[idx + 3] = 0xff;
+    ctx.color_palette.resize(count);
+    if (ctx.dib_header_size == BITMAPCOREHEADER) {
+        // three bytes per entry
+        for (auto &pixel : ctx.color_palette) {
+            source.Read(reinterpret_cast<uint8_t *>(&pixel), 3);
         }
+        return 0;
     }
+    source.Read(reinterpret_cast<uint8_t *>(ctx.color_palette.data()),
+        sizeof(Pixel) * count);
     return 0;
 }
+void convert_line(BmpContext &ctx, uint8_t *dst) {
+    const uint8_t *line = ctx.line.data();
+    int bits = ctx.bits_per_pixel;
+
+    if (bits <= 8) {
+        uint32_t mask = (1u << bits) - 1;
+        for (int32_t x = 0; x < ctx.width; ++x) {
+            uint32_t bit = x * bits;
+            uint32_t v = (line[bit / 8] >> (8 - bits - bit % 8)) & mask;
+            if (v >= ctx.color_palette.size()) {
+                throw FileCorruptedException("palette index out of range.");
+            }
+            const Pixel &p = ctx.color_palette[v];
+            dst[x * 3 + 0] = p.r;
+            dst[x * 3 + 1] = p.g;
+            dst[x * 3 + 2] = p.b;
+        }
+    } else if (bits == 24) {
+        for (int32_t x = 0; x < ctx.width; ++x) {
+            dst[x * 3 + 0] = line[x * 3 + 2];
+            dst[x * 3 + 1] = line[x * 3 + 1];
+            dst[x * 3 + 2] = line[x * 3 + 0];
+        }
+    } else {
+        bool alpha = ctx.masks[3] == 0xff000000;
+        for (int32_t x = 0; x < ctx.width; ++x) {
+            dst[x * 4 + 0] = line[x * 4 + 2];
+            dst[x * 4 + 1] = line[x * 4 + 1];
+            dst[x * 4 + 2] = line[x * 4 + 0];
+            dst[x * 4 + 3] = alpha ? line[x * 4 + 3] : 0xff;
+        }
+    }
+}
 
 }
 }
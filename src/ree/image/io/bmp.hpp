@@ -18,6 +18,12 @@ public:
         const WriteOptions &options) override;
     Image LoadImage(LoadContext *ctx) override;
     void WriteImage(WriteContext *ctx, const Image &image) override;
+
+    /// rows are read one at a time, bottom-up files by seeking
+    void BeginRows(LoadContext *ctx) override;
+    int ReadRows(LoadContext *ctx, uint8_t *dst, size_t stride, int n) override;
+    ProbeInfo Probe(LoadContext *ctx) override;
+    Metadata ReadMetadata(LoadContext *ctx) override;
 };
 
 }
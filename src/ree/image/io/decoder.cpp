@@ -0,0 +1,201 @@
+#include "decoder.hpp"
+
+#include <stdexcept>
+
+#include <ree/image/io/format_registry.hpp>
+#include <ree/image/io/error.hpp>
+#include <ree/image/io/source_guard.hpp>
+
+namespace ree {
+namespace image {
+namespace io {
+
+Decoder::Decoder() : format_(nullptr) {
+}
+
+Decoder::Decoder(FileFormat *format) : format_(format) {
+}
+
+Image Decoder::Decode(ree::io::Source *source, const LoadOptions &options) {
+    End();
+    source->OpenToRead();
+    SourceGuard guard(source);
+
+    auto format = FormatOf(source);
+    if (!format) {
+        throw UnknownFormatException();
+    }
+
+    auto ctx = PrepareContext(format, source, options);
+    Image image;
+    try {
+        image = format->LoadImage(ctx);
+    } catch (...) {
+        ctx->Reset(nullptr, LoadOptions());
+        throw;
+    }
+    ctx->source = nullptr;
+    return image;
+}
+
+const ImageInfo &Decoder::Begin(ree::io::Source *source,
+    const LoadOptions &options, class ColorSpace wanted) {
+    End();
+    source->OpenToRead();
+    SourceGuard guard(source);
+
+    auto format = FormatOf(source);
+    if (!format) {
+        throw UnknownFormatException();
+    }
+
+    auto ctx = PrepareContext(format, source, options);
+    ctx->wanted = wanted;
+    try {
+        format->BeginRows(ctx);
+    } catch (...) {
+        ctx->Reset(nullptr, LoadOptions());
+        throw;
+    }
+    // left open for ReadRows, End closes it
+    guard.Release();
+    streamFormat_ = format;
+    streamContext_ = ctx;
+    return ctx->info;
+}
+
+int Decoder::ReadRows(uint8_t *dst, size_t stride, int n) {
+    if (!streamContext_) {
+        throw std::logic_error("no image begun.");
+    }
+    try {
+        return streamFormat_->ReadRows(streamContext_, dst, stride, n);
+    } catch (...) {
+        End();
+        throw;
+    }
+}
+
+void Decoder::End() {
+    if (!streamContext_) {
+        return;
+    }
+    auto source = streamContext_->source;
+    streamContext_->Reset(nullptr, LoadOptions());
+    streamContext_ = nullptr;
+    streamFormat_ = nullptr;
+    source->Close();
+}
+
+ImageInfo Decoder::DecodeRows(ree::io::Source *source,
+    const LoadOptions &options, const RowCallback &callback) {
+    static constexpr int kStripRows = 16;
+
+    ImageInfo info = Begin(source, options);
+    size_t rowBytes = info.RowBytes();
+    std::vector<uint8_t> strip(rowBytes * kStripRows);
+
+    int y = 0;
+    try {
+        while (y < info.height) {
+            int rows = ReadRows(strip.data(), rowBytes, kStripRows);
+            if (rows <= 0) {
+                throw FileCorruptedException("image ends before its last row.");
+            }
+            for (int i = 0; i < rows; ++i) {
+                callback(y++, strip.data() + rowBytes * i);
+            }
+        }
+    } catch (...) {
+        End();
+        throw;
+    }
+    End();
+    return info;
+}
+
+ProbeInfo Decoder::Probe(ree::io::Source *source,
+    const LoadOptions &options) {
+    End();
+    source->OpenToRead();
+    SourceGuard guard(source);
+
+    auto format = FormatOf(source);
+    if (!format) {
+        throw UnknownFormatException();
+    }
+
+    auto ctx = PrepareContext(format, source, options);
+    ProbeInfo info;
+    try {
+        info = format->Probe(ctx);
+    } catch (...) {
+        ctx->Reset(nullptr, LoadOptions());
+        throw;
+    }
+    ctx->Reset(nullptr, LoadOptions());
+    return info;
+}
+
+Metadata Decoder::ReadMetadata(ree::io::Source *source,
+    const LoadOptions &options) {
+    End();
+    source->OpenToRead();
+    SourceGuard guard(source);
+
+    auto format = FormatOf(source);
+    if (!format) {
+        throw UnknownFormatException();
+    }
+
+    auto ctx = PrepareContext(format, source, options);
+    Metadata metadata;
+    try {
+        metadata = format->ReadMetadata(ctx);
+    } catch (...) {
+        ctx->Reset(nullptr, LoadOptions());
+        throw;
+    }
+    ctx->Reset(nullptr, LoadOptions());
+    return metadata;
+}
+
+void Decoder::Reset() {
+    End();
+    for (auto &context : contexts_) {
+        context.second->Reset(nullptr, LoadOptions());
+    }
+}
+
+LoadContext *Decoder::PrepareContext(FileFormat *format,
+    ree::io::Source *source, const LoadOptions &options) {
+    LoadContext *ctx = nullptr;
+    for (auto &context : contexts_) {
+        if (context.first == format) {
+            ctx = context.second.get();
+            ctx->Reset(source, options);
+            break;
+        }
+    }
+    if (!ctx) {
+        std::unique_ptr<LoadContext> created(
+            format->CreateParseContext(source, options));
+        ctx = created.get();
+        contexts_.emplace_back(format, std::move(created));
+    }
+    if (allocator_) {
+        ctx->allocator = allocator_;
+    }
+    return ctx;
+}
+
+FileFormat *Decoder::FormatOf(ree::io::Source *source) const {
+    if (format_) {
+        return format_;
+    }
+    return FormatRegistry::Instance().Sniff(source);
+}
+
+}
+}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <ree/image/io/file_format.hpp>
+#include <ree/image/io/image.hpp>
+
+namespace ree {
+namespace image {
+namespace io {
+
+/// called with every decoded row in turn, row is ImageInfo::RowBytes() long
+/// and only valid during the call
+using RowCallback = std::function<void(int y, const uint8_t *row)>;
+
+/**
+ * @brief decodes images one after another, keeping the parse contexts (and
+ * the scratch buffers, zlib streams and tables inside them) between images.
+ *
+ * A Decoder is not thread safe, use one per thread.
+ */
+class Decoder {
+public:
+    /// sniff the format of every image from its magic number
+    Decoder();
+    /// decode only images of the given format, which must outlive the decoder
+    explicit Decoder(FileFormat *format);
+
+    Decoder(Decoder &&other) = default;
+    Decoder &operator=(Decoder &&other) = default;
+
+    /// open source, decode its main image and close it again
+    Image Decode(ree::io::Source *source,
+        const LoadOptions &options = LoadOptions());
+
+    /**
+     * @brief open source and read its header, the rows are then pulled with
+     * ReadRows. Ends the image streamed before, if any.
+     * @param wanted a color space the format may decode into directly, the
+     * one the rows come in is the colorspace of the returned info
+     */
+    const ImageInfo &Begin(ree::io::Source *source,
+        const LoadOptions &options = LoadOptions(),
+        class ColorSpace wanted = ColorSpace::Unknown);
+    /**
+     * @brief decode at most n of the next rows of the image begun into dst,
+     * rows stride bytes apart. Returns the number of rows decoded, 0 once all
+     * of them were. The image is ended when decoding fails.
+     */
+    int ReadRows(uint8_t *dst, size_t stride, int n);
+    /// close the source of the image begun, the rows left are dropped
+    void End();
+
+    /// decode source row by row, handing each one to callback, without ever
+    /// holding the whole image
+    ImageInfo DecodeRows(ree::io::Source *source, const LoadOptions &options,
+        const RowCallback &callback);
+
+    /// open source, read its headers, see FileFormat::Probe, and close it
+    ProbeInfo Probe(ree::io::Source *source,
+        const LoadOptions &options = LoadOptions());
+
+    /// open source, read its metadata, see FileFormat::ReadMetadata, and
+    /// close it
+    Metadata ReadMetadata(ree::io::Source *source,
+        const LoadOptions &options = LoadOptions());
+
+    /// drop the state of the last image, retaining the allocated memory
+    void Reset();
+
+    /// allocate decoded pixels from allocator, nullptr for the default one.
+    /// allocator must outlive the decoded images.
+    void SetAllocator(PixelAllocator *allocator) { allocator_ = allocator; }
+    PixelAllocator *Allocator() const { return allocator_; }
+
+protected:
+    /// the context of format, reset to decode from source. source is
+    /// expected to be opened already.
+    LoadContext *PrepareContext(FileFormat *format, ree::io::Source *source,
+        const LoadOptions &options);
+    /// the format of source, sniffed unless the decoder is bound to one
+    FileFormat *FormatOf(ree::io::Source *source) const;
+
+private:
+    FileFormat *format_;
+    PixelAllocator *allocator_ = nullptr;
+    /// the image being streamed between Begin and End
+    FileFormat *streamFormat_ = nullptr;
+    LoadContext *streamContext_ = nullptr;
+    std::vector<std::pair<FileFormat *, std::unique_ptr<LoadContext>>>
+        contexts_;
+};
+
+}
+}
+}
@@ -0,0 +1,170 @@
+#include "encoder.hpp"
+
+#include <stdexcept>
+
+#include <ree/image/io/format_registry.hpp>
+#include <ree/image/io/error.hpp>
+#include <ree/image/io/source_guard.hpp>
+
+namespace ree {
+namespace image {
+namespace io {
+
+Encoder::Encoder() : format_(nullptr) {
+}
+
+Encoder::Encoder(FileFormat *format) : format_(format) {
+}
+
+void Encoder::Encode(const Image &image, ree::io::Source *target,
+    const WriteOptions &options) {
+    Encode(target, options, [&image](FileFormat *format, WriteContext *ctx) {
+        format->WriteImage(ctx, image);
+    });
+}
+
+void Encoder::Encode(const ImageView<const uint8_t> &view,
+    ree::io::Source *target, const WriteOptions &options) {
+    Encode(target, options, [&view](FileFormat *format, WriteContext *ctx) {
+        format->WriteView(ctx, view);
+    });
+}
+
+void Encoder::Encode(const ImageView<const uint16_t> &view,
+    ree::io::Source *target, const WriteOptions &options) {
+    Encode(target, options, [&view](FileFormat *format, WriteContext *ctx) {
+        format->WriteView(ctx, view);
+    });
+}
+
+void Encoder::Encode(ree::io::Source *target, const WriteOptions &options,
+    const std::function<void(FileFormat *, WriteContext *)> &write) {
+    Abort();
+    FileFormat *format = FormatOf(options);
+    auto ctx = PrepareContext(format, target, options);
+    if (!ctx) {
+        // before opening, so no empty file is left behind
+        throw NotImplementException();
+    }
+
+    target->OpenToWrite();
+    SourceGuard guard(target);
+    try {
+        write(format, ctx);
+    } catch (...) {
+        ctx->Reset(nullptr, WriteOptions());
+        throw;
+    }
+    ctx->target = nullptr;
+}
+
+void Encoder::Begin(ree::io::Source *target, const ImageInfo &info,
+    const WriteOptions &options) {
+    Abort();
+    FileFormat *format = FormatOf(options);
+    auto ctx = PrepareContext(format, target, options);
+    if (!ctx) {
+        throw NotImplementException();
+    }
+
+    target->OpenToWrite();
+    SourceGuard guard(target);
+    // from here on Abort closes it
+    guard.Release();
+    streamFormat_ = format;
+    streamContext_ = ctx;
+    try {
+        format->BeginWriteRows(ctx, info);
+    } catch (...) {
+        Abort();
+        throw;
+    }
+}
+
+void Encoder::WriteRows(const uint8_t *rows, size_t stride, int n) {
+    if (!streamContext_) {
+        throw std::logic_error("no image begun.");
+    }
+    try {
+        streamFormat_->WriteRows(streamContext_, rows, stride, n);
+    } catch (...) {
+        Abort();
+        throw;
+    }
+}
+
+void Encoder::End() {
+    if (!streamContext_) {
+        throw std::logic_error("no image begun.");
+    }
+    try {
+        streamFormat_->EndWriteRows(streamContext_);
+    } catch (...) {
+        Abort();
+        throw;
+    }
+    auto target = streamContext_->target;
+    streamContext_->target = nullptr;
+    streamContext_ = nullptr;
+    streamFormat_ = nullptr;
+    target->Close();
+}
+
+void Encoder::Abort() {
+    if (!streamContext_) {
+        return;
+    }
+    auto target = streamContext_->target;
+    streamContext_->Reset(nullptr, WriteOptions());
+    streamContext_ = nullptr;
+    streamFormat_ = nullptr;
+    target->Close();
+}
+
+FileFormat *Encoder::FormatOf(const WriteOptions &options) const {
+    FileFormat *format = format_;
+    if (!format) {
+        auto find = options.find("format");
+        if (find != options.end()) {
+            format = FormatRegistry::Instance().FindByExtension(find->second);
+        }
+    }
+    if (!format) {
+        throw UnknownFormatException();
+    }
+    return format;
+}
+
+bool Encoder::StreamsRows(const WriteOptions &options) const {
+    return FormatOf(options)->StreamsRows();
+}
+
+void Encoder::Reset() {
+    Abort();
+    for (auto &context : contexts_) {
+        context.second->Reset(nullptr, WriteOptions());
+    }
+}
+
+WriteContext *Encoder::PrepareContext(FileFormat *format,
+    ree::io::Source *target, const WriteOptions &options) {
+    for (auto &context : contexts_) {
+        if (context.first == format) {
+            context.second->Reset(target, options);
+            return context.second.get();
+        }
+    }
+
+    std::unique_ptr<WriteContext> ctx(
+        format->CreateComposeContext(target, options));
+    if (!ctx) {
+        // formats without a writer have nothing to keep
+        return nullptr;
+    }
+    contexts_.emplace_back(format, std::move(ctx));
+    return contexts_.back().second.get();
+}
+
+}
+}
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <ree/image/io/file_format.hpp>
+#include <ree/image/io/image.hpp>
+
+namespace ree {
+namespace image {
+namespace io {
+
+/**
+ * @brief encodes images one after another, keeping the compose contexts
+ * between images.
+ *
+ * Formats without an encoder give no compose context, encoding to them
+ * throws NotImplementException before the target is opened.
+ *
+ * An Encoder is not thread safe, use one per thread.
+ */
+class Encoder {
+public:
+    /// pick the format of every image from options["format"]
+    Encoder();
+    /// encode only to the given format, which must outlive the encoder
+    explicit Encoder(FileFormat *format);
+
+    Encoder(Encoder &&other) = default;
+    Encoder &operator=(Encoder &&other) = default;
+
+    /// open target, write image to it and close it again
+    void Encode(const Image &image, ree::io::Source *target,
+        const WriteOptions &options = WriteOptions());
+    /// encode a view, such as a crop, without copying it into an Image
+    void Encode(const ImageView<const uint8_t> &view, ree::io::Source *target,
+        const WriteOptions &options = WriteOptions());
+    void Encode(const ImageView<const uint16_t> &view, ree::io::Source *target,
+        const WriteOptions &options = WriteOptions());
+
+    /**
+     * @brief open target and start an image described by info, its rows then
+     * come in order through WriteRows. Ends the image written before, if any.
+     */
+    void Begin(ree::io::Source *target, const ImageInfo &info,
+        const WriteOptions &options = WriteOptions());
+    /// write the next n rows of the image begun, rows stride bytes apart
+    void WriteRows(const uint8_t *rows, size_t stride, int n);
+    /// finish the image begun and close its target
+    void End();
+
+    /// whether the format chosen for options writes the rows given to
+    /// WriteRows as they come, rather than holding the image until End
+    bool StreamsRows(const WriteOptions &options = WriteOptions()) const;
+
+    /// drop the state of the last image, retaining the allocated memory
+    void Reset();
+
+private:
+    /// the format chosen by the encoder or by options["format"]
+    FileFormat *FormatOf(const WriteOptions &options) const;
+    /// drop the image begun after a failure and close its target
+    void Abort();
+
+    /// open target and call write(format, ctx) for the chosen format
+    void Encode(ree::io::Source *target, const WriteOptions &options,
+        const std::function<void(FileFormat *, WriteContext *)> &write);
+    WriteContext *PrepareContext(FileFormat *format, ree::io::Source *target,
+        const WriteOptions &options);
+
+    FileFormat *format_;
+    /// the image being written between Begin and End
+    FileFormat *streamFormat_ = nullptr;
+    WriteContext *streamContext_ = nullptr;
+    std::vector<std::pair<FileFormat *, std::unique_ptr<WriteContext>>>
+        contexts_;
+};
+
+}
+}
+}
@@ -0,0 +1,159 @@
+#include "exif.hpp"
+
+// https://www.cipa.jp/std/documents/e/DC-008-2012_E.pdf
+namespace ree {
+namespace image {
+namespace io {
+
+namespace {
+
+enum ExifTag : uint16_t {
+    kOrientation = 0x0112,
+    kXResolution = 0x011a,
+    kYResolution = 0x011b,
+    kResolutionUnit = 0x0128,
+    kDateTime = 0x0132,
+    kExifIfd = 0x8769,
+    kDateTimeOriginal = 0x9003,
+};
+
+enum ExifType : uint16_t {
+    kAscii = 2,
+    kShort = 3,
+    kLong = 4,
+    kRational = 5,
+};
+
+constexpr size_t kEntrySize = 12;
+constexpr size_t kDateTimeSize = 19;
+
+/// bounds checked reads in the byte order of the block
+struct TiffReader {
+    const uint8_t *data;
+    size_t size;
+    bool littleEndian;
+
+    bool Has(size_t offset, size_t bytes) const {
+        return offset <= size && bytes <= size - offset;
+    }
+    uint16_t U16(size_t offset) const {
+        const uint8_t *p = data + offset;
+        return static_cast<uint16_t>(littleEndian ?
+            p[0] | p[1] << 8 : p[0] << 8 | p[1]);
+    }
+    uint32_t U32(size_t offset) const {
+        const uint8_t *p = data + offset;
+        return littleEndian ?
+            static_cast<uint32_t>(p[3]) << 24 | p[2] << 16 | p[1] << 8 | p[0] :
+            static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+    }
+    /// an unsigned SHORT or LONG stored in the entry itself
+    uint32_t Integer(size_t entry) const {
+        return U16(entry + 2) == kShort ? U16(entry + 8) : U32(entry + 8);
+    }
+    /// a RATIONAL pointed to by the entry, 0 when out of bounds
+    double Rational(size_t entry) const {
+        size_t offset = U32(entry + 8);
+        if (!Has(offset, 8) || U32(offset + 4) == 0) {
+            return 0;
+        }
+        return static_cast<double>(U32(offset)) / U32(offset + 4);
+    }
+};
+
+/// the entries of the IFD at offset, false when it does not fit
+bool IfdEntries(const TiffReader &tiff, size_t offset, size_t *first,
+    size_t *count) {
+    if (!tiff.Has(offset, 2)) {
+        return false;
+    }
+    *count = tiff.U16(offset);
+    *first = offset + 2;
+    return tiff.Has(*first, *count * kEntrySize);
+}
+
+void ReadDateTime(const TiffReader &tiff, size_t entry, std::string *time) {
+    size_t offset = tiff.U32(entry + 8);
+    if (tiff.U16(entry + 2) != kAscii || tiff.U32(entry + 4) < kDateTimeSize ||
+        !tiff.Has(offset, kDateTimeSize)) {
+        return;
+    }
+    time->assign(reinterpret_cast<const char *>(tiff.data + offset),
+        kDateTimeSize);
+}
+
+}
+
+bool ParseExif(const uint8_t *data, size_t size, Metadata *metadata) {
+    if (size < 8 || data[0] != data[1] || (data[0] != 'I' && data[0] != 'M')) {
+        return false;
+    }
+    TiffReader tiff{data, size, data[0] == 'I'};
+    if (tiff.U16(2) != 42) {
+        return false;
+    }
+
+    size_t first;
+    size_t count;
+    if (!IfdEntries(tiff, tiff.U32(4), &first, &count)) {
+        return false;
+    }
+    double xResolution = 0;
+    double yResolution = 0;
+    uint32_t unit = 2;
+    size_t exifIfd = 0;
+    for (size_t i = 0; i < count; ++i) {
+        size_t entry = first + i * kEntrySize;
+        switch (tiff.U16(entry)) {
+        case kOrientation: {
+            uint32_t orientation = tiff.Integer(entry);
+            if (orientation >= 1 && orientation <= 8) {
+                metadata->orientation = static_cast<int>(orientation);
+            }
+            break;
+        }
+        case kXResolution:
+            xResolution = tiff.Rational(entry);
+            break;
+        case kYResolution:
+            yResolution = tiff.Rational(entry);
+            break;
+        case kResolutionUnit:
+            unit = tiff.Integer(entry);
+            break;
+        case kDateTime:
+            ReadDateTime(tiff, entry, &metadata->captureTime);
+            break;
+        case kExifIfd:
+            exifIfd = tiff.U32(entry + 8);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // unit 2 is the inch, 3 the centimeter, 1 tells no absolute unit
+    if (metadata->dpiX == 0 && (unit == 2 || unit == 3)) {
+        double scale = unit == 3 ? 2.54 : 1.0;
+        metadata->dpiX = xResolution * scale;
+        metadata->dpiY = yResolution * scale;
+    }
+
+    // DateTimeOriginal, when there is one, takes over DateTime
+    if (exifIfd != 0) {
+        if (!IfdEntries(tiff, exifIfd, &first, &count)) {
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            size_t entry = first + i * kEntrySize;
+            if (tiff.U16(entry) == kDateTimeOriginal) {
+                ReadDateTime(tiff, entry, &metadata->captureTime);
+            }
+        }
+    }
+    return true;
+}
+
+}
+}
+}
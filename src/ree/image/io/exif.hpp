@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <ree/image/io/image.hpp>
+
+namespace ree {
+namespace image {
+namespace io {
+
+/**
+ * @brief read orientation, capture time and resolution from the TIFF
+ * structure of an EXIF block into metadata. The resolution is only taken
+ * when metadata has none yet. Returns false, leaving what was read so far,
+ * when the block is malformed.
+ */
+bool ParseExif(const uint8_t *data, size_t size, Metadata *metadata);
+
+}
+}
+}
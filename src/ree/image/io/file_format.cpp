@@ -1,5 +1,10 @@
 #include "file_format.hpp"
 
+#include <algorithm>
+#include <stdexcept>
+
+#include <ree/image/io/error.hpp>
+
 namespace ree {
 namespace image {
 namespace io {
@@ -7,14 +12,174 @@ namespace io {
 LoadContext::LoadContext(ree::io::Source *src, const LoadOptions &opt)
     : source(src),
       options(opt),
+      allocator(DefaultPixelAllocator()),
       done(false) {
 }
 
+void LoadContext::Reset(ree::io::Source *src, const LoadOptions &opt) {
+    source = src;
+    options = opt;
+    allocator = DefaultPixelAllocator();
+    done = false;
+    wanted = ColorSpace::Unknown;
+    info = ImageInfo();
+    nextRow = 0;
+    decoded = Image();
+}
+
 WriteContext::WriteContext(ree::io::Source *tgt, const LoadOptions &opt)
     : target(tgt),
       options(opt) {
 }
 
+void WriteContext::Reset(ree::io::Source *tgt, const WriteOptions &opt) {
+    target = tgt;
+    options = opt;
+    info = ImageInfo();
+    nextRow = 0;
+    pending.clear();
+}
+
+void ReadExactly(ree::io::Source *source, uint8_t *data, size_t size) {
+    if (size > 0 && static_cast<size_t>(source->Read(data, size)) != size) {
+        throw FileCorruptedException("unexpected end of file.");
+    }
+}
+
+template <typename ValueT>
+static Image PackView(const ImageView<const ValueT> &view) {
+    size_t rowBytes = view.RowValues() * sizeof(ValueT);
+    PixelBuffer<uint8_t> data;
+    data.resize(rowBytes * view.Height());
+    for (int row = 0; row < view.Height(); ++row) {
+        auto begin = reinterpret_cast<const uint8_t *>(view.Row(row));
+        std::copy(begin, begin + rowBytes, data.data() + rowBytes * row);
+    }
+    return Image(view.Width(), view.Height(), view.ColorSpace(),
+        view.DepthBits(), std::move(data));
+}
+
+bool FileFormat::MatchMagic(const uint8_t *data, size_t size) {
+    auto magic = MagicNumber();
+    return !magic.empty() && magic.size() <= size &&
+        std::equal(magic.begin(), magic.end(), data);
+}
+
+ProbeInfo FileFormat::Probe(LoadContext *ctx) {
+    BeginRows(ctx);
+    ProbeInfo info;
+    static_cast<ImageInfo &>(info) = ctx->info;
+    info.format = PreferredExtension();
+    return info;
+}
+
+Metadata FileFormat::ReadMetadata(LoadContext *ctx) {
+    return Metadata();
+}
+
+void FileFormat::BeginRows(LoadContext *ctx) {
+    ctx->decoded = LoadImage(ctx);
+    ctx->info.width = ctx->decoded.Width();
+    ctx->info.height = ctx->decoded.Height();
+    ctx->info.colorspace = ctx->decoded.ColorSpace();
+    ctx->info.depth = ctx->decoded.DepthBits();
+    ctx->nextRow = 0;
+}
+
+int FileFormat::ReadRows(LoadContext *ctx, uint8_t *dst, size_t stride,
+    int n) {
+    size_t rowBytes = ctx->info.RowBytes();
+    int rows = std::min(n, ctx->info.height - ctx->nextRow);
+    for (int i = 0; i < rows; ++i) {
+        auto begin = ctx->decoded.Data().data() + rowBytes * ctx->nextRow++;
+        std::copy(begin, begin + rowBytes, dst + stride * i);
+    }
+    if (ctx->nextRow == ctx->info.height) {
+        ctx->decoded = Image();
+    }
+    return std::max(rows, 0);
+}
+
+int FileFormat::ScaleDenominator(const LoadOptions &options) {
+    auto find = options.find("scale_denom");
+    if (find == options.end()) {
+        return 1;
+    }
+    const std::string &denom = find->second;
+    if (denom != "1" && denom != "2" && denom != "4" && denom != "8") {
+        throw std::invalid_argument("scale_denom must be 1, 2, 4 or 8.");
+    }
+    return denom[0] - '0';
+}
+
+Image FileFormat::LoadImageByRows(LoadContext *ctx) {
+    BeginRows(ctx);
+    const ImageInfo &info = ctx->info;
+    if (ctx->decoded.Width() == info.width &&
+        ctx->decoded.Height() == info.height && info.width > 0) {
+        // decoded whole by BeginRows already
+        ctx->nextRow = info.height;
+        return std::move(ctx->decoded);
+    }
+    size_t rowBytes = info.RowBytes();
+
+    PixelBuffer<uint8_t> data(ctx->allocator);
+    data.resize(rowBytes * info.height);
+    int row = 0;
+    while (row < info.height) {
+        int rows = ReadRows(ctx, data.data() + rowBytes * row, rowBytes,
+            info.height - row);
+        if (rows <= 0) {
+            throw FileCorruptedException("image ends before its last row.");
+        }
+        row += rows;
+    }
+    return Image(info.width, info.height, info.colorspace, info.depth,
+        std::move(data));
+}
+
+void FileFormat::BeginWriteRows(WriteContext *ctx, const ImageInfo &info) {
+    ctx->info = info;
+    ctx->nextRow = 0;
+    ctx->pending.resize(info.RowBytes() * info.height);
+}
+
+void FileFormat::WriteRows(WriteContext *ctx, const uint8_t *rows,
+    size_t stride, int n) {
+    size_t rowBytes = ctx->info.RowBytes();
+    if (n > ctx->info.height - ctx->nextRow) {
+        throw std::out_of_range("more rows than the image has.");
+    }
+    for (int i = 0; i < n; ++i) {
+        std::copy(rows + stride * i, rows + stride * i + rowBytes,
+            ctx->pending.data() + rowBytes * ctx->nextRow++);
+    }
+}
+
+void FileFormat::EndWriteRows(WriteContext *ctx) {
+    const ImageInfo &info = ctx->info;
+    if (ctx->nextRow != info.height) {
+        throw std::logic_error("image ended before its last row.");
+    }
+    WriteImage(ctx, Image(info.width, info.height, info.colorspace,
+        info.depth, std::move(ctx->pending)));
+    ctx->pending = PixelBuffer<uint8_t>();
+}
+
+bool FileFormat::StreamsRows() {
+    return false;
+}
+
+void FileFormat::WriteView(WriteContext *ctx,
+    const ImageView<const uint8_t> &view) {
+    WriteImage(ctx, PackView(view));
+}
+
+void FileFormat::WriteView(WriteContext *ctx,
+    const ImageView<const uint16_t> &view) {
+    WriteImage(ctx, PackView(view));
+}
+
 }
 }
 }
\ No newline at end of file
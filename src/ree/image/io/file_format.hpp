@@ -6,6 +6,8 @@
 #include <memory>
 
 #include <ree/image/io/image.hpp>
+#include <ree/image/pixel_buffer.hpp>
+#include <ree/image/image_view.hpp>
 #include <ree/io/source.h>
 
 namespace ree {
@@ -14,18 +16,46 @@ namespace io {
 
 struct LoadContext {
     LoadContext(ree::io::Source *src, const LoadOptions &opt);
+    virtual ~LoadContext() = default;
+
+    /// prepare for the next image, keeping whatever memory can be reused.
+    /// contexts holding per-image state must override it.
+    virtual void Reset(ree::io::Source *src, const LoadOptions &opt);
 
     ree::io::Source *source;
     LoadOptions options;
+    /// where the pixels of the decoded image are allocated from
+    PixelAllocator *allocator;
 
     bool done;
+
+    /// the color space the caller wants rows in, Unknown for the stored one.
+    /// Formats that can produce it while decoding report it in info.
+    class ColorSpace wanted { ColorSpace::Unknown };
+    /// filled by FileFormat::BeginRows
+    ImageInfo info;
+    /// rows handed out by FileFormat::ReadRows so far
+    int nextRow = 0;
+    /// the image the default row implementation serves rows from
+    Image decoded;
 };
 
 struct WriteContext {
     WriteContext(ree::io::Source *tgt, const LoadOptions &opt);
-    
+    virtual ~WriteContext() = default;
+
+    /// prepare for the next image, keeping whatever memory can be reused
+    virtual void Reset(ree::io::Source *tgt, const WriteOptions &opt);
+
     ree::io::Source *target;
     WriteOptions options;
+
+    /// the image being written by FileFormat::WriteRows
+    ImageInfo info;
+    /// rows written so far
+    int nextRow = 0;
+    /// rows the default row implementation collects until EndWriteRows
+    PixelBuffer<uint8_t> pending;
 };
 
 class FileFormat {
@@ -35,7 +65,14 @@ public:
     virtual std::vector<std::string> ValidExtensions() = 0;
     virtual std::string PreferredExtension() = 0;
     virtual std::vector<uint8_t> MagicNumber() = 0;
+    /**
+     * @brief whether the leading bytes of a file belong to this format. The
+     * default compares them with MagicNumber(), formats without a fixed
+     * prefix return an empty MagicNumber() and override this.
+     */
+    virtual bool MatchMagic(const uint8_t *data, size_t size);
 
+    /// the caller owns the returned contexts
     virtual LoadContext *CreateParseContext(ree::io::Source *source,
         const LoadOptions &options) = 0;
     virtual WriteContext *CreateComposeContext(ree::io::Source *target,
@@ -43,8 +80,68 @@ public:
 
     virtual Image LoadImage(LoadContext *ctx) = 0;
     virtual void WriteImage(WriteContext *ctx, const Image &image) = 0;
+
+    /**
+     * @brief read only as much of the headers as needed to describe the
+     * image. The default reads up to the first row with BeginRows.
+     */
+    virtual ProbeInfo Probe(LoadContext *ctx);
+    /**
+     * @brief read the metadata the file carries, skipping the pixel data.
+     * The default finds none.
+     */
+    virtual Metadata ReadMetadata(LoadContext *ctx);
+
+    /**
+     * @brief read up to the first row of pixels and fill ctx->info.
+     * The default decodes the whole image with LoadImage and serves its rows,
+     * formats that can decode incrementally override both BeginRows and
+     * ReadRows.
+     */
+    virtual void BeginRows(LoadContext *ctx);
+    /**
+     * @brief decode at most n of the next rows into dst, rows stride bytes
+     * apart, each ctx->info.RowBytes() long. Returns the number of rows
+     * decoded, 0 once every row was read.
+     */
+    virtual int ReadRows(LoadContext *ctx, uint8_t *dst, size_t stride, int n);
+
+    /**
+     * @brief start writing an image described by info, whose rows then come
+     * in order through WriteRows. The default collects the rows and writes
+     * them with WriteImage in EndWriteRows, formats that can encode
+     * incrementally override all three.
+     */
+    virtual void BeginWriteRows(WriteContext *ctx, const ImageInfo &info);
+    /// write the next n rows, stride bytes apart, info.RowBytes() each
+    virtual void WriteRows(WriteContext *ctx, const uint8_t *rows,
+        size_t stride, int n);
+    /// finish the image once all of its rows were written
+    virtual void EndWriteRows(WriteContext *ctx);
+    /// whether WriteRows writes the rows as they come. The default holds the
+    /// whole image until EndWriteRows.
+    virtual bool StreamsRows();
+
+    /// write the pixels of a view, images up to 8 bits deep. The default
+    /// packs the view into an Image and calls WriteImage.
+    virtual void WriteView(WriteContext *ctx,
+        const ImageView<const uint8_t> &view);
+    /// write the pixels of a view, images deeper than 8 bits
+    virtual void WriteView(WriteContext *ctx,
+        const ImageView<const uint16_t> &view);
+
+protected:
+    /// LoadImage on top of BeginRows and ReadRows
+    Image LoadImageByRows(LoadContext *ctx);
+    /// options["scale_denom"], 1, 2, 4 or 8, 1 when not given. Throws
+    /// std::invalid_argument for any other value.
+    static int ScaleDenominator(const LoadOptions &options);
 };
 
+/// read size bytes from source, throwing FileCorruptedException when it ends
+/// before
+void ReadExactly(ree::io::Source *source, uint8_t *data, size_t size);
+
 }
 }
 }
@@ -0,0 +1,142 @@
+#include "format_registry.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#include <ree/image/io/jpeg.hpp>
+#include <ree/image/io/png.hpp>
+#include <ree/image/io/bmp.hpp>
+#include <ree/image/io/ppm.hpp>
+#include <ree/image/io/heif.hpp>
+
+namespace ree {
+namespace image {
+namespace io {
+
+constexpr size_t FormatRegistry::kMaxMagicSize;
+
+static char ToLower(char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+static std::string NormalizeExtension(const std::string &extension) {
+    size_t begin = (!extension.empty() && extension[0] == '.') ? 1 : 0;
+    std::string ext(extension.begin() + begin, extension.end());
+    std::transform(ext.begin(), ext.end(), ext.begin(), ToLower);
+    return ext;
+}
+
+FormatRegistry &FormatRegistry::Instance() {
+    static FormatRegistry registry;
+    return registry;
+}
+
+FormatRegistry::FormatRegistry() {
+    Register(std::make_shared<Jpeg>());
+    Register(std::make_shared<Png>());
+    Register(std::make_shared<Bmp>());
+    Register(std::make_shared<Ppm>());
+    Register(std::make_shared<Heif>());
+}
+
+void FormatRegistry::Register(std::shared_ptr<FileFormat> format) {
+    if (!format) {
+        return;
+    }
+    auto magic = format->MagicNumber();
+    if (magic.size() > kMaxMagicSize) {
+        throw std::invalid_argument("magic number of " +
+            format->PreferredExtension() + " is too long.");
+    }
+    auto extensions = format->ValidExtensions();
+    extensions.push_back(format->PreferredExtension());
+
+    FileFormat *fmt = format.get();
+    formats_.push_back(std::move(format));
+
+    // later registrations take precedence over the builtin formats
+    if (!magic.empty()) {
+        auto &candidates = magicTable_[magic[0]];
+        candidates.insert(candidates.begin(), Entry{fmt, std::move(magic)});
+    } else {
+        matchers_.insert(matchers_.begin(), fmt);
+    }
+    for (const auto &ext : extensions) {
+        auto normalized = NormalizeExtension(ext);
+        auto find = std::find_if(extensions_.begin(), extensions_.end(),
+            [&](const ExtensionEntry &entry) {
+                return entry.extension == normalized;
+            });
+        if (find != extensions_.end()) {
+            find->format = fmt;
+        } else {
+            extensions_.push_back(ExtensionEntry{std::move(normalized), fmt});
+        }
+    }
+}
+
+FileFormat *FormatRegistry::FindByMagic(const uint8_t *data,
+    size_t size) const {
+    if (size == 0) {
+        return nullptr;
+    }
+    for (const auto &entry : magicTable_[data[0]]) {
+        if (entry.magic.size() <= size &&
+            std::equal(entry.magic.begin(), entry.magic.end(), data)) {
+            return entry.format;
+        }
+    }
+    for (auto format : matchers_) {
+        if (format->MatchMagic(data, size)) {
+            return format;
+        }
+    }
+    return nullptr;
+}
+
+FileFormat *FormatRegistry::FindExtension(const char *extension,
+    size_t size) const {
+    if (size > 0 && extension[0] == '.') {
+        extension++;
+        size--;
+    }
+    // a handful of entries, compared in place instead of hashing a lower
+    // case copy
+    for (const auto &entry : extensions_) {
+        if (entry.extension.size() == size && std::equal(extension,
+            extension + size, entry.extension.begin(), [](char a, char b) {
+                return ToLower(a) == b;
+            })) {
+            return entry.format;
+        }
+    }
+    return nullptr;
+}
+
+FileFormat *FormatRegistry::FindByExtension(
+    const std::string &extension) const {
+    return FindExtension(extension.data(), extension.size());
+}
+
+FileFormat *FormatRegistry::FindByPath(const std::string &path) const {
+    auto dot = path.find_last_of('.');
+    auto slash = path.find_last_of("/\\");
+    if (dot == std::string::npos ||
+        (slash != std::string::npos && dot < slash)) {
+        return nullptr;
+    }
+    return FindExtension(path.data() + dot + 1, path.size() - dot - 1);
+}
+
+FileFormat *FormatRegistry::Sniff(ree::io::Source *source) const {
+    std::array<uint8_t, kMaxMagicSize> data;
+    data.fill(0);
+    source->Read(data.data(), data.size());
+    source->Seek(0);
+    return FindByMagic(data.data(), data.size());
+}
+
+}
+}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <ree/image/io/file_format.hpp>
+
+namespace ree {
+namespace image {
+namespace io {
+
+/**
+ * @brief process-wide table of the known file formats.
+ *
+ * The builtin formats are registered once on first use; third-party formats
+ * may be added with Register() at startup, before any other thread looks a
+ * format up. The table is not locked, lookups never allocate.
+ */
+class FormatRegistry {
+public:
+    static FormatRegistry &Instance();
+
+    /// longest magic number prefix a lookup needs to see
+    static constexpr size_t kMaxMagicSize = 12;
+
+    /// throws std::invalid_argument for a magic number longer than
+    /// kMaxMagicSize
+    void Register(std::shared_ptr<FileFormat> format);
+
+    /// match the leading bytes of a file against registered magic numbers
+    FileFormat *FindByMagic(const uint8_t *data, size_t size) const;
+    /// case insensitive, with or without the leading dot
+    FileFormat *FindByExtension(const std::string &extension) const;
+    /// the format matching the extension of the path
+    FileFormat *FindByPath(const std::string &path) const;
+
+    /// read the magic number from source and seek back to its begining
+    FileFormat *Sniff(ree::io::Source *source) const;
+
+private:
+    FormatRegistry();
+    FormatRegistry(const FormatRegistry &) = delete;
+    FormatRegistry &operator=(const FormatRegistry &) = delete;
+
+    struct Entry {
+        FileFormat *format;
+        std::vector<uint8_t> magic;
+    };
+    struct ExtensionEntry {
+        /// lower case, without the leading dot
+        std::string extension;
+        FileFormat *format;
+    };
+
+    FileFormat *FindExtension(const char *extension, size_t size) const;
+
+    std::vector<std::shared_ptr<FileFormat>> formats_;
+    /// candidates indexed by the first byte of their magic number
+    std::array<std::vector<Entry>, 256> magicTable_;
+    /// formats without a fixed magic number, asked by FileFormat::MatchMagic
+    std::vector<FileFormat *> matchers_;
+    std::vector<ExtensionEntry> extensions_;
+};
+
+}
+}
+}
@@ -0,0 +1,350 @@
+#include "heif.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include <ree/image/io/error.hpp>
+
+// https://www.iso.org/standard/66067.html, boxes as in ISO/IEC 14496-12
+namespace ree {
+namespace image {
+namespace io {
+
+static const char *kBrands[] = {
+    "heic", "heix", "hevc", "hevx", "heim", "heis", "mif1", "msf1",
+};
+
+/// item types that hold an image, coded or derived
+static const uint32_t kImageItems[] = {
+    'hvc1', 'av01', 'grid', 'iden', 'iovl',
+};
+
+/// the meta box is read whole, anything larger is taken as corrupted
+static constexpr uint64_t kMaxMetaSize = 16 << 20;
+
+struct HeifContext : public LoadContext {
+    using LoadContext::LoadContext;
+
+    /// payload of the meta box, reused across images
+    std::vector<uint8_t> meta;
+};
+
+/// a box inside a buffer, data points past its header
+struct Box {
+    uint32_t type;
+    const uint8_t *data;
+    size_t size;
+};
+
+struct Item {
+    uint32_t id;
+    uint32_t type;
+    bool hidden;
+    /// it is an alpha plane, a thumbnail or a tile of another item
+    bool auxiliary;
+};
+
+static inline uint32_t ReadU32(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+static inline uint16_t ReadU16(const uint8_t *p) {
+    return static_cast<uint16_t>(p[0] << 8 | p[1]);
+}
+
+/// the boxes in [data, data + size), a truncated one ends the list
+static std::vector<Box> ChildBoxes(const uint8_t *data, size_t size) {
+    std::vector<Box> boxes;
+    size_t offset = 0;
+    while (offset + 8 <= size) {
+        uint64_t length = ReadU32(data + offset);
+        uint32_t type = ReadU32(data + offset + 4);
+        size_t header = 8;
+        if (length == 1 && offset + 16 <= size) {
+            length = static_cast<uint64_t>(ReadU32(data + offset + 8)) << 32 |
+                ReadU32(data + offset + 12);
+            header = 16;
+        } else if (length == 0) {
+            length = size - offset;
+        }
+        if (length < header || length > size - offset) {
+            break;
+        }
+        boxes.push_back(Box{type, data + offset + header,
+            static_cast<size_t>(length - header)});
+        offset += static_cast<size_t>(length);
+    }
+    return boxes;
+}
+
+/// the payload of a full box, past its version and flags
+static Box FullBoxBody(const Box &box, uint8_t *version, uint32_t *flags) {
+    if (box.size < 4) {
+        throw FileCorruptedException("box too short.");
+    }
+    *version = box.data[0];
+    *flags = ReadU32(box.data) & 0xffffff;
+    return Box{box.type, box.data + 4, box.size - 4};
+}
+
+static std::vector<Item> ParseItemInfo(const Box &iinf) {
+    uint8_t version;
+    uint32_t flags;
+    Box body = FullBoxBody(iinf, &version, &flags);
+    size_t countSize = version == 0 ? 2 : 4;
+    if (body.size < countSize) {
+        throw FileCorruptedException("wrong item info.");
+    }
+
+    std::vector<Item> items;
+    for (const auto &infe : ChildBoxes(body.data + countSize,
+        body.size - countSize)) {
+        if (infe.type != 'infe') {
+            continue;
+        }
+        Box entry = FullBoxBody(infe, &version, &flags);
+        // item types came with version 2
+        size_t idSize = version == 3 ? 4 : 2;
+        if (version < 2 || entry.size < idSize + 6) {
+            continue;
+        }
+        Item item;
+        item.id = idSize == 4 ? ReadU32(entry.data) : ReadU16(entry.data);
+        item.type = ReadU32(entry.data + idSize + 2);
+        item.hidden = (flags & 1) != 0;
+        item.auxiliary = false;
+        items.push_back(item);
+    }
+    return items;
+}
+
+/// mark the items referring to others as auxiliary ones, and whether an
+/// alpha item belongs to primary
+static void ParseReferences(const Box &iref, std::vector<Item> &items,
+    uint32_t primary, const std::vector<uint32_t> &alphaItems,
+    bool *primaryAlpha) {
+    uint8_t version;
+    uint32_t flags;
+    Box body = FullBoxBody(iref, &version, &flags);
+    size_t idSize = version == 0 ? 2 : 4;
+    auto readId = [idSize](const uint8_t *p) {
+        return idSize == 4 ? ReadU32(p) : ReadU16(p);
+    };
+
+    for (const auto &ref : ChildBoxes(body.data, body.size)) {
+        if (ref.size < idSize + 2) {
+            continue;
+        }
+        uint32_t from = readId(ref.data);
+        size_t count = ReadU16(ref.data + idSize);
+        if (ref.size < idSize + 2 + count * idSize) {
+            throw FileCorruptedException("wrong item reference.");
+        }
+        if (ref.type == 'auxl' || ref.type == 'thmb') {
+            for (auto &item : items) {
+                item.auxiliary = item.auxiliary || item.id == from;
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t to = readId(ref.data + idSize + 2 + i * idSize);
+            if (ref.type == 'dimg') {
+                for (auto &item : items) {
+                    item.auxiliary = item.auxiliary || item.id == to;
+                }
+            }
+            if (ref.type == 'auxl' && to == primary &&
+                std::find(alphaItems.begin(), alphaItems.end(), from) !=
+                alphaItems.end()) {
+                *primaryAlpha = true;
+            }
+        }
+    }
+}
+
+std::vector<std::string> Heif::ValidExtensions() {
+    return {"heic", "heif", "hif"};
+}
+std::vector<uint8_t> Heif::MagicNumber() {
+    return {};
+}
+bool Heif::MatchMagic(const uint8_t *data, size_t size) {
+    if (size < 12 || std::memcmp(data + 4, "ftyp", 4) != 0) {
+        return false;
+    }
+    for (auto brand : kBrands) {
+        if (std::memcmp(data + 8, brand, 4) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+std::string Heif::PreferredExtension() {
+    return "heic";
+}
+
+LoadContext *Heif::CreateParseContext(ree::io::Source *source,
+    const LoadOptions &options) {
+    return new HeifContext(source, options);
+}
+WriteContext *Heif::CreateComposeContext(ree::io::Source *target,
+    const WriteOptions &options) {
+    return nullptr;
+}
+
+Image Heif::LoadImage(LoadContext *ctx) {
+    throw NotImplementException();
+}
+
+void Heif::WriteImage(WriteContext *ctx, const Image &image) {
+    throw NotImplementException();
+}
+
+ProbeInfo Heif::Probe(LoadContext *contex) {
+    auto ctx = static_cast<HeifContext *>(contex);
+    auto source = ctx->source;
+
+    // top level boxes are skipped by seeking until the meta box
+    size_t position = 0;
+    while (true) {
+        std::array<uint8_t, 16> header;
+        ReadExactly(source, header.data(), 8);
+        uint64_t length = ReadU32(header.data());
+        uint32_t type = ReadU32(header.data() + 4);
+        size_t headerSize = 8;
+        if (length == 1) {
+            ReadExactly(source, header.data() + 8, 8);
+            length = static_cast<uint64_t>(ReadU32(header.data() + 8)) << 32 |
+                ReadU32(header.data() + 12);
+            headerSize = 16;
+        }
+        if (length < headerSize || (type == 'meta' && length > kMaxMetaSize)) {
+            throw FileCorruptedException("wrong box size.");
+        }
+        if (type == 'meta') {
+            ctx->meta.resize(static_cast<size_t>(length) - headerSize);
+            ReadExactly(source, ctx->meta.data(), ctx->meta.size());
+            break;
+        }
+        position += static_cast<size_t>(length);
+        source->Seek(position);
+    }
+
+    uint8_t version;
+    uint32_t flags;
+    Box meta = FullBoxBody(Box{'meta', ctx->meta.data(), ctx->meta.size()},
+        &version, &flags);
+    auto boxes = ChildBoxes(meta.data, meta.size);
+    auto find = [](const std::vector<Box> &list, uint32_t type) {
+        auto it = std::find_if(list.begin(), list.end(),
+            [type](const Box &box) { return box.type == type; });
+        return it == list.end() ? nullptr : &*it;
+    };
+
+    const Box *pitm = find(boxes, 'pitm');
+    const Box *iinf = find(boxes, 'iinf');
+    const Box *iprp = find(boxes, 'iprp');
+    if (!pitm || !iinf || !iprp) {
+        throw FileCorruptedException("no primary item.");
+    }
+    Box body = FullBoxBody(*pitm, &version, &flags);
+    if (body.size < (version == 0 ? 2u : 4u)) {
+        throw FileCorruptedException("wrong primary item.");
+    }
+    uint32_t primary = version == 0 ? ReadU16(body.data) : ReadU32(body.data);
+    auto items = ParseItemInfo(*iinf);
+
+    // the properties in ipco are numbered from 1 by their associations
+    auto properties = ChildBoxes(iprp->data, iprp->size);
+    const Box *ipco = find(properties, 'ipco');
+    const Box *ipma = find(properties, 'ipma');
+    if (!ipco || !ipma) {
+        throw FileCorruptedException("no item properties.");
+    }
+    auto propertyList = ChildBoxes(ipco->data, ipco->size);
+
+    ProbeInfo info;
+    info.format = PreferredExtension();
+    info.colorspace = ColorSpace::RGB;
+    int channels = 3;
+    std::vector<uint32_t> alphaItems;
+
+    body = FullBoxBody(*ipma, &version, &flags);
+    const uint8_t *cursor = body.data;
+    const uint8_t *end = body.data + body.size;
+    size_t idSize = version < 1 ? 2 : 4;
+    size_t indexSize = (flags & 1) ? 2 : 1;
+    if (end - cursor < 4) {
+        throw FileCorruptedException("wrong item properties.");
+    }
+    uint32_t entries = ReadU32(cursor);
+    cursor += 4;
+    for (uint32_t i = 0; i < entries; ++i) {
+        if (static_cast<size_t>(end - cursor) < idSize + 1) {
+            throw FileCorruptedException("wrong item properties.");
+        }
+        uint32_t id = idSize == 4 ? ReadU32(cursor) : ReadU16(cursor);
+        uint8_t count = cursor[idSize];
+        cursor += idSize + 1;
+        if (static_cast<size_t>(end - cursor) < count * indexSize) {
+            throw FileCorruptedException("wrong item properties.");
+        }
+        for (uint8_t j = 0; j < count; ++j, cursor += indexSize) {
+            // the top bit tells whether the property is essential
+            size_t index = indexSize == 2 ? ReadU16(cursor) & 0x7fff :
+                cursor[0] & 0x7f;
+            if (index == 0 || index > propertyList.size()) {
+                continue;
+            }
+            const Box &property = propertyList[index - 1];
+            // the properties read here are all full boxes
+            Box value = property.size >= 4 ?
+                FullBoxBody(property, &version, &flags) : property;
+            if (property.type == 'auxC') {
+                std::string auxType(reinterpret_cast<const char *>(value.data),
+                    strnlen(reinterpret_cast<const char *>(value.data),
+                    value.size));
+                if (auxType == "urn:mpeg:hevc:2015:auxid:1" ||
+                    auxType == "urn:mpeg:mpegB:cicp:systems:auxiliary:alpha") {
+                    alphaItems.push_back(id);
+                }
+            }
+            if (id != primary) {
+                continue;
+            }
+            if (property.type == 'ispe' && value.size >= 8) {
+                info.width = static_cast<int>(ReadU32(value.data));
+                info.height = static_cast<int>(ReadU32(value.data + 4));
+            } else if (property.type == 'pixi' && value.size >= 2) {
+                channels = value.data[0];
+                info.depth = value.data[1];
+            }
+        }
+    }
+
+    bool alpha = false;
+    const Box *iref = find(boxes, 'iref');
+    if (iref) {
+        ParseReferences(*iref, items, primary, alphaItems, &alpha);
+    }
+    if (channels == 1) {
+        info.colorspace = alpha ? ColorSpace::GrayAlpha : ColorSpace::Gray;
+    } else if (alpha) {
+        info.colorspace = ColorSpace::RGBA;
+    }
+
+    // image sequences in a moov box are not counted
+    info.frames = static_cast<int>(std::count_if(items.begin(), items.end(),
+        [](const Item &item) {
+        return !item.hidden && !item.auxiliary &&
+            std::find(std::begin(kImageItems), std::end(kImageItems),
+            item.type) != std::end(kImageItems);
+    }));
+    if (info.width <= 0 || info.height <= 0) {
+        throw FileCorruptedException("no image size.");
+    }
+    return info;
+}
+
+}
+}
+}
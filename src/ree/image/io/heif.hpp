@@ -0,0 +1,36 @@
+#pragma once
+
+#include <ree/image/io/file_format.hpp>
+
+namespace ree {
+namespace image {
+namespace io {
+
+/**
+ * @brief HEIF/HEIC, ISO/IEC 23008-12. Only the item boxes describing the
+ * image are parsed, decoding the coded items is not implemented.
+ */
+class Heif : public FileFormat {
+public:
+    std::vector<std::string> ValidExtensions() override;
+    /// empty, the brand follows the size of the ftyp box, see MatchMagic
+    std::vector<uint8_t> MagicNumber() override;
+    bool MatchMagic(const uint8_t *data, size_t size) override;
+    std::string PreferredExtension() override;
+
+    LoadContext *CreateParseContext(ree::io::Source *source,
+        const LoadOptions &options) override;
+    WriteContext *CreateComposeContext(ree::io::Source *target,
+        const WriteOptions &options) override;
+
+    Image LoadImage(LoadContext *ctx) override;
+    void WriteImage(WriteContext *ctx, const Image &image) override;
+
+    /// size, depth and alpha of the primary item from its ispe, pixi and
+    /// auxC properties
+    ProbeInfo Probe(LoadContext *ctx) override;
+};
+
+}
+}
+}
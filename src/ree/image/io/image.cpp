@@ -1,73 +1,164 @@
 #include "image.hpp"
 
-#include <ree/image/io/file_format.hpp>
-#include <ree/image/io/jpeg.hpp>
-#include <ree/image/io/png.hpp>
-#include <ree/image/io/bmp.hpp>
-#include <ree/image/io/ppm.hpp>
+#include <stdexcept>
+
+#include <ree/image/io/decoder.hpp>
+#include <ree/image/io/encoder.hpp>
+#include <ree/image/io/format_registry.hpp>
 #include <ree/image/io/error.hpp>
+#include <ree/image/thread_pool.hpp>
+#include <ree/image/color_convert.hpp>
 
 namespace ree {
 namespace image {
 namespace io {
 
-static std::shared_ptr<FileFormat> FindFileFormat(ree::io::Source *source) {
-    std::vector<std::shared_ptr<FileFormat>> formats = {
-        std::make_shared<Jpeg>(),
-        std::make_shared<Png>(),
-        std::make_shared<Bmp>(),
-        std::make_shared<Ppm>(),
-    };
-
-    std::shared_ptr<FileFormat> format;
-
-    std::vector<uint8_t> data(8);
-    source->Read(data.data(), data.size());
-    for (const auto &fmt: formats) {
-        auto magicNumber = fmt->MagicNumber();
-        bool match = true;
-        for (size_t i = 0; i < magicNumber.size(); ++i) {
-            if (magicNumber[i] != data[i]) {
-                match = false;
-                break;
-            }
+/// one decoder per thread, so the parse contexts are reused across loads
+static Decoder &ThreadDecoder() {
+    thread_local Decoder decoder;
+    return decoder;
+}
+
+Image Image::Load(ree::io::Source *source, const LoadOptions &options) {
+    return ThreadDecoder().Decode(source, options);
+}
+
+template <typename ValueT>
+static void ConvertRows(const uint8_t *src, size_t srcStride, uint8_t *dst,
+    size_t dstStride, int rows, const ImageInfo &from, class ColorSpace to) {
+    for (int i = 0; i < rows; ++i) {
+        ConvertPixels(reinterpret_cast<const ValueT *>(src + srcStride * i),
+            from.colorspace, reinterpret_cast<ValueT *>(dst + dstStride * i),
+            to, from.width, from.depth);
+    }
+}
+
+ImageInfo Image::LoadInto(ree::io::Source *source, void *dst, size_t stride,
+    class ColorSpace wanted, const LoadOptions &options) {
+    static constexpr int kStripRows = 16;
+
+    Decoder &decoder = ThreadDecoder();
+    ImageInfo info = decoder.Begin(source, options, wanted);
+    ImageInfo out = info;
+    if (wanted != ColorSpace::Unknown) {
+        out.colorspace = wanted;
+    }
+    uint8_t *rows = static_cast<uint8_t *>(dst);
+
+    try {
+        if (stride < out.RowBytes()) {
+            throw std::invalid_argument("stride shorter than a row.");
         }
-        if (match) {
-            format = fmt;
-            break;
+        if (!CanConvert(info.colorspace, out.colorspace)) {
+            throw std::invalid_argument("can not convert from " +
+                info.colorspace.ToString() + " to " +
+                out.colorspace.ToString() + ".");
         }
+        // rows the decoder can not produce as wanted pass through a strip
+        // small enough to stay in cache until they are converted
+        bool direct = info.colorspace == out.colorspace;
+        std::vector<uint8_t> strip;
+        size_t stripStride = info.RowBytes();
+        if (!direct) {
+            strip.resize(stripStride * kStripRows);
+        }
+
+        int y = 0;
+        while (y < info.height) {
+            int n = direct ?
+                decoder.ReadRows(rows + stride * y, stride, info.height - y) :
+                decoder.ReadRows(strip.data(), stripStride, kStripRows);
+            if (n <= 0) {
+                throw FileCorruptedException("image ends before its last row.");
+            }
+            if (!direct && info.depth > 8) {
+                ConvertRows<uint16_t>(strip.data(), stripStride,
+                    rows + stride * y, stride, n, info, out.colorspace);
+            } else if (!direct) {
+                ConvertRows<uint8_t>(strip.data(), stripStride,
+                    rows + stride * y, stride, n, info, out.colorspace);
+            }
+            y += n;
+        }
+    } catch (...) {
+        decoder.End();
+        throw;
     }
+    decoder.End();
+    return out;
+}
 
-    source->Seek(0);
-    return format;
+ProbeInfo Image::Probe(ree::io::Source *source, const LoadOptions &options) {
+    return ThreadDecoder().Probe(source, options);
 }
 
-Image Image::Load(ree::io::Source *source, const LoadOptions &options) {
-    source->OpenToRead();
+Metadata Image::ReadMetadata(ree::io::Source *source,
+    const LoadOptions &options) {
+    return ThreadDecoder().ReadMetadata(source, options);
+}
 
-    auto format = FindFileFormat(source);
-    if (!format) {
-        source->Close();
-        throw UnknownFormatException();
-    }
+std::future<Image> Image::LoadAsync(ree::io::Source *source,
+    const LoadOptions &options) {
+    auto promise = std::make_shared<std::promise<Image>>();
+    auto future = promise->get_future();
+    ThreadPool::SharedIo().Submit([source, options, promise]() {
+        try {
+            promise->set_value(Load(source, options));
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+    return future;
+}
 
-    auto ctx = format->CreateParseContext(source, options);
-    auto image = format->LoadImage(ctx);
-    source->Close();
-    return image;
+std::future<void> Image::LoadAsync(ree::io::Source *source,
+    const LoadOptions &options, LoadCallback done) {
+    auto promise = std::make_shared<std::promise<void>>();
+    auto future = promise->get_future();
+    ThreadPool::SharedIo().Submit([source, options, done, promise]() {
+        Image image;
+        std::exception_ptr error;
+        try {
+            image = Load(source, options);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        // pool tasks must not throw
+        try {
+            done(std::move(image), error);
+            promise->set_value();
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+    return future;
 }
 
 Image::Image() : width_(0), height_(0) {
 }
 
 Image::Image(int w, int h, class ColorSpace cs, uint8_t depth, 
-    std::vector<uint8_t> &&d)
-    : width_(w), height_(h), colorspace_(cs), depthBits_(depth), data_(d) {
+    PixelBuffer<uint8_t> &&d)
+    : width_(w), height_(h), colorspace_(cs), depthBits_(depth),
+      data_(std::move(d)) {
     if (w != 0 && h != 0 && data_.empty()) {
-        data_.resize(w * h * cs.Components());
+        size_t bytesPerValue = depth > 8 ? 2 : 1;
+        data_.resize(static_cast<size_t>(w) * h * cs.Components() *
+            bytesPerValue, 0);
     }
 }
 
+Image::Image(int w, int h, class ColorSpace cs, uint8_t depth,
+    std::vector<uint8_t> &&d)
+    : Image(w, h, cs, depth, PixelBuffer<uint8_t>(d.begin(), d.end())) {
+}
+
+PixelBuffer<uint8_t> Image::Release() {
+    width_ = 0;
+    height_ = 0;
+    return std::move(data_);
+}
+
 Image::Image(Image &&other)
     : Image() {
     *this = std::move(other);
@@ -87,17 +178,81 @@ Image &Image::operator=(Image &&other) {
 }
 
 void Image::WriteTo(ree::io::Source *target, const WriteOptions &options) const {
-    auto format = FindFileFormat(target);
-    if (!format) {
-        throw UnknownFormatException();
+    thread_local Encoder encoder;
+    encoder.Encode(*this, target, options);
+}
+
+std::future<void> Image::WriteToAsync(ree::io::Source *target,
+    const WriteOptions &options) const & {
+    return WriteAsync(std::make_shared<Image>(width_, height_, colorspace_,
+        depthBits_, PixelBuffer<uint8_t>(data_)), target, options, nullptr);
+}
+
+std::future<void> Image::WriteToAsync(ree::io::Source *target,
+    const WriteOptions &options) && {
+    return WriteAsync(std::make_shared<Image>(std::move(*this)), target,
+        options, nullptr);
+}
+
+std::future<void> Image::WriteToAsync(ree::io::Source *target,
+    const WriteOptions &options, WriteCallback done) const & {
+    return WriteAsync(std::make_shared<Image>(width_, height_, colorspace_,
+        depthBits_, PixelBuffer<uint8_t>(data_)), target, options,
+        std::move(done));
+}
+
+std::future<void> Image::WriteToAsync(ree::io::Source *target,
+    const WriteOptions &options, WriteCallback done) && {
+    return WriteAsync(std::make_shared<Image>(std::move(*this)), target,
+        options, std::move(done));
+}
+
+std::future<void> Image::WriteAsync(std::shared_ptr<const Image> image,
+    ree::io::Source *target, const WriteOptions &options,
+    WriteCallback done) {
+    auto promise = std::make_shared<std::promise<void>>();
+    auto future = promise->get_future();
+    ThreadPool::SharedIo().Submit([image, target, options, done, promise]() {
+        std::exception_ptr error;
+        try {
+            image->WriteTo(target, options);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        if (!done) {
+            if (error) {
+                promise->set_exception(error);
+            } else {
+                promise->set_value();
+            }
+            return;
+        }
+        // pool tasks must not throw
+        try {
+            done(error);
+            promise->set_value();
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+    return future;
+}
+
+void Image::WriteTo(const std::string &path,
+    const WriteOptions &options) const {
+    WriteOptions opts(options);
+    if (opts.find("format") == opts.end()) {
+        auto format = FormatRegistry::Instance().FindByPath(path);
+        if (!format) {
+            throw UnknownFormatException();
+        }
+        opts["format"] = format->PreferredExtension();
     }
 
-    target->OpenToWrite();
-    auto ctx = format->CreateComposeContext(target, options);
-    format->WriteImage(ctx, *this);
-    target->Close();
+    auto target = ree::io::Source::SourceByPath(path);
+    WriteTo(target.get(), opts);
 }
 
 }
 }
-}
\ No newline at end of file
+}
@@ -4,24 +4,111 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <functional>
+#include <future>
+#include <memory>
+#include <exception>
 
 #include <ree/io/source.h>
 #include <ree/image/types.hpp>
+#include <ree/image/pixel_buffer.hpp>
+#include <ree/image/image_view.hpp>
 
 namespace ree {
 namespace image {
 namespace io {
 
+/// "apply_orientation": "true" turns JPEG images upright as EXIF tells,
+/// "scale_denom": "2", "4" or "8" decodes JPEG and interlaced PNG images
+/// scaled down by that much, formats which can not scale ignore it
 using LoadOptions = std::map<std::string, std::string>;
 using WriteOptions = std::map<std::string, std::string>;
 
+/// what the header of an image tells before any pixel is decoded
+struct ImageInfo {
+    int width = 0;
+    int height = 0;
+    class ColorSpace colorspace { ColorSpace::Unknown };
+    uint8_t depth = 8;
+
+    /// bytes of one decoded row, samples deeper than 8 bits take two bytes
+    size_t RowBytes() const {
+        return static_cast<size_t>(width) * colorspace.Components() *
+            (depth > 8 ? 2 : 1);
+    }
+};
+
+/// what Image::Probe reads from the headers of a file
+struct ProbeInfo : public ImageInfo {
+    /// the preferred extension of the format, e.g. "png"
+    std::string format;
+    /// images in the file, e.g. animation frames, 1 for still images
+    int frames = 1;
+};
+
+/// what Image::ReadMetadata finds beside the pixels, fields are left empty
+/// for what the file does not carry
+struct Metadata {
+    /// the TIFF structure of the EXIF block, past any "Exif" prefix
+    std::vector<uint8_t> exif;
+    /// the embedded ICC profile
+    std::vector<uint8_t> icc;
+    /// the XMP packet
+    std::string xmp;
+
+    /// EXIF orientation, 1 to 8, 1 when the rows are stored upright
+    int orientation = 1;
+    /// EXIF DateTimeOriginal, or DateTime, as "YYYY:MM:DD HH:MM:SS"
+    std::string captureTime;
+    /// pixels per inch, 0 when unknown
+    double dpiX = 0;
+    double dpiY = 0;
+};
+
+class Image;
+/// error is set when the operation failed, the image is empty then
+using LoadCallback = std::function<void(Image &&image,
+    std::exception_ptr error)>;
+using WriteCallback = std::function<void(std::exception_ptr error)>;
+
 class Image {
 public:
     /// load the main image from source
     static Image Load(ree::io::Source *source,
         const LoadOptions &options = LoadOptions());
+    /**
+     * @brief decode source into memory the caller owns, rows stride bytes
+     * apart, converting the pixels to wanted as the rows come out of the
+     * decoder. wanted Unknown keeps the stored color space. dst must hold
+     * every row of the image, returns how they were written. Throws
+     * std::invalid_argument when stride is shorter than a row.
+     */
+    static ImageInfo LoadInto(ree::io::Source *source, void *dst,
+        size_t stride, class ColorSpace wanted,
+        const LoadOptions &options = LoadOptions());
+    /// read what the headers of source tell, without decoding any pixel
+    static ProbeInfo Probe(ree::io::Source *source,
+        const LoadOptions &options = LoadOptions());
+    /// read EXIF, ICC, XMP and resolution of source, without decoding pixels
+    static Metadata ReadMetadata(ree::io::Source *source,
+        const LoadOptions &options = LoadOptions());
+
+    /**
+     * @brief load on ThreadPool::SharedIo(). source must stay alive until the
+     * load completes. Callbacks run on a pool thread and should return fast,
+     * the returned future is ready once done returned and carries what it
+     * threw.
+     */
+    static std::future<Image> LoadAsync(ree::io::Source *source,
+        const LoadOptions &options = LoadOptions());
+    static std::future<void> LoadAsync(ree::io::Source *source,
+        const LoadOptions &options, LoadCallback done);
 
     Image();
+    /// allocates a zero-filled buffer when d is empty
+    Image(int w, int h, class ColorSpace cs, uint8_t depth,
+          PixelBuffer<uint8_t> &&d);
+    /// copies d into a pixel buffer from the default allocator
     Image(int w, int h, class ColorSpace cs, uint8_t depth,
           std::vector<uint8_t> &&d);
 
@@ -32,17 +119,50 @@ public:
     int Height() const  { return height_; }
     uint8_t DepthBits() const { return depthBits_; }
     class ColorSpace ColorSpace() const { return colorspace_; }
-    const std::vector<uint8_t> &Data() const { return data_; }
+    const PixelBuffer<uint8_t> &Data() const { return data_; }
+    /// give up the pixels, leaving an empty image
+    PixelBuffer<uint8_t> Release();
 
+    /// ValueT is uint8_t for images up to 8 bits deep, uint16_t otherwise
+    template <typename ValueT>
+    ImageView<const ValueT> View() const {
+        return ImageView<const ValueT>(
+            reinterpret_cast<const ValueT *>(data_.data()), width_, height_,
+            colorspace_, depthBits_);
+    }
+
+    /// the format is picked from options["format"], an extension like "png"
     void WriteTo(ree::io::Source *target,
         const WriteOptions &options = WriteOptions()) const;
+    /// the format is picked from the extension of path unless given in options
+    void WriteTo(const std::string &path,
+        const WriteOptions &options = WriteOptions()) const;
+
+    /**
+     * @brief write on ThreadPool::SharedIo(). target must stay alive until the
+     * write completes, the image need not: the pixels are copied, or moved
+     * out of an rvalue image. done runs as in LoadAsync.
+     */
+    std::future<void> WriteToAsync(ree::io::Source *target,
+        const WriteOptions &options = WriteOptions()) const &;
+    std::future<void> WriteToAsync(ree::io::Source *target,
+        const WriteOptions &options = WriteOptions()) &&;
+    std::future<void> WriteToAsync(ree::io::Source *target,
+        const WriteOptions &options, WriteCallback done) const &;
+    std::future<void> WriteToAsync(ree::io::Source *target,
+        const WriteOptions &options, WriteCallback done) &&;
 
 private:
+    /// done may be empty
+    static std::future<void> WriteAsync(std::shared_ptr<const Image> image,
+        ree::io::Source *target, const WriteOptions &options,
+        WriteCallback done);
+
     int width_;
     int height_;
     class ColorSpace colorspace_ { ColorSpace::RGBA };
     int depthBits_ { 8 };
-    std::vector<uint8_t> data_;
+    PixelBuffer<uint8_t> data_;
 };
 
 }
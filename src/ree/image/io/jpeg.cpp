@@ -1,92 +1,75 @@
 #include "jpeg.hpp"
 
+#define _USE_MATH_DEFINES
 #include <cmath>
 #include <cassert>
-#include <sstream>
-#include <iostream>
 #include <array>
 #include <algorithm>
-#include <queue>
-#include <bitset>
 
-#include <ree/io/bit_buffer.h>
 #include <ree/image/io/error.hpp>
+#include <ree/image/io/exif.hpp>
+#include <ree/image/orientation.hpp>
 
 #ifdef WIN32
 #include <Winsock2.h>
 #undef  LoadImage
 #endif
 
+// https://www.w3.org/Graphics/JPEG/itu-t81.pdf
 namespace ree {
 namespace image {
 namespace io {
 
 static std::vector<uint8_t> kMagicStr = {0xff, 0xd8, 0xff};
 
-static ColorSpace kColorSpaces[] = {
-    ColorSpace::Gray, // 0x00
-    ColorSpace::Unknown, // 0x01
-    ColorSpace::RGB, // 0x02
-    ColorSpace::RGB, // 0x03
-    ColorSpace::GrayAlpha, // 0x04
-    ColorSpace::Unknown, // 0x05
-    ColorSpace::RGBA, // 0x06
-};
-static std::array<int, 7> kComponents = { 1, 0, 3, 3, 2, 0, 4 };
+/// the identifiers leading the APPn segments carrying metadata
+static const char kJfif[] = "JFIF";
+static const char kExif[] = "Exif\0";
+static const char kXmp[] = "http://ns.adobe.com/xap/1.0/";
+static const char kIccProfile[] = "ICC_PROFILE";
 
 static constexpr size_t nLenSize = 16;
-    
+static constexpr size_t kMaxTables = 4;
+/// codes up to this length are decoded with a single table lookup
+static constexpr int kLookupBits = 9;
+
+/// natural order index of the i-th coefficient in zigzag order
+static const uint8_t kZigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63,
+};
+
 struct Component {
     uint8_t id;
     uint8_t hSampleFactor;
     uint8_t vSampleFactor;
-    uint8_t qhtCount;
+    uint8_t qtId;
 
     uint8_t dcHtId;
     uint8_t acHtId;
-};
-    
-struct HuffmanTable {
-    struct Node {
-        uint8_t symbol;
-        bool isLeaf = false;
-        
-        std::unique_ptr<Node> lChild; // 0
-        std::unique_ptr<Node> rChild; // 1
-    };
-    
-    std::unique_ptr<Node> root;
-    
-    void PrintLevelOrder() const {
-        std::queue<Node *> queue;
-        queue.push(root.get());
-        size_t level = 0;
-        size_t levelSize = 1;
-        size_t levelIdx = 0;
-        
-        while (queue.size() > 0) {
-            if (levelIdx >= levelSize) {
-                ++level;
-                levelSize = queue.size();
-                levelIdx = 0;
-                std::cout << "\n" << level << ": ";
-            }
 
-            auto node = queue.front();
-            queue.pop();
-            levelIdx++;
-            if (node->isLeaf) {
-                std::cout << std::to_string(node->symbol) << " ";
-            }
+    int dcPred;
+    /// samples of one MCU row, planeStride bytes per line
+    std::vector<uint8_t> plane;
+    size_t planeStride;
+};
 
-            if (node->lChild) {
-                queue.push(node->lChild.get());
-            }
-            if (node->rChild) {
-                queue.push(node->rChild.get());
-            }
-        }
-    }
+/// canonical huffman decoding tables, see F.2.2.3 of the spec
+struct HuffmanTable {
+    bool defined = false;
+    std::array<uint8_t, 256> symbols;
+    /// largest code of each length, -1 if there is none
+    std::array<int32_t, nLenSize + 2> maxCode;
+    /// symbols index of a code minus the code itself, per length
+    std::array<int32_t, nLenSize + 1> valOffset;
+    /// (length << 8 | symbol) of the codes up to kLookupBits long, 0 if longer
+    std::array<uint16_t, 1 << kLookupBits> lookup;
 };
 
 using QuantizationTable = std::array<uint16_t, 64>;
@@ -94,31 +77,79 @@ using QuantizationTable = std::array<uint16_t, 64>;
 struct JpegParseContext : public LoadContext {
     using LoadContext::LoadContext;
 
+    void Reset(ree::io::Source *src, const LoadOptions &opt) override {
+        LoadContext::Reset(src, opt);
+        components.clear();
+        for (auto &ht : dcHt) { ht.defined = false; }
+        for (auto &ht : acHt) { ht.defined = false; }
+        restartInterval = 0;
+        frameRead = false;
+        bits = 0;
+        bitCount = 0;
+        marker = 0;
+        rowsInBuffer = 0;
+        bufferRow = 0;
+        mcuRow = 0;
+        orientation = 1;
+        oriented = false;
+        blockSize = 8;
+    }
+
     uint8_t precision;
     uint16_t width;
     uint16_t height;
+    bool frameRead = false;
     std::vector<Component> components;
 
-    std::vector<HuffmanTable> dcHt;
-    std::vector<HuffmanTable> acHt;
+    /// indexed by table id
+    std::array<HuffmanTable, kMaxTables> dcHt;
+    std::array<HuffmanTable, kMaxTables> acHt;
+    std::array<QuantizationTable, kMaxTables> qts;
 
-    std::vector<QuantizationTable> qts;
+    /// payload of the marker segment being handled
+    std::vector<uint8_t> payload;
 
-    uint8_t depth;
-    uint8_t colorType;
-    uint8_t compression;
-    uint8_t filter;
-    uint8_t interlace;
-    
-    std::vector<uint8_t> color;
-    size_t have = 0;
+    uint16_t restartInterval = 0;
+    int restartsLeft = 0;
+
+    /// components of the current scan, in their order in the stream
+    std::vector<Component *> scan;
+    int hMax = 1;
+    int vMax = 1;
+    int mcusX = 0;
+    int mcusY = 0;
+    int mcuRow = 0;
+
+    /// entropy decoder state
+    uint64_t bits = 0;
+    int bitCount = 0;
+    /// the marker which ended the entropy coded data, 0 while there is none
+    uint8_t marker = 0;
+
+    /// decoded rows of the current MCU row, info.RowBytes() each
+    std::vector<uint8_t> rows;
+    int rowsInBuffer = 0;
+    int bufferRow = 0;
+
+    /// samples per side each block is inverse transformed to, 8 over the
+    /// scale denominator asked for, and the size of the image so scaled
+    int blockSize = 8;
+    int scaledWidth = 0;
+    int scaledHeight = 0;
+
+    /// EXIF orientation, only read when options ask to apply it
+    bool applyOrientation = false;
+    int orientation = 1;
+    /// the image was decoded whole into decoded, oriented, by BeginRows
+    bool oriented = false;
 };
 
 static void HandleMarker(uint8_t marker, JpegParseContext *ctx);
-static void SetupHuffmanTree(HuffmanTable *ht,
-    const std::vector<std::vector<uint8_t>> &lenSymbols);
-static uint8_t ReadEntropyCodedData(JpegParseContext *ctx);
-static Image CreateImage(JpegParseContext *ctx);
+static void SetupHuffmanTable(HuffmanTable *ht,
+    const std::array<uint8_t, nLenSize> &nLens, const uint8_t *symbols);
+static void BeginScan(JpegParseContext *ctx);
+static void DecodeMcuRow(JpegParseContext *ctx);
+static void DecodeOriented(JpegParseContext *ctx);
 
 std::vector<std::string> Jpeg::ValidExtensions() {
     return {"jpg", "JPG", "jpeg", "JPEG"};
@@ -134,272 +165,807 @@ LoadContext *Jpeg::CreateParseContext(ree::io::Source *source,
     const LoadOptions &options) {
     return new JpegParseContext(source, options);
 }
-WriteContext *Jpeg::CreateComposeContext(ree::io::Source *target,
-    const WriteOptions &options) {
-    return new WriteContext(target, options);
+WriteContext *Jpeg::CreateComposeContext(ree::io::Source *,
+    const WriteOptions &) {
+    return nullptr;
 }
 
 Image Jpeg::LoadImage(LoadContext *contex) {
+    return LoadImageByRows(contex);
+}
+
+void Jpeg::BeginRows(LoadContext *contex) {
     JpegParseContext *ctx = static_cast<JpegParseContext *>(contex);
     auto source = ctx->source;
+    auto apply = ctx->options.find("apply_orientation");
+    ctx->applyOrientation = apply != ctx->options.end() &&
+        apply->second == "true";
+    ctx->blockSize = 8 / ScaleDenominator(ctx->options);
 
-    while (true) {
+    // every marker up to the first scan
+    while (!ctx->done) {
         uint8_t byte;
-        source->Read(&byte, 1);
-        assert(byte == 0xff);
+        ReadExactly(source, &byte, 1);
+        if (byte != 0xff) {
+            throw FileCorruptedException("marker expected.");
+        }
+        do {
+            // markers may be preceded by any number of fill bytes
+            ReadExactly(source, &byte, 1);
+        } while (byte == 0xff);
 
-        source->Read(&byte, 1);
-        HandleMarker(byte, ctx);
-        if (ctx->done) {
+        if (byte == 0xda) { // SOS
+            HandleMarker(byte, ctx);
             break;
         }
+        HandleMarker(byte, ctx);
+    }
+    if (!ctx->frameRead || ctx->scan.empty()) {
+        throw FileCorruptedException("no frame before the end of image.");
+    }
+
+    ctx->scaledWidth = (ctx->width * ctx->blockSize + 7) / 8;
+    ctx->scaledHeight = (ctx->height * ctx->blockSize + 7) / 8;
+    ctx->info.width = ctx->scaledWidth;
+    ctx->info.height = ctx->scaledHeight;
+    ctx->info.colorspace = ColorSpace::Gray;
+    if (ctx->components.size() == 3) {
+        // the color conversion produces any of these as cheaply as RGB
+        ColorSpace wanted = ctx->wanted;
+        bool direct = wanted == ColorSpace::Gray ||
+            wanted == ColorSpace::YCbCr || wanted == ColorSpace::RGBA;
+        ctx->info.colorspace = direct ? wanted : ColorSpace::RGB;
     }
+    ctx->info.depth = 8;
+    ctx->nextRow = 0;
+    ctx->rows.resize(ctx->info.RowBytes() * ctx->blockSize * ctx->vMax);
 
-    return CreateImage(ctx);
+    if (ctx->applyOrientation && ctx->orientation != 1) {
+        DecodeOriented(ctx);
+    }
 }
 
-void Jpeg::WriteImage(WriteContext *ctx, const Image &image) {
-    auto target = ctx->target;
+int Jpeg::ReadRows(LoadContext *contex, uint8_t *dst, size_t stride, int n) {
+    JpegParseContext *ctx = static_cast<JpegParseContext *>(contex);
+    if (ctx->oriented) {
+        return FileFormat::ReadRows(ctx, dst, stride, n);
+    }
+    size_t rowBytes = ctx->info.RowBytes();
+
+    int rows = 0;
+    while (rows < n && ctx->nextRow < ctx->info.height) {
+        if (ctx->bufferRow == ctx->rowsInBuffer) {
+            DecodeMcuRow(ctx);
+        }
+        int count = std::min(n - rows, ctx->rowsInBuffer - ctx->bufferRow);
+        for (int i = 0; i < count; ++i) {
+            auto begin = ctx->rows.data() + rowBytes * ctx->bufferRow++;
+            std::copy(begin, begin + rowBytes, dst + stride * rows++);
+        }
+        ctx->nextRow += count;
+    }
+    if (ctx->nextRow == ctx->info.height) {
+        ctx->done = true;
+    }
+    return rows;
 }
 
-Image CreateImage(JpegParseContext *ctx) {
-    int components = kComponents[ctx->colorType];
-    size_t bpp = (components * ctx->depth + 7) / 8;
-    std::vector<uint8_t> data(ctx->width * ctx->height * components);
-
-    size_t stride = (ctx->width * ctx->depth * components + 7) / 8 + 1;
-    assert(stride * ctx->height == ctx->color.size());
-    for (int row = 0; row < ctx->height; ++row) {
-        auto bufferBeign = ctx->color.data() + row * stride;
-        ree::io::BigEndianRLSBBuffer buffer(bufferBeign, stride);
-        int filter = buffer.ReadBits(8);
-
-        size_t dataBeginIndex = row * ctx->width * components;
-        for (int i = 0; i < components; ++i) {
-            data[dataBeginIndex + i] = buffer.ReadBits(ctx->depth);
-        }
-        for (int col = 1; col < ctx->width; ++col) {
-            for (int i = 0; i < components; ++i) {
-                uint32_t value = buffer.ReadBits(ctx->depth);
-                switch (filter) {
-                case 0:
-                    break;
-                case 1:
-                    value += data[dataBeginIndex + col * 4 + i - bpp];
-                    break;
-                }
-                data[dataBeginIndex + col * 4 + i] = value;
+/// any frame header, whatever the coding process
+static inline bool IsStartOfFrame(uint8_t marker) {
+    return marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 &&
+        marker != 0xc8 && marker != 0xcc;
+}
+
+ProbeInfo Jpeg::Probe(LoadContext *contex) {
+    JpegParseContext *ctx = static_cast<JpegParseContext *>(contex);
+    auto source = ctx->source;
+
+    // segments are skipped by seeking until a frame header shows up
+    size_t position = 0;
+    while (true) {
+        std::array<uint8_t, 2> marker;
+        ReadExactly(source, marker.data(), marker.size());
+        position += marker.size();
+        if (marker[0] != 0xff) {
+            throw FileCorruptedException("marker expected.");
+        }
+        while (marker[1] == 0xff) {
+            ReadExactly(source, &marker[1], 1);
+            position++;
+        }
+        uint8_t code = marker[1];
+        if (code == 0xd8 || code == 0x01 || (code >= 0xd0 && code <= 0xd7)) {
+            continue;
+        }
+        if (code == 0xd9 || code == 0xda) {
+            throw FileCorruptedException("no frame before the first scan.");
+        }
+
+        std::array<uint8_t, 8> segment;
+        ReadExactly(source, segment.data(), 2);
+        uint16_t len = static_cast<uint16_t>(segment[0] << 8 | segment[1]);
+        if (len < 2) {
+            throw FileCorruptedException("wrong segment length.");
+        }
+        if (IsStartOfFrame(code)) {
+            if (len < segment.size()) {
+                throw FileCorruptedException("frame header too short.");
             }
+            ReadExactly(source, segment.data() + 2, segment.size() - 2);
+            ProbeInfo info;
+            info.format = PreferredExtension();
+            info.depth = segment[2];
+            info.height = segment[3] << 8 | segment[4];
+            info.width = segment[5] << 8 | segment[6];
+            uint8_t components = segment[7];
+            info.colorspace = components == 1 ? ColorSpace::Gray :
+                components == 3 ? ColorSpace::RGB : ColorSpace::Unknown;
+            return info;
         }
+        position += len;
+        source->Seek(position);
     }
-    return Image(ctx->width, ctx->height, kColorSpaces[ctx->colorType],
-        ctx->depth, std::move(data));
+}
+
+/// whether the segment starts with the identifier, including its nul
+template <size_t N>
+static inline bool HasIdentifier(const std::array<uint8_t, 32> &prefix,
+    size_t size, const char (&identifier)[N]) {
+    return size >= N && std::equal(identifier, identifier + N, prefix.begin());
+}
+
+Metadata Jpeg::ReadMetadata(LoadContext *contex) {
+    JpegParseContext *ctx = static_cast<JpegParseContext *>(contex);
+    auto source = ctx->source;
+
+    // the segments before the first scan, only APP0-2 are read; payloads go
+    // straight into the returned blobs
+    Metadata metadata;
+    size_t position = 0;
+    while (true) {
+        std::array<uint8_t, 2> marker;
+        ReadExactly(source, marker.data(), marker.size());
+        position += marker.size();
+        if (marker[0] != 0xff) {
+            throw FileCorruptedException("marker expected.");
+        }
+        while (marker[1] == 0xff) {
+            ReadExactly(source, &marker[1], 1);
+            position++;
+        }
+        uint8_t code = marker[1];
+        if (code == 0xd8 || code == 0x01 || (code >= 0xd0 && code <= 0xd7)) {
+            continue;
+        }
+        if (code == 0xd9 || code == 0xda) {
+            break;
+        }
+
+        std::array<uint8_t, 32> prefix;
+        ReadExactly(source, prefix.data(), 2);
+        uint16_t len = static_cast<uint16_t>(prefix[0] << 8 | prefix[1]);
+        if (len < 2) {
+            throw FileCorruptedException("wrong segment length.");
+        }
+        size_t size = len - 2u;
+        size_t end = position + len;
+        if (code < 0xe0 || code > 0xe2) {
+            position = end;
+            source->Seek(position);
+            continue;
+        }
+
+        // the longest identifier is the XMP one
+        size_t read = std::min(size, sizeof(kXmp));
+        ReadExactly(source, prefix.data(), read);
+        if (code == 0xe0 && HasIdentifier(prefix, read, kJfif) &&
+            read >= 12) {
+            uint8_t units = prefix[7];
+            double x = prefix[8] << 8 | prefix[9];
+            double y = prefix[10] << 8 | prefix[11];
+            // 1 for dots per inch, 2 per centimeter, 0 tells only the aspect
+            if (units == 1 || units == 2) {
+                double scale = units == 2 ? 2.54 : 1.0;
+                metadata.dpiX = x * scale;
+                metadata.dpiY = y * scale;
+            }
+        } else if (code == 0xe1 && HasIdentifier(prefix, read, kExif)) {
+            // the identifier is padded by a second nul, kExif holds both
+            size_t offset = sizeof(kExif);
+            if (size > offset) {
+                metadata.exif.resize(size - offset);
+                std::copy(prefix.begin() + offset, prefix.begin() + read,
+                    metadata.exif.begin());
+                ReadExactly(source, metadata.exif.data() + (read - offset),
+                    metadata.exif.size() - (read - offset));
+                ParseExif(metadata.exif.data(), metadata.exif.size(),
+                    &metadata);
+            }
+        } else if (code == 0xe1 && HasIdentifier(prefix, read, kXmp)) {
+            metadata.xmp.resize(size - read);
+            if (!metadata.xmp.empty()) {
+                ReadExactly(source,
+                    reinterpret_cast<uint8_t *>(&metadata.xmp[0]),
+                    metadata.xmp.size());
+            }
+        } else if (code == 0xe2 && HasIdentifier(prefix, read, kIccProfile)) {
+            // profiles larger than a segment are split in sequence, each
+            // chunk led by its number and the count of chunks
+            size_t offset = sizeof(kIccProfile) + 2;
+            if (size > offset) {
+                size_t begin = metadata.icc.size();
+                metadata.icc.resize(begin + size - offset);
+                std::copy(prefix.begin() + offset, prefix.begin() + read,
+                    metadata.icc.begin() + begin);
+                ReadExactly(source,
+                    metadata.icc.data() + begin + (read - offset), size - read);
+            }
+        }
+        position = end;
+        source->Seek(position);
+    }
+    return metadata;
+}
+
+void Jpeg::WriteImage(WriteContext *, const Image &) {
+    throw NotImplementException();
 }
 
 void HandleMarker(uint8_t marker, JpegParseContext *ctx) {
     auto source = ctx->source;
 
     uint16_t len = 0;
-    std::vector<uint8_t> payload;
-    if (marker > 0xda || marker < 0xd0) {
-        source->Read(reinterpret_cast<uint8_t *>(&len), 2);
-        len = ntohs(len);
-
-        payload.resize(len - 2);
-        source->Read(payload.data(), len - 2);
+    auto &payload = ctx->payload;
+    payload.clear();
+    if (marker == 0xd8 || marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) {
+        return; // SOI, TEM and RSTn come without a segment
     }
-    printf("marker %x, len: %x\n", marker, len);
-    if (marker == 0xd8) { // SOI 
+    if (marker == 0xd9) { // EOI
+        ctx->done = true;
         return;
     }
-    if (marker == 0xd9) { // EOI 
-        ctx->done = true;
+
+    ReadExactly(source, reinterpret_cast<uint8_t *>(&len), 2);
+    len = ntohs(len);
+    if (len < 2) {
+        throw FileCorruptedException("wrong segment length.");
+    }
+    payload.resize(len - 2);
+    ReadExactly(source, payload.data(), payload.size());
+
+    if (marker == 0xe1 && ctx->applyOrientation &&
+        payload.size() > sizeof(kExif) &&
+        std::equal(kExif, kExif + sizeof(kExif), payload.begin())) {
+        // only the orientation is of use while decoding
+        Metadata exif;
+        ParseExif(payload.data() + sizeof(kExif),
+            payload.size() - sizeof(kExif), &exif);
+        ctx->orientation = exif.orientation;
         return;
     }
     if (marker >= 0xe0 && marker <= 0xef) { // APPn
         return;
     }
-    if (marker == 0xc0) { // SOF0
-        ree::io::BigEndianRLSBBuffer bitBuffer(payload.data(), payload.size());
-        ctx->precision = bitBuffer.ReadBits(8);
-        ctx->height = bitBuffer.ReadBits(16);
-        ctx->width = bitBuffer.ReadBits(16);
-        uint8_t comp = bitBuffer.ReadBits(8);
+    if (marker == 0xc0 || marker == 0xc1) { // SOF0, SOF1
+        if (payload.size() < 6) {
+            throw FileCorruptedException("frame header too short.");
+        }
+        ctx->precision = payload[0];
+        ctx->height = payload[1] << 8 | payload[2];
+        ctx->width = payload[3] << 8 | payload[4];
+        uint8_t comp = payload[5];
+        if (ctx->precision != 8) {
+            throw NotImplementException();
+        }
+        if ((comp != 1 && comp != 3) || payload.size() < 6u + comp * 3) {
+            throw FileCorruptedException("wrong frame header.");
+        }
+        if (ctx->width == 0 || ctx->height == 0) {
+            throw FileCorruptedException("wrong image size.");
+        }
         ctx->components.resize(comp);
+        ctx->hMax = 1;
+        ctx->vMax = 1;
         for (int i = 0; i < comp; ++i) {
-            ctx->components[i].id = bitBuffer.ReadBits(8);
-            ctx->components[i].hSampleFactor = bitBuffer.ReadBits(4);
-            ctx->components[i].vSampleFactor = bitBuffer.ReadBits(4);
-            ctx->components[i].qhtCount = bitBuffer.ReadBits(8);
+            const uint8_t *c = payload.data() + 6 + i * 3;
+            Component &component = ctx->components[i];
+            component.id = c[0];
+            component.hSampleFactor = c[1] >> 4;
+            component.vSampleFactor = c[1] & 0x0f;
+            component.qtId = c[2];
+            if (component.hSampleFactor < 1 || component.hSampleFactor > 4 ||
+                component.vSampleFactor < 1 || component.vSampleFactor > 4 ||
+                component.qtId >= kMaxTables) {
+                throw FileCorruptedException("wrong component.");
+            }
+            ctx->hMax = std::max<int>(ctx->hMax, component.hSampleFactor);
+            ctx->vMax = std::max<int>(ctx->vMax, component.vSampleFactor);
         }
+        for (auto &component : ctx->components) {
+            if (ctx->hMax % component.hSampleFactor != 0 ||
+                ctx->vMax % component.vSampleFactor != 0) {
+                throw NotImplementException();
+            }
+        }
+        ctx->frameRead = true;
         return;
     }
-    if (marker == 0xc2) { // SOF2
-        return;
+    if (marker >= 0xc2 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 &&
+        marker != 0xcc) { // progressive, lossless and arithmetic frames
+        throw NotImplementException();
     }
     if (marker == 0xc4) { // DHT
         size_t cursor = 0;
-        uint8_t hti = payload[cursor++];
-        uint8_t htNo = hti & 0x0f;
-        assert(htNo <= 3);
-        uint8_t htizero = hti >> 5;
-        assert(htizero == 0);
-        
-        uint8_t type = (hti >> 4) & 0x01;
-        HuffmanTable *ht;
-        if (type == 0) {
-            ctx->dcHt.push_back(HuffmanTable());
-            ht = &ctx->dcHt.back();
-        } else {
-            ctx->acHt.push_back(HuffmanTable());
-            ht = &ctx->acHt.back();
-        }
-
-        std::array<uint8_t, nLenSize> nLens;
-        size_t totalCodes = 0;
-        uint8_t maxDepth = 0;
-        for (uint8_t i = 0; i < nLenSize; ++i) {
-            nLens[i] = payload[cursor++];
-            totalCodes += nLens[i];
-            if (nLens[i] > 0) { maxDepth = i; }
-        }
-        
-        std::vector<std::vector<uint8_t>> lenSymbols(maxDepth + 1);
-        for (uint8_t i = 0; i < lenSymbols.size(); ++i) {
-            lenSymbols[i].resize(nLens[i]);
-            for (uint8_t j = 0; j < nLens[i]; j++) {
-                lenSymbols[i][j] = payload[cursor++];
+        while (cursor < payload.size()) {
+            uint8_t hti = payload[cursor++];
+            uint8_t htNo = hti & 0x0f;
+            uint8_t type = (hti >> 4) & 0x01;
+            if (htNo >= kMaxTables || (hti >> 5) != 0) {
+                throw FileCorruptedException("wrong huffman table id.");
+            }
+            if (cursor + nLenSize > payload.size()) {
+                throw FileCorruptedException("huffman table too short.");
+            }
+
+            std::array<uint8_t, nLenSize> nLens;
+            size_t totalCodes = 0;
+            for (uint8_t i = 0; i < nLenSize; ++i) {
+                nLens[i] = payload[cursor++];
+                totalCodes += nLens[i];
             }
+            if (totalCodes > 256 || cursor + totalCodes > payload.size()) {
+                throw FileCorruptedException("huffman table too short.");
+            }
+
+            HuffmanTable *ht = type == 0 ? &ctx->dcHt[htNo] : &ctx->acHt[htNo];
+            SetupHuffmanTable(ht, nLens, payload.data() + cursor);
+            cursor += totalCodes;
         }
-        
-        SetupHuffmanTree(ht, lenSymbols);
-        
         return;
     }
     if (marker == 0xdd) { // DRI
+        if (payload.size() < 2) {
+            throw FileCorruptedException("wrong restart interval.");
+        }
+        ctx->restartInterval = payload[0] << 8 | payload[1];
         return;
     }
     if (marker == 0xdb) { // DQT
         size_t cursor = 0;
-        uint8_t qti = payload[cursor++];
-        uint8_t qtNo = qti & 0x0f;
-        assert(qtNo <= 3);
-        uint8_t qt_precision = qti >> 4;
-        
-        ctx->qts.push_back(QuantizationTable());
-
-        QuantizationTable &qt = ctx->qts.back();
-        if (qt_precision == 0) {
-            for (size_t i = 0; i < qt.size(); ++i) {
-                qt[i] = payload[cursor++];
+        while (cursor < payload.size()) {
+            uint8_t qti = payload[cursor++];
+            uint8_t qtNo = qti & 0x0f;
+            uint8_t qt_precision = qti >> 4;
+            if (qtNo >= kMaxTables) {
+                throw FileCorruptedException("wrong quantization table id.");
             }
-        } else {
-            for (size_t i = 0; i < qt.size(); ++i) {
-                qt[i] = payload[cursor++];
-                qt[i] = qt[i] << 8 | payload[cursor++];
+            if (cursor + 64 * (qt_precision + 1) > payload.size()) {
+                throw FileCorruptedException("quantization table too short.");
+            }
+
+            // kept in zigzag order, like the coefficients are decoded
+            QuantizationTable &qt = ctx->qts[qtNo];
+            if (qt_precision == 0) {
+                for (size_t i = 0; i < qt.size(); ++i) {
+                    qt[i] = payload[cursor++];
+                }
+            } else {
+                for (size_t i = 0; i < qt.size(); ++i) {
+                    qt[i] = payload[cursor++];
+                    qt[i] = qt[i] << 8 | payload[cursor++];
+                }
             }
         }
         return;
     }
     if (marker == 0xda) { // SOS
-        marker = ReadEntropyCodedData(ctx);
-        HandleMarker(marker, ctx);
+        BeginScan(ctx);
         return;
     }
 }
-    
-void SetupHuffmanTree(HuffmanTable *ht,
-    const std::vector<std::vector<uint8_t>> &lenSymbols) {
-    ht->root.reset(new HuffmanTable::Node());
-    
-    std::vector<HuffmanTable::Node *> nonLeafNodes = { ht->root.get() };
-    for (size_t i = 0; i < lenSymbols.size(); ++i) {
-        std::vector<HuffmanTable::Node *> childNodes;
-        childNodes.reserve(2 * nonLeafNodes.size() - lenSymbols[i].size());
-        
-        size_t symbolsIndex = 0;
-        for (auto node : nonLeafNodes) {
-            node->lChild.reset(new HuffmanTable::Node());
-            node->rChild.reset(new HuffmanTable::Node());
-
-            std::array<HuffmanTable::Node *, 2> children = {
-                node->lChild.get(), node->rChild.get()
-            };
-            for (auto child : children) {
-                if (symbolsIndex < lenSymbols[i].size()) {
-                    child->symbol = lenSymbols[i][symbolsIndex];
-                    child->isLeaf = true;
-                    ++symbolsIndex;
-                } else {
-                    childNodes.push_back(child);
+
+void SetupHuffmanTable(HuffmanTable *ht,
+    const std::array<uint8_t, nLenSize> &nLens, const uint8_t *symbols) {
+    // the codes of each length must fit in it without taking the all-ones
+    // code, checked before any of them is spread over the lookup table
+    int32_t code = 0;
+    for (int len = 1; len <= static_cast<int>(nLenSize); ++len) {
+        code += nLens[len - 1];
+        if (code >= (1 << len)) {
+            throw FileCorruptedException("wrong huffman code lengths.");
+        }
+        code <<= 1;
+    }
+
+    ht->lookup.fill(0);
+    code = 0;
+    int32_t index = 0;
+    for (int len = 1; len <= static_cast<int>(nLenSize); ++len) {
+        int count = nLens[len - 1];
+        ht->valOffset[len] = index - code;
+        for (int i = 0; i < count; ++i, ++index, ++code) {
+            ht->symbols[index] = symbols[index];
+            if (len <= kLookupBits) {
+                // every lookup index starting with this code
+                int shift = kLookupBits - len;
+                for (int fill = 0; fill < (1 << shift); ++fill) {
+                    ht->lookup[(code << shift) | fill] =
+                        static_cast<uint16_t>(len << 8 | symbols[index]);
                 }
             }
         }
-        nonLeafNodes = std::move(childNodes);
+        ht->maxCode[len] = count > 0 ? code - 1 : -1;
+        code <<= 1;
     }
-//    ht->PrintLevelOrder();
+    ht->maxCode[nLenSize + 1] = INT32_MAX;
+    ht->defined = true;
 }
 
-uint8_t ReadEntropyCodedData(JpegParseContext *ctx) {
-    auto source = ctx->source;
-
-    uint16_t len = 0;
-    std::vector<uint8_t> payload;
-    source->Read(reinterpret_cast<uint8_t *>(&len), 2);
-    len = ntohs(len);
-    
-    uint8_t components;
-    source->Read(&components, 1);
-
-    assert(len == 6 + 2 * components);
-    for (uint8_t i = 0; i < components; ++i) {
-        uint8_t cid;
-        source->Read(&cid, 1);
+void BeginScan(JpegParseContext *ctx) {
+    const auto &payload = ctx->payload;
+    if (!ctx->frameRead) {
+        throw FileCorruptedException("scan before frame.");
+    }
+    uint8_t count = payload.empty() ? 0 : payload[0];
+    if (count == 0 || payload.size() < 4u + count * 2) {
+        throw FileCorruptedException("wrong scan header.");
+    }
+    // only one interleaved scan over every component is supported
+    if (count != ctx->components.size()) {
+        throw NotImplementException();
+    }
 
-        uint8_t tableInfo;
-        source->Read(&tableInfo, 1);
+    ctx->scan.clear();
+    for (uint8_t i = 0; i < count; ++i) {
+        uint8_t cid = payload[1 + i * 2];
+        uint8_t tableInfo = payload[2 + i * 2];
 
         auto find = std::find_if(ctx->components.begin(), ctx->components.end(),
             [cid](const Component &component) { return component.id == cid; });
         if (find == ctx->components.end()) {
             throw FileCorruptedException("component not found");
         }
-        find->acHtId = tableInfo >> 4;
-        find->dcHtId = tableInfo & 0x0f;
-    }
-    
-    std::array<uint8_t, 3> skip;
-    source->Read(skip.data(), skip.size());
-
-    auto componentIt = ctx->components.begin();
-    HuffmanTable &dcht = ctx->dcHt[componentIt->dcHtId];
-    HuffmanTable &acht = ctx->acHt[componentIt->acHtId];
-    
-    HuffmanTable::Node *dcNode = dcht.root.get();
-    HuffmanTable::Node *acNode = acht.root.get();
-    
-    uint8_t prevByte = 0x00;
-    while (true) {
+        find->dcHtId = tableInfo >> 4;
+        find->acHtId = tableInfo & 0x0f;
+        if (find->dcHtId >= kMaxTables || find->acHtId >= kMaxTables ||
+            !ctx->dcHt[find->dcHtId].defined ||
+            !ctx->acHt[find->acHtId].defined) {
+            throw FileCorruptedException("huffman table not found");
+        }
+        ctx->scan.push_back(&*find);
+    }
+
+    if (count == 1) {
+        // a non-interleaved scan is made of single blocks
+        Component &component = *ctx->scan[0];
+        component.hSampleFactor = 1;
+        component.vSampleFactor = 1;
+        ctx->hMax = 1;
+        ctx->vMax = 1;
+    }
+    ctx->mcusX = (ctx->width + 8 * ctx->hMax - 1) / (8 * ctx->hMax);
+    ctx->mcusY = (ctx->height + 8 * ctx->vMax - 1) / (8 * ctx->vMax);
+    ctx->mcuRow = 0;
+    for (auto &component : ctx->components) {
+        component.dcPred = 0;
+        component.planeStride = ctx->mcusX * component.hSampleFactor *
+            ctx->blockSize;
+        component.plane.resize(component.planeStride *
+            component.vSampleFactor * ctx->blockSize);
+    }
+
+    ctx->bits = 0;
+    ctx->bitCount = 0;
+    ctx->marker = 0;
+    ctx->restartsLeft = ctx->restartInterval;
+    ctx->rowsInBuffer = 0;
+    ctx->bufferRow = 0;
+}
+
+/// top up the bit buffer to at least 25 bits. Once a marker is hit, zeros
+/// are fed instead, as the spec asks for.
+static inline void FillBits(JpegParseContext *ctx) {
+    while (ctx->bitCount <= 24) {
+        uint8_t byte = 0;
+        if (ctx->marker == 0) {
+            ReadExactly(ctx->source, &byte, 1);
+            if (byte == 0xff) {
+                uint8_t next;
+                do {
+                    ReadExactly(ctx->source, &next, 1);
+                } while (next == 0xff);
+                if (next != 0x00) {
+                    ctx->marker = next;
+                    byte = 0;
+                }
+            }
+        }
+        ctx->bits = ctx->bits << 8 | byte;
+        ctx->bitCount += 8;
+    }
+}
+
+static inline int ReceiveBits(JpegParseContext *ctx, int count) {
+    if (count == 0) {
+        return 0;
+    }
+    if (ctx->bitCount < count) {
+        FillBits(ctx);
+    }
+    ctx->bitCount -= count;
+    return static_cast<int>((ctx->bits >> ctx->bitCount) & ((1u << count) - 1));
+}
+
+/// F.2.2.1, the sign of a value received with count bits
+static inline int Extend(int value, int count) {
+    return value < (1 << (count - 1)) ? value - (1 << count) + 1 : value;
+}
+
+static inline int DecodeHuffman(JpegParseContext *ctx, const HuffmanTable &ht) {
+    if (ctx->bitCount < static_cast<int>(nLenSize)) {
+        FillBits(ctx);
+    }
+    int look = static_cast<int>((ctx->bits >> (ctx->bitCount - kLookupBits)) &
+        ((1 << kLookupBits) - 1));
+    uint16_t entry = ht.lookup[look];
+    if (entry != 0) {
+        ctx->bitCount -= entry >> 8;
+        return entry & 0xff;
+    }
+
+    for (int len = kLookupBits + 1; len <= static_cast<int>(nLenSize); ++len) {
+        int32_t code = static_cast<int32_t>(
+            (ctx->bits >> (ctx->bitCount - len)) & ((1u << len) - 1));
+        if (code <= ht.maxCode[len]) {
+            ctx->bitCount -= len;
+            return ht.symbols[ht.valOffset[len] + code];
+        }
+    }
+    throw FileCorruptedException("invalid huffman code");
+}
+
+/// cos((2x + 1)uπ / 16) * C(u) / 2, indexed [x][u]
+using IdctMatrix = std::array<std::array<float, 8>, 8>;
+
+/// the inverse DCT to size samples, each the mean of 8 / size samples of
+/// the full one, so blocks are scaled down as by a box filter
+static IdctMatrix MakeIdctTable(int size) {
+    int scale = 8 / size;
+    IdctMatrix t = {};
+    for (int x = 0; x < size; ++x) {
+        for (int u = 0; u < 8; ++u) {
+            double cu = u == 0 ? 1.0 / std::sqrt(2.0) : 1.0;
+            double sum = 0;
+            for (int i = scale * x; i < scale * (x + 1); ++i) {
+                sum += std::cos((2 * i + 1) * u * M_PI / 16.0);
+            }
+            t[x][u] = static_cast<float>(cu / 2 * sum / scale);
+        }
+    }
+    return t;
+}
+
+static const IdctMatrix &IdctTable(int size) {
+    static const std::array<IdctMatrix, 4> tables = {{
+        MakeIdctTable(1), MakeIdctTable(2), MakeIdctTable(4), MakeIdctTable(8),
+    }};
+    return tables[size == 8 ? 3 : size / 2];
+}
+
+/// separable inverse DCT of a dequantized block into size x size samples,
+/// written with level shift
+static void InverseDct(const float *coefs, uint8_t *out, size_t stride,
+    int size) {
+    const auto &table = IdctTable(size);
+    float tmp[64];
+    // rows: tmp[v][x] = sum_u coefs[v][u] * table[x][u]
+    for (int v = 0; v < 8; ++v) {
+        const float *in = coefs + v * 8;
+        for (int x = 0; x < size; ++x) {
+            float s = 0;
+            for (int u = 0; u < 8; ++u) {
+                s += in[u] * table[x][u];
+            }
+            tmp[v * 8 + x] = s;
+        }
+    }
+    // columns
+    for (int y = 0; y < size; ++y) {
+        for (int x = 0; x < size; ++x) {
+            float s = 0;
+            for (int v = 0; v < 8; ++v) {
+                s += tmp[v * 8 + x] * table[y][v];
+            }
+            int value = static_cast<int>(std::lround(s + 128));
+            out[y * stride + x] = static_cast<uint8_t>(
+                std::min(std::max(value, 0), 255));
+        }
+    }
+}
+
+static void DecodeBlock(JpegParseContext *ctx, Component &component,
+    uint8_t *out, size_t stride) {
+    const HuffmanTable &dcht = ctx->dcHt[component.dcHtId];
+    const HuffmanTable &acht = ctx->acHt[component.acHtId];
+    const QuantizationTable &qt = ctx->qts[component.qtId];
+
+    float coefs[64] = {0};
+    int t = DecodeHuffman(ctx, dcht);
+    if (t > 11) {
+        throw FileCorruptedException("wrong dc coefficient.");
+    }
+    int diff = t ? Extend(ReceiveBits(ctx, t), t) : 0;
+    component.dcPred += diff;
+    coefs[0] = static_cast<float>(component.dcPred * qt[0]);
+
+    for (int k = 1; k < 64; ++k) {
+        int rs = DecodeHuffman(ctx, acht);
+        int r = rs >> 4;
+        int s = rs & 0x0f;
+        if (s == 0) {
+            if (r != 15) {
+                break; // EOB
+            }
+            k += 15;
+            continue;
+        }
+        k += r;
+        if (k > 63) {
+            throw FileCorruptedException("too many ac coefficients.");
+        }
+        coefs[kZigzag[k]] = static_cast<float>(
+            Extend(ReceiveBits(ctx, s), s) * qt[k]);
+    }
+
+    InverseDct(coefs, out, stride, ctx->blockSize);
+}
+
+/// skip to the next RSTn marker and restart the entropy decoder
+static void HandleRestart(JpegParseContext *ctx) {
+    ctx->bits = 0;
+    ctx->bitCount = 0;
+    while (ctx->marker == 0) {
         uint8_t byte;
-        source->Read(&byte, 1);
-        if (prevByte == 0xff) {
-            if (byte <= 0xd7 && byte >= 0xd0) {
-                //
-            } else if (byte != 0x00) {
-                return byte;
+        ReadExactly(ctx->source, &byte, 1);
+        if (byte == 0xff) {
+            uint8_t next;
+            do {
+                ReadExactly(ctx->source, &next, 1);
+            } while (next == 0xff);
+            if (next != 0x00) {
+                ctx->marker = next;
             }
         }
-        prevByte = byte;
+    }
+    if (ctx->marker < 0xd0 || ctx->marker > 0xd7) {
+        throw FileCorruptedException("restart marker expected.");
+    }
+    ctx->marker = 0;
+    for (auto &component : ctx->components) {
+        component.dcPred = 0;
+    }
+    ctx->restartsLeft = ctx->restartInterval;
+}
 
-        std::bitset<8> bits(byte);
-        for (size_t i = 0; i < bits.size(); ++i) {
-            dcNode = bits[i] ? dcNode->rChild.get() : dcNode->lChild.get();
-            if (dcNode->isLeaf) {
-                // TODO: append data
-                dcNode = dcht.root.get();
+static inline uint8_t Clamp(int value) {
+    return static_cast<uint8_t>(std::min(std::max(value, 0), 255));
+}
+
+void DecodeMcuRow(JpegParseContext *ctx) {
+    if (ctx->mcuRow >= ctx->mcusY) {
+        throw FileCorruptedException("image ends before its last row.");
+    }
+
+    for (int mcu = 0; mcu < ctx->mcusX; ++mcu) {
+        if (ctx->restartInterval) {
+            if (ctx->restartsLeft == 0) {
+                HandleRestart(ctx);
+            }
+            ctx->restartsLeft--;
+        }
+        for (Component *component : ctx->scan) {
+            int h = component->hSampleFactor;
+            int v = component->vSampleFactor;
+            for (int by = 0; by < v; ++by) {
+                for (int bx = 0; bx < h; ++bx) {
+                    int size = ctx->blockSize;
+                    uint8_t *out = component->plane.data() +
+                        by * size * component->planeStride +
+                        (mcu * h + bx) * size;
+                    DecodeBlock(ctx, *component, out, component->planeStride);
+                }
             }
         }
     }
+
+    // upsample and convert the MCU row to interleaved output rows
+    int rowsPerMcu = ctx->blockSize * ctx->vMax;
+    int firstRow = ctx->mcuRow * rowsPerMcu;
+    int rows = std::min(rowsPerMcu, ctx->scaledHeight - firstRow);
+    size_t rowBytes = static_cast<size_t>(ctx->scaledWidth) *
+        ctx->info.colorspace.Components();
+    int width = ctx->scaledWidth;
+
+    if (ctx->components.size() == 1) {
+        const Component &y = ctx->components[0];
+        for (int row = 0; row < rows; ++row) {
+            std::copy(y.plane.data() + row * y.planeStride,
+                y.plane.data() + row * y.planeStride + width,
+                ctx->rows.data() + rowBytes * row);
+        }
+    } else {
+        const Component &cy = ctx->components[0];
+        const Component &cb = ctx->components[1];
+        const Component &cr = ctx->components[2];
+        int yh = ctx->hMax / cy.hSampleFactor, yv = ctx->vMax / cy.vSampleFactor;
+        int bh = ctx->hMax / cb.hSampleFactor, bv = ctx->vMax / cb.vSampleFactor;
+        int rh = ctx->hMax / cr.hSampleFactor, rv = ctx->vMax / cr.vSampleFactor;
+        ColorSpace cs = ctx->info.colorspace;
+        int comps = cs.Components();
+        for (int row = 0; row < rows; ++row) {
+            const uint8_t *ys = cy.plane.data() + (row / yv) * cy.planeStride;
+            const uint8_t *bs = cb.plane.data() + (row / bv) * cb.planeStride;
+            const uint8_t *rs = cr.plane.data() + (row / rv) * cr.planeStride;
+            uint8_t *out = ctx->rows.data() + rowBytes * row;
+            if (cs == ColorSpace::Gray) {
+                for (int x = 0; x < width; ++x) {
+                    out[x] = ys[x / yh];
+                }
+                continue;
+            }
+            if (cs == ColorSpace::YCbCr) {
+                for (int x = 0; x < width; ++x) {
+                    out[x * 3] = ys[x / yh];
+                    out[x * 3 + 1] = bs[x / bh];
+                    out[x * 3 + 2] = rs[x / rh];
+                }
+                continue;
+            }
+            for (int x = 0; x < width; ++x) {
+                // JFIF conversion in 16.16 fixed point
+                int yy = ys[x / yh] << 16;
+                int cbv = bs[x / bh] - 128;
+                int crv = rs[x / rh] - 128;
+                uint8_t *pixel = out + x * comps;
+                pixel[0] = Clamp((yy + 91881 * crv + 32768) >> 16);
+                pixel[1] = Clamp((yy - 22554 * cbv - 46802 * crv + 32768)
+                    >> 16);
+                pixel[2] = Clamp((yy + 116130 * cbv + 32768) >> 16);
+                if (comps == 4) {
+                    pixel[3] = 0xff;
+                }
+            }
+        }
+    }
+
+    ctx->mcuRow++;
+    ctx->rowsInBuffer = rows;
+    ctx->bufferRow = 0;
+}
+
+/// decode every MCU row, placing its pixels straight where the orientation
+/// puts them, into ctx->decoded
+void DecodeOriented(JpegParseContext *ctx) {
+    ImageInfo &info = ctx->info;
+    size_t rowBytes = info.RowBytes();
+    size_t pixelBytes = info.colorspace.Components();
+    if (SwapsAxes(ctx->orientation)) {
+        std::swap(info.width, info.height);
+    }
+
+    PixelBuffer<uint8_t> data(ctx->allocator);
+    data.resize(info.RowBytes() * info.height);
+    while (ctx->mcuRow < ctx->mcusY) {
+        int firstRow = ctx->mcuRow * ctx->blockSize * ctx->vMax;
+        DecodeMcuRow(ctx);
+        PlaceOriented(ctx->rows.data(), rowBytes, ctx->scaledWidth,
+            ctx->scaledHeight,
+            firstRow, ctx->rowsInBuffer, pixelBytes, ctx->orientation,
+            data.data(), info.RowBytes());
+    }
+    ctx->decoded = Image(info.width, info.height, info.colorspace, info.depth,
+        std::move(data));
+    ctx->oriented = true;
 }
 
 }
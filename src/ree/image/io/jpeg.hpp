@@ -19,6 +19,12 @@ public:
 
     Image LoadImage(LoadContext *ctx) override;
     void WriteImage(WriteContext *ctx, const Image &image) override;
+
+    /// baseline frames decode one MCU row at a time
+    void BeginRows(LoadContext *ctx) override;
+    int ReadRows(LoadContext *ctx, uint8_t *dst, size_t stride, int n) override;
+    ProbeInfo Probe(LoadContext *ctx) override;
+    Metadata ReadMetadata(LoadContext *ctx) override;
 };
 
 }
@@ -4,11 +4,13 @@
 #include <cmath>
 #include <cassert>
 #include <sstream>
-#include <iostream>
+#include <algorithm>
+#include <array>
 
 #include <zlib.h>
 #include <ree/io/bit_buffer.h>
 #include <ree/image/io/error.hpp>
+#include <ree/image/io/exif.hpp>
 
 #define WITH_LIBZ 1
 
@@ -34,12 +36,30 @@ static ColorSpace kColorSpaces[] = {
 };
 static int kComponents[] = { 1, 0, 3, 3, 2, 0, 4 };
 
+/// samples stored per pixel, a palette index is a single one
+static inline int StoredSamples(uint8_t colorType) {
+    return colorType == 3 ? 1 : kComponents[colorType];
+}
+
+/// whether the bit depth is one the color type allows
+static bool ValidHeader(uint8_t depth, uint8_t colorType) {
+    switch (colorType) {
+    case 0: return depth == 1 || depth == 2 || depth == 4 || depth == 8 ||
+        depth == 16;
+    case 3: return depth == 1 || depth == 2 || depth == 4 || depth == 8;
+    case 2:
+    case 4:
+    case 6: return depth == 8 || depth == 16;
+    }
+    return false;
+}
+
 struct Chunk {
-    Chunk(uint32_t length, uint32_t type, const std::vector<uint8_t> &&payload,
+    Chunk(uint32_t length, uint32_t type, const std::vector<uint8_t> &payload,
         uint32_t crcValue)
         : length(length),
           type(type),
-          payload(std::move(payload)),
+          payload(payload),
           crc(crcValue) {
     }
 
@@ -47,33 +67,81 @@ struct Chunk {
 
     uint32_t length = 0;
     uint32_t type;
-    std::vector<uint8_t> payload;
+    const std::vector<uint8_t> &payload;
     uint32_t crc;
 };
 
 struct PngParseContext : public LoadContext {
     using LoadContext::LoadContext;
 
-    int width;
-    int height;
-    uint8_t depth;
-    uint8_t colorType;
-    uint8_t compression;
-    uint8_t filter;
-    uint8_t interlace;
-    
+    ~PngParseContext() override {
+#if WITH_LIBZ
+        if (strmInited) {
+            inflateEnd(&strm);
+        }
+#endif
+    }
+
+    void Reset(ree::io::Source *src, const LoadOptions &opt) override {
+        LoadContext::Reset(src, opt);
+        headerSeen = false;
+        width = 0;
+        height = 0;
+        depth = 0;
+        colorType = 0;
+        compression = 0;
+        filter = 0;
+        interlace = 0;
+        paletteSize = 0;
+        transparent = false;
+        idatEnded = false;
+    }
+
+    /// IHDR parsed for the image being read
+    bool headerSeen = false;
+    int width = 0;
+    int height = 0;
+    uint8_t depth = 0;
+    uint8_t colorType = 0;
+    uint8_t compression = 0;
+    uint8_t filter = 0;
+    uint8_t interlace = 0;
+
 #if WITH_LIBZ
     z_stream strm;
+    bool strmInited = false;
 #endif
-    std::vector<uint8_t> color;
-    size_t have = 0;
+    /// payload of the chunk being parsed, reused across chunks and images
+    std::vector<uint8_t> payload;
+
+    /// PLTE entries as RGBA, alpha from tRNS
+    std::array<uint8_t, 256 * 4> palette;
+    int paletteSize = 0;
+    bool transparent = false;
+
+    /// no more IDAT chunk follows the one being inflated
+    bool idatEnded = false;
+    /// bytes per complete pixel, at least 1, as the filters count them
+    size_t bpp = 1;
+    /// the scanline being unfiltered and the one above it, each led by its
+    /// filter byte
+    std::vector<uint8_t> scanline;
+    std::vector<uint8_t> previous;
 };
     
 static bool ParseChunk(const Chunk &chunk, PngParseContext *ctx);
+#if WITH_LIBZ
+static void ResetInflate(PngParseContext *ctx);
+#endif
+static size_t InflateInto(PngParseContext *ctx, const uint8_t *data,
+    size_t size, uint8_t *dst, size_t dstSize);
+static void InflateWhole(PngParseContext *ctx, const uint8_t *data,
+    size_t size, std::string &dst, size_t limit);
 static Chunk ReadChunk(PngParseContext *ctx);
-static Image CreateImage(PngParseContext *ctx);
-
-static void LibZInflate(const uint8_t *data, size_t size, PngParseContext *ctx);
+static void InflateScanline(PngParseContext *ctx, size_t size);
+static void UnfilterScanline(PngParseContext *ctx, size_t size);
+static void ConvertScanline(PngParseContext *ctx, int width, uint8_t *dst);
+static void ReadInterlaced(PngParseContext *ctx, int denom);
 static void DecFixedHuffmanDeflate(PngParseContext *ctx);
 static void DecDynamicHuffmanDeflate(PngParseContext *ctx,
     ree::io::BigEndianRLSBBuffer &bitBuffer);
@@ -92,69 +160,299 @@ LoadContext *Png::CreateParseContext(ree::io::Source *source,
     const LoadOptions &options) {
     return new PngParseContext(source, options);
 }
-WriteContext *Png::CreateComposeContext(ree::io::Source *target,
-    const WriteOptions &options) {
-    return new WriteContext(target, options);
+WriteContext *Png::CreateComposeContext(ree::io::Source *,
+    const WriteOptions &) {
+    return nullptr;
 }
 
 Image Png::LoadImage(LoadContext *contex) {
+    return LoadImageByRows(contex);
+}
+
+void Png::BeginRows(LoadContext *contex) {
     PngParseContext *ctx = static_cast<PngParseContext *>(contex);
     auto source = ctx->source;
 
     std::vector<uint8_t> magicStr(kMagicStr.size());
-    source->Read(magicStr.data(), magicStr.size());
+    ReadExactly(source, magicStr.data(), magicStr.size());
     if (magicStr != kMagicStr) {
 		throw FileCorruptedException("magic number not match.");
     }
 
+    // every chunk up to the first IDAT, which is left to ReadRows
     while (true) {
         Chunk chunk = ReadChunk(ctx);
-        if (chunk.Empty()) {
-            break;
-        }
-        if (!ParseChunk(chunk, ctx)) {
+        if (chunk.type == 'IDAT') {
+            if (!ctx->headerSeen) {
+                throw FileCorruptedException("image data before the header.");
+            }
+#if WITH_LIBZ
+            ctx->strm.next_in = ctx->payload.data();
+            ctx->strm.avail_in = static_cast<uInt>(ctx->payload.size());
+#endif
             break;
         }
+        ParseChunk(chunk, ctx);
         if (ctx->done) {
+            throw FileCorruptedException("no image data.");
+        }
+    }
+
+    if (ctx->width <= 0 || ctx->height <= 0) {
+        throw FileCorruptedException("wrong image header.");
+    }
+    if (ctx->colorType == 3 && ctx->paletteSize == 0) {
+        throw FileCorruptedException("palette not found.");
+    }
+
+    ImageInfo &info = ctx->info;
+    info.width = ctx->width;
+    info.height = ctx->height;
+    if (ctx->colorType == 3) {
+        // palette images are expanded to the colors they index
+        info.colorspace = ctx->transparent ? ColorSpace::RGBA : ColorSpace::RGB;
+        info.depth = 8;
+    } else {
+        info.colorspace = kColorSpaces[ctx->colorType];
+        info.depth = ctx->depth;
+    }
+    ctx->nextRow = 0;
+
+    int components = StoredSamples(ctx->colorType);
+    ctx->bpp = std::max(components * ctx->depth / 8, 1);
+    size_t stride = (static_cast<size_t>(ctx->width) * ctx->depth *
+        components + 7) / 8 + 1;
+    ctx->scanline.resize(stride);
+    ctx->previous.assign(stride, 0);
+
+    if (ctx->interlace == 1) {
+        // the first passes hold every pixel of a coarser grid
+        int denom = ScaleDenominator(ctx->options);
+        info.width = (info.width + denom - 1) / denom;
+        info.height = (info.height + denom - 1) / denom;
+        ReadInterlaced(ctx, denom);
+    }
+}
+
+int Png::ReadRows(LoadContext *contex, uint8_t *dst, size_t stride, int n) {
+    PngParseContext *ctx = static_cast<PngParseContext *>(contex);
+    if (ctx->interlace == 1) {
+        return FileFormat::ReadRows(ctx, dst, stride, n);
+    }
+
+    int rows = std::min(n, ctx->height - ctx->nextRow);
+    for (int i = 0; i < rows; ++i) {
+        InflateScanline(ctx, ctx->scanline.size());
+        UnfilterScanline(ctx, ctx->scanline.size());
+        ConvertScanline(ctx, ctx->width, dst + stride * i);
+        ctx->nextRow++;
+    }
+    return std::max(rows, 0);
+}
+
+ProbeInfo Png::Probe(LoadContext *contex) {
+    PngParseContext *ctx = static_cast<PngParseContext *>(contex);
+    auto source = ctx->source;
+
+    std::array<uint8_t, 8> magicStr;
+    ReadExactly(source, magicStr.data(), magicStr.size());
+    if (!std::equal(kMagicStr.begin(), kMagicStr.end(), magicStr.begin())) {
+        throw FileCorruptedException("magic number not match.");
+    }
+
+    // chunk headers up to the first IDAT, skipping the payloads not needed
+    ProbeInfo info;
+    info.format = PreferredExtension();
+    bool headerRead = false;
+    bool transparent = false;
+    uint8_t colorType = 0;
+    size_t position = magicStr.size();
+    while (true) {
+        std::array<uint8_t, 8> header;
+        ReadExactly(source, header.data(), header.size());
+        uint32_t length = header[0] << 24 | header[1] << 16 |
+            header[2] << 8 | header[3];
+        uint32_t type = header[4] << 24 | header[5] << 16 |
+            header[6] << 8 | header[7];
+        position += header.size();
+        if (type == 'IDAT' || type == 'IEND') {
             break;
         }
+
+        std::array<uint8_t, 13> payload;
+        if (type == 'IHDR' && length == payload.size()) {
+            ReadExactly(source, payload.data(), payload.size());
+            info.width = payload[0] << 24 | payload[1] << 16 |
+                payload[2] << 8 | payload[3];
+            info.height = payload[4] << 24 | payload[5] << 16 |
+                payload[6] << 8 | payload[7];
+            info.depth = payload[8];
+            colorType = payload[9];
+            if (!ValidHeader(payload[8], colorType)) {
+                throw FileCorruptedException("wrong image header.");
+            }
+            info.colorspace = kColorSpaces[colorType];
+            if (colorType == 3) {
+                info.depth = 8;
+            }
+            headerRead = true;
+            source->Seek(position + length + 4);
+        } else if (type == 'acTL' && length >= 4) {
+            ReadExactly(source, payload.data(), 4);
+            info.frames = payload[0] << 24 | payload[1] << 16 |
+                payload[2] << 8 | payload[3];
+            source->Seek(position + length + 4);
+        } else {
+            transparent = transparent || type == 'tRNS';
+            source->Seek(position + length + 4);
+        }
+        position += length + 4;
+    }
+
+    if (!headerRead || info.width <= 0 || info.height <= 0) {
+        throw FileCorruptedException("wrong image header.");
     }
+    // palette images are expanded as BeginRows does
+    if (colorType == 3 && transparent) {
+        info.colorspace = ColorSpace::RGBA;
+    }
+    return info;
+}
+
+static const char kXmpKeyword[] = "XML:com.adobe.xmp";
+/// larger profile sizes are taken as corrupted
+static constexpr uint32_t kMaxProfileSize = 64 << 20;
+/// larger metadata chunks are taken as corrupted rather than allocated
+static constexpr uint32_t kMaxMetadataChunkSize = 64 << 20;
+
+Metadata Png::ReadMetadata(LoadContext *contex) {
+    PngParseContext *ctx = static_cast<PngParseContext *>(contex);
+    auto source = ctx->source;
+
+    std::array<uint8_t, 8> magicStr;
+    ReadExactly(source, magicStr.data(), magicStr.size());
+    if (!std::equal(kMagicStr.begin(), kMagicStr.end(), magicStr.begin())) {
+        throw FileCorruptedException("magic number not match.");
+    }
+
+    // metadata chunks may follow the image data, so every chunk header up to
+    // IEND is read and everything else is skipped by seeking
+    Metadata metadata;
+    auto &payload = ctx->payload;
+    size_t position = magicStr.size();
+    while (true) {
+        std::array<uint8_t, 9> header;
+        ReadExactly(source, header.data(), 8);
+        uint32_t length = header[0] << 24 | header[1] << 16 |
+            header[2] << 8 | header[3];
+        uint32_t type = header[4] << 24 | header[5] << 16 |
+            header[6] << 8 | header[7];
+        position += 8;
+        if (type == 'IEND') {
+            break;
+        }
 
-    return CreateImage(ctx);
+        if (type == 'pHYs' && length == header.size()) {
+            ReadExactly(source, header.data(), header.size());
+            // unit 1 is the meter, 0 tells only the aspect ratio
+            if (header[8] == 1) {
+                uint32_t x = header[0] << 24 | header[1] << 16 |
+                    header[2] << 8 | header[3];
+                uint32_t y = header[4] << 24 | header[5] << 16 |
+                    header[6] << 8 | header[7];
+                metadata.dpiX = x * 0.0254;
+                metadata.dpiY = y * 0.0254;
+            }
+        } else if (type == 'eXIf') {
+            if (length > kMaxMetadataChunkSize) {
+                throw FileCorruptedException("wrong chunk length.");
+            }
+            metadata.exif.resize(length);
+            ReadExactly(source, metadata.exif.data(), length);
+            ParseExif(metadata.exif.data(), length, &metadata);
+        } else if (type == 'iCCP' || type == 'iTXt') {
+            // compressed or prefixed by text, so read into the reused payload
+            if (length > kMaxMetadataChunkSize) {
+                throw FileCorruptedException("wrong chunk length.");
+            }
+            payload.resize(length);
+            ReadExactly(source, payload.data(), length);
+            auto end = payload.data() + length;
+            auto keywordEnd = std::find(payload.data(), end, 0);
+            if (type == 'iCCP' && end - keywordEnd > 2) {
+                // the profile tells its own size in its first 4 bytes
+                std::array<uint8_t, 4> size;
+                if (InflateInto(ctx, keywordEnd + 2, end - keywordEnd - 2,
+                    size.data(), size.size()) < size.size()) {
+                    throw FileCorruptedException("wrong icc profile.");
+                }
+                uint32_t profileSize = size[0] << 24 | size[1] << 16 |
+                    size[2] << 8 | size[3];
+                if (profileSize > kMaxProfileSize) {
+                    throw FileCorruptedException("wrong icc profile.");
+                }
+                metadata.icc.resize(profileSize);
+                metadata.icc.resize(InflateInto(ctx, keywordEnd + 2,
+                    end - keywordEnd - 2, metadata.icc.data(), profileSize));
+            } else if (type == 'iTXt' && std::equal(payload.data(), keywordEnd,
+                kXmpKeyword) && keywordEnd - payload.data() ==
+                static_cast<ptrdiff_t>(sizeof(kXmpKeyword) - 1) &&
+                end - keywordEnd > 2) {
+                // compression flag and method, then language and translated
+                // keyword, each ended by a nul
+                bool compressed = keywordEnd[1] != 0;
+                auto text = std::find(keywordEnd + 3, end, 0);
+                text = std::find(std::min(text + 1, end), end, 0);
+                text = std::min(text + 1, end);
+                if (!compressed) {
+                    metadata.xmp.assign(text, end);
+                } else {
+                    InflateWhole(ctx, text, end - text, metadata.xmp,
+                        kMaxMetadataChunkSize);
+                }
+            }
+        }
+        position += length + 4;
+        source->Seek(position);
+    }
+    return metadata;
 }
 
-void Png::WriteImage(WriteContext *ctx, const Image &image) {
-    auto target = ctx->target;
+void Png::WriteImage(WriteContext *, const Image &) {
+    throw NotImplementException();
 }
 
 
 Chunk ReadChunk(PngParseContext *ctx) {
     auto source = ctx->source;
 
+    // a file ending early throws here, so BeginRows waiting for IDAT and
+    // InflateScanline never loop on stale chunks
     uint32_t length = 0;
-    source->Read(reinterpret_cast<uint8_t *>(&length), 4);
+    ReadExactly(source, reinterpret_cast<uint8_t *>(&length), 4);
     length = ntohl(length);
 
     uint32_t type;
-    source->Read(reinterpret_cast<uint8_t *>(&type), 4);
+    ReadExactly(source, reinterpret_cast<uint8_t *>(&type), 4);
     type = ntohl(type);
 
-    std::vector<uint8_t> payload;
-    if (length > 0) {
-        payload.resize(length);
-        source->Read(payload.data(), length);
-    }
+    auto &payload = ctx->payload;
+    payload.resize(length);
+    ReadExactly(source, payload.data(), length);
 
     uint32_t crc;
-    source->Read(reinterpret_cast<uint8_t *>(&crc), 4);
+    ReadExactly(source, reinterpret_cast<uint8_t *>(&crc), 4);
     crc = ntohl(crc);
 
-    return Chunk(length, type, std::move(payload), crc);
+    return Chunk(length, type, payload, crc);
 }
 
 bool ParseChunk(const Chunk &chunk, PngParseContext *ctx) {
     uint32_t type = chunk.type;
     if (type == 'IHDR') {
+        if (chunk.length != 13) {
+            throw FileCorruptedException("wrong image header.");
+        }
         const uint8_t *cursor = chunk.payload.data();
         
         std::copy(cursor, cursor + 4, reinterpret_cast<uint8_t *>(&ctx->width));
@@ -180,27 +478,43 @@ bool ParseChunk(const Chunk &chunk, PngParseContext *ctx) {
         std::copy(cursor, cursor + 1, &ctx->interlace);
         cursor += 1;
 
-        ctx->strm.zalloc = Z_NULL;
-        ctx->strm.zfree = Z_NULL;
-        ctx->strm.opaque = Z_NULL;
-        ctx->strm.avail_in = 0;
-        ctx->strm.next_in = Z_NULL;
-        int ret = inflateInit(&ctx->strm);
-        assert(ret == 0);
-    } else if (type == 'iCCP') {
-        
-    } else if (type == 'pHYs') {
-        
-    } else if (type == 'iTXt') {
-        std::string xml(chunk.payload.begin(), chunk.payload.end());
-        std::cout << xml << std::endl;
+        if (!ValidHeader(ctx->depth, ctx->colorType)) {
+            throw FileCorruptedException("wrong image header.");
+        }
+        ctx->headerSeen = true;
+
+#if WITH_LIBZ
+        ResetInflate(ctx);
+#endif
+        if (ctx->compression != 0 || ctx->filter != 0 || ctx->interlace > 1) {
+            throw NotImplementException();
+        }
+    } else if (type == 'iCCP' || type == 'pHYs' || type == 'iTXt' ||
+        type == 'eXIf') {
+        // metadata, see Png::ReadMetadata
     } else if (type == 'iDOT') {
         
     } else if (type == 'PLTE') {
-        
+        if (chunk.length % 3 != 0 || chunk.length > 256 * 3) {
+            throw FileCorruptedException("wrong palette.");
+        }
+        ctx->paletteSize = chunk.length / 3;
+        for (int i = 0; i < ctx->paletteSize; ++i) {
+            std::copy(chunk.payload.data() + i * 3,
+                chunk.payload.data() + i * 3 + 3, &ctx->palette[i * 4]);
+            ctx->palette[i * 4 + 3] = 0xff;
+        }
+    } else if (type == 'tRNS') {
+        if (ctx->colorType == 3) {
+            size_t count = std::min<size_t>(chunk.length, ctx->paletteSize);
+            for (size_t i = 0; i < count; ++i) {
+                ctx->palette[i * 4 + 3] = chunk.payload[i];
+            }
+            ctx->transparent = true;
+        }
     } else if (type == 'IDAT') {
 #if WITH_LIBZ
-        LibZInflate(chunk.payload.data(), chunk.payload.size(), ctx);
+        // inflated a scanline at a time, see InflateScanline
 #else
         ree::io::BigEndianRLSBBuffer bitBuffer(chunk.payload.data(),
             chunk.payload.size());
@@ -255,30 +569,271 @@ bool ParseChunk(const Chunk &chunk, PngParseContext *ctx) {
     return true;
 }
     
-void LibZInflate(const uint8_t *data, size_t size, PngParseContext *ctx) {
+#if WITH_LIBZ
+/// (re)initialize ctx->strm for a new zlib stream
+void ResetInflate(PngParseContext *ctx) {
+    int ret = Z_OK;
+    if (ctx->strmInited) {
+        ret = inflateReset(&ctx->strm);
+    } else {
+        ctx->strm.zalloc = Z_NULL;
+        ctx->strm.zfree = Z_NULL;
+        ctx->strm.opaque = Z_NULL;
+        ctx->strm.avail_in = 0;
+        ctx->strm.next_in = Z_NULL;
+        ret = inflateInit(&ctx->strm);
+        ctx->strmInited = ret == Z_OK;
+    }
+    if (ret != Z_OK) {
+        throw std::bad_alloc();
+    }
+}
+#endif
+
+/// inflate the zlib stream in data into dst until either of them ends,
+/// returns the bytes inflated
+size_t InflateInto(PngParseContext *ctx, const uint8_t *data, size_t size,
+    uint8_t *dst, size_t dstSize) {
+#if WITH_LIBZ
+    ResetInflate(ctx);
     ctx->strm.next_in = const_cast<uint8_t *>(data);
-    ctx->strm.avail_in = size;
-    
-    uint8_t chunk[32768];
-    
-    ctx->strm.next_out = chunk;
-    ctx->strm.avail_out = sizeof(chunk);
-    int ret = inflate(&ctx->strm, Z_NO_FLUSH);
-    assert(ret != Z_STREAM_ERROR);  /* state not clobbered */
-    switch (ret) {
-        case Z_NEED_DICT:
-            ret = Z_DATA_ERROR;     /* and fall through */
-        case Z_DATA_ERROR:
-        case Z_MEM_ERROR:
-            assert(false);
+    ctx->strm.avail_in = static_cast<uInt>(size);
+    ctx->strm.next_out = dst;
+    ctx->strm.avail_out = static_cast<uInt>(dstSize);
+    int ret = inflate(&ctx->strm, Z_FINISH);
+    if (ret != Z_STREAM_END && ret != Z_BUF_ERROR && ret != Z_OK) {
+        throw FileCorruptedException("wrong compressed data.");
     }
-    
-    size_t outSize = sizeof(chunk) - ctx->strm.avail_out;
-    ctx->color.insert(ctx->color.end(), chunk, chunk + outSize); 
-    
-    if (ret == Z_STREAM_END) {
-        inflateEnd(&ctx->strm);
+    return dstSize - ctx->strm.avail_out;
+#else
+    throw NotImplementException();
+#endif
+}
+
+/// inflate the whole zlib stream in data into dst, growing it as needed.
+/// Streams ending early or inflating past limit bytes are taken as
+/// corrupted.
+void InflateWhole(PngParseContext *ctx, const uint8_t *data, size_t size,
+    std::string &dst, size_t limit) {
+#if WITH_LIBZ
+    ResetInflate(ctx);
+    ctx->strm.next_in = const_cast<uint8_t *>(data);
+    ctx->strm.avail_in = static_cast<uInt>(size);
+    size_t produced = 0;
+    dst.resize(std::min(std::max<size_t>(size * 4, 1), limit));
+    while (true) {
+        ctx->strm.next_out = reinterpret_cast<uint8_t *>(&dst[produced]);
+        ctx->strm.avail_out = static_cast<uInt>(dst.size() - produced);
+        int ret = inflate(&ctx->strm, Z_NO_FLUSH);
+        produced = dst.size() - ctx->strm.avail_out;
+        if (ret == Z_STREAM_END) {
+            break;
+        }
+        if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            throw FileCorruptedException("wrong compressed data.");
+        }
+        if (ctx->strm.avail_out > 0) {
+            // all of the input taken without reaching the end of the stream
+            throw FileCorruptedException("wrong compressed data.");
+        }
+        if (dst.size() == limit) {
+            throw FileCorruptedException("metadata too large.");
+        }
+        dst.resize(std::min(dst.size() * 2, limit));
+    }
+    dst.resize(produced);
+#else
+    throw NotImplementException();
+#endif
+}
+
+/// inflate the next size bytes of image data into ctx->scanline, reading
+/// further IDAT chunks as their predecessors run out
+void InflateScanline(PngParseContext *ctx, size_t size) {
+#if WITH_LIBZ
+    ctx->strm.next_out = ctx->scanline.data();
+    ctx->strm.avail_out = static_cast<uInt>(size);
+    while (ctx->strm.avail_out > 0) {
+        if (ctx->strm.avail_in == 0) {
+            if (ctx->idatEnded) {
+                throw FileCorruptedException("image ends before its last row.");
+            }
+            Chunk chunk = ReadChunk(ctx);
+            if (chunk.type != 'IDAT') {
+                ctx->idatEnded = true;
+                ParseChunk(chunk, ctx);
+                continue;
+            }
+            ctx->strm.next_in = ctx->payload.data();
+            ctx->strm.avail_in = static_cast<uInt>(ctx->payload.size());
+            continue;
+        }
+
+        int ret = inflate(&ctx->strm, Z_NO_FLUSH);
+        assert(ret != Z_STREAM_ERROR);  /* state not clobbered */
+        switch (ret) {
+            case Z_NEED_DICT:
+            case Z_DATA_ERROR:
+            case Z_MEM_ERROR:
+                throw FileCorruptedException("broken zlib stream.");
+            case Z_STREAM_END:
+                if (ctx->strm.avail_out > 0) {
+                    throw FileCorruptedException(
+                        "image ends before its last row.");
+                }
+                break;
+        }
+    }
+#else
+    throw NotImplementException();
+#endif
+}
+
+static inline uint8_t Paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) {
+        return static_cast<uint8_t>(a);
+    }
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+}
+
+/// undo the filter of ctx->scanline, whose first size bytes are used, against
+/// ctx->previous, then make it the previous scanline
+void UnfilterScanline(PngParseContext *ctx, size_t size) {
+    uint8_t *cur = ctx->scanline.data() + 1;
+    const uint8_t *prev = ctx->previous.data() + 1;
+    size_t length = size - 1;
+    size_t bpp = std::min(ctx->bpp, length);
+
+    switch (ctx->scanline[0]) {
+    case 0:
+        break;
+    case 1:
+        for (size_t i = bpp; i < length; ++i) {
+            cur[i] += cur[i - bpp];
+        }
+        break;
+    case 2:
+        for (size_t i = 0; i < length; ++i) {
+            cur[i] += prev[i];
+        }
+        break;
+    case 3:
+        for (size_t i = 0; i < bpp; ++i) {
+            cur[i] += prev[i] >> 1;
+        }
+        for (size_t i = bpp; i < length; ++i) {
+            cur[i] += (cur[i - bpp] + prev[i]) >> 1;
+        }
+        break;
+    case 4:
+        for (size_t i = 0; i < bpp; ++i) {
+            cur[i] += prev[i];
+        }
+        for (size_t i = bpp; i < length; ++i) {
+            cur[i] += Paeth(cur[i - bpp], prev[i], prev[i - bpp]);
+        }
+        break;
+    default:
+        throw FileCorruptedException("unknown filter type.");
+    }
+    std::copy(ctx->scanline.begin(), ctx->scanline.begin() + size,
+        ctx->previous.begin());
+}
+
+/// turn the unfiltered scanline of width pixels into a row of ctx->info:
+/// samples below 8 bits get a byte each, palette indexes are looked up and
+/// 16 bit samples are stored in native byte order
+void ConvertScanline(PngParseContext *ctx, int width, uint8_t *dst) {
+    const uint8_t *src = ctx->previous.data() + 1;
+    int components = StoredSamples(ctx->colorType);
+
+    if (ctx->depth == 16) {
+        uint16_t *out = reinterpret_cast<uint16_t *>(dst);
+        size_t count = static_cast<size_t>(width) * components;
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = static_cast<uint16_t>(src[i * 2] << 8 | src[i * 2 + 1]);
+        }
+        return;
+    }
+
+    if (ctx->colorType == 3) {
+        int outComponents = ctx->transparent ? 4 : 3;
+        int mask = (1 << ctx->depth) - 1;
+        for (int x = 0; x < width; ++x) {
+            int bit = x * ctx->depth;
+            int index = (src[bit >> 3] >> (8 - ctx->depth - (bit & 7))) & mask;
+            if (index >= ctx->paletteSize) {
+                throw FileCorruptedException("palette index out of range.");
+            }
+            std::copy(&ctx->palette[index * 4],
+                &ctx->palette[index * 4] + outComponents,
+                dst + x * outComponents);
+        }
+        return;
+    }
+
+    if (ctx->depth == 8) {
+        std::copy(src, src + static_cast<size_t>(width) * components, dst);
+        return;
+    }
+
+    // 1, 2 or 4 bit gray
+    int mask = (1 << ctx->depth) - 1;
+    for (int x = 0; x < width; ++x) {
+        int bit = x * ctx->depth;
+        dst[x] = (src[bit >> 3] >> (8 - ctx->depth - (bit & 7))) & mask;
+    }
+}
+
+/// decode the passes of an Adam7 image holding the pixels on every denom-th
+/// row and column into ctx->decoded, which ReadRows then serves rows of
+void ReadInterlaced(PngParseContext *ctx, int denom) {
+    static const int kPasses[7][4] = {
+        // xstart, ystart, xstep, ystep
+        {0, 0, 8, 8}, {4, 0, 8, 8}, {0, 4, 4, 8}, {2, 0, 4, 4},
+        {0, 2, 2, 4}, {1, 0, 2, 2}, {0, 1, 1, 2},
+    };
+    // passes 1, 1-3, 1-5 and all of them complete the grids of 8, 4, 2 and 1
+    int passes = denom == 8 ? 1 : denom == 4 ? 3 : denom == 2 ? 5 : 7;
+    const ImageInfo &info = ctx->info;
+    size_t rowBytes = info.RowBytes();
+    size_t pixelBytes = rowBytes / info.width;
+    int components = StoredSamples(ctx->colorType);
+
+    PixelBuffer<uint8_t> data(ctx->allocator);
+    data.resize(rowBytes * info.height);
+    std::vector<uint8_t> row(rowBytes);
+
+    for (int p = 0; p < passes; ++p) {
+        const int *pass = kPasses[p];
+        int width = (ctx->width - pass[0] + pass[2] - 1) / pass[2];
+        int height = (ctx->height - pass[1] + pass[3] - 1) / pass[3];
+        if (width <= 0 || height <= 0) {
+            continue;
+        }
+        size_t size = (static_cast<size_t>(width) * ctx->depth * components +
+            7) / 8 + 1;
+        std::fill(ctx->previous.begin(), ctx->previous.end(), 0);
+        for (int y = 0; y < height; ++y) {
+            InflateScanline(ctx, size);
+            UnfilterScanline(ctx, size);
+            ConvertScanline(ctx, width, row.data());
+
+            uint8_t *out = data.data() +
+                rowBytes * ((pass[1] + y * pass[3]) / denom);
+            for (int x = 0; x < width; ++x) {
+                std::copy(row.data() + x * pixelBytes,
+                    row.data() + (x + 1) * pixelBytes,
+                    out + (pass[0] + x * pass[2]) / denom * pixelBytes);
+            }
+        }
     }
+    ctx->decoded = Image(info.width, info.height, info.colorspace, info.depth,
+        std::move(data));
 }
 
 void DecFixedHuffmanDeflate(PngParseContext *ctx) {
@@ -303,40 +858,6 @@ void DecDynamicHuffmanDeflate(PngParseContext *ctx,
     uint32_t nlen = bitBuffer.ReadBits(16);
 }
 
-Image CreateImage(PngParseContext *ctx) {
-    int components = kComponents[ctx->colorType];
-    size_t bpp = (components * ctx->depth + 7) / 8;
-    std::vector<uint8_t> data(ctx->width * ctx->height * components);
-
-    size_t stride = (ctx->width * ctx->depth * components + 7) / 8 + 1;
-    assert(stride * ctx->height == ctx->color.size());
-    for (int row = 0; row < ctx->height; ++row) {
-        auto bufferBeign = ctx->color.data() + row * stride;
-        ree::io::BigEndianRLSBBuffer buffer(bufferBeign, stride);
-        int filter = buffer.ReadBits(8);
-
-        size_t dataBeginIndex = row * ctx->width * components;
-        for (int i = 0; i < components; ++i) {
-            data[dataBeginIndex + i] = buffer.ReadBits(ctx->depth);
-        }
-        for (int col = 1; col < ctx->width; ++col) {
-            for (int i = 0; i < components; ++i) {
-                uint32_t value = buffer.ReadBits(ctx->depth);
-                switch (filter) {
-                case 0:
-                    break;
-                case 1:
-                    value += data[dataBeginIndex + col * 4 + i - bpp];
-                    break;
-                }
-                data[dataBeginIndex + col * 4 + i] = value;
-            }
-        }
-    }
-    return Image(ctx->width, ctx->height, kColorSpaces[ctx->colorType],
-		ctx->depth, std::move(data));
-}
-
 }
 }
 }
\ No newline at end of file
@@ -20,6 +20,13 @@ public:
 
     Image LoadImage(LoadContext *ctx) override;
     void WriteImage(WriteContext *ctx, const Image &image) override;
+
+    /// scanlines are inflated and unfiltered one at a time, interlaced
+    /// images are decoded whole by BeginRows
+    void BeginRows(LoadContext *ctx) override;
+    int ReadRows(LoadContext *ctx, uint8_t *dst, size_t stride, int n) override;
+    ProbeInfo Probe(LoadContext *ctx) override;
+    Metadata ReadMetadata(LoadContext *ctx) override;
 };
 
 }
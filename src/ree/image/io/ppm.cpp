@@ -1,7 +1,9 @@
 #include "ppm.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <sstream>
+#include <stdexcept>
 
 #include <ree/image/io/error.hpp>
 
@@ -30,6 +32,10 @@ WriteContext *Ppm::CreateComposeContext(ree::io::Source *target,
 }
 
 Image Ppm::LoadImage(LoadContext *ctx) {
+    return LoadImageByRows(ctx);
+}
+
+void Ppm::BeginRows(LoadContext *ctx) {
     auto source = ctx->source;
 
     std::string header;
@@ -59,57 +65,133 @@ Image Ppm::LoadImage(LoadContext *ctx) {
     while ((maxValue >> depthBits) > 0) {
         depthBits++;
     }
-    int bytesPerValue = depthBits > 8 ? 2 : 1;
-    std::vector<uint8_t> buffer;
-    buffer.resize(width * height * 3 * bytesPerValue);
-    source->Read(buffer.data(), buffer.size());
-
-    if (bytesPerValue > 1) {
-        uint16_t *data = reinterpret_cast<uint16_t *>(buffer.data());
-        for (int i = 0; i < width * height; ++i) {
-            data[i] = (data[i] >> 8) | ((data[i] & 0xff) << 8);
+
+    ctx->info.width = width;
+    ctx->info.height = height;
+    ctx->info.colorspace = ColorSpace::RGB;
+    ctx->info.depth = depthBits;
+    ctx->nextRow = 0;
+}
+
+int Ppm::ReadRows(LoadContext *ctx, uint8_t *dst, size_t stride, int n) {
+    auto source = ctx->source;
+    size_t rowBytes = ctx->info.RowBytes();
+
+    int rows = std::max(std::min(n, ctx->info.height - ctx->nextRow), 0);
+    for (int i = 0; i < rows; ++i) {
+        uint8_t *row = dst + stride * i;
+        source->Read(row, rowBytes);
+        if (ctx->info.depth > 8) {
+            // samples are big endian in the file
+            uint16_t *data = reinterpret_cast<uint16_t *>(row);
+            for (size_t j = 0; j < rowBytes / 2; ++j) {
+                data[j] = (data[j] >> 8) | ((data[j] & 0xff) << 8);
+            }
         }
     }
-
-    Image image(width, height, ColorSpace::RGB, depthBits, std::move(buffer));
-    return image;
+    ctx->nextRow += rows;
+    return rows;
 }
+
 void Ppm::WriteImage(WriteContext *ctx, const Image &image) {
-    auto target = ctx->target;
+    if (image.DepthBits() <= 8) {
+        WriteView(ctx, image.View<uint8_t>());
+    } else {
+        WriteView(ctx, image.View<uint16_t>());
+    }
+}
 
-    int maxValue = (1 << image.DepthBits()) - 1;
+static void WriteHeader(WriteContext *ctx, int width, int height,
+    class ColorSpace cs, uint8_t depth) {
+    if (cs != ColorSpace::RGB) {
+        throw std::invalid_argument("ppm only holds RGB images.");
+    }
+    int maxValue = (1 << depth) - 1;
 
     std::stringstream ss;
     ss << "P6\n";
-    ss << image.Width() << "\n";
-    ss << image.Height() << "\n";
+    ss << width << "\n";
+    ss << height << "\n";
     ss << maxValue << "\n";
 
     std::string header = ss.str();
-    target->Write(reinterpret_cast<const uint8_t *>(header.data()),
+    ctx->target->Write(reinterpret_cast<const uint8_t *>(header.data()),
         header.size());
+}
 
-    if (image.DepthBits() <= 8) {
-        target->Write(image.Data().data(), image.Data().size());
-    } else {
-        std::vector<uint16_t> buffer;
-        buffer.resize(image.Width() * image.Height() * 3);
-
-        auto inData = reinterpret_cast<const uint16_t *>(image.Data().data());
-        for (int row = 0; row < image.Height(); ++row) {
-            for (int col = 0; col < image.Width(); ++col) {
-                int idx = row * image.Width() + col;
-                buffer[idx * 3] = (inData[idx * 3] >> 8) |
-                    ((inData[idx * 3] & 0xff) << 8);
-                buffer[idx * 3 + 1] = (inData[idx * 3 + 1] >> 8) |
-                    ((inData[idx * 3 + 1] & 0xff) << 8);
-                buffer[idx * 3 + 2] = (inData[idx * 3 + 2] >> 8) |
-                    ((inData[idx * 3 + 2] & 0xff) << 8);
-            }
+template <typename ValueT>
+static void WriteHeader(WriteContext *ctx, const ImageView<const ValueT> &view) {
+    WriteHeader(ctx, view.Width(), view.Height(), view.ColorSpace(),
+        view.DepthBits());
+}
+
+/// write count 16 bit samples big endian, through buffer
+static void WriteSwapped(WriteContext *ctx, const uint16_t *samples,
+    size_t count, std::vector<uint16_t> &buffer) {
+    buffer.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        buffer[i] = (samples[i] >> 8) | ((samples[i] & 0xff) << 8);
+    }
+    ctx->target->Write(reinterpret_cast<const uint8_t *>(buffer.data()),
+        buffer.size() * 2);
+}
+
+void Ppm::WriteView(WriteContext *ctx, const ImageView<const uint8_t> &view) {
+    auto target = ctx->target;
+    WriteHeader(ctx, view);
+
+    if (view.Contiguous()) {
+        target->Write(view.Data(), view.RowValues() * view.Height());
+        return;
+    }
+    for (int row = 0; row < view.Height(); ++row) {
+        target->Write(view.Row(row), view.RowValues());
+    }
+}
+
+void Ppm::WriteView(WriteContext *ctx, const ImageView<const uint16_t> &view) {
+    WriteHeader(ctx, view);
+
+    // samples are big endian in the file
+    std::vector<uint16_t> buffer;
+    for (int row = 0; row < view.Height(); ++row) {
+        WriteSwapped(ctx, view.Row(row), view.RowValues(), buffer);
+    }
+}
+
+void Ppm::BeginWriteRows(WriteContext *ctx, const ImageInfo &info) {
+    ctx->info = info;
+    ctx->nextRow = 0;
+    WriteHeader(ctx, info.width, info.height, info.colorspace, info.depth);
+}
+
+void Ppm::WriteRows(WriteContext *ctx, const uint8_t *rows, size_t stride,
+    int n) {
+    if (n > ctx->info.height - ctx->nextRow) {
+        throw std::out_of_range("more rows than the image has.");
+    }
+    size_t rowBytes = ctx->info.RowBytes();
+    std::vector<uint16_t> buffer;
+    for (int i = 0; i < n; ++i) {
+        const uint8_t *row = rows + stride * i;
+        if (ctx->info.depth > 8) {
+            WriteSwapped(ctx, reinterpret_cast<const uint16_t *>(row),
+                rowBytes / 2, buffer);
+        } else {
+            ctx->target->Write(row, rowBytes);
         }
-        target->Write(reinterpret_cast<const uint8_t *>(buffer.data()),
-            buffer.size() * 2);
     }
+    ctx->nextRow += n;
+}
+
+void Ppm::EndWriteRows(WriteContext *ctx) {
+    if (ctx->nextRow != ctx->info.height) {
+        throw std::logic_error("image ended before its last row.");
+    }
+}
+
+bool Ppm::StreamsRows() {
+    return true;
 }
 
 }
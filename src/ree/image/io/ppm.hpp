@@ -19,6 +19,21 @@ public:
 
     Image LoadImage(LoadContext *ctx) override;
     void WriteImage(WriteContext *ctx, const Image &image) override;
+
+    /// rows are read straight into the caller's buffer
+    void BeginRows(LoadContext *ctx) override;
+    int ReadRows(LoadContext *ctx, uint8_t *dst, size_t stride, int n) override;
+    void WriteView(WriteContext *ctx,
+        const ImageView<const uint8_t> &view) override;
+    void WriteView(WriteContext *ctx,
+        const ImageView<const uint16_t> &view) override;
+
+    /// the header goes out first, rows are written as they come
+    void BeginWriteRows(WriteContext *ctx, const ImageInfo &info) override;
+    void WriteRows(WriteContext *ctx, const uint8_t *rows, size_t stride,
+        int n) override;
+    void EndWriteRows(WriteContext *ctx) override;
+    bool StreamsRows() override;
 };
 
 }
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <ree/io/source.h>
+
+namespace ree {
+namespace image {
+namespace io {
+
+/**
+ * @brief closes an opened source when leaving the scope, unless released to
+ * whatever keeps reading from or writing to it afterwards.
+ */
+class SourceGuard {
+public:
+    explicit SourceGuard(ree::io::Source *source) : source_(source) {}
+    ~SourceGuard() {
+        if (source_) {
+            source_->Close();
+        }
+    }
+    SourceGuard(const SourceGuard &) = delete;
+    SourceGuard &operator=(const SourceGuard &) = delete;
+
+    void Release() { source_ = nullptr; }
+
+private:
+    ree::io::Source *source_;
+};
+
+}
+}
+}
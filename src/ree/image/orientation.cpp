@@ -0,0 +1,132 @@
+#include "orientation.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace ree {
+namespace image {
+
+namespace {
+
+/// pixels per side of the blocks transposed at once
+constexpr int kBlock = 16;
+
+template <size_t PixelBytes>
+inline void CopyPixel(const uint8_t *src, uint8_t *dst, size_t) {
+    std::memcpy(dst, src, PixelBytes);
+}
+
+template <>
+inline void CopyPixel<0>(const uint8_t *src, uint8_t *dst,
+    size_t pixelBytes) {
+    std::memcpy(dst, src, pixelBytes);
+}
+
+/// copy the rows of src, stepping xStep bytes in dst for every pixel and
+/// yStep bytes for every row, in kBlock square blocks
+template <size_t PixelBytes>
+void CopyBlocked(const uint8_t *src, size_t srcStride, int width, int rows,
+    size_t pixelBytes, uint8_t *origin, ptrdiff_t xStep, ptrdiff_t yStep) {
+    for (int by = 0; by < rows; by += kBlock) {
+        int blockRows = std::min(kBlock, rows - by);
+        for (int bx = 0; bx < width; bx += kBlock) {
+            int blockCols = std::min(kBlock, width - bx);
+            for (int y = by; y < by + blockRows; ++y) {
+                const uint8_t *in = src + srcStride * y + pixelBytes * bx;
+                uint8_t *out = origin + yStep * y + xStep * bx;
+                for (int x = 0; x < blockCols; ++x) {
+                    CopyPixel<PixelBytes>(in, out, pixelBytes);
+                    in += pixelBytes;
+                    out += xStep;
+                }
+            }
+        }
+    }
+}
+
+}
+
+void PlaceOriented(const uint8_t *src, size_t srcStride, int width,
+    int height, int firstRow, int rows, size_t pixelBytes, int orientation,
+    uint8_t *dst, size_t dstStride) {
+    // where pixel (0, firstRow) lands and how far its neighbours right and
+    // below land from it
+    ptrdiff_t p = static_cast<ptrdiff_t>(pixelBytes);
+    ptrdiff_t s = static_cast<ptrdiff_t>(dstStride);
+    ptrdiff_t right = width - 1;
+    ptrdiff_t top = firstRow;
+    ptrdiff_t bottom = height - 1 - firstRow;
+    ptrdiff_t offset;
+    ptrdiff_t xStep;
+    ptrdiff_t yStep;
+    switch (orientation) {
+    case 2: // mirrored
+        offset = top * s + right * p;
+        xStep = -p;
+        yStep = s;
+        break;
+    case 3: // rotated by 180 degrees
+        offset = bottom * s + right * p;
+        xStep = -p;
+        yStep = -s;
+        break;
+    case 4: // flipped
+        offset = bottom * s;
+        xStep = p;
+        yStep = -s;
+        break;
+    case 5: // transposed
+        offset = top * p;
+        xStep = s;
+        yStep = p;
+        break;
+    case 6: // to be rotated by 90 degrees clockwise
+        offset = bottom * p;
+        xStep = s;
+        yStep = -p;
+        break;
+    case 7: // transversed
+        offset = right * s + bottom * p;
+        xStep = -s;
+        yStep = -p;
+        break;
+    case 8: // to be rotated by 90 degrees counterclockwise
+        offset = right * s + top * p;
+        xStep = -s;
+        yStep = p;
+        break;
+    default:
+        offset = top * s;
+        xStep = p;
+        yStep = s;
+        break;
+    }
+
+    uint8_t *origin = dst + offset;
+    if (xStep == p) {
+        // rows stay rows in the same order of pixels
+        for (int y = 0; y < rows; ++y) {
+            std::memcpy(origin + yStep * y, src + srcStride * y,
+                pixelBytes * width);
+        }
+        return;
+    }
+    switch (pixelBytes) {
+    case 1:
+        CopyBlocked<1>(src, srcStride, width, rows, 1, origin, xStep, yStep);
+        break;
+    case 3:
+        CopyBlocked<3>(src, srcStride, width, rows, 3, origin, xStep, yStep);
+        break;
+    case 4:
+        CopyBlocked<4>(src, srcStride, width, rows, 4, origin, xStep, yStep);
+        break;
+    default:
+        CopyBlocked<0>(src, srcStride, width, rows, pixelBytes, origin, xStep,
+            yStep);
+        break;
+    }
+}
+
+}
+}
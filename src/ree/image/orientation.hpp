@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ree {
+namespace image {
+
+/// EXIF orientations 5 to 8 turn the width into the height
+inline bool SwapsAxes(int orientation) {
+    return orientation >= 5 && orientation <= 8;
+}
+
+/**
+ * @brief copy rows [firstRow, firstRow + rows) of a width x height image,
+ * pixelBytes per pixel, to where they belong in dst once the image is shown
+ * as EXIF orientation tells. dst holds the whole oriented image, dstStride
+ * bytes per row. Transposing orientations copy square blocks at a time, so
+ * that only a few rows of dst are written at once.
+ */
+void PlaceOriented(const uint8_t *src, size_t srcStride, int width,
+    int height, int firstRow, int rows, size_t pixelBytes, int orientation,
+    uint8_t *dst, size_t dstStride);
+
+}
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <ree/image/allocator.hpp>
+
+namespace ree {
+namespace image {
+
+/**
+ * @brief contiguous pixel storage from a PixelAllocator, a small subset of
+ * std::vector for trivially copyable values.
+ *
+ * Unlike std::vector, resize() leaves new values uninitialized, and a buffer
+ * can hand its memory to a buffer of another value type (Reinterpret), so
+ * 16-bit samples read as bytes become uint16_t without a copy.
+ */
+template <typename T>
+class PixelBuffer {
+    static_assert(std::is_trivially_copyable<T>::value,
+        "pixel values must be trivially copyable");
+
+public:
+    using value_type = T;
+    using iterator = T *;
+    using const_iterator = const T *;
+
+    PixelBuffer() : PixelBuffer(nullptr) {}
+    explicit PixelBuffer(PixelAllocator *allocator)
+        : allocator_(allocator ? allocator : DefaultPixelAllocator()) {}
+    /// copy and convert the values of [first, last)
+    template <typename It>
+    PixelBuffer(It first, It last, PixelAllocator *allocator = nullptr)
+        : PixelBuffer(allocator) {
+        resize(static_cast<size_t>(std::distance(first, last)));
+        std::copy(first, last, data_);
+    }
+
+    PixelBuffer(const PixelBuffer &other)
+        : PixelBuffer(other.begin(), other.end(), other.allocator_) {}
+    PixelBuffer(PixelBuffer &&other) noexcept
+        : PixelBuffer(other.allocator_) {
+        Swap(other);
+    }
+    PixelBuffer &operator=(const PixelBuffer &other) {
+        if (this != &other) {
+            resize(other.size());
+            std::copy(other.begin(), other.end(), data_);
+        }
+        return *this;
+    }
+    PixelBuffer &operator=(PixelBuffer &&other) noexcept {
+        if (this != &other) {
+            PixelBuffer released(std::move(*this));
+            Swap(other);
+        }
+        return *this;
+    }
+    ~PixelBuffer() {
+        if (data_) {
+            allocator_->Deallocate(data_, capacityBytes_);
+        }
+    }
+
+    /**
+     * @brief take the memory of other and view its bytes as values of T.
+     * The byte size of other must be a multiple of sizeof(T).
+     */
+    template <typename U>
+    static PixelBuffer<T> Reinterpret(PixelBuffer<U> &&other) {
+        size_t bytes = other.size_ * sizeof(U);
+        if (bytes % sizeof(T) != 0) {
+            throw std::invalid_argument("buffer size is not a multiple of "
+                "the value size.");
+        }
+        PixelBuffer<T> buffer(other.allocator_);
+        buffer.data_ = reinterpret_cast<T *>(other.data_);
+        buffer.size_ = bytes / sizeof(T);
+        buffer.capacityBytes_ = other.capacityBytes_;
+        other.data_ = nullptr;
+        other.size_ = 0;
+        other.capacityBytes_ = 0;
+        return buffer;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacityBytes_ / sizeof(T); }
+    bool empty() const { return size_ == 0; }
+
+    T *data() { return data_; }
+    const T *data() const { return data_; }
+    T &operator[](size_t i) { return data_[i]; }
+    const T &operator[](size_t i) const { return data_[i]; }
+
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+
+    void reserve(size_t n) {
+        if (n <= capacity()) {
+            return;
+        }
+        T *data = static_cast<T *>(allocator_->Allocate(n * sizeof(T)));
+        if (data_) {
+            std::memcpy(data, data_, size_ * sizeof(T));
+            allocator_->Deallocate(data_, capacityBytes_);
+        }
+        data_ = data;
+        capacityBytes_ = n * sizeof(T);
+    }
+    /// new values are left uninitialized
+    void resize(size_t n) {
+        if (n > capacity()) {
+            reserve(std::max(n, capacity() + capacity() / 2));
+        }
+        size_ = n;
+    }
+    void resize(size_t n, const T &value) {
+        size_t old = size_;
+        resize(n);
+        if (n > old) {
+            std::fill(data_ + old, data_ + n, value);
+        }
+    }
+    void clear() { size_ = 0; }
+
+    PixelAllocator *Allocator() const { return allocator_; }
+
+    void Swap(PixelBuffer &other) noexcept {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacityBytes_, other.capacityBytes_);
+        std::swap(allocator_, other.allocator_);
+    }
+
+private:
+    template <typename U> friend class PixelBuffer;
+
+    T *data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacityBytes_ = 0;
+    PixelAllocator *allocator_;
+};
+
+template <typename T>
+bool operator==(const PixelBuffer<T> &a, const PixelBuffer<T> &b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+template <typename T>
+bool operator!=(const PixelBuffer<T> &a, const PixelBuffer<T> &b) {
+    return !(a == b);
+}
+
+}
+}
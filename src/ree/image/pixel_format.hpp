@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+
+#include <ree/image/types.hpp>
+
+namespace ree {
+namespace image {
+
+/**
+ * @brief the layout and value range of pixels of color space CS with samples
+ * of Depth bits, known at compile time so kernels made for a format have
+ * loops of a fixed length and constant clamps.
+ *
+ * Depth 0 stands for any depth, the one passed to MaxValue and MidValue.
+ */
+template <ColorSpace::Value CS, int Depth>
+struct PixelFormat {
+    static_assert(Depth >= 0 && Depth <= 16, "samples have at most 16 bits");
+    static_assert(CS != ColorSpace::Unknown, "pixels need a color space");
+
+    static constexpr ColorSpace::Value kColorSpace = CS;
+    static constexpr int kComponents = ColorSpace(CS).Components();
+    /// the index of the alpha sample, -1 without alpha
+    static constexpr int kAlpha = ColorSpace(CS).AlphaIndex();
+    static constexpr int kDepth = Depth;
+
+    /// the largest sample
+    static constexpr int64_t MaxValue(int depth) {
+        return (int64_t(1) << (Depth ? Depth : depth)) - 1;
+    }
+    /// the zero of chroma samples
+    static constexpr int64_t MidValue(int depth) {
+        return int64_t(1) << ((Depth ? Depth : depth) - 1);
+    }
+};
+
+template <ColorSpace::Value CS, int Depth>
+constexpr ColorSpace::Value PixelFormat<CS, Depth>::kColorSpace;
+template <ColorSpace::Value CS, int Depth>
+constexpr int PixelFormat<CS, Depth>::kComponents;
+template <ColorSpace::Value CS, int Depth>
+constexpr int PixelFormat<CS, Depth>::kAlpha;
+template <ColorSpace::Value CS, int Depth>
+constexpr int PixelFormat<CS, Depth>::kDepth;
+
+/// call fn with the PixelFormat of cs and Depth
+template <int Depth, typename Fn>
+void DispatchColorSpace(ColorSpace cs, Fn &fn) {
+    switch (cs.Id()) {
+    case ColorSpace::RGB:
+        fn(PixelFormat<ColorSpace::RGB, Depth>());
+        break;
+    case ColorSpace::RGBA:
+        fn(PixelFormat<ColorSpace::RGBA, Depth>());
+        break;
+    case ColorSpace::Gray:
+        fn(PixelFormat<ColorSpace::Gray, Depth>());
+        break;
+    case ColorSpace::GrayAlpha:
+        fn(PixelFormat<ColorSpace::GrayAlpha, Depth>());
+        break;
+    case ColorSpace::YCbCr:
+        fn(PixelFormat<ColorSpace::YCbCr, Depth>());
+        break;
+    default:
+        throw std::invalid_argument("no pixel format for " + cs.ToString() +
+            ".");
+    }
+}
+
+/// the depths of 8 bit samples kernels are made for, the rest take depth 0
+template <typename Fn>
+void DispatchDepth(ColorSpace cs, uint8_t depth, Fn &fn, const uint8_t *) {
+    if (depth == 8) {
+        DispatchColorSpace<8>(cs, fn);
+    } else {
+        DispatchColorSpace<0>(cs, fn);
+    }
+}
+
+/// and of 16 bit samples, those of JPEG, HEIF and PNG
+template <typename Fn>
+void DispatchDepth(ColorSpace cs, uint8_t depth, Fn &fn, const uint16_t *) {
+    switch (depth) {
+    case 10:
+        DispatchColorSpace<10>(cs, fn);
+        break;
+    case 12:
+        DispatchColorSpace<12>(cs, fn);
+        break;
+    case 16:
+        DispatchColorSpace<16>(cs, fn);
+        break;
+    default:
+        DispatchColorSpace<0>(cs, fn);
+        break;
+    }
+}
+
+/// float samples range over [0, 1] whatever their depth
+template <typename Fn>
+void DispatchDepth(ColorSpace cs, uint8_t, Fn &fn, const float *) {
+    DispatchColorSpace<0>(cs, fn);
+}
+
+/**
+ * @brief call fn with the PixelFormat of cs and depth for ValueT samples,
+ * once for a whole image, so fn can pick kernels made for that format. fn
+ * takes the format as an argument, e.g. a functor with a member template
+ * `template <typename Format> void operator()(Format)`.
+ */
+template <typename ValueT, typename Fn>
+void DispatchPixelFormat(ColorSpace cs, uint8_t depth, Fn &&fn) {
+    DispatchDepth(cs, depth, fn, static_cast<const ValueT *>(nullptr));
+}
+
+}
+}
@@ -0,0 +1,532 @@
+#include "composite.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+#include <ree/image/rounded_division.hpp>
+#include <ree/image/simd.hpp>
+
+#ifdef REE_IMAGE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace ree {
+namespace image {
+namespace process {
+
+namespace {
+
+/// rows of pixels a thread takes at a time
+constexpr int kBand = 16;
+
+/// what an operator weighs the source and destination samples by, each a
+/// constant plus a multiple of the alpha of the other, in units of the
+/// largest sample
+struct Factors {
+    int source;
+    /// of the alpha of the destination
+    int sourceAlpha;
+    int destination;
+    /// of the alpha of the source
+    int destinationAlpha;
+};
+
+Factors FactorsOf(CompositeOp op) {
+    switch (op) {
+    case CompositeOp::SourceOver: return {1, 0, 1, -1};
+    case CompositeOp::DestinationOver: return {1, -1, 1, 0};
+    case CompositeOp::SourceIn: return {0, 1, 0, 0};
+    case CompositeOp::DestinationIn: return {0, 0, 0, 1};
+    case CompositeOp::SourceOut: return {1, -1, 0, 0};
+    case CompositeOp::DestinationOut: return {0, 0, 1, -1};
+    case CompositeOp::SourceAtop: return {0, 1, 1, -1};
+    case CompositeOp::DestinationAtop: return {1, -1, 0, 1};
+    case CompositeOp::Xor: return {1, -1, 1, -1};
+    case CompositeOp::Plus: return {1, 0, 1, 0};
+    }
+    throw std::invalid_argument("unknown composite operator.");
+}
+
+/// products of integer samples of depth bits, rounded back to nearest. The
+/// largest sample is odd, so no product lies half way.
+template <typename ValueT>
+struct IntegerAlpha {
+    using Factor = int64_t;
+
+    explicit IntegerAlpha(uint8_t depth)
+        : max((int64_t(1) << depth) - 1),
+          divide(static_cast<double>(max)) {}
+
+    Factor One() const { return max; }
+    ValueT FromFraction(float f) const {
+        return static_cast<ValueT>(std::lround(f * max));
+    }
+    /// t / max, clamped to max
+    ValueT Round(int64_t t) const {
+        return static_cast<ValueT>(std::min(
+            static_cast<int64_t>(divide(static_cast<double>(t))), max));
+    }
+    ValueT Scale(ValueT c, ValueT a) const {
+        return Round(static_cast<int64_t>(c) * a);
+    }
+    ValueT Unscale(ValueT c, ValueT a) const {
+        if (a == 0) {
+            return 0;
+        }
+        return static_cast<ValueT>(std::min((2 * max * c + a) / (2 * a),
+            max));
+    }
+    ValueT Blend(ValueT s, Factor fa, ValueT d, Factor fb) const {
+        return Round(s * fa + d * fb);
+    }
+
+    int64_t max;
+    RoundedDivision divide;
+};
+
+/// samples in [0, 1], left unclamped
+struct FloatAlpha {
+    using Factor = float;
+
+    explicit FloatAlpha(uint8_t) {}
+
+    Factor One() const { return 1.0f; }
+    float FromFraction(float f) const { return f; }
+    float Scale(float c, float a) const { return c * a; }
+    float Unscale(float c, float a) const { return a > 0 ? c / a : 0.0f; }
+    float Blend(float s, Factor fa, float d, Factor fb) const {
+        return s * fa + d * fb;
+    }
+};
+
+template <typename ValueT>
+struct AlphaMathOf {
+    using Type = IntegerAlpha<ValueT>;
+};
+
+template <>
+struct AlphaMathOf<float> {
+    using Type = FloatAlpha;
+};
+
+/// the pixels of a row from first on, whose alpha is their last sample
+template <typename Math, typename ValueT>
+void PremultiplyLoop(const Math &math, ValueT *row, int components,
+    int first, int width) {
+    for (int x = first; x < width; ++x) {
+        ValueT *pixel = row + x * components;
+        ValueT a = pixel[components - 1];
+        if (a == math.One()) {
+            continue;
+        }
+        for (int c = 0; c < components - 1; ++c) {
+            pixel[c] = math.Scale(pixel[c], a);
+        }
+    }
+}
+
+template <typename Math, typename ValueT>
+void UnpremultiplyLoop(const Math &math, ValueT *row, int components,
+    int first, int width) {
+    for (int x = first; x < width; ++x) {
+        ValueT *pixel = row + x * components;
+        ValueT a = pixel[components - 1];
+        if (a == math.One()) {
+            continue;
+        }
+        for (int c = 0; c < components - 1; ++c) {
+            pixel[c] = math.Unscale(pixel[c], a);
+        }
+    }
+}
+
+/// the samples of src and dst pixels, colors first then alpha if any
+struct Layout {
+    int colors;
+    int srcComponents;
+    bool srcAlpha;
+    int dstComponents;
+    bool dstAlpha;
+};
+
+template <typename Math, typename ValueT>
+void CompositeLoop(const Math &math, const Layout &layout,
+    const Factors &factors, ValueT opacity, const ValueT *src, ValueT *dst,
+    int first, int width) {
+    using Factor = typename Math::Factor;
+    bool over = factors.source == 1 && factors.sourceAlpha == 0 &&
+        factors.destination == 1 && factors.destinationAlpha == -1;
+    bool scaled = opacity != math.One();
+    ValueT s[4];
+    for (int x = first; x < width; ++x) {
+        const ValueT *in = src + x * layout.srcComponents;
+        ValueT *out = dst + x * layout.dstComponents;
+        ValueT as = layout.srcAlpha ? in[layout.colors] :
+            static_cast<ValueT>(math.One());
+        for (int c = 0; c < layout.colors; ++c) {
+            s[c] = scaled ? math.Scale(in[c], opacity) : in[c];
+        }
+        if (scaled) {
+            as = math.Scale(as, opacity);
+        }
+        if (over && as == 0) {
+            continue;
+        }
+        if (over && as == math.One()) {
+            std::copy(s, s + layout.colors, out);
+            if (layout.dstAlpha) {
+                out[layout.colors] = as;
+            }
+            continue;
+        }
+        Factor ad = layout.dstAlpha ? out[layout.colors] : math.One();
+        Factor fa = factors.source * math.One() + factors.sourceAlpha * ad;
+        Factor fb = factors.destination * math.One() +
+            factors.destinationAlpha * static_cast<Factor>(as);
+        for (int c = 0; c < layout.colors; ++c) {
+            out[c] = math.Blend(s[c], fa, out[c], fb);
+        }
+        if (layout.dstAlpha) {
+            out[layout.colors] = math.Blend(as, fa, out[layout.colors], fb);
+        }
+    }
+}
+
+/// kernels for RGBA pixels of 8 bits, each returning how many pixels it did
+struct AlphaKernels {
+    int (*premultiply)(uint8_t *row, int width);
+    int (*unpremultiply)(uint8_t *row, int width);
+    /// SourceOver onto RGBA and RGB pixels
+    int (*over)(const uint8_t *src, uint8_t *dst, int width,
+        uint8_t opacity);
+    int (*overRgb)(const uint8_t *src, uint8_t *dst, int width,
+        uint8_t opacity);
+};
+
+#ifdef REE_IMAGE_SIMD_X86
+
+/// 255 / a, nudged up so that c * 255 / a rounds as it would exactly
+const float *ReciprocalTable() {
+    static const struct Table {
+        float values[256];
+        Table() {
+            values[0] = 0;
+            for (int a = 1; a < 256; ++a) {
+                values[a] = static_cast<float>(255.0 / a *
+                    (1.0 + 1.0 / (1 << 20)));
+            }
+        }
+    } table;
+    return table.values;
+}
+
+/// t / 255 rounded to nearest, for t up to 255 * 255
+REE_TARGET("avx2")
+inline __m256i Divide255(__m256i t) {
+    return _mm256_mulhi_epu16(_mm256_add_epi16(t, _mm256_set1_epi16(128)),
+        _mm256_set1_epi16(257));
+}
+
+/// the alpha of each pixel of 16 bit samples in all four of its samples
+REE_TARGET("avx2")
+inline __m256i AlphaWords(__m256i pixels) {
+    return _mm256_shuffle_epi8(pixels, _mm256_setr_epi8(6, 7, 6, 7, 6, 7,
+        6, 7, 14, 15, 14, 15, 14, 15, 14, 15, 6, 7, 6, 7, 6, 7, 6, 7, 14, 15,
+        14, 15, 14, 15, 14, 15));
+}
+
+REE_TARGET("avx2")
+inline bool Opaque(__m256i pixels, __m256i alpha) {
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_and_si256(pixels, alpha), alpha)) == -1;
+}
+
+REE_TARGET("avx2")
+int PremultiplyAvx2(uint8_t *row, int width) {
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xff000000));
+    const __m256i zero = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i *p = reinterpret_cast<__m256i *>(row + 4 * x);
+        __m256i v = _mm256_loadu_si256(p);
+        if (Opaque(v, alpha)) {
+            continue;
+        }
+        if (_mm256_testz_si256(v, alpha)) {
+            _mm256_storeu_si256(p, zero);
+            continue;
+        }
+        // alpha times 255 over 255 stays as it is
+        __m256i lo = _mm256_unpacklo_epi8(v, zero);
+        __m256i hi = _mm256_unpackhi_epi8(v, zero);
+        lo = Divide255(_mm256_mullo_epi16(lo, _mm256_blend_epi16(
+            AlphaWords(lo), _mm256_set1_epi16(255), 0x88)));
+        hi = Divide255(_mm256_mullo_epi16(hi, _mm256_blend_epi16(
+            AlphaWords(hi), _mm256_set1_epi16(255), 0x88)));
+        _mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+    }
+    return x;
+}
+
+REE_TARGET("avx2")
+int UnpremultiplyAvx2(uint8_t *row, int width) {
+    const float *table = ReciprocalTable();
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xff000000));
+    const __m256i sample = _mm256_set1_epi32(255);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i *p = reinterpret_cast<__m256i *>(row + 4 * x);
+        __m256i v = _mm256_loadu_si256(p);
+        if (Opaque(v, alpha)) {
+            continue;
+        }
+        if (_mm256_testz_si256(v, alpha)) {
+            _mm256_storeu_si256(p, _mm256_setzero_si256());
+            continue;
+        }
+        __m256 reciprocal = _mm256_i32gather_ps(table,
+            _mm256_srli_epi32(v, 24), 4);
+        __m256i out = _mm256_and_si256(v, alpha);
+        for (int shift = 0; shift < 24; shift += 8) {
+            __m128i count = _mm_cvtsi32_si128(shift);
+            __m256 c = _mm256_cvtepi32_ps(_mm256_and_si256(
+                _mm256_srl_epi32(v, count), sample));
+            __m256i u = _mm256_cvttps_epi32(_mm256_add_ps(
+                _mm256_mul_ps(c, reciprocal), _mm256_set1_ps(0.5f)));
+            out = _mm256_or_si256(out, _mm256_sll_epi32(
+                _mm256_min_epu32(u, sample), count));
+        }
+        _mm256_storeu_si256(p, out);
+    }
+    return x;
+}
+
+/// s scaled by opacity over d, each 8 RGBA pixels
+REE_TARGET("avx2")
+__m256i OverAvx2(__m256i s, __m256i d, __m256i opacity) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i full = _mm256_set1_epi16(255);
+    __m256i sLo = Divide255(_mm256_mullo_epi16(
+        _mm256_unpacklo_epi8(s, zero), opacity));
+    __m256i sHi = Divide255(_mm256_mullo_epi16(
+        _mm256_unpackhi_epi8(s, zero), opacity));
+    __m256i dLo = _mm256_add_epi16(sLo, Divide255(_mm256_mullo_epi16(
+        _mm256_unpacklo_epi8(d, zero),
+        _mm256_sub_epi16(full, AlphaWords(sLo)))));
+    __m256i dHi = _mm256_add_epi16(sHi, Divide255(_mm256_mullo_epi16(
+        _mm256_unpackhi_epi8(d, zero),
+        _mm256_sub_epi16(full, AlphaWords(sHi)))));
+    return _mm256_packus_epi16(dLo, dHi);
+}
+
+REE_TARGET("avx2")
+int OverAvx2(const uint8_t *src, uint8_t *dst, int width, uint8_t opacity) {
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xff000000));
+    const __m256i scale = _mm256_set1_epi16(opacity);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i s = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(src + 4 * x));
+        __m256i *p = reinterpret_cast<__m256i *>(dst + 4 * x);
+        if (_mm256_testz_si256(s, alpha)) {
+            continue;
+        }
+        if (opacity == 255 && Opaque(s, alpha)) {
+            _mm256_storeu_si256(p, s);
+            continue;
+        }
+        _mm256_storeu_si256(p, OverAvx2(s, _mm256_loadu_si256(p), scale));
+    }
+    return x;
+}
+
+/// 8 RGB pixels as RGBA ones, alpha 0
+REE_TARGET("avx2")
+__m256i LoadRgb(const uint8_t *rgb) {
+    __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgb))),
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(rgb + 16)), 1);
+    v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 0, 3, 4,
+        5, 0));
+    return _mm256_shuffle_epi8(v, _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1,
+        6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9,
+        10, 11, -1));
+}
+
+REE_TARGET("avx2")
+void StoreRgb(__m256i rgba, uint8_t *rgb) {
+    __m256i v = _mm256_shuffle_epi8(rgba, _mm256_setr_epi8(0, 1, 2, 4, 5, 6,
+        8, 9, 10, 12, 13, 14, -1, -1, -1, -1, 0, 1, 2, 4, 5, 6, 8, 9, 10, 12,
+        13, 14, -1, -1, -1, -1));
+    v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6,
+        7, 7));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(rgb),
+        _mm256_castsi256_si128(v));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(rgb + 16),
+        _mm256_extracti128_si256(v, 1));
+}
+
+REE_TARGET("avx2")
+int OverRgbAvx2(const uint8_t *src, uint8_t *dst, int width,
+    uint8_t opacity) {
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xff000000));
+    const __m256i scale = _mm256_set1_epi16(opacity);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i s = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(src + 4 * x));
+        if (_mm256_testz_si256(s, alpha)) {
+            continue;
+        }
+        if (opacity == 255 && Opaque(s, alpha)) {
+            StoreRgb(s, dst + 3 * x);
+            continue;
+        }
+        StoreRgb(OverAvx2(s, LoadRgb(dst + 3 * x), scale), dst + 3 * x);
+    }
+    return x;
+}
+
+#endif
+
+/// null where the CPU lacks AVX2 or the pixels are not RGBA of 8 bits
+AlphaKernels FindAlphaKernels(bool rgba8) {
+    AlphaKernels kernels = {nullptr, nullptr, nullptr, nullptr};
+#ifdef REE_IMAGE_SIMD_X86
+    if (rgba8 && ActiveSimdLevel() >= SimdLevel::Avx2) {
+        kernels = {PremultiplyAvx2, UnpremultiplyAvx2, OverAvx2,
+            OverRgbAvx2};
+    }
+#endif
+    return kernels;
+}
+
+template <typename ValueT>
+bool IsRgba8(const ImageView<ValueT> &view) {
+    return std::is_same<typename std::remove_const<ValueT>::type,
+        uint8_t>::value && view.ColorSpace() == ColorSpace::RGBA &&
+        view.DepthBits() == 8;
+}
+
+/// fn(y) for each row of image, in bands on pool
+template <typename Fn>
+void ForRows(ThreadPool *pool, int height, const Fn &fn) {
+    ThreadPool &threads = pool ? *pool : ThreadPool::Shared();
+    threads.ParallelFor((height + kBand - 1) / kBand, [&](size_t band) {
+        int first = static_cast<int>(band) * kBand;
+        for (int y = first; y < std::min(first + kBand, height); ++y) {
+            fn(y);
+        }
+    });
+}
+
+bool CanComposite(ColorSpace cs) {
+    return cs == ColorSpace::RGB || cs == ColorSpace::RGBA ||
+        cs == ColorSpace::Gray || cs == ColorSpace::GrayAlpha;
+}
+
+}
+
+template <typename ValueT>
+void Premultiply(const ImageView<ValueT> &image, ThreadPool *pool) {
+    if (image.ColorSpace().AlphaIndex() < 0 || image.Empty()) {
+        return;
+    }
+    typename AlphaMathOf<ValueT>::Type math(image.DepthBits());
+    AlphaKernels kernels = FindAlphaKernels(IsRgba8(image));
+    int components = image.Components();
+    ForRows(pool, image.Height(), [&](int y) {
+        ValueT *row = image.Row(y);
+        int done = kernels.premultiply ? kernels.premultiply(
+            reinterpret_cast<uint8_t *>(row), image.Width()) : 0;
+        PremultiplyLoop(math, row, components, done, image.Width());
+    });
+}
+
+template <typename ValueT>
+void Unpremultiply(const ImageView<ValueT> &image, ThreadPool *pool) {
+    if (image.ColorSpace().AlphaIndex() < 0 || image.Empty()) {
+        return;
+    }
+    typename AlphaMathOf<ValueT>::Type math(image.DepthBits());
+    AlphaKernels kernels = FindAlphaKernels(IsRgba8(image));
+    int components = image.Components();
+    ForRows(pool, image.Height(), [&](int y) {
+        ValueT *row = image.Row(y);
+        int done = kernels.unpremultiply ? kernels.unpremultiply(
+            reinterpret_cast<uint8_t *>(row), image.Width()) : 0;
+        UnpremultiplyLoop(math, row, components, done, image.Width());
+    });
+}
+
+template <typename ValueT>
+void Composite(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst, int x, int y, CompositeOp op,
+    float opacity, ThreadPool *pool) {
+    class ColorSpace from = src.ColorSpace();
+    class ColorSpace to = dst.ColorSpace();
+    int colors = from.Components() - (from.AlphaIndex() < 0 ? 0 : 1);
+    if (!CanComposite(from) || !CanComposite(to) ||
+        colors != to.Components() - (to.AlphaIndex() < 0 ? 0 : 1)) {
+        throw std::invalid_argument("only RGB or gray images, with or "
+            "without alpha, can be composited onto each other.");
+    }
+    if (!std::is_floating_point<ValueT>::value &&
+        src.DepthBits() != dst.DepthBits()) {
+        throw std::invalid_argument("images to composite differ in depth.");
+    }
+    if (!(opacity >= 0.0f && opacity <= 1.0f)) {
+        throw std::invalid_argument("opacity must be in [0, 1].");
+    }
+    int left = std::max(x, 0);
+    int top = std::max(y, 0);
+    int right = std::min(static_cast<int64_t>(x) + src.Width(),
+        static_cast<int64_t>(dst.Width()));
+    int bottom = std::min(static_cast<int64_t>(y) + src.Height(),
+        static_cast<int64_t>(dst.Height()));
+    if (src.Empty() || dst.Empty() || left >= right || top >= bottom) {
+        return;
+    }
+    ImageView<const ValueT> in = src.Crop(left - x, top - y, right - left,
+        bottom - top);
+    ImageView<ValueT> out = dst.Crop(left, top, right - left, bottom - top);
+
+    typename AlphaMathOf<ValueT>::Type math(dst.DepthBits());
+    Layout layout = {colors, from.Components(), from.AlphaIndex() >= 0,
+        to.Components(), to.AlphaIndex() >= 0};
+    Factors factors = FactorsOf(op);
+    ValueT scale = math.FromFraction(opacity);
+    AlphaKernels kernels = FindAlphaKernels(IsRgba8(src) &&
+        op == CompositeOp::SourceOver && (to == ColorSpace::RGBA ||
+        to == ColorSpace::RGB));
+    auto kernel = to == ColorSpace::RGBA ? kernels.over : kernels.overRgb;
+    ForRows(pool, in.Height(), [&](int row) {
+        int done = kernel ? kernel(
+            reinterpret_cast<const uint8_t *>(in.Row(row)),
+            reinterpret_cast<uint8_t *>(out.Row(row)), in.Width(),
+            static_cast<uint8_t>(scale)) : 0;
+        CompositeLoop(math, layout, factors, scale, in.Row(row), out.Row(row),
+            done, in.Width());
+    });
+}
+
+#define REE_IMAGE_COMPOSITE(ValueT) \
+    template void Premultiply<ValueT>(const ImageView<ValueT> &image, \
+        ThreadPool *pool); \
+    template void Unpremultiply<ValueT>(const ImageView<ValueT> &image, \
+        ThreadPool *pool); \
+    template void Composite<ValueT>(const ImageView<const ValueT> &src, \
+        const ImageView<ValueT> &dst, int x, int y, CompositeOp op, \
+        float opacity, ThreadPool *pool);
+
+REE_IMAGE_COMPOSITE(uint8_t)
+REE_IMAGE_COMPOSITE(uint16_t)
+REE_IMAGE_COMPOSITE(float)
+
+#undef REE_IMAGE_COMPOSITE
+
+}
+}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <ree/image/image_view.hpp>
+#include <ree/image/thread_pool.hpp>
+
+namespace ree {
+namespace image {
+namespace process {
+
+/// the Porter-Duff operators Composite puts a source over a destination with
+enum class CompositeOp {
+    /// the source, then the destination where the source is transparent
+    SourceOver,
+    DestinationOver,
+    /// the source where the destination is
+    SourceIn,
+    DestinationIn,
+    /// the source where the destination is not
+    SourceOut,
+    DestinationOut,
+    /// the source where the destination is, the destination elsewhere
+    SourceAtop,
+    DestinationAtop,
+    /// each where the other is not
+    Xor,
+    /// the sum, clamped to the largest sample
+    Plus,
+};
+
+/**
+ * @brief multiply the color samples of image by its alpha, rounded to
+ * nearest. Images without alpha are left as they are.
+ *
+ * RGBA pixels of 8 bits go 8 at a time through AVX2 where the CPU has it,
+ * which skips opaque ones and clears transparent ones a register at a time.
+ */
+template <typename ValueT>
+void Premultiply(const ImageView<ValueT> &image, ThreadPool *pool = nullptr);
+
+/// divide the color samples of a premultiplied image by its alpha back,
+/// rounded to nearest through a table of reciprocals. The colors of
+/// transparent pixels become 0.
+template <typename ValueT>
+void Unpremultiply(const ImageView<ValueT> &image, ThreadPool *pool = nullptr);
+
+/**
+ * @brief put src onto dst with op, its top left corner at (x, y) of dst and
+ * whatever falls outside of dst cut off. Both hold premultiplied samples of
+ * the same depth, RGB or RGBA or both gray, and src does not overlap dst.
+ *
+ * opacity in [0, 1] scales the whole of src first, to blend it in. Missing
+ * alpha counts as opaque, and the alpha of dst is written where it has one.
+ * SourceOver of RGBA pixels of 8 bits onto RGBA or RGB ones runs through
+ * AVX2 where the CPU has it, which skips transparent spans of src and
+ * copies opaque ones. Integer samples are rounded to nearest and clamped.
+ */
+template <typename ValueT>
+void Composite(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst, int x, int y,
+    CompositeOp op = CompositeOp::SourceOver, float opacity = 1.0f,
+    ThreadPool *pool = nullptr);
+
+}
+}
+}
@@ -0,0 +1,693 @@
+#include "convolve.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+
+#include <ree/image/depth_convert.hpp>
+#include <ree/image/simd.hpp>
+
+#ifdef REE_IMAGE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace ree {
+namespace image {
+namespace process {
+
+namespace {
+
+/// pixels across and down a tile, its rows of floats stay in L1 and the
+/// rows a vertical pass keeps in L2
+constexpr int kTileWidth = 256;
+constexpr int kTileHeight = 128;
+/// gaussians up to this radius are cheaper as kernels than as box blurs
+constexpr int kMaxGaussianRadius = 6;
+
+/// the pixel standing for pixel i of a line of size pixels, past its edges
+/// too
+int BorderIndex(int i, int size, BorderMode border) {
+    if (i >= 0 && i < size) {
+        return i;
+    }
+    if (border == BorderMode::Clamp || size == 1) {
+        return i < 0 ? 0 : size - 1;
+    }
+    int period = 2 * (size - 1);
+    i %= period;
+    if (i < 0) {
+        i += period;
+    }
+    return i < size ? i : period - i;
+}
+
+/// the filter along one axis, a kernel of odd length or box blurs of the
+/// radii in turn
+struct AxisFilter {
+    std::vector<float> taps;
+    std::vector<int> boxes;
+
+    /// the pixels to each side an output pixel depends on
+    int Reach() const {
+        int reach = static_cast<int>(taps.size() / 2);
+        for (int radius : boxes) {
+            reach += radius;
+        }
+        return reach;
+    }
+};
+
+AxisFilter KernelFilter(const std::vector<float> &taps) {
+    if (taps.size() % 2 == 0) {
+        throw std::invalid_argument("kernels must have an odd length.");
+    }
+    AxisFilter filter;
+    filter.taps = taps;
+    return filter;
+}
+
+/// three box blurs making up a gaussian of sigma, sized as in Kovesi's
+/// "Fast almost-gaussian filtering"
+AxisFilter BoxFilter(double sigma) {
+    constexpr int kPasses = 3;
+    double variance = 12.0 * sigma * sigma;
+    int lower = static_cast<int>(std::sqrt(variance / kPasses + 1.0));
+    if (lower % 2 == 0) {
+        lower--;
+    }
+    int upper = lower + 2;
+    int smaller = static_cast<int>(std::lround((variance -
+        kPasses * lower * lower - 4.0 * kPasses * lower - 3.0 * kPasses) /
+        (-4.0 * lower - 4.0)));
+    AxisFilter filter;
+    for (int i = 0; i < kPasses; ++i) {
+        filter.boxes.push_back(((i < smaller ? lower : upper) - 1) / 2);
+    }
+    return filter;
+}
+
+AxisFilter GaussianFilter(double sigma) {
+    if (!(sigma > 0)) {
+        throw std::invalid_argument("sigma must be positive.");
+    }
+    if (std::ceil(3.0 * sigma) <= kMaxGaussianRadius) {
+        return KernelFilter(GaussianKernel(sigma));
+    }
+    return BoxFilter(sigma);
+}
+
+void WeightedSumLoop(const float *const *inputs, const float *weights,
+    int count, size_t first, size_t values, float *dst) {
+    for (size_t i = first; i < values; ++i) {
+        float sum = 0.0f;
+        for (int k = 0; k < count; ++k) {
+            sum += weights[k] * inputs[k][i];
+        }
+        dst[i] = sum;
+    }
+}
+
+void BoxStepLoop(float *sums, const float *add, const float *sub,
+    float scale, size_t first, size_t values, float *dst) {
+    for (size_t i = first; i < values; ++i) {
+        sums[i] += add[i] - sub[i];
+        dst[i] = sums[i] * scale;
+    }
+}
+
+void SharpenLoop(const float *original, float *blurred, size_t first,
+    size_t values, float amount, float threshold) {
+    for (size_t i = first; i < values; ++i) {
+        float difference = original[i] - blurred[i];
+        blurred[i] = std::fabs(difference) > threshold ?
+            original[i] + amount * difference : original[i];
+    }
+}
+
+#ifdef REE_IMAGE_SIMD_X86
+
+/// 16 samples per step in two sums, returns the samples done
+REE_TARGET("avx2")
+size_t WeightedSumAvx2(const float *const *inputs, const float *weights,
+    int count, size_t values, float *dst) {
+    size_t i = 0;
+    for (; i + 16 <= values; i += 16) {
+        __m256 low = _mm256_setzero_ps();
+        __m256 high = _mm256_setzero_ps();
+        for (int k = 0; k < count; ++k) {
+            __m256 weight = _mm256_set1_ps(weights[k]);
+            low = _mm256_add_ps(low, _mm256_mul_ps(weight,
+                _mm256_loadu_ps(inputs[k] + i)));
+            high = _mm256_add_ps(high, _mm256_mul_ps(weight,
+                _mm256_loadu_ps(inputs[k] + i + 8)));
+        }
+        _mm256_storeu_ps(dst + i, low);
+        _mm256_storeu_ps(dst + i + 8, high);
+    }
+    for (; i + 8 <= values; i += 8) {
+        __m256 sum = _mm256_setzero_ps();
+        for (int k = 0; k < count; ++k) {
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(
+                _mm256_set1_ps(weights[k]), _mm256_loadu_ps(inputs[k] + i)));
+        }
+        _mm256_storeu_ps(dst + i, sum);
+    }
+    return i;
+}
+
+REE_TARGET("avx2")
+size_t BoxStepAvx2(float *sums, const float *add, const float *sub,
+    float scale, size_t values, float *dst) {
+    const __m256 factor = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= values; i += 8) {
+        __m256 sum = _mm256_add_ps(_mm256_loadu_ps(sums + i), _mm256_sub_ps(
+            _mm256_loadu_ps(add + i), _mm256_loadu_ps(sub + i)));
+        _mm256_storeu_ps(sums + i, sum);
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(sum, factor));
+    }
+    return i;
+}
+
+REE_TARGET("avx2")
+size_t SharpenAvx2(const float *original, float *blurred, size_t values,
+    float amount, float threshold) {
+    const __m256 sign = _mm256_set1_ps(-0.0f);
+    const __m256 factor = _mm256_set1_ps(amount);
+    const __m256 limit = _mm256_set1_ps(threshold);
+    size_t i = 0;
+    for (; i + 8 <= values; i += 8) {
+        __m256 in = _mm256_loadu_ps(original + i);
+        __m256 difference = _mm256_sub_ps(in, _mm256_loadu_ps(blurred + i));
+        __m256 beyond = _mm256_cmp_ps(_mm256_andnot_ps(sign, difference),
+            limit, _CMP_GT_OQ);
+        _mm256_storeu_ps(blurred + i, _mm256_blendv_ps(in, _mm256_add_ps(in,
+            _mm256_mul_ps(factor, difference)), beyond));
+    }
+    return i;
+}
+
+/**
+ * @brief BoxRowOf for 3 and 4 components, a pixel to a vector. 3 component
+ * pixels are read and written 4 samples at a time, so the rows need a
+ * sample to spare past their end.
+ */
+REE_TARGET("ssse3")
+void BoxRowSsse3(const float *in, int pixels, int components, int radius,
+    float *out) {
+    const __m128 scale = _mm_set1_ps(1.0f / (2 * radius + 1));
+    __m128 sum = _mm_setzero_ps();
+    for (int k = 0; k <= 2 * radius; ++k) {
+        sum = _mm_add_ps(sum, _mm_loadu_ps(in + k * components));
+    }
+    _mm_storeu_ps(out, _mm_mul_ps(sum, scale));
+    const float *add = in + (2 * radius + 1) * components;
+    for (int x = 1; x < pixels; ++x) {
+        sum = _mm_add_ps(sum, _mm_sub_ps(_mm_loadu_ps(add),
+            _mm_loadu_ps(in)));
+        _mm_storeu_ps(out + x * components, _mm_mul_ps(sum, scale));
+        add += components;
+        in += components;
+    }
+}
+
+#endif
+
+/// box blur of radius along a row of pixels + 2 radius pixels into pixels
+/// pixels. The components of a pixel are summed side by side, so their
+/// running sums make one chain of vector adds.
+template <int Components>
+void BoxRowOf(const float *in, int pixels, int radius, float *out) {
+    float scale = 1.0f / (2 * radius + 1);
+    float sums[Components] = {};
+    for (int k = 0; k <= 2 * radius; ++k) {
+        for (int c = 0; c < Components; ++c) {
+            sums[c] += in[k * Components + c];
+        }
+    }
+    for (int c = 0; c < Components; ++c) {
+        out[c] = sums[c] * scale;
+    }
+    const float *add = in + (2 * radius + 1) * Components;
+    for (int x = 1; x < pixels; ++x) {
+        for (int c = 0; c < Components; ++c) {
+            sums[c] += add[c] - in[c];
+            out[x * Components + c] = sums[c] * scale;
+        }
+        add += Components;
+        in += Components;
+    }
+}
+
+void BoxRow(const float *in, int pixels, int components, int radius,
+    float *out) {
+    switch (components) {
+    case 1:
+        BoxRowOf<1>(in, pixels, radius, out);
+        break;
+    case 2:
+        BoxRowOf<2>(in, pixels, radius, out);
+        break;
+    case 3:
+        BoxRowOf<3>(in, pixels, radius, out);
+        break;
+    default:
+        BoxRowOf<4>(in, pixels, radius, out);
+        break;
+    }
+}
+
+/// the inner loops, picked once for a whole image by the SIMD level
+struct FloatKernels {
+    /// dst[i] is the sum of weights[k] * inputs[k][i] for k below count
+    void (*weightedSum)(const float *const *inputs, const float *weights,
+        int count, size_t values, float *dst);
+    /// one step of a running box sum, adding a row and taking one off
+    void (*boxStep)(float *sums, const float *add, const float *sub,
+        float scale, size_t values, float *dst);
+    /// blurred becomes the sharpened samples
+    void (*sharpen)(const float *original, float *blurred, size_t values,
+        float amount, float threshold);
+    /// box blur along a row, see BoxRowOf
+    void (*boxRow)(const float *in, int pixels, int components, int radius,
+        float *out);
+};
+
+void WeightedSum(const float *const *inputs, const float *weights,
+    int count, size_t values, float *dst) {
+    WeightedSumLoop(inputs, weights, count, 0, values, dst);
+}
+
+void BoxStep(float *sums, const float *add, const float *sub, float scale,
+    size_t values, float *dst) {
+    BoxStepLoop(sums, add, sub, scale, 0, values, dst);
+}
+
+void Sharpen(const float *original, float *blurred, size_t values,
+    float amount, float threshold) {
+    SharpenLoop(original, blurred, 0, values, amount, threshold);
+}
+
+#ifdef REE_IMAGE_SIMD_X86
+
+void WeightedSumSimd(const float *const *inputs, const float *weights,
+    int count, size_t values, float *dst) {
+    size_t done = WeightedSumAvx2(inputs, weights, count, values, dst);
+    WeightedSumLoop(inputs, weights, count, done, values, dst);
+}
+
+void BoxStepSimd(float *sums, const float *add, const float *sub,
+    float scale, size_t values, float *dst) {
+    size_t done = BoxStepAvx2(sums, add, sub, scale, values, dst);
+    BoxStepLoop(sums, add, sub, scale, done, values, dst);
+}
+
+void SharpenSimd(const float *original, float *blurred, size_t values,
+    float amount, float threshold) {
+    size_t done = SharpenAvx2(original, blurred, values, amount, threshold);
+    SharpenLoop(original, blurred, done, values, amount, threshold);
+}
+
+void BoxRowSimd(const float *in, int pixels, int components, int radius,
+    float *out) {
+    if (components >= 3) {
+        BoxRowSsse3(in, pixels, components, radius, out);
+    } else {
+        BoxRow(in, pixels, components, radius, out);
+    }
+}
+
+#endif
+
+FloatKernels FindFloatKernels() {
+    FloatKernels kernels{WeightedSum, BoxStep, Sharpen, BoxRow};
+#ifdef REE_IMAGE_SIMD_X86
+    if (ActiveSimdLevel() >= SimdLevel::Ssse3) {
+        kernels.boxRow = BoxRowSimd;
+    }
+    if (ActiveSimdLevel() >= SimdLevel::Avx2) {
+        kernels.weightedSum = WeightedSumSimd;
+        kernels.boxStep = BoxStepSimd;
+        kernels.sharpen = SharpenSimd;
+    }
+#endif
+    return kernels;
+}
+
+/**
+ * @brief a vertical pass over a stream of rows of values samples, keeping
+ * only the rows its window spans: a kernel of odd length or a box blur of
+ * radius.
+ */
+struct ColumnPass {
+    ColumnPass(const std::vector<float> *taps, int radius, size_t values)
+        : taps(taps), radius(radius), values(values),
+          window(taps ? static_cast<int>(taps->size()) : 2 * radius + 1),
+          ring(values * window), out(values),
+          sums(taps ? 0 : values, 0.0f), inputs(window) {}
+
+    const std::vector<float> *taps;
+    int radius;
+    size_t values;
+    int window;
+    /// row n of the stream in slot n % window
+    std::vector<float> ring;
+    std::vector<float> out;
+    std::vector<float> sums;
+    std::vector<const float *> inputs;
+    int rows = 0;
+};
+
+/// feed the next row to pass, returns the row this completes, or null
+/// while the window is filling
+float *Feed(ColumnPass &pass, const FloatKernels &kernels, const float *row) {
+    size_t values = pass.values;
+    float *slot = pass.ring.data() + values * (pass.rows % pass.window);
+    pass.rows++;
+    if (pass.taps) {
+        std::copy(row, row + values, slot);
+        if (pass.rows < pass.window) {
+            return nullptr;
+        }
+        for (int k = 0; k < pass.window; ++k) {
+            pass.inputs[k] = pass.ring.data() +
+                values * ((pass.rows + k) % pass.window);
+        }
+        kernels.weightedSum(pass.inputs.data(), pass.taps->data(),
+            pass.window, values, pass.out.data());
+        return pass.out.data();
+    }
+
+    // the slot holds the row leaving the window
+    float scale = 1.0f / pass.window;
+    float *done = pass.out.data();
+    if (pass.rows <= pass.window) {
+        for (size_t i = 0; i < values; ++i) {
+            pass.sums[i] += row[i];
+        }
+        if (pass.rows < pass.window) {
+            done = nullptr;
+        } else {
+            for (size_t i = 0; i < values; ++i) {
+                done[i] = pass.sums[i] * scale;
+            }
+        }
+    } else {
+        kernels.boxStep(pass.sums.data(), row, slot, scale, values, done);
+    }
+    std::copy(row, row + values, slot);
+    return done;
+}
+
+/// stores the filtered samples of the pixels [x, x + width) of row y
+using StoreFn = std::function<void(int y, int x, int width, float *row)>;
+
+/// the samples of the pixels [x0, x1) of row y of src as floats in [0, 1],
+/// those past the edges made up by border
+template <typename ValueT>
+void LoadRow(const ImageView<const ValueT> &src, int y, int x0, int x1,
+    BorderMode border, float *out) {
+    int components = src.Components();
+    uint8_t depth = src.DepthBits();
+    const ValueT *row = src.Row(BorderIndex(y, src.Height(), border));
+    int first = std::max(x0, 0);
+    int last = std::min(x1, src.Width());
+    ConvertSamples(row + first * components, depth,
+        out + (first - x0) * components, depth,
+        static_cast<size_t>(last - first) * components);
+    auto edge = [&](int x) {
+        ConvertSamples(row + BorderIndex(x, src.Width(), border) * components,
+            depth, out + (x - x0) * components, depth, components);
+    };
+    for (int x = x0; x < first; ++x) {
+        edge(x);
+    }
+    for (int x = last; x < x1; ++x) {
+        edge(x);
+    }
+}
+
+/**
+ * @brief run horizontal then vertical over the tile of width x height
+ * pixels at x, y, handing its rows to store. Rows stream through the
+ * tile top to bottom, each filtered along once, so box blurs cost the same
+ * for any radius.
+ */
+template <typename ValueT>
+void FilterTile(const ImageView<const ValueT> &src,
+    const AxisFilter &horizontal, const AxisFilter &vertical,
+    BorderMode border, const FloatKernels &kernels, int x, int y, int width,
+    int height, const StoreFn &store) {
+    int components = src.Components();
+    int hReach = horizontal.Reach();
+    int vReach = vertical.Reach();
+    size_t values = static_cast<size_t>(width) * components;
+    size_t lineValues = static_cast<size_t>(width + 2 * hReach) * components;
+    // a sample to spare past every row for BoxRowSsse3
+    std::vector<float> line(lineValues + 1);
+    std::vector<float> spare(horizontal.boxes.empty() ? 0 : lineValues + 1);
+    std::vector<float> filtered(values + 1);
+    std::vector<const float *> inputs(horizontal.taps.size());
+    std::vector<ColumnPass> passes;
+    if (vertical.boxes.empty()) {
+        passes.emplace_back(&vertical.taps, 0, values);
+    }
+    for (int radius : vertical.boxes) {
+        passes.emplace_back(nullptr, radius, values);
+    }
+
+    for (int r = y - vReach; r < y + height + vReach; ++r) {
+        LoadRow(src, r, x - hReach, x + width + hReach, border, line.data());
+        if (horizontal.boxes.empty()) {
+            for (size_t k = 0; k < horizontal.taps.size(); ++k) {
+                inputs[k] = line.data() + k * components;
+            }
+            kernels.weightedSum(inputs.data(), horizontal.taps.data(),
+                static_cast<int>(horizontal.taps.size()), values,
+                filtered.data());
+        } else {
+            float *from = line.data();
+            float *to = spare.data();
+            int pixels = width + 2 * hReach;
+            for (size_t i = 0; i < horizontal.boxes.size(); ++i) {
+                pixels -= 2 * horizontal.boxes[i];
+                kernels.boxRow(from, pixels, components, horizontal.boxes[i],
+                    i + 1 == horizontal.boxes.size() ? filtered.data() : to);
+                std::swap(from, to);
+            }
+        }
+
+        float *row = filtered.data();
+        for (auto &pass : passes) {
+            row = row ? Feed(pass, kernels, row) : nullptr;
+        }
+        if (row) {
+            // the rows out lag the rows in by the reach
+            store(r - vReach, x, width, row);
+        }
+    }
+}
+
+/// the size x size kernel over the tile of width x height pixels at x, y,
+/// keeping the last size rows
+template <typename ValueT>
+void ConvolveTile(const ImageView<const ValueT> &src,
+    const std::vector<float> &kernel, int size, BorderMode border,
+    const FloatKernels &kernels, int x, int y, int width, int height,
+    const StoreFn &store) {
+    int components = src.Components();
+    int radius = size / 2;
+    size_t values = static_cast<size_t>(width) * components;
+    size_t lineValues = static_cast<size_t>(width + 2 * radius) * components;
+    std::vector<float> lines(lineValues * size);
+    std::vector<float> out(values);
+    std::vector<const float *> inputs(kernel.size());
+    for (int n = 0; n < height + 2 * radius; ++n) {
+        LoadRow(src, y - radius + n, x - radius, x + width + radius, border,
+            lines.data() + lineValues * (n % size));
+        if (n + 1 < size) {
+            continue;
+        }
+        for (int ky = 0; ky < size; ++ky) {
+            const float *line = lines.data() +
+                lineValues * ((n + 1 + ky) % size);
+            for (int kx = 0; kx < size; ++kx) {
+                inputs[ky * size + kx] = line + kx * components;
+            }
+        }
+        kernels.weightedSum(inputs.data(), kernel.data(),
+            static_cast<int>(kernel.size()), values, out.data());
+        store(y + n + 1 - size, x, width, out.data());
+    }
+}
+
+/**
+ * @brief fn(x, y, width, height) for tiles covering an image of width x
+ * height pixels, run in parallel. Tiles are at least twice the reach
+ * wide and four times as tall, so the pixels read past them stay few.
+ */
+void ForTiles(ThreadPool &pool, int width, int height, int reach,
+    const std::function<void(int, int, int, int)> &fn) {
+    int tileWidth = std::min(width, std::max(kTileWidth, 2 * reach));
+    int tileHeight = std::min(height, std::max(kTileHeight, 4 * reach));
+    int across = (width + tileWidth - 1) / tileWidth;
+    int down = (height + tileHeight - 1) / tileHeight;
+    pool.ParallelFor(static_cast<size_t>(across) * down, [&](size_t tile) {
+        int x = static_cast<int>(tile % across) * tileWidth;
+        int y = static_cast<int>(tile / across) * tileHeight;
+        fn(x, y, std::min(tileWidth, width - x),
+            std::min(tileHeight, height - y));
+    });
+}
+
+template <typename ValueT>
+void CheckViews(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst) {
+    if (src.Width() != dst.Width() || src.Height() != dst.Height() ||
+        src.ColorSpace() != dst.ColorSpace()) {
+        throw std::invalid_argument("images to filter differ in size or "
+            "color space.");
+    }
+}
+
+/// rows rounded back into dst
+template <typename ValueT>
+StoreFn StoreInto(const ImageView<ValueT> &dst) {
+    return [dst](int y, int x, int width, float *row) {
+        ConvertSamples(row, 0, dst.Pixel(x, y), dst.DepthBits(),
+            static_cast<size_t>(width) * dst.Components());
+    };
+}
+
+template <typename ValueT>
+void FilterSeparable(const ImageView<const ValueT> &src,
+    const AxisFilter &horizontal, const AxisFilter &vertical,
+    BorderMode border, ThreadPool *pool, const FloatKernels &kernels,
+    const StoreFn &store) {
+    if (src.Empty()) {
+        return;
+    }
+    ThreadPool &threads = pool ? *pool : ThreadPool::Shared();
+    ForTiles(threads, src.Width(), src.Height(),
+        std::max(horizontal.Reach(), vertical.Reach()),
+        [&](int x, int y, int width, int height) {
+        FilterTile(src, horizontal, vertical, border, kernels, x, y, width,
+            height, store);
+    });
+}
+
+}
+
+std::vector<float> GaussianKernel(double sigma) {
+    if (!(sigma > 0)) {
+        throw std::invalid_argument("sigma must be positive.");
+    }
+    int radius = std::max(static_cast<int>(std::ceil(3.0 * sigma)), 1);
+    std::vector<double> weights(2 * radius + 1);
+    double total = 0;
+    for (int k = -radius; k <= radius; ++k) {
+        weights[k + radius] = std::exp(-k * k / (2.0 * sigma * sigma));
+        total += weights[k + radius];
+    }
+    std::vector<float> kernel(weights.size());
+    for (size_t k = 0; k < weights.size(); ++k) {
+        kernel[k] = static_cast<float>(weights[k] / total);
+    }
+    return kernel;
+}
+
+template <typename ValueT>
+void ConvolveSeparable(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst, const std::vector<float> &horizontal,
+    const std::vector<float> &vertical, BorderMode border, ThreadPool *pool) {
+    CheckViews(src, dst);
+    FilterSeparable(src, KernelFilter(horizontal), KernelFilter(vertical),
+        border, pool, FindFloatKernels(), StoreInto(dst));
+}
+
+template <typename ValueT>
+void Convolve(const ImageView<const ValueT> &src, const ImageView<ValueT> &dst,
+    const std::vector<float> &kernel, int size, BorderMode border,
+    ThreadPool *pool) {
+    CheckViews(src, dst);
+    if (size % 2 == 0 || kernel.size() != static_cast<size_t>(size) * size) {
+        throw std::invalid_argument("kernels must be size x size with size "
+            "odd.");
+    }
+    if (src.Empty()) {
+        return;
+    }
+    ThreadPool &threads = pool ? *pool : ThreadPool::Shared();
+    FloatKernels kernels = FindFloatKernels();
+    StoreFn store = StoreInto(dst);
+    ForTiles(threads, src.Width(), src.Height(), size / 2,
+        [&](int x, int y, int width, int height) {
+        ConvolveTile(src, kernel, size, border, kernels, x, y, width, height,
+            store);
+    });
+}
+
+template <typename ValueT>
+void GaussianBlur(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst, double sigma, BorderMode border,
+    ThreadPool *pool) {
+    CheckViews(src, dst);
+    AxisFilter filter = GaussianFilter(sigma);
+    FilterSeparable(src, filter, filter, border, pool, FindFloatKernels(),
+        StoreInto(dst));
+}
+
+template <typename ValueT>
+void UnsharpMask(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst, double sigma, float amount,
+    float threshold, ThreadPool *pool) {
+    CheckViews(src, dst);
+    if (src.Empty()) {
+        return;
+    }
+    AxisFilter filter = GaussianFilter(sigma);
+    ThreadPool &threads = pool ? *pool : ThreadPool::Shared();
+    FloatKernels kernels = FindFloatKernels();
+    StoreFn store = StoreInto(dst);
+    int components = src.Components();
+    ForTiles(threads, src.Width(), src.Height(), filter.Reach(),
+        [&](int x, int y, int width, int height) {
+        // the rows of a tile are all width wide, they share one buffer
+        size_t values = static_cast<size_t>(width) * components;
+        std::vector<float> original(values);
+        FilterTile(src, filter, filter, BorderMode::Clamp, kernels, x, y,
+            width, height, [&](int ry, int rx, int, float *row) {
+            ConvertSamples(src.Pixel(rx, ry), src.DepthBits(),
+                original.data(), 0, values);
+            kernels.sharpen(original.data(), row, values, amount, threshold);
+            store(ry, rx, width, row);
+        });
+    });
+}
+
+#define REE_IMAGE_CONVOLVE(ValueT) \
+    template void ConvolveSeparable<ValueT>( \
+        const ImageView<const ValueT> &src, const ImageView<ValueT> &dst, \
+        const std::vector<float> &horizontal, \
+        const std::vector<float> &vertical, BorderMode border, \
+        ThreadPool *pool); \
+    template void Convolve<ValueT>(const ImageView<const ValueT> &src, \
+        const ImageView<ValueT> &dst, const std::vector<float> &kernel, \
+        int size, BorderMode border, ThreadPool *pool); \
+    template void GaussianBlur<ValueT>(const ImageView<const ValueT> &src, \
+        const ImageView<ValueT> &dst, double sigma, BorderMode border, \
+        ThreadPool *pool); \
+    template void UnsharpMask<ValueT>(const ImageView<const ValueT> &src, \
+        const ImageView<ValueT> &dst, double sigma, float amount, \
+        float threshold, ThreadPool *pool);
+
+REE_IMAGE_CONVOLVE(uint8_t)
+REE_IMAGE_CONVOLVE(uint16_t)
+REE_IMAGE_CONVOLVE(float)
+
+#undef REE_IMAGE_CONVOLVE
+
+}
+}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+#include <ree/image/image_view.hpp>
+#include <ree/image/thread_pool.hpp>
+
+namespace ree {
+namespace image {
+namespace process {
+
+/// how the pixels past the edges of an image are made up
+enum class BorderMode {
+    /// the edge pixel repeated
+    Clamp,
+    /// the pixels mirrored about the edge one, which is not repeated
+    Mirror,
+};
+
+/**
+ * @brief filter src into dst, of the same size and color space, with
+ * horizontal along the rows then vertical along the columns. Both kernels
+ * have odd lengths and are centered, e.g. {0.25, 0.5, 0.25}.
+ *
+ * Samples are filtered as floats in [0, 1] and rounded back, alpha like the
+ * others. The image is split into tiles run in parallel, whose rows in
+ * between stay in L2. The inner loops take AVX2 where the CPU has it,
+ * which gives what the scalar loops give up to float rounding. src and dst
+ * must not overlap.
+ */
+template <typename ValueT>
+void ConvolveSeparable(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst, const std::vector<float> &horizontal,
+    const std::vector<float> &vertical, BorderMode border = BorderMode::Clamp,
+    ThreadPool *pool = nullptr);
+
+/// filter with a size x size kernel, row major with size odd, which costs
+/// size^2 per sample so suits small kernels, e.g. 3x3 edge detection
+template <typename ValueT>
+void Convolve(const ImageView<const ValueT> &src, const ImageView<ValueT> &dst,
+    const std::vector<float> &kernel, int size,
+    BorderMode border = BorderMode::Clamp, ThreadPool *pool = nullptr);
+
+/// the gaussian of sigma sampled over 3 sigma to each side, summing to 1
+std::vector<float> GaussianKernel(double sigma);
+
+/**
+ * @brief gaussian blur of src into dst. Small sigmas convolve with
+ * GaussianKernel, larger ones run three box blurs along each axis, whose
+ * cost does not grow with sigma.
+ */
+template <typename ValueT>
+void GaussianBlur(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst, double sigma,
+    BorderMode border = BorderMode::Clamp, ThreadPool *pool = nullptr);
+
+/**
+ * @brief sharpen src into dst as src + amount * (src - blurred), blurred by
+ * GaussianBlur with sigma, where the two differ by more than threshold, a
+ * fraction of the largest sample.
+ */
+template <typename ValueT>
+void UnsharpMask(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst, double sigma, float amount,
+    float threshold = 0.0f, ThreadPool *pool = nullptr);
+
+}
+}
+}
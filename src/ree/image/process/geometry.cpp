@@ -0,0 +1,554 @@
+#include "geometry.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <ree/image/simd.hpp>
+
+#ifdef REE_IMAGE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace ree {
+namespace image {
+namespace process {
+
+namespace {
+
+/// rows of pixels a thread flips at a time
+constexpr int kBand = 16;
+/// bytes of each row of the destination a band of a transpose writes, a
+/// cache line, while taller bands miss the TLB more than they save
+constexpr size_t kLineRun = 64;
+
+/// pixels across a tile of a transpose, whose source and destination stay
+/// in L1 together
+int TileWidth(size_t pixelBytes) {
+    return pixelBytes <= 4 ? 64 : 32;
+}
+
+/// rows of the source a thread transposes at a time
+int BandHeight(size_t pixelBytes) {
+    int rows = static_cast<int>((kLineRun + pixelBytes - 1) / pixelBytes);
+    return std::max((rows + 15) / 16 * 16, 16);
+}
+
+/// the pixels of an image as bytes, whatever they hold
+struct Pixels {
+    uint8_t *data;
+    ptrdiff_t stride;
+    int width;
+    int height;
+    size_t pixelBytes;
+
+    uint8_t *At(int x, int y) const {
+        return data + y * stride + x * static_cast<ptrdiff_t>(pixelBytes);
+    }
+};
+
+template <typename ValueT>
+Pixels PixelsOf(const ImageView<ValueT> &view) {
+    return {reinterpret_cast<uint8_t *>(const_cast<
+        typename std::remove_const<ValueT>::type *>(view.Data())),
+        static_cast<ptrdiff_t>(view.Stride()), view.Width(), view.Height(),
+        view.Components() * sizeof(ValueT)};
+}
+
+/// pixel (x, y) of the rows x cols block at src to (y, x) of the block at
+/// dst, strides in bytes and either of them negative to run upwards
+using TransposeLoopFn = void (*)(const uint8_t *src, ptrdiff_t srcStride,
+    int rows, int cols, uint8_t *dst, ptrdiff_t dstStride);
+/// the same for a whole block of the size of the kernel
+using TransposeBlockFn = void (*)(const uint8_t *src, ptrdiff_t srcStride,
+    uint8_t *dst, ptrdiff_t dstStride);
+/// pixel i of a row of width pixels at src to pixel width - 1 - i at dst,
+/// returning how many pixels it did from the start of dst
+using ReverseFn = int (*)(const uint8_t *src, uint8_t *dst, int width);
+/// reverse a row in place, returning how many pixels it swapped at each end
+using ReverseInPlaceFn = int (*)(uint8_t *row, int width);
+
+template <size_t PixelBytes>
+void TransposeLoop(const uint8_t *src, ptrdiff_t srcStride, int rows,
+    int cols, uint8_t *dst, ptrdiff_t dstStride) {
+    for (int x = 0; x < cols; ++x) {
+        const uint8_t *in = src + x * PixelBytes;
+        uint8_t *out = dst + x * dstStride;
+        for (int y = 0; y < rows; ++y) {
+            std::memcpy(out + y * PixelBytes, in + y * srcStride, PixelBytes);
+        }
+    }
+}
+
+template <size_t PixelBytes>
+void ReverseLoop(const uint8_t *src, uint8_t *dst, int first, int width) {
+    for (int i = first; i < width; ++i) {
+        std::memcpy(dst + i * PixelBytes, src + (width - 1 - i) * PixelBytes,
+            PixelBytes);
+    }
+}
+
+template <size_t PixelBytes>
+void ReverseInPlaceLoop(uint8_t *row, int first, int width) {
+    uint8_t pixel[PixelBytes];
+    for (int i = first, j = width - 1 - first; i < j; ++i, --j) {
+        std::memcpy(pixel, row + i * PixelBytes, PixelBytes);
+        std::memcpy(row + i * PixelBytes, row + j * PixelBytes, PixelBytes);
+        std::memcpy(row + j * PixelBytes, pixel, PixelBytes);
+    }
+}
+
+template <size_t PixelBytes>
+int ReverseScalar(const uint8_t *, uint8_t *, int) {
+    return 0;
+}
+
+template <size_t PixelBytes>
+int ReverseInPlaceScalar(uint8_t *, int) {
+    return 0;
+}
+
+#ifdef REE_IMAGE_SIMD_X86
+
+template <size_t Bytes>
+REE_TARGET("ssse3")
+__m128i UnpackLo(__m128i a, __m128i b) {
+    switch (Bytes) {
+    case 1: return _mm_unpacklo_epi8(a, b);
+    case 2: return _mm_unpacklo_epi16(a, b);
+    case 4: return _mm_unpacklo_epi32(a, b);
+    default: return _mm_unpacklo_epi64(a, b);
+    }
+}
+
+template <size_t Bytes>
+REE_TARGET("ssse3")
+__m128i UnpackHi(__m128i a, __m128i b) {
+    switch (Bytes) {
+    case 1: return _mm_unpackhi_epi8(a, b);
+    case 2: return _mm_unpackhi_epi16(a, b);
+    case 4: return _mm_unpackhi_epi32(a, b);
+    default: return _mm_unpackhi_epi64(a, b);
+    }
+}
+
+/// a block of one register of pixels per row: interleaving the first half
+/// of the rows with the second log2(rows) times leaves the columns
+template <size_t PixelBytes>
+REE_TARGET("ssse3")
+void TransposeSsse3(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst,
+    ptrdiff_t dstStride) {
+    constexpr int n = 16 / PixelBytes;
+    __m128i rows[n];
+    __m128i next[n];
+    for (int i = 0; i < n; ++i) {
+        rows[i] = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(src + i * srcStride));
+    }
+    for (int step = 1; step < n; step *= 2) {
+        for (int i = 0; i < n / 2; ++i) {
+            next[2 * i] = UnpackLo<PixelBytes>(rows[i], rows[i + n / 2]);
+            next[2 * i + 1] = UnpackHi<PixelBytes>(rows[i], rows[i + n / 2]);
+        }
+        std::copy(next, next + n, rows);
+    }
+    for (int i = 0; i < n; ++i) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * dstStride),
+            rows[i]);
+    }
+}
+
+/// 8x8 pixels of 4 bytes
+REE_TARGET("avx2")
+void Transpose32Avx2(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst,
+    ptrdiff_t dstStride) {
+    __m256 r[8];
+    for (int i = 0; i < 8; ++i) {
+        r[i] = _mm256_loadu_ps(reinterpret_cast<const float *>(
+            src + i * srcStride));
+    }
+    __m256 t[8];
+    for (int i = 0; i < 4; ++i) {
+        t[2 * i] = _mm256_unpacklo_ps(r[2 * i], r[2 * i + 1]);
+        t[2 * i + 1] = _mm256_unpackhi_ps(r[2 * i], r[2 * i + 1]);
+    }
+    for (int i = 0; i < 2; ++i) {
+        r[4 * i] = _mm256_shuffle_ps(t[4 * i], t[4 * i + 2], 0x44);
+        r[4 * i + 1] = _mm256_shuffle_ps(t[4 * i], t[4 * i + 2], 0xee);
+        r[4 * i + 2] = _mm256_shuffle_ps(t[4 * i + 1], t[4 * i + 3], 0x44);
+        r[4 * i + 3] = _mm256_shuffle_ps(t[4 * i + 1], t[4 * i + 3], 0xee);
+    }
+    for (int i = 0; i < 4; ++i) {
+        _mm256_storeu_ps(reinterpret_cast<float *>(dst + i * dstStride),
+            _mm256_permute2f128_ps(r[i], r[i + 4], 0x20));
+        _mm256_storeu_ps(reinterpret_cast<float *>(dst + (i + 4) * dstStride),
+            _mm256_permute2f128_ps(r[i], r[i + 4], 0x31));
+    }
+}
+
+/// 4x4 pixels of 8 bytes
+REE_TARGET("avx2")
+void Transpose64Avx2(const uint8_t *src, ptrdiff_t srcStride, uint8_t *dst,
+    ptrdiff_t dstStride) {
+    __m256i r[4];
+    for (int i = 0; i < 4; ++i) {
+        r[i] = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i *>(src + i * srcStride));
+    }
+    __m256i t0 = _mm256_unpacklo_epi64(r[0], r[1]);
+    __m256i t1 = _mm256_unpackhi_epi64(r[0], r[1]);
+    __m256i t2 = _mm256_unpacklo_epi64(r[2], r[3]);
+    __m256i t3 = _mm256_unpackhi_epi64(r[2], r[3]);
+    __m256i columns[4] = {_mm256_permute2x128_si256(t0, t2, 0x20),
+        _mm256_permute2x128_si256(t1, t3, 0x20),
+        _mm256_permute2x128_si256(t0, t2, 0x31),
+        _mm256_permute2x128_si256(t1, t3, 0x31)};
+    for (int i = 0; i < 4; ++i) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * dstStride),
+            columns[i]);
+    }
+}
+
+/// the shuffle that reverses the order of the pixels in a register
+template <size_t PixelBytes>
+REE_TARGET("ssse3")
+__m128i ReverseMask() {
+    alignas(16) uint8_t mask[16];
+    for (size_t j = 0; j < 16; ++j) {
+        mask[j] = static_cast<uint8_t>(
+            (16 / PixelBytes - 1 - j / PixelBytes) * PixelBytes +
+            j % PixelBytes);
+    }
+    return _mm_load_si128(reinterpret_cast<const __m128i *>(mask));
+}
+
+template <size_t PixelBytes>
+REE_TARGET("ssse3")
+int ReverseSsse3(const uint8_t *src, uint8_t *dst, int width) {
+    __m128i mask = ReverseMask<PixelBytes>();
+    ptrdiff_t bytes = static_cast<ptrdiff_t>(width) * PixelBytes;
+    ptrdiff_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        __m128i v = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(src + bytes - i - 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+            _mm_shuffle_epi8(v, mask));
+    }
+    return static_cast<int>(i / static_cast<ptrdiff_t>(PixelBytes));
+}
+
+template <size_t PixelBytes>
+REE_TARGET("ssse3")
+int ReverseInPlaceSsse3(uint8_t *row, int width) {
+    __m128i mask = ReverseMask<PixelBytes>();
+    ptrdiff_t left = 0;
+    ptrdiff_t right = static_cast<ptrdiff_t>(width) * PixelBytes;
+    for (; right - left >= 32; left += 16, right -= 16) {
+        __m128i a = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(row + left));
+        __m128i b = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(row + right - 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(row + left),
+            _mm_shuffle_epi8(b, mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(row + right - 16),
+            _mm_shuffle_epi8(a, mask));
+    }
+    return static_cast<int>(left / static_cast<ptrdiff_t>(PixelBytes));
+}
+
+#endif
+
+/// the kernels for pixels of a size, picked once per image
+struct GeometryKernels {
+    TransposeLoopFn transposeLoop;
+    /// null where no registers fit the pixels
+    TransposeBlockFn transposeBlock;
+    /// pixels across and down what transposeBlock takes, which tiles are
+    /// multiples of
+    int block;
+    ReverseFn reverse;
+    ReverseInPlaceFn reverseInPlace;
+    void (*reverseLoop)(const uint8_t *src, uint8_t *dst, int first,
+        int width);
+    void (*reverseInPlaceLoop)(uint8_t *row, int first, int width);
+};
+
+template <size_t PixelBytes>
+GeometryKernels KernelsOf() {
+    GeometryKernels kernels = {TransposeLoop<PixelBytes>, nullptr, 16,
+        ReverseScalar<PixelBytes>, ReverseInPlaceScalar<PixelBytes>,
+        ReverseLoop<PixelBytes>, ReverseInPlaceLoop<PixelBytes>};
+#ifdef REE_IMAGE_SIMD_X86
+    constexpr bool fits = PixelBytes < 16 && 16 % PixelBytes == 0;
+    if (fits && ActiveSimdLevel() >= SimdLevel::Ssse3) {
+        constexpr size_t bytes = fits ? PixelBytes : 1;
+        kernels.transposeBlock = TransposeSsse3<bytes>;
+        kernels.block = 16 / bytes;
+        kernels.reverse = ReverseSsse3<bytes>;
+        kernels.reverseInPlace = ReverseInPlaceSsse3<bytes>;
+    }
+    if (ActiveSimdLevel() >= SimdLevel::Avx2) {
+        if (PixelBytes == 4) {
+            kernels.transposeBlock = Transpose32Avx2;
+            kernels.block = 8;
+        } else if (PixelBytes == 8) {
+            kernels.transposeBlock = Transpose64Avx2;
+            kernels.block = 4;
+        }
+    }
+#endif
+    return kernels;
+}
+
+GeometryKernels FindGeometryKernels(size_t pixelBytes) {
+    switch (pixelBytes) {
+    case 1: return KernelsOf<1>();
+    case 2: return KernelsOf<2>();
+    case 3: return KernelsOf<3>();
+    case 4: return KernelsOf<4>();
+    case 6: return KernelsOf<6>();
+    case 8: return KernelsOf<8>();
+    case 12: return KernelsOf<12>();
+    case 16: return KernelsOf<16>();
+    }
+    throw std::invalid_argument("unsupported pixel size.");
+}
+
+/// transpose the rows x cols block at src to dst, whole blocks through the
+/// kernel and the ones cut by the edges pixel by pixel
+void TransposeBlock(const GeometryKernels &kernels, const uint8_t *src,
+    ptrdiff_t srcStride, int rows, int cols, uint8_t *dst,
+    ptrdiff_t dstStride) {
+    if (kernels.transposeBlock && rows == kernels.block &&
+        cols == kernels.block) {
+        kernels.transposeBlock(src, srcStride, dst, dstStride);
+    } else {
+        kernels.transposeLoop(src, srcStride, rows, cols, dst, dstStride);
+    }
+}
+
+/// the rows of src from first on of a transform that swaps the axes, tile
+/// by tile. Rotate90 and Transverse read the columns from the bottom up,
+/// Rotate270 and Transverse write the rows of dst from the bottom up.
+void TransposeRows(const Pixels &src, const Pixels &dst, Transform t,
+    const GeometryKernels &kernels, int first, int rows) {
+    bool bottomUp = t == Transform::Rotate90 || t == Transform::Transverse;
+    bool lastRowFirst = t == Transform::Rotate270 ||
+        t == Transform::Transverse;
+    ptrdiff_t srcStride = bottomUp ? -src.stride : src.stride;
+    ptrdiff_t dstStride = lastRowFirst ? -dst.stride : dst.stride;
+    int tile = TileWidth(src.pixelBytes);
+    int block = kernels.block;
+    for (int tileX = 0; tileX < src.width; tileX += tile) {
+        int tileEnd = std::min(tileX + tile, src.width);
+        for (int y = first; y < first + rows; y += block) {
+            int height = std::min(block, first + rows - y);
+            const uint8_t *in = src.At(0, bottomUp ? y + height - 1 : y);
+            int dstX = bottomUp ? src.height - y - height : y;
+            for (int x = tileX; x < tileEnd; x += block) {
+                int width = std::min(block, tileEnd - x);
+                TransposeBlock(kernels, in + x * src.pixelBytes, srcStride,
+                    height, width,
+                    dst.At(dstX, lastRowFirst ? src.width - 1 - x : x),
+                    dstStride);
+            }
+        }
+    }
+}
+
+/// row y of dst from src, as a transform that keeps the axes leaves it
+void MirrorRow(const Pixels &src, const Pixels &dst, Transform t,
+    const GeometryKernels &kernels, int y) {
+    int from = t == Transform::FlipHorizontal ? y : src.height - 1 - y;
+    if (t == Transform::FlipVertical) {
+        std::memcpy(dst.At(0, y), src.At(0, from), src.width * src.pixelBytes);
+        return;
+    }
+    int done = kernels.reverse(src.At(0, from), dst.At(0, y), src.width);
+    kernels.reverseLoop(src.At(0, from), dst.At(0, y), done, src.width);
+}
+
+void ReverseInPlace(const GeometryKernels &kernels, uint8_t *row, int width) {
+    int done = kernels.reverseInPlace(row, width);
+    kernels.reverseInPlaceLoop(row, done, width);
+}
+
+/// swap rows y and its mirror, reversed too for Rotate180
+void MirrorRowsInPlace(const Pixels &image, Transform t,
+    const GeometryKernels &kernels, int y, std::vector<uint8_t> &buffer) {
+    int other = image.height - 1 - y;
+    size_t bytes = image.width * image.pixelBytes;
+    if (t == Transform::FlipVertical && y == other) {
+        return;
+    }
+    if (t == Transform::FlipHorizontal || y == other) {
+        ReverseInPlace(kernels, image.At(0, y), image.width);
+        if (t == Transform::FlipHorizontal && y != other) {
+            ReverseInPlace(kernels, image.At(0, other), image.width);
+        }
+        return;
+    }
+    if (t == Transform::FlipVertical) {
+        std::swap_ranges(image.At(0, y), image.At(0, y) + bytes,
+            image.At(0, other));
+        return;
+    }
+    buffer.resize(bytes);
+    std::memcpy(buffer.data(), image.At(0, y), bytes);
+    int done = kernels.reverse(image.At(0, other), image.At(0, y),
+        image.width);
+    kernels.reverseLoop(image.At(0, other), image.At(0, y), done,
+        image.width);
+    done = kernels.reverse(buffer.data(), image.At(0, other), image.width);
+    kernels.reverseLoop(buffer.data(), image.At(0, other), done, image.width);
+}
+
+/// flip or rotate by 180 in place, the pairs of rows in parallel
+void MirrorInPlace(const Pixels &image, Transform t, ThreadPool &pool) {
+    GeometryKernels kernels = FindGeometryKernels(image.pixelBytes);
+    int pairs = (image.height + 1) / 2;
+    pool.ParallelFor((pairs + kBand - 1) / kBand, [&](size_t band) {
+        std::vector<uint8_t> buffer;
+        int first = static_cast<int>(band) * kBand;
+        for (int y = first; y < std::min(first + kBand, pairs); ++y) {
+            MirrorRowsInPlace(image, t, kernels, y, buffer);
+        }
+    });
+}
+
+/// transpose a square image in place, swapping the blocks on either side
+/// of the diagonal through buffers. Thread i takes block rows i and
+/// n - 1 - i, which together hold as many blocks as any other pair.
+void TransposeInPlace(const Pixels &image, ThreadPool &pool) {
+    GeometryKernels kernels = FindGeometryKernels(image.pixelBytes);
+    int block = kernels.block;
+    int blocks = (image.width + block - 1) / block;
+    ptrdiff_t pitch = block * image.pixelBytes;
+    auto sizeOf = [&](int i) {
+        return std::min(block, image.width - i * block);
+    };
+    pool.ParallelFor((blocks + 1) / 2, [&](size_t pair) {
+        std::vector<uint8_t> upper(block * pitch);
+        std::vector<uint8_t> lower(block * pitch);
+        int ends[] = {static_cast<int>(pair),
+            blocks - 1 - static_cast<int>(pair)};
+        for (int k = 0; k < (ends[0] == ends[1] ? 1 : 2); ++k) {
+            int i = ends[k];
+            for (int j = i; j < blocks; ++j) {
+                uint8_t *a = image.At(j * block, i * block);
+                uint8_t *b = image.At(i * block, j * block);
+                int rows = sizeOf(i);
+                int cols = sizeOf(j);
+                for (int y = 0; y < rows; ++y) {
+                    std::memcpy(upper.data() + y * pitch, a + y * image.stride,
+                        cols * image.pixelBytes);
+                }
+                if (i != j) {
+                    for (int y = 0; y < cols; ++y) {
+                        std::memcpy(lower.data() + y * pitch,
+                            b + y * image.stride, rows * image.pixelBytes);
+                    }
+                    TransposeBlock(kernels, lower.data(), pitch, cols, rows,
+                        a, image.stride);
+                }
+                TransposeBlock(kernels, upper.data(), pitch, rows, cols, b,
+                    image.stride);
+            }
+        }
+    });
+}
+
+}
+
+bool SwapsDimensions(Transform t) {
+    return t == Transform::Rotate90 || t == Transform::Rotate270 ||
+        t == Transform::Transpose || t == Transform::Transverse;
+}
+
+template <typename ValueT>
+void ApplyTransform(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst, Transform t, ThreadPool *pool) {
+    bool swaps = SwapsDimensions(t);
+    if (src.ColorSpace() != dst.ColorSpace() ||
+        dst.Width() != (swaps ? src.Height() : src.Width()) ||
+        dst.Height() != (swaps ? src.Width() : src.Height())) {
+        throw std::invalid_argument("the destination differs in color space "
+            "or in size from the transformed image.");
+    }
+    if (src.Empty()) {
+        return;
+    }
+    ThreadPool &threads = pool ? *pool : ThreadPool::Shared();
+    Pixels from = PixelsOf(src);
+    Pixels to = PixelsOf(dst);
+    GeometryKernels kernels = FindGeometryKernels(from.pixelBytes);
+    if (!swaps) {
+        threads.ParallelFor((from.height + kBand - 1) / kBand,
+            [&](size_t band) {
+            int first = static_cast<int>(band) * kBand;
+            for (int y = first; y < std::min(first + kBand, from.height);
+                ++y) {
+                MirrorRow(from, to, t, kernels, y);
+            }
+        });
+        return;
+    }
+    int rows = BandHeight(from.pixelBytes);
+    threads.ParallelFor((from.height + rows - 1) / rows, [&](size_t band) {
+        int first = static_cast<int>(band) * rows;
+        TransposeRows(from, to, t, kernels, first,
+            std::min(rows, from.height - first));
+    });
+}
+
+template <typename ValueT>
+void ApplyTransformInPlace(const ImageView<ValueT> &image, Transform t,
+    ThreadPool *pool) {
+    if (SwapsDimensions(t) && image.Width() != image.Height()) {
+        throw std::invalid_argument("only square images can be rotated or "
+            "transposed in place.");
+    }
+    if (image.Empty()) {
+        return;
+    }
+    ThreadPool &threads = pool ? *pool : ThreadPool::Shared();
+    Pixels pixels = PixelsOf(image);
+    if (!SwapsDimensions(t)) {
+        MirrorInPlace(pixels, t, threads);
+        return;
+    }
+    // the rotations are the transpose mirrored
+    TransposeInPlace(pixels, threads);
+    switch (t) {
+    case Transform::Rotate90:
+        MirrorInPlace(pixels, Transform::FlipHorizontal, threads);
+        break;
+    case Transform::Rotate270:
+        MirrorInPlace(pixels, Transform::FlipVertical, threads);
+        break;
+    case Transform::Transverse:
+        MirrorInPlace(pixels, Transform::Rotate180, threads);
+        break;
+    default:
+        break;
+    }
+}
+
+#define REE_IMAGE_GEOMETRY(ValueT) \
+    template void ApplyTransform<ValueT>(const ImageView<const ValueT> &src, \
+        const ImageView<ValueT> &dst, Transform t, ThreadPool *pool); \
+    template void ApplyTransformInPlace<ValueT>( \
+        const ImageView<ValueT> &image, Transform t, ThreadPool *pool);
+
+REE_IMAGE_GEOMETRY(uint8_t)
+REE_IMAGE_GEOMETRY(uint16_t)
+REE_IMAGE_GEOMETRY(float)
+
+#undef REE_IMAGE_GEOMETRY
+
+}
+}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <ree/image/image_view.hpp>
+#include <ree/image/thread_pool.hpp>
+
+namespace ree {
+namespace image {
+namespace process {
+
+/// the ways ApplyTransform moves pixels around
+enum class Transform {
+    /// left and right swapped
+    FlipHorizontal,
+    /// top and bottom swapped
+    FlipVertical,
+    /// clockwise
+    Rotate90,
+    Rotate180,
+    Rotate270,
+    /// mirrored about the diagonal from the top left corner
+    Transpose,
+    /// mirrored about the diagonal from the top right corner
+    Transverse,
+};
+
+/// whether t turns the width into the height
+bool SwapsDimensions(Transform t);
+
+/**
+ * @brief write src moved as t tells into dst, of the same color space and
+ * of the size of the result. src and dst must not overlap.
+ *
+ * Transforms which swap the dimensions go through tiles that stay in L1,
+ * transposed in blocks of 8x8 or 16x16 pixels held in SSSE3 or AVX2
+ * registers where the CPU has them and the pixels are 1, 2, 4 or 8 bytes.
+ */
+template <typename ValueT>
+void ApplyTransform(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst, Transform t, ThreadPool *pool = nullptr);
+
+/**
+ * @brief move the pixels of image as t tells without a second image. Flips
+ * and Rotate180 work on any image, the transforms which swap the dimensions
+ * on square ones only, and throw std::invalid_argument otherwise.
+ */
+template <typename ValueT>
+void ApplyTransformInPlace(const ImageView<ValueT> &image, Transform t,
+    ThreadPool *pool = nullptr);
+
+}
+}
+}
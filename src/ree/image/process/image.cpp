@@ -1,62 +1,213 @@
-#include "image.hpp"
-
-namespace ree {
-namespace image {
-namespace process {
-
-
-
-template <typename ValueT> Image<ValueT>::Image(int w, int h,
-    class ColorSpace cs, uint8_t depth, std::vector<ValueT> &&d)
-    : width_(w), height_(h), colorspace_(cs), depthBits_(depth), data_(d) {
-    if (w != 0 && h != 0 && data_.empty()) {
-        data_.resize(w * h * cs.Components());
-    }
-}
-
-template <typename ValueT>
-Image<ValueT> Image<ValueT>::ConvertToColor(class ColorSpace to) const {
-    Image<ValueT> dst(width_, height_, to, depthBits_, std::vector<ValueT>());
-
-    if (colorspace_ == ColorSpace::RGBA) {
-        if (to == ColorSpace::RGB) {
-            for (int row = 0; row < height_; ++row) {
-                for (int col = 0; col < width_; ++col) {
-                    int idx = row * width_ + col;
-                    dst.data_[idx * 3] = data_[idx * 4];
-                    dst.data_[idx * 3 + 1] = data_[idx * 4 + 1];
-                    dst.data_[idx * 3 + 2] = data_[idx * 4 + 2];
-                }
-            }
-        }
-    }
-    return dst;
-}
-
-
-template <typename ValueT>
-Image<ValueT> ImageFromIOImage(const io::Image &srcImg) {
-    auto &srcImgData = srcImg.Data();
-    std::vector<ValueT> data(srcImgData.begin(), srcImgData.end());
-
-    return Image<ValueT>(srcImg.Width(), srcImg.Height(), srcImg.ColorSpace(),
-        srcImg.DepthBits(), std::move(data));
-
-}
-
-
-
-template Image<uint8_t>::Image(int w, int h, class ColorSpace cs,
-    uint8_t depth, std::vector<uint8_t> &&d);
-template Image<uint16_t>::Image(int w, int h, class ColorSpace cs,
-    uint8_t depth, std::vector<uint16_t> &&d);
-
-template Image<uint8_t> Image<uint8_t>::ConvertToColor(class ColorSpace to) const;
-template Image<uint16_t> Image<uint16_t>::ConvertToColor(class ColorSpace to) const;
-
-template Image<uint8_t> ImageFromIOImage<uint8_t>(const io::Image &srcImg);
-template Image<uint16_t> ImageFromIOImage<uint16_t>(const io::Image &srcImg);
-
-}
-}
+#include "image.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <ree/image/color_convert.hpp>
+#include <ree/image/depth_convert.hpp>
+
+namespace ree {
+namespace image {
+namespace process {
+
+
+
+template <typename ValueT> Image<ValueT>::Image(int w, int h,
+    class ColorSpace cs, uint8_t depth, PixelBuffer<ValueT> &&d)
+    : width_(w), height_(h), colorspace_(cs), depthBits_(depth),
+      data_(std::move(d)) {
+    if (w != 0 && h != 0 && data_.empty()) {
+        data_.resize(static_cast<size_t>(w) * h * cs.Components(), 0);
+    }
+}
+
+template <typename ValueT>
+void Image<ValueT>::Resize(int width, int height, ResampleFilter filter) {
+    Image<ValueT> dst(width, height, colorspace_, depthBits_);
+    Resample(static_cast<const Image<ValueT> &>(*this).View(), dst.View(),
+        filter);
+    *this = std::move(dst);
+}
+
+template <typename ValueT>
+Image<ValueT> Image<ValueT>::ConvertToColor(class ColorSpace to) const {
+    Image<ValueT> dst(width_, height_, to, depthBits_, PixelBuffer<ValueT>());
+    ConvertColor(View(), dst.View());
+    return dst;
+}
+
+template <typename ValueT>
+void ConvertColor(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst) {
+    if (src.Width() != dst.Width() || src.Height() != dst.Height()) {
+        throw std::invalid_argument("image sizes do not match.");
+    }
+
+    auto convert = FindConverter<ValueT>(src.ColorSpace(), dst.ColorSpace(),
+        src.DepthBits());
+    for (int row = 0; row < src.Height(); ++row) {
+        convert(src.Row(row), dst.Row(row), src.Width(), src.DepthBits());
+    }
+}
+
+template <typename ValueT>
+Image<ValueT> ImageFromView(const ImageView<const ValueT> &view) {
+    PixelBuffer<ValueT> data;
+    data.resize(view.RowValues() * view.Height());
+    for (int row = 0; row < view.Height(); ++row) {
+        std::copy(view.Row(row), view.Row(row) + view.RowValues(),
+            data.data() + view.RowValues() * row);
+    }
+    return Image<ValueT>(view.Width(), view.Height(), view.ColorSpace(),
+        view.DepthBits(), std::move(data));
+}
+
+
+template <typename ValueT>
+PixelBuffer<ValueT> Image<ValueT>::Release() {
+    width_ = 0;
+    height_ = 0;
+    return std::move(data_);
+}
+
+/// whether io images of this depth store ValueT samples
+template <typename ValueT>
+static bool SameLayout(uint8_t depthBits) {
+    return sizeof(ValueT) == (depthBits > 8 ? 2 : 1);
+}
+
+/// the depth of ValueT samples made from samples of depthBits, bytes hold
+/// at most 8 bits and the others keep the depth
+template <typename ValueT>
+static uint8_t DepthFor(uint8_t depthBits) {
+    return sizeof(ValueT) == 1 && depthBits > 8 ? 8 : depthBits;
+}
+
+/// the samples of src, IOValueT ones, as ValueT samples of depth bits
+template <typename ValueT, typename IOValueT>
+static PixelBuffer<ValueT> SamplesFrom(const io::Image &src, uint8_t depth) {
+    auto view = src.View<IOValueT>();
+    size_t count = view.RowValues() * view.Height();
+    PixelBuffer<ValueT> data;
+    data.resize(count);
+    ConvertSamples(view.Data(), src.DepthBits(), data.data(), depth, count);
+    return data;
+}
+
+template <typename ValueT>
+io::Image Image<ValueT>::ToIOImage() const & {
+    PixelBuffer<uint8_t> data;
+    if (SameLayout<ValueT>(depthBits_)) {
+        auto begin = reinterpret_cast<const uint8_t *>(data_.data());
+        data = PixelBuffer<uint8_t>(begin, begin + data_.size() * sizeof(ValueT));
+    } else if (depthBits_ > 8) {
+        PixelBuffer<uint16_t> samples;
+        samples.resize(data_.size());
+        ConvertSamples(data_.data(), depthBits_, samples.data(), depthBits_,
+            data_.size());
+        data = PixelBuffer<uint8_t>::Reinterpret(std::move(samples));
+    } else {
+        data.resize(data_.size());
+        ConvertSamples(data_.data(), depthBits_, data.data(), depthBits_,
+            data_.size());
+    }
+    return io::Image(width_, height_, colorspace_, depthBits_,
+        std::move(data));
+}
+
+template <typename ValueT>
+io::Image Image<ValueT>::ToIOImage() && {
+    if (!SameLayout<ValueT>(depthBits_)) {
+        return static_cast<const Image<ValueT> &>(*this).ToIOImage();
+    }
+    int width = width_;
+    int height = height_;
+    return io::Image(width, height, colorspace_, depthBits_,
+        PixelBuffer<uint8_t>::Reinterpret(Release()));
+}
+
+template <typename ValueT>
+Image<ValueT> ImageFromIOImage(const io::Image &srcImg) {
+    uint8_t depth = DepthFor<ValueT>(srcImg.DepthBits());
+    PixelBuffer<ValueT> data;
+    if (SameLayout<ValueT>(srcImg.DepthBits())) {
+        auto view = srcImg.View<ValueT>();
+        data = PixelBuffer<ValueT>(view.Data(),
+            view.Data() + view.RowValues() * view.Height());
+    } else if (srcImg.DepthBits() > 8) {
+        data = SamplesFrom<ValueT, uint16_t>(srcImg, depth);
+    } else {
+        data = SamplesFrom<ValueT, uint8_t>(srcImg, depth);
+    }
+
+    return Image<ValueT>(srcImg.Width(), srcImg.Height(), srcImg.ColorSpace(),
+        depth, std::move(data));
+
+}
+
+template <typename ValueT>
+Image<ValueT> ImageFromIOImage(io::Image &&srcImg) {
+    if (!SameLayout<ValueT>(srcImg.DepthBits())) {
+        return ImageFromIOImage<ValueT>(
+            static_cast<const io::Image &>(srcImg));
+    }
+    int width = srcImg.Width();
+    int height = srcImg.Height();
+    return Image<ValueT>(width, height, srcImg.ColorSpace(),
+        srcImg.DepthBits(), PixelBuffer<ValueT>::Reinterpret(srcImg.Release()));
+}
+
+template <typename ToT, typename FromT>
+Image<ToT> ConvertDepth(const ImageView<const FromT> &src, uint8_t depth) {
+    Image<ToT> dst(src.Width(), src.Height(), src.ColorSpace(), depth);
+    auto out = dst.View();
+    for (int row = 0; row < src.Height(); ++row) {
+        ConvertSamples(src.Row(row), src.DepthBits(), out.Row(row), depth,
+            src.RowValues());
+    }
+    return dst;
+}
+
+template class Image<uint8_t>;
+template class Image<uint16_t>;
+template class Image<float>;
+
+template Image<uint8_t> ImageFromIOImage<uint8_t>(const io::Image &srcImg);
+template Image<uint16_t> ImageFromIOImage<uint16_t>(const io::Image &srcImg);
+template Image<uint8_t> ImageFromIOImage<uint8_t>(io::Image &&srcImg);
+template Image<uint16_t> ImageFromIOImage<uint16_t>(io::Image &&srcImg);
+template Image<float> ImageFromIOImage<float>(const io::Image &srcImg);
+template Image<float> ImageFromIOImage<float>(io::Image &&srcImg);
+
+template Image<uint8_t> ImageFromView<uint8_t>(
+    const ImageView<const uint8_t> &view);
+template Image<uint16_t> ImageFromView<uint16_t>(
+    const ImageView<const uint16_t> &view);
+template Image<float> ImageFromView<float>(const ImageView<const float> &view);
+
+#define REE_IMAGE_CONVERT_DEPTH(ToT, FromT) \
+    template Image<ToT> ConvertDepth<ToT, FromT>( \
+        const ImageView<const FromT> &src, uint8_t depth);
+
+REE_IMAGE_CONVERT_DEPTH(uint8_t, uint8_t)
+REE_IMAGE_CONVERT_DEPTH(uint8_t, uint16_t)
+REE_IMAGE_CONVERT_DEPTH(uint8_t, float)
+REE_IMAGE_CONVERT_DEPTH(uint16_t, uint8_t)
+REE_IMAGE_CONVERT_DEPTH(uint16_t, uint16_t)
+REE_IMAGE_CONVERT_DEPTH(uint16_t, float)
+REE_IMAGE_CONVERT_DEPTH(float, uint8_t)
+REE_IMAGE_CONVERT_DEPTH(float, uint16_t)
+REE_IMAGE_CONVERT_DEPTH(float, float)
+
+#undef REE_IMAGE_CONVERT_DEPTH
+
+template void ConvertColor<uint8_t>(const ImageView<const uint8_t> &src,
+    const ImageView<uint8_t> &dst);
+template void ConvertColor<uint16_t>(const ImageView<const uint16_t> &src,
+    const ImageView<uint16_t> &dst);
+template void ConvertColor<float>(const ImageView<const float> &src,
+    const ImageView<float> &dst);
+
+}
+}
 }
\ No newline at end of file
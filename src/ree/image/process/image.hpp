@@ -5,23 +5,29 @@
 #include <vector>
 
 #include <ree/image/types.hpp>
+#include <ree/image/pixel_buffer.hpp>
+#include <ree/image/image_view.hpp>
 #include <ree/image/io/image.hpp>
+#include <ree/image/process/resample.hpp>
 
 namespace ree {
 namespace image {
 namespace process {
 
 /**
- * @brief normally ValueType should be uint8_t or uint16_t
+ * @brief normally ValueType should be uint8_t or uint16_t, or float for
+ * samples in [0, 1]. The depth of a float image is the one of the samples it
+ * was made from, and the one it is written at.
  */
 template <typename ValueT>
 class Image {
 public:
+    /// allocates a zero-filled buffer when d is empty
     Image(int w, int h, ColorSpace cs, uint8_t depth,
-        std::vector<ValueT> &&d = std::vector<ValueT>());
+        PixelBuffer<ValueT> &&d);
     Image(int w, int h, class ColorSpace cs = ColorSpace::RGBA,
         uint8_t depth = 8)
-        : Image(w, h, cs, depth) {}
+        : Image(w, h, cs, depth, PixelBuffer<ValueT>()) {}
     Image(class ColorSpace cs = ColorSpace::RGBA, uint8_t depth = 8)
         : Image(0, 0, cs, depth) {}
 
@@ -29,31 +35,69 @@ public:
     int Height() const  { return height_; }
     uint8_t DepthBits() const { return depthBits_; }
     class ColorSpace ColorSpace() const { return colorspace_; }
-    std::vector<ValueT> &Data() { return data_; }
+    PixelBuffer<ValueT> &Data() { return data_; }
+    const PixelBuffer<ValueT> &Data() const { return data_; }
 
-    void Resize(int width, int height) {
-        width_ = width;
-        height_ = height;
-        data_.resize(width * height);
+    ImageView<ValueT> View() {
+        return ImageView<ValueT>(data_.data(), width_, height_, colorspace_,
+            depthBits_);
     }
+    ImageView<const ValueT> View() const {
+        return ImageView<const ValueT>(data_.data(), width_, height_,
+            colorspace_, depthBits_);
+    }
+
+    /// resample the pixels to width x height, see process::Resample
+    void Resize(int width, int height,
+        ResampleFilter filter = ResampleFilter::Lanczos);
     Image<ValueT> ConvertToColor(class ColorSpace to) const;
 
-    io::Image ToIOImage() const {
-        std::vector<uint8_t> data(data_.begin(), data_.end());
-        return io::Image(width_, height_, colorspace_, depthBits_,
-            std::move(data));
-    }
+    /// give up the pixels, leaving an empty image
+    PixelBuffer<ValueT> Release();
+
+    /// samples not stored as they are, e.g. float ones, are quantized to
+    /// DepthBits
+    io::Image ToIOImage() const &;
+    /// hands the pixels over without copying whenever the io layout allows
+    io::Image ToIOImage() &&;
 
 private:
     int width_;
     int height_;
     class ColorSpace colorspace_ { ColorSpace::RGBA };
     int depthBits_ { 8 };
-    std::vector<ValueT> data_;
+    PixelBuffer<ValueT> data_;
 };
 
+/**
+ * @brief the pixels of srcImg as ValueT samples. Samples deeper than 8 bits
+ * are scaled down to 8 bits for uint8_t, uint16_t keeps the values of 8 bit
+ * ones, and float takes every depth to [0, 1].
+ */
 template <typename ValueT> 
 Image<ValueT> ImageFromIOImage(const io::Image &srcImg);
+/**
+ * @brief take over the pixels of srcImg. No copy is made for uint8_t when
+ * srcImg is up to 8 bits deep, nor for uint16_t when it is deeper.
+ */
+template <typename ValueT>
+Image<ValueT> ImageFromIOImage(io::Image &&srcImg);
+
+/// copy the pixels of a view, e.g. a crop, into a new image
+template <typename ValueT>
+Image<ValueT> ImageFromView(const ImageView<const ValueT> &view);
+
+/// the pixels of src as ToT samples of depth bits, see ConvertSamples
+template <typename ToT, typename FromT>
+Image<ToT> ConvertDepth(const ImageView<const FromT> &src, uint8_t depth);
+
+/**
+ * @brief convert the pixels of src into the color space of dst. Both views
+ * must have the same size.
+ */
+template <typename ValueT>
+void ConvertColor(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst);
 
 }
 }
@@ -0,0 +1,489 @@
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <stdexcept>
+
+#include <ree/image/color_convert.hpp>
+#include <ree/image/rounded_division.hpp>
+
+namespace ree {
+namespace image {
+namespace process {
+
+/// what the buffers of a tile may take, about the L2 cache of a core
+static constexpr size_t kCacheBytes = 256 << 10;
+/// the largest tile tried, and the smallest side it shrinks to
+static constexpr int kMaxTile = 256;
+static constexpr int kMinTile = 16;
+
+template <typename ValueT>
+struct Pipeline<ValueT>::Scratch {
+    explicit Scratch(size_t nodes)
+        : buffers(nodes), scaled(nodes), rows(nodes), sums(nodes),
+          columns(nodes) {}
+
+    /// the output of every node made in a buffer
+    std::vector<std::vector<ValueT>> buffers;
+    /// rows a resize scaled horizontally
+    std::vector<std::vector<ValueT>> scaled;
+    /// three rows for every conversion, two to pass between its steps, the
+    /// row a blur sums
+    std::vector<std::vector<ValueT>> rows;
+    /// rows a blur summed horizontally, and the sums of their columns
+    std::vector<std::vector<uint32_t>> sums;
+    std::vector<std::vector<uint64_t>> columns;
+    std::vector<const ValueT *> taps;
+};
+
+/// the weights of the width samples from x on, the source counted from offset
+static ResampleWeights SliceWeights(const ResampleWeights &weights, int x,
+    int width, int offset) {
+    ResampleWeights slice;
+    slice.taps = weights.taps;
+    slice.first.resize(width);
+    slice.count.assign(weights.count.begin() + x,
+        weights.count.begin() + x + width);
+    slice.weights.assign(weights.weights.begin() +
+        static_cast<size_t>(x) * weights.taps, weights.weights.begin() +
+        static_cast<size_t>(x + width) * weights.taps);
+    for (int i = 0; i < width; ++i) {
+        slice.first[i] = weights.first[x + i] - offset;
+    }
+    return slice;
+}
+
+/// the source samples [first, last) the samples [x, x + width) depend on
+static void Span(const ResampleWeights &weights, int x, int width, int *first,
+    int *last) {
+    *first = weights.first[x];
+    *last = *first;
+    for (int i = x; i < x + width; ++i) {
+        *first = std::min(*first, weights.first[i]);
+        *last = std::max(*last, weights.first[i] + weights.count[i]);
+    }
+}
+
+template <typename ValueT>
+Pipeline<ValueT>::Pipeline(const ImageView<const ValueT> &source)
+    : source_(source) {
+    if (source.Empty()) {
+        throw std::invalid_argument("pipeline of an empty image.");
+    }
+    Node node;
+    node.kind = Kind::Source;
+    node.width = source.Width();
+    node.height = source.Height();
+    node.colorspace = source.ColorSpace();
+    nodes_.push_back(node);
+}
+
+template <typename ValueT>
+Pipeline<ValueT> &Pipeline<ValueT>::ConvertToColor(class ColorSpace to) {
+    class ColorSpace from = ColorSpace();
+    if (to == from) {
+        return *this;
+    }
+    if (!CanConvert(from, to)) {
+        throw std::invalid_argument("can not convert from " +
+            from.ToString() + " to " + to.ToString() + ".");
+    }
+    // conversions in a row run on the same rows one after another
+    if (nodes_.back().kind != Kind::Convert) {
+        Node node;
+        node.kind = Kind::Convert;
+        node.width = Width();
+        node.height = Height();
+        nodes_.push_back(node);
+    }
+    nodes_.back().steps.push_back(to);
+    nodes_.back().colorspace = to;
+    return *this;
+}
+
+template <typename ValueT>
+Pipeline<ValueT> &Pipeline<ValueT>::Crop(int x, int y, int w, int h) {
+    if (x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > Width() ||
+        y + h > Height()) {
+        throw std::out_of_range("crop out of image.");
+    }
+    if (w == Width() && h == Height()) {
+        return *this;
+    }
+    if (nodes_.back().kind == Kind::Crop) {
+        nodes_.back().x += x;
+        nodes_.back().y += y;
+    } else {
+        Node node;
+        node.kind = Kind::Crop;
+        node.colorspace = ColorSpace();
+        node.x = x;
+        node.y = y;
+        nodes_.push_back(node);
+    }
+    nodes_.back().width = w;
+    nodes_.back().height = h;
+    return *this;
+}
+
+template <typename ValueT>
+Pipeline<ValueT> &Pipeline<ValueT>::Resize(int width, int height,
+    ResampleFilter filter) {
+    if (width <= 0 || height <= 0) {
+        throw std::invalid_argument("sizes to resample must be positive.");
+    }
+    if (width == Width() && height == Height()) {
+        return *this;
+    }
+    Node node;
+    node.kind = Kind::Resize;
+    node.width = width;
+    node.height = height;
+    node.colorspace = ColorSpace();
+    node.kernels = FindResampleKernels<ValueT>(ColorSpace(),
+        source_.DepthBits());
+    if (width != Width()) {
+        node.horizontal = FilterWeights(filter, Width(), width);
+    }
+    if (height != Height()) {
+        node.vertical = FilterWeights(filter, Height(), height);
+    }
+    nodes_.push_back(std::move(node));
+    return *this;
+}
+
+template <typename ValueT>
+Pipeline<ValueT> &Pipeline<ValueT>::BoxBlur(int radius) {
+    if (radius < 0) {
+        throw std::invalid_argument("negative blur radius.");
+    }
+    if (radius == 0) {
+        return *this;
+    }
+    Node node;
+    node.kind = Kind::Blur;
+    node.width = Width();
+    node.height = Height();
+    node.colorspace = ColorSpace();
+    node.radius = radius;
+    nodes_.push_back(node);
+    return *this;
+}
+
+template <typename ValueT>
+typename Pipeline<ValueT>::Rect Pipeline<ValueT>::Needs(size_t node,
+    const Rect &rect) const {
+    const Node &n = nodes_[node];
+    switch (n.kind) {
+    case Kind::Crop:
+        return Rect{rect.x + n.x, rect.y + n.y, rect.width, rect.height};
+    case Kind::Resize: {
+        Rect need = rect;
+        int last;
+        if (!n.horizontal.first.empty()) {
+            Span(n.horizontal, rect.x, rect.width, &need.x, &last);
+            need.width = last - need.x;
+        }
+        if (!n.vertical.first.empty()) {
+            Span(n.vertical, rect.y, rect.height, &need.y, &last);
+            need.height = last - need.y;
+        }
+        return need;
+    }
+    case Kind::Blur: {
+        const Node &in = nodes_[node - 1];
+        int x = std::max(rect.x - n.radius, 0);
+        int y = std::max(rect.y - n.radius, 0);
+        return Rect{x, y,
+            std::min(rect.x + rect.width + n.radius, in.width) - x,
+            std::min(rect.y + rect.height + n.radius, in.height) - y};
+    }
+    default:
+        return rect;
+    }
+}
+
+template <typename ValueT>
+size_t Pipeline<ValueT>::Footprint(size_t node, const Rect &rect) const {
+    const Node &n = nodes_[node];
+    size_t values = static_cast<size_t>(rect.width) * rect.height *
+        n.colorspace.Components();
+    switch (n.kind) {
+    case Kind::Source:
+        return 0;
+    case Kind::Convert:
+        return Footprint(node - 1, rect) +
+            3 * static_cast<size_t>(rect.width) * 4 * sizeof(ValueT);
+    case Kind::Crop:
+        return Footprint(node - 1, Needs(node, rect));
+    case Kind::Resize: {
+        Rect need = Needs(node, rect);
+        return Footprint(node - 1, need) + (values + static_cast<size_t>(
+            rect.width) * need.height * n.colorspace.Components()) *
+            sizeof(ValueT);
+    }
+    default: {
+        Rect need = Needs(node, rect);
+        size_t rowValues = static_cast<size_t>(rect.width) *
+            n.colorspace.Components();
+        return Footprint(node - 1, need) + values * sizeof(ValueT) +
+            rowValues * (need.height * sizeof(uint32_t) + sizeof(uint64_t));
+    }
+    }
+}
+
+template <typename ValueT>
+void Pipeline<ValueT>::TileSize(size_t cacheBytes, int *width,
+    int *height) const {
+    int w = std::min(kMaxTile, Width());
+    int h = std::min(kMaxTile, Height());
+    // halve the longer side while the buffers of a tile in the middle of
+    // the image do not fit
+    while (Footprint(nodes_.size() - 1, Rect{(Width() - w) / 2,
+        (Height() - h) / 2, w, h}) > cacheBytes &&
+        std::max(w, h) > kMinTile) {
+        if (w >= h) {
+            w = std::max(w / 2, std::min(kMinTile, Width()));
+        } else {
+            h = std::max(h / 2, std::min(kMinTile, Height()));
+        }
+    }
+    *width = w;
+    *height = h;
+}
+
+template <typename ValueT>
+ImageView<const ValueT> Pipeline<ValueT>::Fetch(size_t node, const Rect &rect,
+    Scratch &scratch) const {
+    const Node &n = nodes_[node];
+    if (n.kind == Kind::Source) {
+        return source_.Crop(rect.x, rect.y, rect.width, rect.height);
+    }
+    if (n.kind == Kind::Crop) {
+        return Fetch(node - 1, Needs(node, rect), scratch);
+    }
+    auto &buffer = scratch.buffers[node];
+    buffer.resize(static_cast<size_t>(rect.width) * rect.height *
+        n.colorspace.Components());
+    ImageView<ValueT> view(buffer.data(), rect.width, rect.height,
+        n.colorspace, source_.DepthBits());
+    Produce(node, rect, view, scratch);
+    return view;
+}
+
+template <typename ValueT>
+void Pipeline<ValueT>::ForRows(size_t node, const Rect &rect,
+    Scratch &scratch, const RowFn &fn) const {
+    const Node &n = nodes_[node];
+    if (n.kind != Kind::Convert) {
+        auto view = Fetch(node, rect, scratch);
+        for (int r = 0; r < rect.height; ++r) {
+            fn(r, view.Row(r));
+        }
+        return;
+    }
+
+    size_t rowValues = static_cast<size_t>(rect.width) * 4;
+    auto &rows = scratch.rows[node];
+    rows.resize(rowValues * 3);
+    ForRows(node - 1, rect, scratch, [&](int r, const ValueT *row) {
+        const ValueT *from = row;
+        class ColorSpace cs = nodes_[node - 1].colorspace;
+        for (size_t i = 0; i < n.steps.size(); ++i) {
+            ValueT *to = rows.data() + rowValues * (i + 1 == n.steps.size() ?
+                2 : i % 2);
+            ConvertPixels(from, cs, to, n.steps[i], rect.width,
+                source_.DepthBits());
+            from = to;
+            cs = n.steps[i];
+        }
+        fn(r, from);
+    });
+}
+
+template <typename ValueT>
+void Pipeline<ValueT>::Produce(size_t node, const Rect &rect,
+    const ImageView<ValueT> &out, Scratch &scratch) const {
+    const Node &n = nodes_[node];
+    if (n.kind == Kind::Resize) {
+        ProduceResize(node, rect, out, scratch);
+    } else if (n.kind == Kind::Blur) {
+        ProduceBlur(node, rect, out, scratch);
+    } else {
+        size_t rowValues = out.RowValues();
+        ForRows(node, rect, scratch, [&](int r, const ValueT *row) {
+            std::copy(row, row + rowValues, out.Row(r));
+        });
+    }
+}
+
+template <typename ValueT>
+void Pipeline<ValueT>::ProduceResize(size_t node, const Rect &rect,
+    const ImageView<ValueT> &out, Scratch &scratch) const {
+    const Node &n = nodes_[node];
+    int components = n.colorspace.Components();
+    int depth = source_.DepthBits();
+    size_t rowValues = static_cast<size_t>(rect.width) * components;
+    Rect need = Needs(node, rect);
+
+    // rows scale straight into out when the height stays
+    bool scaleX = !n.horizontal.first.empty();
+    bool scaleY = !n.vertical.first.empty();
+    ResampleWeights sliced;
+    const ResampleWeights *horizontal = &n.horizontal;
+    if (scaleX && (rect.x != 0 || rect.width != n.width || need.x != 0)) {
+        sliced = SliceWeights(n.horizontal, rect.x, rect.width, need.x);
+        horizontal = &sliced;
+    }
+    auto &scaled = scratch.scaled[node];
+    if (scaleY) {
+        scaled.resize(rowValues * need.height);
+    }
+    ForRows(node - 1, need, scratch, [&](int r, const ValueT *in) {
+        ValueT *to = scaleY ? scaled.data() + rowValues * r : out.Row(r);
+        if (scaleX) {
+            n.kernels.scaleRow(in, need.width, to, *horizontal, depth);
+        } else {
+            std::copy(in, in + rowValues, to);
+        }
+    });
+    if (!scaleY) {
+        return;
+    }
+
+    const ResampleWeights &vertical = n.vertical;
+    scratch.taps.resize(vertical.taps);
+    for (int r = 0; r < rect.height; ++r) {
+        int y = rect.y + r;
+        int count = vertical.count[y];
+        for (int k = 0; k < count; ++k) {
+            scratch.taps[k] = scaled.data() +
+                rowValues * (vertical.first[y] - need.y + k);
+        }
+        n.kernels.blendRows(scratch.taps.data(), &vertical.weights[
+            static_cast<size_t>(y) * vertical.taps], count, rowValues,
+            out.Row(r), depth);
+    }
+}
+
+template <typename ValueT>
+void Pipeline<ValueT>::ProduceBlur(size_t node, const Rect &rect,
+    const ImageView<ValueT> &out, Scratch &scratch) const {
+    const Node &n = nodes_[node];
+    int radius = n.radius;
+    int components = n.colorspace.Components();
+    size_t rowValues = static_cast<size_t>(rect.width) * components;
+    Rect need = Needs(node, rect);
+    int lastX = nodes_[node - 1].width - 1;
+    int lastY = nodes_[node - 1].height - 1;
+
+    // a running sum along every row, over a copy with the edge pixels
+    // repeated past the ends
+    auto &padded = scratch.rows[node];
+    padded.resize(static_cast<size_t>(rect.width + 2 * radius) * components);
+    auto &sums = scratch.sums[node];
+    sums.resize(rowValues * need.height);
+    ForRows(node - 1, need, scratch, [&](int r, const ValueT *in) {
+        for (int i = 0; i < rect.width + 2 * radius; ++i) {
+            int x = std::min(std::max(rect.x - radius + i, 0), lastX) -
+                need.x;
+            std::copy(in + x * components, in + (x + 1) * components,
+                padded.data() + i * components);
+        }
+        uint32_t *sum = sums.data() + rowValues * r;
+        for (int c = 0; c < components; ++c) {
+            uint32_t total = 0;
+            for (int k = 0; k <= 2 * radius; ++k) {
+                total += padded[k * components + c];
+            }
+            sum[c] = total;
+        }
+        const ValueT *leave = padded.data();
+        const ValueT *enter = padded.data() + (2 * radius + 1) * components;
+        for (size_t i = components; i < rowValues; ++i) {
+            sum[i] = sum[i - components] + enter[i - components] -
+                leave[i - components];
+        }
+    });
+
+    // and down the columns
+    auto row = [&](int y) {
+        y = std::min(std::max(y, 0), lastY) - need.y;
+        return sums.data() + rowValues * y;
+    };
+    auto &columns = scratch.columns[node];
+    columns.assign(rowValues, 0);
+    for (int k = -radius; k <= radius; ++k) {
+        const uint32_t *sum = row(rect.y + k);
+        for (size_t i = 0; i < rowValues; ++i) {
+            columns[i] += sum[i];
+        }
+    }
+    uint64_t area = static_cast<uint64_t>(2 * radius + 1) * (2 * radius + 1);
+    RoundedDivision divide(static_cast<double>(area));
+    for (int r = 0;; ++r) {
+        ValueT *dst = out.Row(r);
+        for (size_t i = 0; i < rowValues; ++i) {
+            dst[i] = static_cast<ValueT>(
+                divide(static_cast<double>(columns[i])));
+        }
+        if (r + 1 == rect.height) {
+            break;
+        }
+        int y = rect.y + r;
+        const uint32_t *enter = row(y + radius + 1);
+        const uint32_t *leave = row(y - radius);
+        for (size_t i = 0; i < rowValues; ++i) {
+            columns[i] += enter[i];
+            columns[i] -= leave[i];
+        }
+    }
+}
+
+template <typename ValueT>
+void Pipeline<ValueT>::Run(const ImageView<ValueT> &dst,
+    ThreadPool *pool) const {
+    if (dst.Width() != Width() || dst.Height() != Height() ||
+        dst.ColorSpace() != ColorSpace()) {
+        throw std::invalid_argument("output differs from the pipeline.");
+    }
+    ThreadPool &threads = pool ? *pool : ThreadPool::Shared();
+
+    // tiles as large as the cache allows, yet enough to keep threads busy
+    int tileWidth;
+    int tileHeight;
+    TileSize(kCacheBytes, &tileWidth, &tileHeight);
+    int columns = (Width() + tileWidth - 1) / tileWidth;
+    size_t tiles = static_cast<size_t>(columns) *
+        ((Height() + tileHeight - 1) / tileHeight);
+    size_t workers = std::min(std::max<size_t>(threads.Size(), 1), tiles);
+
+    std::atomic<size_t> next(0);
+    threads.ParallelFor(workers, [&](size_t) {
+        Scratch scratch(nodes_.size());
+        for (size_t tile = next++; tile < tiles; tile = next++) {
+            int x = static_cast<int>(tile % columns) * tileWidth;
+            int y = static_cast<int>(tile / columns) * tileHeight;
+            int w = std::min(tileWidth, Width() - x);
+            int h = std::min(tileHeight, Height() - y);
+            Produce(nodes_.size() - 1, Rect{x, y, w, h},
+                dst.Crop(x, y, w, h), scratch);
+        }
+    });
+}
+
+template <typename ValueT>
+Image<ValueT> Pipeline<ValueT>::Run(ThreadPool *pool) const {
+    Image<ValueT> image(Width(), Height(), ColorSpace(),
+        source_.DepthBits());
+    Run(image.View(), pool);
+    return image;
+}
+
+template class Pipeline<uint8_t>;
+template class Pipeline<uint16_t>;
+
+}
+}
+}
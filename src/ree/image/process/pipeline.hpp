@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <ree/image/types.hpp>
+#include <ree/image/image_view.hpp>
+#include <ree/image/thread_pool.hpp>
+#include <ree/image/process/image.hpp>
+#include <ree/image/process/resample.hpp>
+
+namespace ree {
+namespace image {
+namespace process {
+
+/**
+ * @brief records operations on an image and runs them all at once, tile by
+ * tile of the output, so no intermediate image is ever made whole.
+ *
+ * Every tile pulls just the region of the source it depends on through the
+ * chain. Crops only narrow that region, color conversions are applied to
+ * every row as it is read, and only resize and blur keep buffers of their
+ * own, with tiles sized so these stay in L2. Tiles run in parallel on a
+ * ThreadPool and give the pixels the operations give one after another on a
+ * process::Image.
+ *
+ * The source pixels must outlive the pipeline.
+ */
+template <typename ValueT>
+class Pipeline {
+public:
+    explicit Pipeline(const ImageView<const ValueT> &source);
+
+    Pipeline &ConvertToColor(class ColorSpace to);
+    Pipeline &Crop(int x, int y, int w, int h);
+    Pipeline &Resize(int width, int height,
+        ResampleFilter filter = ResampleFilter::Lanczos);
+    /// the mean of the (2 radius + 1)^2 pixels around, edges repeated
+    Pipeline &BoxBlur(int radius);
+
+    /// size and color space of the output
+    int Width() const { return nodes_.back().width; }
+    int Height() const { return nodes_.back().height; }
+    class ColorSpace ColorSpace() const { return nodes_.back().colorspace; }
+
+    /// write the output to dst, of the output size and color space
+    void Run(const ImageView<ValueT> &dst, ThreadPool *pool = nullptr) const;
+    Image<ValueT> Run(ThreadPool *pool = nullptr) const;
+
+    /// the size of the output tiles whose buffers fit cacheBytes
+    void TileSize(size_t cacheBytes, int *width, int *height) const;
+
+private:
+    enum class Kind {
+        Source,
+        Convert,
+        Crop,
+        Resize,
+        Blur,
+    };
+
+    struct Rect {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    struct Node {
+        Kind kind = Kind::Source;
+        int width = 0;
+        int height = 0;
+        class ColorSpace colorspace { ColorSpace::Unknown };
+        /// Convert: the color spaces passed through in turn, fused
+        std::vector<class ColorSpace> steps;
+        /// Crop: where the output lies in the input
+        int x = 0;
+        int y = 0;
+        /// Resize
+        ResampleWeights horizontal;
+        ResampleWeights vertical;
+        ResampleKernels<ValueT> kernels {};
+        /// Blur
+        int radius = 0;
+    };
+
+    struct Scratch;
+    using RowFn = std::function<void(int r, const ValueT *values)>;
+
+    /// the part of the input of node the rect of its output depends on
+    Rect Needs(size_t node, const Rect &rect) const;
+    /// bytes of buffers making rect of node's output keeps
+    size_t Footprint(size_t node, const Rect &rect) const;
+
+    /// rect of node's output, made in a buffer of scratch unless it exists
+    ImageView<const ValueT> Fetch(size_t node, const Rect &rect,
+        Scratch &scratch) const;
+    /// compute rect of node's output into out
+    void Produce(size_t node, const Rect &rect, const ImageView<ValueT> &out,
+        Scratch &scratch) const;
+    /// fn(r, values) for the rows of rect of node's output in turn,
+    /// converting rows only as they are read
+    void ForRows(size_t node, const Rect &rect, Scratch &scratch,
+        const RowFn &fn) const;
+
+    void ProduceResize(size_t node, const Rect &rect,
+        const ImageView<ValueT> &out, Scratch &scratch) const;
+    void ProduceBlur(size_t node, const Rect &rect,
+        const ImageView<ValueT> &out, Scratch &scratch) const;
+
+    ImageView<const ValueT> source_;
+    std::vector<Node> nodes_;
+};
+
+}
+}
+}
@@ -0,0 +1,264 @@
+#include "planar.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <ree/image/allocator.hpp>
+#include <ree/image/byte_shuffle.hpp>
+#include <ree/image/simd.hpp>
+
+#ifdef REE_IMAGE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace ree {
+namespace image {
+namespace process {
+
+static size_t AlignUp(size_t size) {
+    return (size + kPixelAlignment - 1) / kPixelAlignment * kPixelAlignment;
+}
+
+template <typename ValueT>
+PlanarImage<ValueT>::PlanarImage(int w, int h, class ColorSpace cs,
+    uint8_t depth, size_t stride)
+    : width_(w), height_(h), colorspace_(cs), depthBits_(depth),
+      stride_(stride) {
+    if (w < 0 || h < 0) {
+        throw std::invalid_argument("negative image size.");
+    }
+    size_t rowBytes = static_cast<size_t>(w) * sizeof(ValueT);
+    if (stride_ == 0) {
+        stride_ = AlignUp(rowBytes);
+    } else if (stride_ < rowBytes || stride_ % sizeof(ValueT) != 0) {
+        throw std::invalid_argument("stride too small for the rows.");
+    }
+    planeBytes_ = AlignUp(stride_ * h);
+    data_.resize(planeBytes_ * cs.Components(), 0);
+}
+
+template <typename ValueT>
+ImageView<ValueT> PlanarImage<ValueT>::Plane(int c) {
+    if (c < 0 || c >= Components()) {
+        throw std::out_of_range("no such plane.");
+    }
+    return ImageView<ValueT>(
+        reinterpret_cast<ValueT *>(data_.data() + planeBytes_ * c), width_,
+        height_, stride_, ColorSpace::Gray, depthBits_);
+}
+
+template <typename ValueT>
+ImageView<const ValueT> PlanarImage<ValueT>::Plane(int c) const {
+    return const_cast<PlanarImage<ValueT> *>(this)->Plane(c);
+}
+
+#ifdef REE_IMAGE_SIMD_X86
+
+/**
+ * @brief the shuffles moving 16 pixels of components values, bytes each,
+ * between interleaved chunks and one run of chunks per plane.
+ */
+class PlaneShuffles {
+public:
+    static const PlaneShuffles &Instance() {
+        static const PlaneShuffles shuffles;
+        return shuffles;
+    }
+
+    const ChunkShuffle &Split(int components, int bytes) const {
+        return split_[components - 2][bytes - 1];
+    }
+    const ChunkShuffle &Merge(int components, int bytes) const {
+        return merge_[components - 2][bytes - 1];
+    }
+
+private:
+    PlaneShuffles() {
+        for (int c = 2; c <= 4; ++c) {
+            for (int b = 1; b <= 2; ++b) {
+                int chunks = c * b;
+                // plane p takes output chunks p * b to p * b + b - 1
+                split_[c - 2][b - 1] = ChunkShuffle::Build(chunks, chunks,
+                    [c, b](int pos) {
+                    int plane = pos / (16 * b);
+                    int offset = pos % (16 * b);
+                    return (offset / b * c + plane) * b + offset % b;
+                });
+                merge_[c - 2][b - 1] = ChunkShuffle::Build(chunks, chunks,
+                    [c, b](int pos) {
+                    int pixel = pos / (c * b);
+                    int plane = pos / b % c;
+                    return plane * 16 * b + pixel * b + pos % b;
+                });
+            }
+        }
+    }
+
+    ChunkShuffle split_[3][2];
+    ChunkShuffle merge_[3][2];
+};
+
+REE_TARGET("ssse3")
+static size_t SplitSsse3(const uint8_t *src, uint8_t *const *planes,
+    size_t count, int components, int bytes) {
+    const ChunkShuffle &shuffle =
+        PlaneShuffles::Instance().Split(components, bytes);
+    __m128i in[ChunkShuffle::kMaxChunks];
+    __m128i out[ChunkShuffle::kMaxChunks];
+    size_t blocks = count / 16;
+    for (size_t block = 0; block < blocks; ++block) {
+        for (int i = 0; i < shuffle.inChunks; ++i) {
+            in[i] = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(src) + i);
+        }
+        ApplyShuffle(shuffle, in, out);
+        for (int p = 0; p < components; ++p) {
+            for (int j = 0; j < bytes; ++j) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(
+                    planes[p] + block * 16 * bytes) + j, out[p * bytes + j]);
+            }
+        }
+        src += 16 * shuffle.inChunks;
+    }
+    return blocks * 16;
+}
+
+REE_TARGET("ssse3")
+static size_t MergeSsse3(const uint8_t *const *planes, uint8_t *dst,
+    size_t count, int components, int bytes) {
+    const ChunkShuffle &shuffle =
+        PlaneShuffles::Instance().Merge(components, bytes);
+    __m128i in[ChunkShuffle::kMaxChunks];
+    __m128i out[ChunkShuffle::kMaxChunks];
+    size_t blocks = count / 16;
+    for (size_t block = 0; block < blocks; ++block) {
+        for (int p = 0; p < components; ++p) {
+            for (int j = 0; j < bytes; ++j) {
+                in[p * bytes + j] = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(
+                    planes[p] + block * 16 * bytes) + j);
+            }
+        }
+        ApplyShuffle(shuffle, in, out);
+        for (int i = 0; i < shuffle.outChunks; ++i) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst) + i, out[i]);
+        }
+        dst += 16 * shuffle.outChunks;
+    }
+    return blocks * 16;
+}
+
+#endif
+
+/// split count pixels of row into planes, returns the pixels done
+template <typename ValueT>
+static size_t SplitRowSimd(const ValueT *row, ValueT *const *planes,
+    size_t count, int components) {
+#ifdef REE_IMAGE_SIMD_X86
+    if (components >= 2 && ActiveSimdLevel() >= SimdLevel::Ssse3) {
+        return SplitSsse3(reinterpret_cast<const uint8_t *>(row),
+            reinterpret_cast<uint8_t *const *>(planes), count, components,
+            sizeof(ValueT));
+    }
+#endif
+    return 0;
+}
+
+template <typename ValueT>
+static size_t MergeRowSimd(const ValueT *const *planes, ValueT *row,
+    size_t count, int components) {
+#ifdef REE_IMAGE_SIMD_X86
+    if (components >= 2 && ActiveSimdLevel() >= SimdLevel::Ssse3) {
+        return MergeSsse3(reinterpret_cast<const uint8_t *const *>(planes),
+            reinterpret_cast<uint8_t *>(row), count, components,
+            sizeof(ValueT));
+    }
+#endif
+    return 0;
+}
+
+template <typename ValueT>
+static void CheckLayout(const ImageView<const ValueT> &view,
+    const PlanarImage<ValueT> &planar) {
+    if (view.Width() != planar.Width() || view.Height() != planar.Height() ||
+        view.ColorSpace() != planar.ColorSpace()) {
+        throw std::invalid_argument("planar and interleaved images differ.");
+    }
+}
+
+template <typename ValueT>
+void Deinterleave(const ImageView<const ValueT> &src,
+    PlanarImage<ValueT> &dst) {
+    CheckLayout(src, dst);
+    int components = src.Components();
+    ImageView<ValueT> planes[4];
+    for (int c = 0; c < components; ++c) {
+        planes[c] = dst.Plane(c);
+    }
+    size_t width = static_cast<size_t>(src.Width());
+    for (int y = 0; y < src.Height(); ++y) {
+        const ValueT *row = src.Row(y);
+        ValueT *rows[4];
+        for (int c = 0; c < components; ++c) {
+            rows[c] = planes[c].Row(y);
+        }
+        size_t x = SplitRowSimd(row, rows, width, components);
+        for (; x < width; ++x) {
+            for (int c = 0; c < components; ++c) {
+                rows[c][x] = row[x * components + c];
+            }
+        }
+    }
+}
+
+template <typename ValueT>
+void Interleave(const PlanarImage<ValueT> &src, const ImageView<ValueT> &dst) {
+    CheckLayout(ImageView<const ValueT>(dst), src);
+    int components = dst.Components();
+    ImageView<const ValueT> planes[4];
+    for (int c = 0; c < components; ++c) {
+        planes[c] = src.Plane(c);
+    }
+    size_t width = static_cast<size_t>(dst.Width());
+    for (int y = 0; y < dst.Height(); ++y) {
+        ValueT *row = dst.Row(y);
+        const ValueT *rows[4];
+        for (int c = 0; c < components; ++c) {
+            rows[c] = planes[c].Row(y);
+        }
+        size_t x = MergeRowSimd(rows, row, width, components);
+        for (; x < width; ++x) {
+            for (int c = 0; c < components; ++c) {
+                row[x * components + c] = rows[c][x];
+            }
+        }
+    }
+}
+
+template <typename ValueT>
+PlanarImage<ValueT> ToPlanar(const ImageView<const ValueT> &view) {
+    PlanarImage<ValueT> planar(view.Width(), view.Height(), view.ColorSpace(),
+        view.DepthBits());
+    Deinterleave(view, planar);
+    return planar;
+}
+
+template class PlanarImage<uint8_t>;
+template class PlanarImage<uint16_t>;
+
+template void Deinterleave<uint8_t>(const ImageView<const uint8_t> &src,
+    PlanarImage<uint8_t> &dst);
+template void Deinterleave<uint16_t>(const ImageView<const uint16_t> &src,
+    PlanarImage<uint16_t> &dst);
+template void Interleave<uint8_t>(const PlanarImage<uint8_t> &src,
+    const ImageView<uint8_t> &dst);
+template void Interleave<uint16_t>(const PlanarImage<uint16_t> &src,
+    const ImageView<uint16_t> &dst);
+template PlanarImage<uint8_t> ToPlanar<uint8_t>(
+    const ImageView<const uint8_t> &view);
+template PlanarImage<uint16_t> ToPlanar<uint16_t>(
+    const ImageView<const uint16_t> &view);
+
+}
+}
+}
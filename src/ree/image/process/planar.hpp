@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <ree/image/types.hpp>
+#include <ree/image/pixel_buffer.hpp>
+#include <ree/image/image_view.hpp>
+
+namespace ree {
+namespace image {
+namespace process {
+
+/**
+ * @brief an image holding every component in a plane of its own, e.g. for
+ * per channel filters and the planes of YCbCr JPEG. Planes share one
+ * buffer, each starting aligned to kPixelAlignment, with rows Stride()
+ * bytes apart.
+ */
+template <typename ValueT>
+class PlanarImage {
+public:
+    /// stride 0 pads the rows to kPixelAlignment, the planes are zero-filled
+    PlanarImage(int w, int h, class ColorSpace cs = ColorSpace::RGBA,
+        uint8_t depth = 8, size_t stride = 0);
+
+    int Width() const { return width_; }
+    int Height() const  { return height_; }
+    uint8_t DepthBits() const { return depthBits_; }
+    class ColorSpace ColorSpace() const { return colorspace_; }
+    uint8_t Components() const { return colorspace_.Components(); }
+    /// distance between two rows of a plane in bytes
+    size_t Stride() const { return stride_; }
+
+    /// the values of component c, as a one component view
+    ImageView<ValueT> Plane(int c);
+    ImageView<const ValueT> Plane(int c) const;
+
+private:
+    int width_;
+    int height_;
+    class ColorSpace colorspace_;
+    int depthBits_;
+    size_t stride_;
+    /// bytes from one plane to the next
+    size_t planeBytes_;
+    PixelBuffer<uint8_t> data_;
+};
+
+/// split the pixels of src into the planes of dst, of the same size and
+/// color space
+template <typename ValueT>
+void Deinterleave(const ImageView<const ValueT> &src, PlanarImage<ValueT> &dst);
+
+/// the reverse of Deinterleave
+template <typename ValueT>
+void Interleave(const PlanarImage<ValueT> &src, const ImageView<ValueT> &dst);
+
+template <typename ValueT>
+PlanarImage<ValueT> ToPlanar(const ImageView<const ValueT> &view);
+
+}
+}
+}
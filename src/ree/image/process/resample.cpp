@@ -0,0 +1,506 @@
+#include "resample.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include <ree/image/pixel_format.hpp>
+#include <ree/image/simd.hpp>
+
+#ifdef REE_IMAGE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace ree {
+namespace image {
+namespace process {
+
+constexpr int ResampleWeights::kPrecisionBits;
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+/// rows of a band the passes of Resample hand to one task
+constexpr int kBandRows = 16;
+
+double Sinc(double x) {
+    if (x == 0.0) {
+        return 1.0;
+    }
+    x *= kPi;
+    return std::sin(x) / x;
+}
+
+double AreaWeight(double x) {
+    return x > -0.5 && x <= 0.5 ? 1.0 : 0.0;
+}
+
+double BilinearWeight(double x) {
+    x = std::fabs(x);
+    return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+double BicubicWeight(double x) {
+    constexpr double a = -0.5;
+    x = std::fabs(x);
+    if (x < 1.0) {
+        return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+    }
+    if (x < 2.0) {
+        return (((x - 5.0) * x + 8.0) * x - 4.0) * a;
+    }
+    return 0.0;
+}
+
+double LanczosWeight(double x) {
+    if (x < -3.0 || x >= 3.0) {
+        return 0.0;
+    }
+    return Sinc(x) * Sinc(x / 3.0);
+}
+
+/// a weighted sum back to a sample, clamped to [0, maxValue]
+template <typename ValueT, typename AccumT>
+inline ValueT ToSample(AccumT sum, int64_t maxValue) {
+    if (sum <= 0) {
+        return 0;
+    }
+    return static_cast<ValueT>(std::min<int64_t>(
+        sum >> ResampleWeights::kPrecisionBits, maxValue));
+}
+
+/// float sums are neither rounded nor clamped, overshoot is kept for HDR
+template <>
+inline float ToSample<float, float>(float sum, int64_t) {
+    return sum * (1.0f / (1 << ResampleWeights::kPrecisionBits));
+}
+
+/// 8 bit samples times weights of 22 bits stay within 32 bits. Sums start
+/// at half a step so the shift back rounds.
+template <typename ValueT>
+struct Accumulator {
+    using Type = int64_t;
+    static constexpr Type kStart =
+        Type(1) << (ResampleWeights::kPrecisionBits - 1);
+};
+template <>
+struct Accumulator<uint8_t> {
+    using Type = int32_t;
+    static constexpr Type kStart =
+        Type(1) << (ResampleWeights::kPrecisionBits - 1);
+};
+template <>
+struct Accumulator<float> {
+    using Type = float;
+    static constexpr Type kStart = 0.0f;
+};
+
+/// Format is the PixelFormat of the pixels, its components make the inner
+/// loop and its depth the clamp
+template <typename Format, typename ValueT>
+void ScaleRowLoop(const ValueT *src, ValueT *dst, int first, int last,
+    const ResampleWeights &weights, int depth) {
+    using AccumT = typename Accumulator<ValueT>::Type;
+    constexpr int kComponents = Format::kComponents;
+    const int64_t maxValue = Format::MaxValue(depth);
+    for (int x = first; x < last; ++x) {
+        const ValueT *in = src + weights.first[x] * kComponents;
+        const int32_t *w = &weights.weights[
+            static_cast<size_t>(x) * weights.taps];
+        for (int c = 0; c < kComponents; ++c) {
+            AccumT sum = Accumulator<ValueT>::kStart;
+            for (int k = 0; k < weights.count[x]; ++k) {
+                sum += static_cast<AccumT>(in[k * kComponents + c]) * w[k];
+            }
+            dst[x * kComponents + c] = ToSample<ValueT>(sum, maxValue);
+        }
+    }
+}
+
+template <typename Format, typename ValueT>
+void BlendRowsLoop(const ValueT *const *rows, const int32_t *weights,
+    int count, size_t first, size_t last, ValueT *dst, int depth) {
+    using AccumT = typename Accumulator<ValueT>::Type;
+    const int64_t maxValue = Format::MaxValue(depth);
+    for (size_t i = first; i < last; ++i) {
+        AccumT sum = Accumulator<ValueT>::kStart;
+        for (int k = 0; k < count; ++k) {
+            sum += static_cast<AccumT>(rows[k][i]) * weights[k];
+        }
+        dst[i] = ToSample<ValueT>(sum, maxValue);
+    }
+}
+
+#ifdef REE_IMAGE_SIMD_X86
+
+/// 4 bytes from p into the low lane, p need not be aligned
+REE_TARGET("avx2")
+inline __m128i Load32(const uint8_t *p) {
+    int32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return _mm_cvtsi32_si128(v);
+}
+
+/**
+ * @brief horizontal pass of 3 and 4 component 8 bit rows, one pixel per
+ * step with a 32 bit lane per component. 3 component pixels are read 4
+ * bytes at a time, the pixels touching the last source pixel are left to
+ * the loop. Returns the pixels done, from 0 on.
+ */
+REE_TARGET("avx2")
+int ScaleRowAvx2(const uint8_t *src, int srcWidth, uint8_t *dst,
+    const ResampleWeights &weights, int components) {
+    const __m128i half = _mm_set1_epi32(
+        1 << (ResampleWeights::kPrecisionBits - 1));
+    int dstWidth = static_cast<int>(weights.first.size());
+    int x = 0;
+    for (; x < dstWidth; ++x) {
+        int first = weights.first[x];
+        int count = weights.count[x];
+        if (components == 3 && first + count >= srcWidth) {
+            break;
+        }
+        const uint8_t *in = src + first * components;
+        const int32_t *w = &weights.weights[
+            static_cast<size_t>(x) * weights.taps];
+        __m128i sum = half;
+        int k = 0;
+        if (components == 4) {
+            // two pixels per step, one in each 128 bit half
+            __m256i acc = _mm256_setzero_si256();
+            for (; k + 1 < count; k += 2) {
+                __m256i pixels = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+                    reinterpret_cast<const __m128i *>(in + 4 * k)));
+                __m256i factors = _mm256_inserti128_si256(
+                    _mm256_castsi128_si256(_mm_set1_epi32(w[k])),
+                    _mm_set1_epi32(w[k + 1]), 1);
+                acc = _mm256_add_epi32(acc, _mm256_mullo_epi32(pixels,
+                    factors));
+            }
+            sum = _mm_add_epi32(sum, _mm_add_epi32(_mm256_castsi256_si128(acc),
+                _mm256_extracti128_si256(acc, 1)));
+        }
+        for (; k < count; ++k) {
+            sum = _mm_add_epi32(sum, _mm_mullo_epi32(
+                _mm_cvtepu8_epi32(Load32(in + components * k)),
+                _mm_set1_epi32(w[k])));
+        }
+        sum = _mm_srai_epi32(sum, ResampleWeights::kPrecisionBits);
+        sum = _mm_packus_epi32(sum, sum);
+        int32_t pixel = _mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+        std::memcpy(dst + x * components, &pixel, components);
+    }
+    return x;
+}
+
+/// vertical pass of 8 bit samples, 16 per step. Returns the samples done.
+REE_TARGET("avx2")
+size_t BlendRowsAvx2(const uint8_t *const *rows, const int32_t *weights,
+    int count, size_t values, uint8_t *dst) {
+    const __m256i half = _mm256_set1_epi32(
+        1 << (ResampleWeights::kPrecisionBits - 1));
+    size_t i = 0;
+    for (; i + 16 <= values; i += 16) {
+        __m256i low = half;
+        __m256i high = half;
+        for (int k = 0; k < count; ++k) {
+            __m128i samples = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(rows[k] + i));
+            __m256i factor = _mm256_set1_epi32(weights[k]);
+            low = _mm256_add_epi32(low, _mm256_mullo_epi32(
+                _mm256_cvtepu8_epi32(samples), factor));
+            high = _mm256_add_epi32(high, _mm256_mullo_epi32(
+                _mm256_cvtepu8_epi32(_mm_srli_si128(samples, 8)), factor));
+        }
+        low = _mm256_srai_epi32(low, ResampleWeights::kPrecisionBits);
+        high = _mm256_srai_epi32(high, ResampleWeights::kPrecisionBits);
+        // the packs work within 128 bit halves, the permute restores order
+        __m256i packed = _mm256_permute4x64_epi64(
+            _mm256_packus_epi32(low, high), 0xd8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+            _mm_packus_epi16(_mm256_castsi256_si128(packed),
+            _mm256_extracti128_si256(packed, 1)));
+    }
+    return i;
+}
+
+#endif
+
+template <typename Format, typename ValueT>
+void ScaleRow(const ValueT *src, int, ValueT *dst,
+    const ResampleWeights &weights, int depth) {
+    ScaleRowLoop<Format>(src, dst, 0, static_cast<int>(weights.first.size()),
+        weights, depth);
+}
+
+template <typename Format, typename ValueT>
+void BlendRows(const ValueT *const *rows, const int32_t *weights, int count,
+    size_t values, ValueT *dst, int depth) {
+    BlendRowsLoop<Format>(rows, weights, count, 0, values, dst, depth);
+}
+
+#ifdef REE_IMAGE_SIMD_X86
+
+template <typename Format>
+void ScaleRowSimd(const uint8_t *src, int srcWidth, uint8_t *dst,
+    const ResampleWeights &weights, int depth) {
+    int done = ScaleRowAvx2(src, srcWidth, dst, weights, Format::kComponents);
+    ScaleRowLoop<Format>(src, dst, done,
+        static_cast<int>(weights.first.size()), weights, depth);
+}
+
+template <typename Format>
+void BlendRowsSimd(const uint8_t *const *rows, const int32_t *weights,
+    int count, size_t values, uint8_t *dst, int depth) {
+    size_t done = BlendRowsAvx2(rows, weights, count, values, dst);
+    BlendRowsLoop<Format>(rows, weights, count, done, values, dst, depth);
+}
+
+#endif
+
+/// the kernels pack to 8 bits, so they only take full 8 bit samples
+template <typename Format>
+void PickSimd(ResampleKernels<uint8_t> &kernels, Format) {
+#ifdef REE_IMAGE_SIMD_X86
+    if (Format::kDepth == 8 && ActiveSimdLevel() >= SimdLevel::Avx2) {
+        if (Format::kComponents >= 3) {
+            kernels.scaleRow = ScaleRowSimd<Format>;
+        }
+        kernels.blendRows = BlendRowsSimd<Format>;
+    }
+#endif
+}
+
+template <typename Format>
+void PickSimd(ResampleKernels<uint16_t> &, Format) {
+}
+
+template <typename Format>
+void PickSimd(ResampleKernels<float> &, Format) {
+}
+
+template <typename ValueT>
+struct PickKernels {
+    ResampleKernels<ValueT> *kernels;
+
+    template <typename Format>
+    void operator()(Format format) {
+        kernels->scaleRow = ScaleRow<Format, ValueT>;
+        kernels->blendRows = BlendRows<Format, ValueT>;
+        PickSimd(*kernels, format);
+    }
+};
+
+/// the color space resampled alike to pixels of components samples
+ColorSpace WithComponents(int components) {
+    static const ColorSpace kSpaces[] = {
+        ColorSpace::Gray, ColorSpace::GrayAlpha, ColorSpace::RGB,
+        ColorSpace::RGBA,
+    };
+    if (components < 1 || components > 4) {
+        throw std::invalid_argument("pixels have 1 to 4 components.");
+    }
+    return kSpaces[components - 1];
+}
+
+/// fn(first, last) for bands of the rows [0, rows), run in parallel
+void ForBands(ThreadPool &pool, int rows,
+    const std::function<void(int, int)> &fn) {
+    size_t bands = static_cast<size_t>((rows + kBandRows - 1) / kBandRows);
+    pool.ParallelFor(bands, [&](size_t band) {
+        int first = static_cast<int>(band) * kBandRows;
+        fn(first, std::min(rows, first + kBandRows));
+    });
+}
+
+}
+
+ResampleWeights FilterWeights(ResampleFilter filter, int srcSize,
+    int dstSize) {
+    if (srcSize <= 0 || dstSize <= 0) {
+        throw std::invalid_argument("sizes to resample must be positive.");
+    }
+    double baseSupport;
+    double (*weight)(double);
+    switch (filter) {
+    case ResampleFilter::Area:
+        baseSupport = 0.5;
+        weight = AreaWeight;
+        break;
+    case ResampleFilter::Bilinear:
+        baseSupport = 1.0;
+        weight = BilinearWeight;
+        break;
+    case ResampleFilter::Bicubic:
+        baseSupport = 2.0;
+        weight = BicubicWeight;
+        break;
+    default:
+        baseSupport = 3.0;
+        weight = LanczosWeight;
+        break;
+    }
+
+    double scale = static_cast<double>(srcSize) / dstSize;
+    double filterScale = std::max(scale, 1.0);
+    double support = baseSupport * filterScale;
+
+    ResampleWeights result;
+    result.taps = static_cast<int>(std::ceil(support)) * 2 + 1;
+    result.first.resize(dstSize);
+    result.count.resize(dstSize);
+    result.weights.assign(static_cast<size_t>(dstSize) * result.taps, 0);
+
+    std::vector<double> weights(result.taps);
+    for (int i = 0; i < dstSize; ++i) {
+        double center = (i + 0.5) * scale;
+        int first = std::max(static_cast<int>(center - support + 0.5), 0);
+        int last = std::min(static_cast<int>(center + support + 0.5), srcSize);
+        int count = std::min(last - first, result.taps);
+        double total = 0;
+        for (int k = 0; k < count; ++k) {
+            weights[k] = weight((first + k - center + 0.5) / filterScale);
+            total += weights[k];
+        }
+        int32_t *out = &result.weights[static_cast<size_t>(i) * result.taps];
+        for (int k = 0; k < count; ++k) {
+            double w = total != 0 ? weights[k] / total : weights[k];
+            w *= 1 << ResampleWeights::kPrecisionBits;
+            out[k] = static_cast<int32_t>(w < 0 ? w - 0.5 : w + 0.5);
+        }
+        result.first[i] = first;
+        result.count[i] = count;
+    }
+    return result;
+}
+
+template <typename ValueT>
+ResampleKernels<ValueT> FindResampleKernels(ColorSpace cs, uint8_t depth) {
+    ResampleKernels<ValueT> kernels;
+    DispatchPixelFormat<ValueT>(cs, depth, PickKernels<ValueT>{&kernels});
+    return kernels;
+}
+
+template <typename ValueT>
+void Resample(const ImageView<const ValueT> &src, const ImageView<ValueT> &dst,
+    ResampleFilter filter, ThreadPool *pool) {
+    if (src.ColorSpace() != dst.ColorSpace()) {
+        throw std::invalid_argument("color spaces to resample differ.");
+    }
+    if (src.Empty() || dst.Empty()) {
+        throw std::invalid_argument("sizes to resample must be positive.");
+    }
+    ThreadPool &threads = pool ? *pool : ThreadPool::Shared();
+    int depth = src.DepthBits();
+    auto kernels = FindResampleKernels<ValueT>(src.ColorSpace(), depth);
+    size_t rowValues = dst.RowValues();
+
+    // only the source rows the vertical filter reaches are scaled
+    ResampleWeights vertical = FilterWeights(filter, src.Height(),
+        dst.Height());
+    int firstRow = vertical.first.front();
+    int rows = vertical.first.back() + vertical.count.back() - firstRow;
+    std::vector<ValueT> scaled;
+    ImageView<const ValueT> middle = src.Crop(0, firstRow, src.Width(), rows);
+    if (src.Width() != dst.Width()) {
+        ResampleWeights horizontal = FilterWeights(filter, src.Width(),
+            dst.Width());
+        scaled.resize(rowValues * rows);
+        ForBands(threads, rows, [&](int first, int last) {
+            for (int y = first; y < last; ++y) {
+                kernels.scaleRow(middle.Row(y), src.Width(),
+                    scaled.data() + rowValues * y, horizontal, depth);
+            }
+        });
+        middle = ImageView<const ValueT>(scaled.data(), dst.Width(), rows,
+            src.ColorSpace(), src.DepthBits());
+    }
+
+    if (src.Height() == dst.Height()) {
+        for (int y = 0; y < dst.Height(); ++y) {
+            std::copy(middle.Row(y), middle.Row(y) + rowValues, dst.Row(y));
+        }
+        return;
+    }
+    ForBands(threads, dst.Height(), [&](int first, int last) {
+        std::vector<const ValueT *> taps(vertical.taps);
+        for (int y = first; y < last; ++y) {
+            int count = vertical.count[y];
+            for (int k = 0; k < count; ++k) {
+                taps[k] = middle.Row(vertical.first[y] - firstRow + k);
+            }
+            kernels.blendRows(taps.data(), &vertical.weights[
+                static_cast<size_t>(y) * vertical.taps], count, rowValues,
+                dst.Row(y), depth);
+        }
+    });
+}
+
+template <typename ValueT>
+RowResampler<ValueT>::RowResampler(int srcWidth, int srcHeight, int dstWidth,
+    int dstHeight, int components, int depth, ResampleFilter filter)
+    : srcWidth_(srcWidth), srcHeight_(srcHeight), dstWidth_(dstWidth),
+      dstHeight_(dstHeight), components_(components),
+      depth_(depth),
+      kernels_(FindResampleKernels<ValueT>(WithComponents(components),
+          depth)),
+      horizontal_(FilterWeights(filter, srcWidth, dstWidth)),
+      vertical_(FilterWeights(filter, srcHeight, dstHeight)) {
+    size_t rowValues = static_cast<size_t>(dstWidth) * components;
+    window_.resize(rowValues * vertical_.taps);
+    out_.resize(rowValues);
+    rows_.resize(vertical_.taps);
+}
+
+template <typename ValueT>
+void RowResampler<ValueT>::PushRows(const ValueT *rows, size_t stride, int n,
+    const RowSink &sink) {
+    size_t rowValues = static_cast<size_t>(dstWidth_) * components_;
+    int taps = vertical_.taps;
+
+    for (int r = 0; r < n && nextSrc_ < srcHeight_; ++r) {
+        // scale the row horizontally into its slot of the window
+        kernels_.scaleRow(rows + stride * r, srcWidth_,
+            window_.data() + rowValues * (nextSrc_ % taps), horizontal_,
+            depth_);
+        nextSrc_++;
+
+        // every destination row whose last source row just came in
+        while (nextDst_ < dstHeight_ && vertical_.first[nextDst_] +
+            vertical_.count[nextDst_] <= nextSrc_) {
+            int first = vertical_.first[nextDst_];
+            int count = vertical_.count[nextDst_];
+            for (int k = 0; k < count; ++k) {
+                rows_[k] = window_.data() + rowValues * ((first + k) % taps);
+            }
+            kernels_.blendRows(rows_.data(), &vertical_.weights[
+                static_cast<size_t>(nextDst_) * taps], count, rowValues,
+                out_.data(), depth_);
+            sink(nextDst_, out_.data());
+            nextDst_++;
+        }
+    }
+}
+
+template ResampleKernels<uint8_t> FindResampleKernels<uint8_t>(ColorSpace cs,
+    uint8_t depth);
+template ResampleKernels<uint16_t> FindResampleKernels<uint16_t>(
+    ColorSpace cs, uint8_t depth);
+template ResampleKernels<float> FindResampleKernels<float>(ColorSpace cs,
+    uint8_t depth);
+
+template void Resample<uint8_t>(const ImageView<const uint8_t> &src,
+    const ImageView<uint8_t> &dst, ResampleFilter filter, ThreadPool *pool);
+template void Resample<uint16_t>(const ImageView<const uint16_t> &src,
+    const ImageView<uint16_t> &dst, ResampleFilter filter, ThreadPool *pool);
+template void Resample<float>(const ImageView<const float> &src,
+    const ImageView<float> &dst, ResampleFilter filter, ThreadPool *pool);
+
+template class RowResampler<uint8_t>;
+template class RowResampler<uint16_t>;
+template class RowResampler<float>;
+
+}
+}
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <ree/image/image_view.hpp>
+#include <ree/image/thread_pool.hpp>
+
+namespace ree {
+namespace image {
+namespace process {
+
+/// the filters images are resampled with, the ones of Pillow
+enum class ResampleFilter {
+    /// the average of the source pixels a destination pixel covers, the
+    /// cheapest for large reductions
+    Area,
+    Bilinear,
+    /// Keys cubic with a = -0.5
+    Bicubic,
+    /// Lanczos-3
+    Lanczos,
+};
+
+/**
+ * @brief which source samples make up every destination sample along one
+ * axis, and their fixed point weights. Destination sample i is the sum of
+ * weights[i * taps + k] * src[first[i] + k] for k below count[i].
+ */
+struct ResampleWeights {
+    /// fraction bits of the weights
+    static constexpr int kPrecisionBits = 22;
+
+    int taps = 0;
+    std::vector<int> first;
+    std::vector<int> count;
+    std::vector<int32_t> weights;
+};
+
+/// weights scaling srcSize samples to dstSize, the filter widened by the
+/// scale factor when shrinking so every source sample is accounted for
+ResampleWeights FilterWeights(ResampleFilter filter, int srcSize,
+    int dstSize);
+
+/// the passes of Resample over single rows, made for one pixel format
+template <typename ValueT>
+struct ResampleKernels {
+    /// scale one row of srcWidth pixels to weights.first.size() pixels
+    void (*scaleRow)(const ValueT *src, int srcWidth, ValueT *dst,
+        const ResampleWeights &weights, int depth);
+    /// dst is the weighted sum of count rows of values samples each
+    void (*blendRows)(const ValueT *const *rows, const int32_t *weights,
+        int count, size_t values, ValueT *dst, int depth);
+};
+
+/// the kernels of pixels of cs with depth bit samples, picked once for a
+/// whole image by its PixelFormat and the SIMD level of this CPU
+template <typename ValueT>
+ResampleKernels<ValueT> FindResampleKernels(class ColorSpace cs,
+    uint8_t depth);
+
+/**
+ * @brief scale src into dst, which must have the same color space. Rows are
+ * scaled horizontally first, rounded to ValueT, then vertically, the way
+ * Pillow's Image.resize does, each pass split into bands of rows run in
+ * parallel.
+ */
+template <typename ValueT>
+void Resample(const ImageView<const ValueT> &src, const ImageView<ValueT> &dst,
+    ResampleFilter filter = ResampleFilter::Lanczos, ThreadPool *pool = nullptr);
+
+/**
+ * @brief scales an image as its rows stream in, holding only the few
+ * horizontally scaled rows the vertical filter spans. Gives what Resample
+ * gives.
+ */
+template <typename ValueT>
+class RowResampler {
+public:
+    /// called with every destination row in turn, valid during the call
+    using RowSink = std::function<void(int y, const ValueT *row)>;
+
+    /**
+     * @param components samples per pixel
+     * @param depth significant bits of the samples, results are clamped to
+     * the largest value they hold
+     */
+    RowResampler(int srcWidth, int srcHeight, int dstWidth, int dstHeight,
+        int components, int depth = 8 * sizeof(ValueT),
+        ResampleFilter filter = ResampleFilter::Lanczos);
+
+    /// scale the next n source rows, stride values apart, handing every
+    /// destination row they complete to sink
+    void PushRows(const ValueT *rows, size_t stride, int n,
+        const RowSink &sink);
+
+    int DstWidth() const { return dstWidth_; }
+    int DstHeight() const { return dstHeight_; }
+
+private:
+    int srcWidth_;
+    int srcHeight_;
+    int dstWidth_;
+    int dstHeight_;
+    int components_;
+    int depth_;
+    ResampleKernels<ValueT> kernels_;
+    ResampleWeights horizontal_;
+    ResampleWeights vertical_;
+
+    /// horizontally scaled source rows, row y in slot y % taps
+    std::vector<ValueT> window_;
+    std::vector<ValueT> out_;
+    std::vector<const ValueT *> rows_;
+    int nextSrc_ = 0;
+    int nextDst_ = 0;
+};
+
+}
+}
+}
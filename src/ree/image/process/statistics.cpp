@@ -0,0 +1,512 @@
+#include "statistics.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+#include <ree/image/simd.hpp>
+
+#ifdef REE_IMAGE_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace ree {
+namespace image {
+namespace process {
+
+namespace {
+
+/// rows below which a part is not worth a thread of its own
+constexpr int kMinRows = 16;
+
+/// the rows of an image split into parts for the threads of a pool and the
+/// one waiting on them
+struct Parts {
+    int count;
+    int height;
+
+    Parts(ThreadPool &pool, int height)
+        : count(std::max(1, std::min(static_cast<int>(pool.Size()) + 1,
+              height / kMinRows))),
+          height(height) {}
+
+    int First(int part) const {
+        return static_cast<int>(static_cast<int64_t>(height) * part / count);
+    }
+};
+
+/// the bin of samples, bins spread evenly over [0, 2^depth)
+template <typename ValueT>
+struct Binning {
+    Binning(uint8_t depth, int bins) : depth(depth), bins(bins) {}
+
+    int operator()(ValueT v) const {
+        return static_cast<int>(std::min<uint64_t>(
+            (static_cast<uint64_t>(v) * bins) >> depth, bins - 1));
+    }
+
+    uint8_t depth;
+    int bins;
+};
+
+/// bins spread evenly over [0, 1], NaN in the first one
+template <>
+struct Binning<float> {
+    Binning(uint8_t, int bins) : bins(bins) {}
+
+    int operator()(float v) const {
+        return v > 0 ? std::min(static_cast<int>(v * bins), bins - 1) : 0;
+    }
+
+    int bins;
+};
+
+/// count the count samples of a row into Tables tables of 256 in turn
+template <int Tables>
+void CountBytes(const uint8_t *row, size_t count, uint64_t *tables) {
+    size_t i = 0;
+    for (; i + Tables <= count; i += Tables) {
+        for (int t = 0; t < Tables; ++t) {
+            ++tables[t * 256 + row[i + t]];
+        }
+    }
+    for (; i < count; ++i) {
+        ++tables[i % Tables * 256 + row[i]];
+    }
+}
+
+/// the histograms of rows [first, last) of image into counts, channel major
+template <typename ValueT>
+void CountRows(const ImageView<const ValueT> &image,
+    const Binning<ValueT> &bin, int first, int last, uint64_t *counts) {
+    int components = image.Components();
+    size_t count = static_cast<size_t>(image.Width()) * components;
+    for (int y = first; y < last; ++y) {
+        const ValueT *row = image.Row(y);
+        for (size_t i = 0; i < count; i += components) {
+            for (int c = 0; c < components; ++c) {
+                ++counts[c * bin.bins + bin(row[i + c])];
+            }
+        }
+    }
+}
+
+/// bytes binned one to one, through tables a multiple of the components
+void CountRows(const ImageView<const uint8_t> &image, int first, int last,
+    uint64_t *counts) {
+    int components = image.Components();
+    int tables = components == 3 ? 6 : 4;
+    std::vector<uint64_t> counted(tables * 256);
+    size_t count = static_cast<size_t>(image.Width()) * components;
+    for (int y = first; y < last; ++y) {
+        if (tables == 6) {
+            CountBytes<6>(image.Row(y), count, counted.data());
+        } else {
+            CountBytes<4>(image.Row(y), count, counted.data());
+        }
+    }
+    for (int t = 0; t < tables; ++t) {
+        for (int b = 0; b < 256; ++b) {
+            counts[t % components * 256 + b] += counted[t * 256 + b];
+        }
+    }
+}
+
+template <typename ValueT>
+void CountPart(const ImageView<const ValueT> &image,
+    const Binning<ValueT> &bin, int first, int last, uint64_t *counts) {
+    CountRows(image, bin, first, last, counts);
+}
+
+void CountPart(const ImageView<const uint8_t> &image,
+    const Binning<uint8_t> &bin, int first, int last, uint64_t *counts) {
+    if (bin.depth == 8 && bin.bins == 256) {
+        CountRows(image, first, last, counts);
+    } else {
+        CountRows(image, bin, first, last, counts);
+    }
+}
+
+template <typename ValueT>
+std::vector<std::vector<uint64_t>> CountHistograms(
+    const ImageView<const ValueT> &image, uint8_t depth, int bins,
+    ThreadPool *pool) {
+    int components = image.Components();
+    std::vector<std::vector<uint64_t>> histograms(components,
+        std::vector<uint64_t>(bins));
+    if (image.Empty()) {
+        return histograms;
+    }
+    ThreadPool &threads = pool ? *pool : ThreadPool::Shared();
+    Parts parts(threads, image.Height());
+    std::vector<std::vector<uint64_t>> counts(parts.count);
+    Binning<ValueT> bin(depth, bins);
+    threads.ParallelFor(parts.count, [&](size_t part) {
+        std::vector<uint64_t> &partCounts = counts[part];
+        partCounts.assign(static_cast<size_t>(components) * bins, 0);
+        int first = parts.First(static_cast<int>(part));
+        int last = parts.First(static_cast<int>(part) + 1);
+        CountPart(image, bin, first, last, partCounts.data());
+    });
+    for (const auto &partCounts : counts) {
+        for (int c = 0; c < components; ++c) {
+            for (int b = 0; b < bins; ++b) {
+                histograms[c][b] += partCounts[c * bins + b];
+            }
+        }
+    }
+    return histograms;
+}
+
+/// the statistics of a histogram of every value of a channel
+ChannelStatistics StatisticsOf(const std::vector<uint64_t> &histogram) {
+    ChannelStatistics statistics;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t squares = 0;
+    int first = -1;
+    int last = -1;
+    for (int b = 0; b < static_cast<int>(histogram.size()); ++b) {
+        uint64_t n = histogram[b];
+        if (n == 0) {
+            continue;
+        }
+        first = first < 0 ? b : first;
+        last = b;
+        count += n;
+        sum += n * b;
+        squares += n * b * b;
+    }
+    if (count == 0) {
+        return statistics;
+    }
+    statistics.min = first;
+    statistics.max = last;
+    statistics.mean = static_cast<double>(sum) / count;
+    statistics.variance = std::max(static_cast<double>(squares) / count -
+        statistics.mean * statistics.mean, 0.0);
+    return statistics;
+}
+
+/// what the samples of one channel of a part add up to, exactly for
+/// integers
+template <typename ValueT>
+struct Moments {
+    using Sum = typename std::conditional<
+        std::is_floating_point<ValueT>::value, double, uint64_t>::type;
+
+    ValueT min = std::numeric_limits<ValueT>::max();
+    ValueT max = std::numeric_limits<ValueT>::lowest();
+    Sum sum = 0;
+    Sum squares = 0;
+};
+
+template <typename ValueT>
+void AddRows(const ImageView<const ValueT> &image, int first, int last,
+    Moments<ValueT> *moments) {
+    using Sum = typename Moments<ValueT>::Sum;
+    int components = image.Components();
+    size_t count = static_cast<size_t>(image.Width()) * components;
+    for (int y = first; y < last; ++y) {
+        const ValueT *row = image.Row(y);
+        for (int c = 0; c < components; ++c) {
+            Moments<ValueT> &m = moments[c];
+            for (size_t i = c; i < count; i += components) {
+                ValueT v = row[i];
+                m.min = std::min(m.min, v);
+                m.max = std::max(m.max, v);
+                m.sum += v;
+                m.squares += static_cast<Sum>(v) * v;
+            }
+        }
+    }
+}
+
+template <typename ValueT>
+std::vector<ChannelStatistics> StatisticsOfMoments(
+    const ImageView<const ValueT> &image, ThreadPool *pool) {
+    int components = image.Components();
+    std::vector<ChannelStatistics> statistics(components);
+    if (image.Empty()) {
+        return statistics;
+    }
+    ThreadPool &threads = pool ? *pool : ThreadPool::Shared();
+    Parts parts(threads, image.Height());
+    std::vector<std::vector<Moments<ValueT>>> moments(parts.count,
+        std::vector<Moments<ValueT>>(components));
+    threads.ParallelFor(parts.count, [&](size_t part) {
+        AddRows(image, parts.First(static_cast<int>(part)),
+            parts.First(static_cast<int>(part) + 1), moments[part].data());
+    });
+    double count = static_cast<double>(image.Width()) * image.Height();
+    for (int c = 0; c < components; ++c) {
+        Moments<ValueT> total;
+        for (const auto &partMoments : moments) {
+            total.min = std::min(total.min, partMoments[c].min);
+            total.max = std::max(total.max, partMoments[c].max);
+            total.sum += partMoments[c].sum;
+            total.squares += partMoments[c].squares;
+        }
+        ChannelStatistics &s = statistics[c];
+        s.min = total.min;
+        s.max = total.max;
+        s.mean = static_cast<double>(total.sum) / count;
+        s.variance = std::max(static_cast<double>(total.squares) / count -
+            s.mean * s.mean, 0.0);
+    }
+    return statistics;
+}
+
+template <typename ValueT>
+std::vector<ChannelStatistics> Statistics(
+    const ImageView<const ValueT> &image, ThreadPool *pool) {
+    return StatisticsOfMoments(image, pool);
+}
+
+std::vector<ChannelStatistics> Statistics(
+    const ImageView<const uint8_t> &image, ThreadPool *pool) {
+    std::vector<ChannelStatistics> statistics;
+    for (const auto &histogram : CountHistograms(image, 8, 256, pool)) {
+        statistics.push_back(StatisticsOf(histogram));
+    }
+    return statistics;
+}
+
+/// the kernels for rows of bytes, each returning how many pixels from the
+/// start passed, a whole number of registers
+struct RowKernels {
+    int (*opaque)(const uint8_t *row, int width);
+    int (*gray)(const uint8_t *row, int width);
+};
+
+#ifdef REE_IMAGE_SIMD_X86
+
+template <int Components>
+REE_TARGET("avx2")
+int OpaqueAvx2(const uint8_t *row, int width) {
+    // every bit set once the samples but alpha are
+    const __m256i others = Components == 4 ?
+        _mm256_set1_epi32(0x00ffffff) : _mm256_set1_epi16(0x00ff);
+    const __m256i ones = _mm256_set1_epi8(-1);
+    constexpr int step = 128 / Components;
+    int x = 0;
+    for (; x + step <= width; x += step) {
+        const __m256i *p = reinterpret_cast<const __m256i *>(
+            row + x * Components);
+        __m256i all = _mm256_and_si256(
+            _mm256_and_si256(_mm256_loadu_si256(p),
+                _mm256_loadu_si256(p + 1)),
+            _mm256_and_si256(_mm256_loadu_si256(p + 2),
+                _mm256_loadu_si256(p + 3)));
+        if (!_mm256_testc_si256(_mm256_or_si256(all, others), ones)) {
+            break;
+        }
+    }
+    return x;
+}
+
+REE_TARGET("avx2")
+int GrayRgbaAvx2(const uint8_t *row, int width) {
+    // red ^ green and green ^ blue in the low half of each pixel
+    const __m256i colors = _mm256_set1_epi32(0xffff);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        const __m256i *p = reinterpret_cast<const __m256i *>(row + 4 * x);
+        __m256i a = _mm256_loadu_si256(p);
+        __m256i b = _mm256_loadu_si256(p + 1);
+        __m256i differ = _mm256_or_si256(
+            _mm256_xor_si256(a, _mm256_srli_epi32(a, 8)),
+            _mm256_xor_si256(b, _mm256_srli_epi32(b, 8)));
+        if (!_mm256_testz_si256(differ, colors)) {
+            break;
+        }
+    }
+    return x;
+}
+
+REE_TARGET("avx2")
+int GrayRgbAvx2(const uint8_t *row, int width) {
+    // a sample equals the next where the next is the green or blue one of
+    // the same pixel, bits at offsets 0, 1 and 2 of each 3 in turn
+    const uint32_t masks[3] = {0xdb6db6dbu, 0xb6db6db6u, 0x6db6db6du};
+    int x = 0;
+    // the loads one byte on read the first byte past the 32 pixels
+    for (; (x + 32) * 3 < width * 3; x += 32) {
+        const uint8_t *p = row + 3 * x;
+        bool gray = true;
+        for (int k = 0; k < 3; ++k) {
+            __m256i a = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i *>(p + 32 * k));
+            __m256i b = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i *>(p + 32 * k + 1));
+            uint32_t equal = static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+            gray = gray && (equal & masks[k]) == masks[k];
+        }
+        if (!gray) {
+            break;
+        }
+    }
+    return x;
+}
+
+#endif
+
+RowKernels FindRowKernels(ColorSpace cs) {
+    RowKernels kernels = {nullptr, nullptr};
+#ifdef REE_IMAGE_SIMD_X86
+    if (ActiveSimdLevel() >= SimdLevel::Avx2) {
+        if (cs == ColorSpace::RGBA) {
+            kernels = {OpaqueAvx2<4>, GrayRgbaAvx2};
+        } else if (cs == ColorSpace::GrayAlpha) {
+            kernels.opaque = OpaqueAvx2<2>;
+        } else if (cs == ColorSpace::RGB) {
+            kernels.gray = GrayRgbAvx2;
+        }
+    }
+#endif
+    return kernels;
+}
+
+template <typename ValueT>
+ValueT LargestSample(uint8_t depth) {
+    return static_cast<ValueT>((uint32_t(1) << depth) - 1);
+}
+
+template <>
+float LargestSample<float>(uint8_t) {
+    return 1.0f;
+}
+
+template <typename ValueT>
+ValueT MiddleSample(uint8_t depth) {
+    return static_cast<ValueT>(uint32_t(1) << (depth - 1));
+}
+
+template <>
+float MiddleSample<float>(uint8_t) {
+    return 0.5f;
+}
+
+/// whether fn(row) holds for every row of image, parts in parallel giving
+/// up once any fails
+template <typename Fn>
+bool AllRows(ThreadPool *pool, int height, const Fn &fn) {
+    ThreadPool &threads = pool ? *pool : ThreadPool::Shared();
+    Parts parts(threads, height);
+    std::atomic<bool> failed(false);
+    threads.ParallelFor(parts.count, [&](size_t part) {
+        int last = parts.First(static_cast<int>(part) + 1);
+        for (int y = parts.First(static_cast<int>(part)); y < last; ++y) {
+            if (failed.load(std::memory_order_relaxed)) {
+                return;
+            }
+            if (!fn(y)) {
+                failed.store(true, std::memory_order_relaxed);
+                return;
+            }
+        }
+    });
+    return !failed.load();
+}
+
+/// the byte kernel of kernels for image where it applies
+template <typename ValueT>
+int RunRowKernel(int (*kernel)(const uint8_t *, int),
+    const ImageView<const ValueT> &image, const ValueT *row) {
+    if (!kernel || !std::is_same<ValueT, uint8_t>::value ||
+        image.DepthBits() != 8) {
+        return 0;
+    }
+    return kernel(reinterpret_cast<const uint8_t *>(row), image.Width());
+}
+
+}
+
+template <typename ValueT>
+std::vector<std::vector<uint64_t>> ComputeHistograms(
+    const ImageView<const ValueT> &image, int bins, ThreadPool *pool) {
+    if (bins <= 0) {
+        throw std::invalid_argument("histograms need at least one bin.");
+    }
+    return CountHistograms(image, image.DepthBits(), bins, pool);
+}
+
+template <typename ValueT>
+std::vector<ChannelStatistics> ComputeStatistics(
+    const ImageView<const ValueT> &image, ThreadPool *pool) {
+    return Statistics(image, pool);
+}
+
+template <typename ValueT>
+bool IsOpaque(const ImageView<const ValueT> &image, ThreadPool *pool) {
+    int alpha = image.ColorSpace().AlphaIndex();
+    if (alpha < 0 || image.Empty()) {
+        return true;
+    }
+    ValueT largest = LargestSample<ValueT>(image.DepthBits());
+    RowKernels kernels = FindRowKernels(image.ColorSpace());
+    int components = image.Components();
+    return AllRows(pool, image.Height(), [&](int y) {
+        const ValueT *row = image.Row(y);
+        for (int x = RunRowKernel(kernels.opaque, image, row);
+            x < image.Width(); ++x) {
+            if (!(row[x * components + alpha] >= largest)) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+template <typename ValueT>
+bool IsGrayscale(const ImageView<const ValueT> &image, ThreadPool *pool) {
+    class ColorSpace cs = image.ColorSpace();
+    if (cs == ColorSpace::Gray || cs == ColorSpace::GrayAlpha ||
+        image.Empty()) {
+        return true;
+    }
+    if (cs != ColorSpace::RGB && cs != ColorSpace::RGBA &&
+        cs != ColorSpace::YCbCr) {
+        return false;
+    }
+    ValueT middle = MiddleSample<ValueT>(image.DepthBits());
+    RowKernels kernels = FindRowKernels(cs);
+    int components = image.Components();
+    bool chroma = cs == ColorSpace::YCbCr;
+    return AllRows(pool, image.Height(), [&](int y) {
+        const ValueT *row = image.Row(y);
+        for (int x = RunRowKernel(kernels.gray, image, row);
+            x < image.Width(); ++x) {
+            const ValueT *pixel = row + x * components;
+            bool gray = chroma ? pixel[1] == middle && pixel[2] == middle :
+                pixel[0] == pixel[1] && pixel[1] == pixel[2];
+            if (!gray) {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+#define REE_IMAGE_STATISTICS(ValueT) \
+    template std::vector<std::vector<uint64_t>> ComputeHistograms<ValueT>( \
+        const ImageView<const ValueT> &image, int bins, ThreadPool *pool); \
+    template std::vector<ChannelStatistics> ComputeStatistics<ValueT>( \
+        const ImageView<const ValueT> &image, ThreadPool *pool); \
+    template bool IsOpaque<ValueT>(const ImageView<const ValueT> &image, \
+        ThreadPool *pool); \
+    template bool IsGrayscale<ValueT>(const ImageView<const ValueT> &image, \
+        ThreadPool *pool);
+
+REE_IMAGE_STATISTICS(uint8_t)
+REE_IMAGE_STATISTICS(uint16_t)
+REE_IMAGE_STATISTICS(float)
+
+#undef REE_IMAGE_STATISTICS
+
+}
+}
+}
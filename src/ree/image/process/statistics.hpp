@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <ree/image/image_view.hpp>
+#include <ree/image/thread_pool.hpp>
+
+namespace ree {
+namespace image {
+namespace process {
+
+/// the statistics of the samples of one channel, at the depth of the image
+/// or in [0, 1] for floats
+struct ChannelStatistics {
+    double min = 0;
+    double max = 0;
+    double mean = 0;
+    /// over all pixels, not an estimate from a sample of them
+    double variance = 0;
+};
+
+/**
+ * @brief count the samples of each channel of image into bins bins spread
+ * evenly over the samples of its depth, [0, 1] for floats with those past
+ * either end in the end bins.
+ *
+ * The rows are split into one part per thread of the pool and the caller,
+ * each counting into bins of its own which are added up at the end. Bytes
+ * are counted into several tables in turn, so runs of equal samples do not
+ * wait on the same counter.
+ */
+template <typename ValueT>
+std::vector<std::vector<uint64_t>> ComputeHistograms(
+    const ImageView<const ValueT> &image, int bins = 256,
+    ThreadPool *pool = nullptr);
+
+/// the statistics of each channel of image, from histograms of every value
+/// for bytes and from running sums for deeper samples
+template <typename ValueT>
+std::vector<ChannelStatistics> ComputeStatistics(
+    const ImageView<const ValueT> &image, ThreadPool *pool = nullptr);
+
+/**
+ * @brief whether image has no alpha or only the largest alpha samples, 1 and
+ * above for floats, so the alpha channel can be dropped.
+ *
+ * Stops at the first pixel that is not opaque. Bytes are checked 128 at a
+ * time through AVX2 where the CPU has it.
+ */
+template <typename ValueT>
+bool IsOpaque(const ImageView<const ValueT> &image, ThreadPool *pool = nullptr);
+
+/// whether every pixel of image is gray: any Gray or GrayAlpha image, RGB
+/// and RGBA ones with equal colors, YCbCr ones with chroma at the middle.
+/// Stops at the first pixel that is not, and takes AVX2 like IsOpaque.
+template <typename ValueT>
+bool IsGrayscale(const ImageView<const ValueT> &image,
+    ThreadPool *pool = nullptr);
+
+}
+}
+}
@@ -0,0 +1,108 @@
+#include "thumbnail.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <ree/image/io/decoder.hpp>
+#include <ree/image/io/encoder.hpp>
+#include <ree/image/io/error.hpp>
+#include <ree/image/process/resample.hpp>
+
+namespace ree {
+namespace image {
+namespace process {
+
+namespace {
+
+constexpr int kStripRows = 16;
+
+/// the largest of the scales formats decode at that keeps size at least
+/// wanted along both axes
+int ScaleDenominator(const io::ImageInfo &size, int width, int height) {
+    for (int denom = 8; denom > 1; denom /= 2) {
+        if ((size.width + denom - 1) / denom >= width &&
+            (size.height + denom - 1) / denom >= height) {
+            return denom;
+        }
+    }
+    return 1;
+}
+
+template <typename ValueT>
+void Resample(io::Decoder &decoder, const io::ImageInfo &decoded,
+    io::Encoder &encoder, const io::ImageInfo &info) {
+    RowResampler<ValueT> resampler(decoded.width, decoded.height, info.width,
+        info.height, decoded.colorspace.Components(), decoded.depth);
+    size_t rowValues = static_cast<size_t>(decoded.width) *
+        decoded.colorspace.Components();
+    std::vector<ValueT> strip(rowValues * kStripRows);
+    size_t rowBytes = info.RowBytes();
+    auto sink = [&encoder, rowBytes](int, const ValueT *row) {
+        encoder.WriteRows(reinterpret_cast<const uint8_t *>(row), rowBytes, 1);
+    };
+
+    int y = 0;
+    while (y < decoded.height) {
+        int n = decoder.ReadRows(reinterpret_cast<uint8_t *>(strip.data()),
+            rowValues * sizeof(ValueT), kStripRows);
+        if (n <= 0) {
+            throw io::FileCorruptedException("image ends before its last row.");
+        }
+        resampler.PushRows(strip.data(), rowValues, n, sink);
+        y += n;
+    }
+}
+
+}
+
+io::ImageInfo Thumbnail(ree::io::Source *source, ree::io::Source *target,
+    int maxWidth, int maxHeight, int quality,
+    const io::WriteOptions &options) {
+    if (maxWidth <= 0 || maxHeight <= 0) {
+        throw std::invalid_argument("thumbnail size must be positive.");
+    }
+    thread_local io::Decoder decoder;
+    thread_local io::Encoder encoder;
+
+    io::ImageInfo full = decoder.Probe(source);
+    io::ImageInfo info = full;
+    double scale = std::min(1.0, std::min(
+        static_cast<double>(maxWidth) / info.width,
+        static_cast<double>(maxHeight) / info.height));
+    info.width = std::max(1, static_cast<int>(std::lround(info.width * scale)));
+    info.height = std::max(1,
+        static_cast<int>(std::lround(info.height * scale)));
+
+    io::LoadOptions loadOptions;
+    loadOptions["scale_denom"] = std::to_string(
+        ScaleDenominator(full, info.width, info.height));
+    io::WriteOptions writeOptions(options);
+    writeOptions["quality"] = std::to_string(quality);
+
+    // formats which can not scale while decoding hand out every row
+    io::ImageInfo decoded = decoder.Begin(source, loadOptions);
+    info.colorspace = decoded.colorspace;
+    info.depth = decoded.depth;
+    try {
+        encoder.Begin(target, info, writeOptions);
+        if (decoded.depth > 8) {
+            Resample<uint16_t>(decoder, decoded, encoder, info);
+        } else {
+            Resample<uint8_t>(decoder, decoded, encoder, info);
+        }
+        encoder.End();
+    } catch (...) {
+        decoder.End();
+        encoder.Reset();
+        throw;
+    }
+    decoder.End();
+    return info;
+}
+
+}
+}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <ree/io/source.h>
+#include <ree/image/io/image.hpp>
+
+namespace ree {
+namespace image {
+namespace process {
+
+/**
+ * @brief write a copy of source scaled down to fit maxWidth x maxHeight,
+ * keeping its aspect ratio, to target. Images already small enough keep
+ * their size.
+ *
+ * JPEG images are decoded at the smallest DCT scale, and interlaced PNG
+ * images from the fewest Adam7 passes, still larger than the thumbnail. The
+ * rows are then resampled with Lanczos-3 as they are decoded and handed to
+ * the encoder as they are resampled, so the image is never held whole.
+ * Formats whose encoder takes no rows as they come collect the thumbnail
+ * before writing it, and formats without an encoder, all but PPM for now,
+ * throw NotImplementException before target is opened.
+ *
+ * @param quality handed to the encoder as options["quality"]
+ * @param options picks the format written, see io::Encoder
+ * @return size and layout of the thumbnail written
+ */
+io::ImageInfo Thumbnail(ree::io::Source *source, ree::io::Source *target,
+    int maxWidth, int maxHeight, int quality = 85,
+    const io::WriteOptions &options = io::WriteOptions());
+
+}
+}
+}
@@ -0,0 +1,395 @@
+#include "tile_engine.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <ree/image/pixel_buffer.hpp>
+#include <ree/image/io/error.hpp>
+
+namespace ree {
+namespace image {
+namespace process {
+
+namespace {
+
+struct Rect {
+    int x;
+    int y;
+    int w;
+    int h;
+};
+
+/// rect grown by halo on every side, clipped to a width x height image
+Rect Grow(const Rect &rect, int halo, int width, int height) {
+    int x0 = std::max(rect.x - halo, 0);
+    int y0 = std::max(rect.y - halo, 0);
+    int x1 = std::min(rect.x + rect.w + halo, width);
+    int y1 = std::min(rect.y + rect.h + halo, height);
+    return Rect{x0, y0, x1 - x0, y1 - y0};
+}
+
+/**
+ * @brief the rows of a streamed image the tiles currently need. Rows are
+ * decoded as the window moves down, the ones above it are dropped.
+ */
+template <typename ValueT>
+class RowWindow {
+public:
+    RowWindow(io::Decoder &decoder, const io::ImageInfo &info, int capacity)
+        : decoder_(decoder), info_(info), capacity_(capacity),
+          rowValues_(static_cast<size_t>(info.width) *
+            info.colorspace.Components()) {
+        rows_.resize(rowValues_ * capacity);
+    }
+
+    /// the rows [y, y + h), which must not start above the last call's
+    ImageView<const ValueT> Rows(int y, int h) {
+        if (y > first_) {
+            int drop = std::min(y - first_, count_);
+            std::copy(rows_.data() + rowValues_ * drop,
+                rows_.data() + rowValues_ * count_, rows_.data());
+            first_ += drop;
+            count_ -= drop;
+        }
+        if (y + h - first_ > capacity_) {
+            throw std::logic_error("rows do not fit the window.");
+        }
+        while (first_ + count_ < y + h) {
+            int rows = decoder_.ReadRows(
+                reinterpret_cast<uint8_t *>(rows_.data() + rowValues_ * count_),
+                rowValues_ * sizeof(ValueT), y + h - first_ - count_);
+            if (rows <= 0) {
+                throw io::FileCorruptedException(
+                    "image ends before its last row.");
+            }
+            count_ += rows;
+        }
+        return ImageView<const ValueT>(rows_.data() + rowValues_ * (y - first_),
+            info_.width, h, info_.colorspace, info_.depth);
+    }
+
+private:
+    io::Decoder &decoder_;
+    io::ImageInfo info_;
+    int capacity_;
+    size_t rowValues_;
+    PixelBuffer<ValueT> rows_;
+    /// the image row held first, and how many are held
+    int first_ = 0;
+    int count_ = 0;
+};
+
+}
+
+template <typename ValueT>
+TileEngine<ValueT>::TileEngine(const TileOptions &options)
+    : options_(options) {
+    if (options_.tileWidth <= 0 || options_.tileHeight <= 0) {
+        throw std::invalid_argument("tile size must be positive.");
+    }
+    if (options_.threads > 0) {
+        pool_.reset(new ThreadPool(options_.threads));
+    }
+}
+
+template <typename ValueT>
+void TileEngine<ValueT>::AddKernel(Kernel kernel, int halo,
+    class ColorSpace to) {
+    if (halo < 0) {
+        throw std::invalid_argument("halo must not be negative.");
+    }
+    stages_.push_back(Stage{std::move(kernel), halo, to});
+}
+
+template <typename ValueT>
+ColorSpace TileEngine<ValueT>::OutputColorSpace(class ColorSpace cs) const {
+    for (const auto &stage : stages_) {
+        if (stage.to != ColorSpace::Unknown) {
+            cs = stage.to;
+        }
+    }
+    return cs;
+}
+
+template <typename ValueT>
+int TileEngine<ValueT>::TotalHalo() const {
+    int halo = 0;
+    for (const auto &stage : stages_) {
+        halo += stage.halo;
+    }
+    return halo;
+}
+
+template <typename ValueT>
+ThreadPool &TileEngine<ValueT>::Pool() const {
+    return pool_ ? *pool_ : ThreadPool::Shared();
+}
+
+template <typename ValueT>
+typename TileEngine<ValueT>::TilePlan TileEngine<ValueT>::Plan(
+    const io::ImageInfo &info, bool streamIn, bool streamOut,
+    size_t heldBytes) const {
+    int halo = TotalHalo();
+    size_t inRow = static_cast<size_t>(info.width) *
+        info.colorspace.Components() * sizeof(ValueT);
+    size_t outRow = static_cast<size_t>(info.width) *
+        OutputColorSpace(info.colorspace).Components() * sizeof(ValueT);
+
+    // the widest color space a tile is kept in between two kernels
+    size_t scratchComponents = 0;
+    int scratchBuffers = std::min<int>(static_cast<int>(stages_.size()) - 1, 2);
+    class ColorSpace cs = info.colorspace;
+    for (size_t i = 0; i + 1 < stages_.size(); ++i) {
+        if (stages_[i].to != ColorSpace::Unknown) {
+            cs = stages_[i].to;
+        }
+        scratchComponents = std::max<size_t>(scratchComponents,
+            cs.Components());
+    }
+
+    auto bytes = [&](int tileWidth, int tileHeight, size_t concurrency) {
+        size_t total = heldBytes;
+        if (streamIn) {
+            total += inRow * std::min(tileHeight + 2 * halo, info.height);
+        }
+        if (streamOut) {
+            total += outRow * tileHeight;
+        }
+        if (scratchBuffers > 0) {
+            total += concurrency * scratchBuffers * scratchComponents *
+                sizeof(ValueT) * (tileWidth + 2 * halo) *
+                (tileHeight + 2 * halo);
+        }
+        return total;
+    };
+
+    TilePlan plan;
+    plan.tileWidth = std::max(std::min(options_.tileWidth, info.width), 1);
+    plan.tileHeight = std::max(std::min(options_.tileHeight, info.height), 1);
+    plan.concurrency = 1;
+    size_t budget = options_.memoryBudget;
+    if (budget > 0) {
+        // halve the longer side until a single tile fits
+        while (bytes(plan.tileWidth, plan.tileHeight, 1) > budget) {
+            if (plan.tileWidth == 1 && plan.tileHeight == 1) {
+                throw std::invalid_argument("memory budget too small.");
+            }
+            if (plan.tileHeight >= plan.tileWidth) {
+                plan.tileHeight = (plan.tileHeight + 1) / 2;
+            } else {
+                plan.tileWidth = (plan.tileWidth + 1) / 2;
+            }
+        }
+    }
+
+    size_t tilesX = (info.width + plan.tileWidth - 1) / plan.tileWidth;
+    plan.concurrency = std::max<size_t>(std::min(Pool().Size(), tilesX), 1);
+    while (budget > 0 && plan.concurrency > 1 &&
+        bytes(plan.tileWidth, plan.tileHeight, plan.concurrency) > budget) {
+        plan.concurrency--;
+    }
+    plan.bytes = bytes(plan.tileWidth, plan.tileHeight, plan.concurrency);
+    return plan;
+}
+
+template <typename ValueT>
+void TileEngine<ValueT>::InputRows(const io::ImageInfo &info, int y, int h,
+    int *first, int *last) const {
+    int halo = TotalHalo();
+    *first = std::max(y - halo, 0);
+    *last = std::min(y + h + halo, info.height);
+}
+
+template <typename ValueT>
+void TileEngine<ValueT>::Process(const io::ImageInfo &info,
+    const TilePlan &plan, const InputBand &input, const OutputBand &output,
+    const EmitBand &emit) {
+    int width = info.width;
+    int height = info.height;
+    size_t stages = stages_.size();
+
+    // the color space of a tile after each kernel
+    std::vector<class ColorSpace> spaces;
+    size_t scratchComponents = 0;
+    class ColorSpace cs = info.colorspace;
+    for (size_t i = 0; i < stages; ++i) {
+        if (stages_[i].to != ColorSpace::Unknown) {
+            cs = stages_[i].to;
+        }
+        spaces.push_back(cs);
+        if (i + 1 < stages) {
+            scratchComponents = std::max<size_t>(scratchComponents,
+                cs.Components());
+        }
+    }
+
+    // intermediate tiles ping-pong between two buffers per slot
+    int halo = TotalHalo();
+    size_t buffers = std::min<size_t>(stages > 0 ? stages - 1 : 0, 2);
+    std::vector<PixelBuffer<ValueT>> scratch(plan.concurrency * buffers);
+    for (auto &buffer : scratch) {
+        buffer.resize(scratchComponents * (plan.tileWidth + 2 * halo) *
+            (plan.tileHeight + 2 * halo));
+    }
+
+    int tilesX = (width + plan.tileWidth - 1) / plan.tileWidth;
+    size_t slots = std::min<size_t>(plan.concurrency, tilesX);
+
+    for (int y = 0; y < height; y += plan.tileHeight) {
+        int tileHeight = std::min(plan.tileHeight, height - y);
+        int first, last;
+        InputRows(info, y, tileHeight, &first, &last);
+        ImageView<const ValueT> in = input(first, last - first);
+        ImageView<ValueT> out = output(y, tileHeight);
+
+        Pool().ParallelFor(slots, [&](size_t slot) {
+            std::vector<Rect> regions(stages);
+            for (int t = static_cast<int>(slot); t < tilesX;
+                t += static_cast<int>(slots)) {
+                Rect tile{t * plan.tileWidth, y,
+                    std::min(plan.tileWidth, width - t * plan.tileWidth),
+                    tileHeight};
+                ImageView<ValueT> dst = out.Crop(tile.x, 0, tile.w, tile.h);
+                if (stages == 0) {
+                    ImageView<const ValueT> src = in.Crop(tile.x, y - first,
+                        tile.w, tile.h);
+                    for (int row = 0; row < tile.h; ++row) {
+                        std::copy(src.Row(row), src.Row(row) + src.RowValues(),
+                            dst.Row(row));
+                    }
+                    continue;
+                }
+
+                // what every kernel writes, so the next one has its halo
+                regions[stages - 1] = tile;
+                for (size_t i = stages - 1; i > 0; --i) {
+                    regions[i - 1] = Grow(regions[i], stages_[i].halo, width,
+                        height);
+                }
+                Rect srcRect = Grow(regions[0], stages_[0].halo, width, height);
+                ImageView<const ValueT> src = in.Crop(srcRect.x,
+                    srcRect.y - first, srcRect.w, srcRect.h);
+
+                for (size_t i = 0; i < stages; ++i) {
+                    const Rect &region = regions[i];
+                    ImageView<ValueT> stageDst = dst;
+                    if (i + 1 < stages) {
+                        auto &buffer = scratch[slot * buffers + i % buffers];
+                        stageDst = ImageView<ValueT>(buffer.data(), region.w,
+                            region.h, spaces[i], info.depth);
+                    }
+                    stages_[i].kernel(src, stageDst, region.x - srcRect.x,
+                        region.y - srcRect.y);
+                    src = stageDst;
+                    srcRect = region;
+                }
+            }
+        });
+        emit(y, tileHeight);
+    }
+}
+
+/// throw unless samples of depth bits are stored as ValueT
+template <typename ValueT>
+static void CheckDepth(uint8_t depth) {
+    if ((depth > 8) != (sizeof(ValueT) > 1)) {
+        throw std::invalid_argument("image depth does not fit the value type.");
+    }
+}
+
+template <typename ValueT>
+static void CheckOutput(const io::ImageInfo &info, class ColorSpace cs,
+    const ImageView<ValueT> &dst) {
+    if (dst.Width() != info.width || dst.Height() != info.height ||
+        dst.ColorSpace() != cs) {
+        throw std::invalid_argument("output does not match the image.");
+    }
+}
+
+template <typename ValueT>
+io::ImageInfo TileEngine<ValueT>::Run(ree::io::Source *source,
+    const ImageView<ValueT> &dst, const io::LoadOptions &options) {
+    io::ImageInfo info = decoder_.Begin(source, options);
+    io::ImageInfo outInfo = info;
+    outInfo.colorspace = OutputColorSpace(info.colorspace);
+    try {
+        CheckDepth<ValueT>(info.depth);
+        CheckOutput(info, outInfo.colorspace, dst);
+        TilePlan plan = Plan(info, true, false);
+        RowWindow<ValueT> window(decoder_, info,
+            std::min(plan.tileHeight + 2 * TotalHalo(), info.height));
+        Process(info, plan,
+            [&window](int y, int h) { return window.Rows(y, h); },
+            [&dst](int y, int h) { return dst.Crop(0, y, dst.Width(), h); },
+            [](int, int) {});
+    } catch (...) {
+        decoder_.End();
+        throw;
+    }
+    decoder_.End();
+    return outInfo;
+}
+
+template <typename ValueT>
+io::ImageInfo TileEngine<ValueT>::Run(ree::io::Source *source,
+    ree::io::Source *target, const io::WriteOptions &writeOptions,
+    const io::LoadOptions &loadOptions) {
+    io::ImageInfo info = decoder_.Begin(source, loadOptions);
+    io::ImageInfo outInfo = info;
+    outInfo.colorspace = OutputColorSpace(info.colorspace);
+    try {
+        CheckDepth<ValueT>(info.depth);
+        size_t held = encoder_.StreamsRows(writeOptions) ? 0 :
+            outInfo.RowBytes() * outInfo.height;
+        TilePlan plan = Plan(info, true, true, held);
+        RowWindow<ValueT> window(decoder_, info,
+            std::min(plan.tileHeight + 2 * TotalHalo(), info.height));
+
+        size_t rowBytes = outInfo.RowBytes();
+        PixelBuffer<ValueT> band;
+        band.resize(rowBytes / sizeof(ValueT) * plan.tileHeight);
+        ImageView<ValueT> bandView(band.data(), outInfo.width, plan.tileHeight,
+            outInfo.colorspace, outInfo.depth);
+
+        encoder_.Begin(target, outInfo, writeOptions);
+        Process(info, plan,
+            [&window](int y, int h) { return window.Rows(y, h); },
+            [&bandView](int, int h) {
+                return bandView.Crop(0, 0, bandView.Width(), h);
+            },
+            [&](int, int h) {
+                encoder_.WriteRows(reinterpret_cast<const uint8_t *>(
+                    band.data()), rowBytes, h);
+            });
+        encoder_.End();
+    } catch (...) {
+        encoder_.Reset();
+        decoder_.End();
+        throw;
+    }
+    decoder_.End();
+    return outInfo;
+}
+
+template <typename ValueT>
+void TileEngine<ValueT>::Run(const ImageView<const ValueT> &src,
+    const ImageView<ValueT> &dst) {
+    io::ImageInfo info;
+    info.width = src.Width();
+    info.height = src.Height();
+    info.colorspace = src.ColorSpace();
+    info.depth = src.DepthBits();
+    CheckOutput(info, OutputColorSpace(info.colorspace), dst);
+
+    Process(info, Plan(info, false, false),
+        [&src](int y, int h) { return src.Crop(0, y, src.Width(), h); },
+        [&dst](int y, int h) { return dst.Crop(0, y, dst.Width(), h); },
+        [](int, int) {});
+}
+
+template class TileEngine<uint8_t>;
+template class TileEngine<uint16_t>;
+
+}
+}
+}
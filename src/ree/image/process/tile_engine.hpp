@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <ree/image/types.hpp>
+#include <ree/image/image_view.hpp>
+#include <ree/image/thread_pool.hpp>
+#include <ree/image/io/image.hpp>
+#include <ree/image/io/decoder.hpp>
+#include <ree/image/io/encoder.hpp>
+
+namespace ree {
+namespace image {
+namespace process {
+
+struct TileOptions {
+    /// the preferred tile size, shrunk to fit the memory budget
+    int tileWidth = 256;
+    int tileHeight = 256;
+    /// bytes of pixels the engine may hold at once, 0 for no limit. An
+    /// encoder which can not stream its rows holds the whole output, which
+    /// counts against it.
+    size_t memoryBudget = 0;
+    /// threads of a pool of the engine's own, 0 to use ThreadPool::Shared()
+    size_t threads = 0;
+};
+
+/**
+ * @brief runs a chain of kernels over an image tile by tile, so that images
+ * far larger than memory can be processed.
+ *
+ * The input is decoded a band of tiles at a time and the tiles of a band are
+ * processed in parallel. The output goes to a caller buffer or straight to
+ * an encoder. Tile size and parallelism are picked so that the pixels held at
+ * once, with the output an encoder collects if it can not stream, stay
+ * within TileOptions::memoryBudget.
+ *
+ * A TileEngine is not thread safe, use one per thread.
+ */
+template <typename ValueT>
+class TileEngine {
+public:
+    /**
+     * @brief process one tile. src holds the tile grown by the halo of the
+     * kernel on every side, as far as the image reaches, dst is the tile
+     * itself and lies at (x, y) inside src. Called from several threads at
+     * once.
+     */
+    using Kernel = std::function<void(const ImageView<const ValueT> &src,
+        const ImageView<ValueT> &dst, int x, int y)>;
+
+    /// how an image is cut into tiles, see Plan()
+    struct TilePlan {
+        int tileWidth;
+        int tileHeight;
+        /// tiles processed at the same time
+        size_t concurrency;
+        /// pixel bytes held at once
+        size_t bytes;
+    };
+
+    explicit TileEngine(const TileOptions &options = TileOptions());
+
+    /**
+     * @brief append a kernel to the chain run on every tile.
+     * @param halo pixels around the tile the kernel reads, e.g. 1 for a 3x3
+     * convolution
+     * @param to the color space the kernel writes, Unknown to keep the one it
+     * reads
+     */
+    void AddKernel(Kernel kernel, int halo = 0,
+        class ColorSpace to = ColorSpace::Unknown);
+
+    /// the color space the chain turns an input of cs into
+    class ColorSpace OutputColorSpace(class ColorSpace cs) const;
+
+    /**
+     * @brief the tiling of an image, which is streamed from a decoder when
+     * streamIn is set and streamed to an encoder when streamOut is set.
+     * heldBytes are held besides, such as the output of an encoder which
+     * collects it whole. Throws std::invalid_argument when not even one row
+     * of single pixel tiles fits the memory budget.
+     */
+    TilePlan Plan(const io::ImageInfo &info, bool streamIn, bool streamOut,
+        size_t heldBytes = 0) const;
+
+    /// decode source and write the processed pixels to dst, which must have
+    /// the size of source and the output color space
+    io::ImageInfo Run(ree::io::Source *source, const ImageView<ValueT> &dst,
+        const io::LoadOptions &options = io::LoadOptions());
+    /// decode source and encode the processed image to target, in the format
+    /// of writeOptions["format"]
+    io::ImageInfo Run(ree::io::Source *source, ree::io::Source *target,
+        const io::WriteOptions &writeOptions,
+        const io::LoadOptions &loadOptions = io::LoadOptions());
+    /// process pixels already in memory
+    void Run(const ImageView<const ValueT> &src, const ImageView<ValueT> &dst);
+
+private:
+    struct Stage {
+        Kernel kernel;
+        int halo;
+        class ColorSpace to;
+    };
+
+    /// the rows [y, y + h) of the input, full width
+    using InputBand = std::function<ImageView<const ValueT>(int y, int h)>;
+    /// where the rows [y, y + h) of the output go, full width
+    using OutputBand = std::function<ImageView<ValueT>(int y, int h)>;
+    /// called once the output rows [y, y + h) are complete
+    using EmitBand = std::function<void(int y, int h)>;
+
+    void Process(const io::ImageInfo &info, const TilePlan &plan,
+        const InputBand &input, const OutputBand &output,
+        const EmitBand &emit);
+    /// the rows the input band of the tiles at rows [y, y + h) spans
+    void InputRows(const io::ImageInfo &info, int y, int h, int *first,
+        int *last) const;
+    /// halo of the whole chain
+    int TotalHalo() const;
+    ThreadPool &Pool() const;
+
+    TileOptions options_;
+    std::vector<Stage> stages_;
+    std::unique_ptr<ThreadPool> pool_;
+    io::Decoder decoder_;
+    io::Encoder encoder_;
+};
+
+}
+}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+namespace ree {
+namespace image {
+
+/**
+ * @brief n / divisor rounded to nearest, halves up, by an add and a multiply
+ * in double, for integers n >= 0 with n + half below 2^39.
+ *
+ * (n + half) / divisor is truncated, so it has to land at or above a whole
+ * quotient and below the next one. The reciprocal is made larger by 2^-40
+ * of itself, more than the 2^-52 at most the two roundings take off, so
+ * whole quotients are never truncated to one less. Together they add below
+ * 2^-39 of the quotient, and a quotient short of a whole one is short by at
+ * least 1 / divisor, which stays more while n + half is below 2^39.
+ *
+ * Vector kernels take half and reciprocal to do the same on their lanes.
+ */
+struct RoundedDivision {
+    explicit RoundedDivision(double divisor)
+        : half(std::floor(divisor / 2)),
+          reciprocal((1.0 + std::ldexp(1.0, -40)) / divisor) {}
+
+    uint64_t operator()(double n) const {
+        return static_cast<uint64_t>((n + half) * reciprocal);
+    }
+
+    double half;
+    double reciprocal;
+};
+
+}
+}
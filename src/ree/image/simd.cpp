@@ -0,0 +1,35 @@
+#include "simd.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+namespace ree {
+namespace image {
+
+static SimdLevel DetectSimdLevel() {
+#ifdef REE_IMAGE_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return SimdLevel::Avx2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return SimdLevel::Ssse3;
+    }
+#endif
+    return SimdLevel::Scalar;
+}
+
+static std::atomic<int> maxSimdLevel {static_cast<int>(SimdLevel::Avx2)};
+
+SimdLevel ActiveSimdLevel() {
+    static const SimdLevel detected = DetectSimdLevel();
+    return static_cast<SimdLevel>(std::min(static_cast<int>(detected),
+        maxSimdLevel.load(std::memory_order_relaxed)));
+}
+
+void SetMaxSimdLevel(SimdLevel level) {
+    maxSimdLevel.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+}
+}
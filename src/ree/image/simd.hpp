@@ -0,0 +1,29 @@
+#pragma once
+
+// kernels for an instruction set are compiled into every build through
+// target attributes, and picked at run time by what the CPU supports
+#if (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define REE_IMAGE_SIMD_X86 1
+#define REE_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace ree {
+namespace image {
+
+/// the instruction sets kernels are written for, in increasing order
+enum class SimdLevel {
+    Scalar,
+    Ssse3,
+    Avx2,
+};
+
+/// the best level this CPU supports, capped by SetMaxSimdLevel
+SimdLevel ActiveSimdLevel();
+
+/// cap the level kernels are picked for, e.g. to compare them with the
+/// scalar ones. Takes effect for kernels started afterwards.
+void SetMaxSimdLevel(SimdLevel level);
+
+}
+}
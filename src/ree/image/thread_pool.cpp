@@ -0,0 +1,185 @@
+#include "thread_pool.hpp"
+
+#include <exception>
+
+namespace ree {
+namespace image {
+
+/// the pool and worker index of the current thread, if it is a worker
+static thread_local ThreadPool *tlsPool = nullptr;
+static thread_local size_t tlsWorker = 0;
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back(new Worker());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        threads_.emplace_back(&ThreadPool::Run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto &thread : threads_) {
+        thread.join();
+    }
+}
+
+ThreadPool &ThreadPool::Shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool &ThreadPool::SharedIo() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::Submit(std::function<void()> task) {
+    size_t index = tlsPool == this ? tlsWorker : next_++ % workers_.size();
+    // counted before it is visible, so pops never underflow pending_
+    pending_++;
+    {
+        std::lock_guard<std::mutex> lock(workers_[index]->mutex);
+        workers_[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // pairs with the predicate check in Run, so the wakeup is not lost
+        std::lock_guard<std::mutex> lock(mutex_);
+        posted_++;
+    }
+    cv_.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t count,
+    const std::function<void(size_t)> &fn) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1) {
+        fn(0);
+        return;
+    }
+
+    struct State {
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t remaining;
+        std::exception_ptr error;
+    };
+    auto state = std::make_shared<State>();
+    state->remaining = count;
+
+    for (size_t i = 0; i < count; ++i) {
+        Submit([state, &fn, i]() {
+            std::exception_ptr error;
+            try {
+                fn(i);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (error && !state->error) {
+                state->error = error;
+            }
+            if (--state->remaining == 0) {
+                state->cv.notify_all();
+            }
+        });
+    }
+
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->remaining == 0) {
+                break;
+            }
+        }
+        if (!RunPendingTask()) {
+            // everything left is running on some worker
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->cv.wait(lock, [&state]() { return state->remaining == 0; });
+            break;
+        }
+    }
+
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+bool ThreadPool::PopTask(size_t self, std::function<void()> &task) {
+    {
+        Worker &own = *workers_[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            pending_--;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers_.size(); ++i) {
+        Worker &victim = *workers_[(self + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            pending_--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::RunPendingTask() {
+    if (pending_ == 0) {
+        return false;
+    }
+    size_t self = tlsPool == this ? tlsWorker : next_++ % workers_.size();
+    std::function<void()> task;
+    if (!PopTask(self, task)) {
+        return false;
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::Run(size_t self) {
+    tlsPool = this;
+    tlsWorker = self;
+
+    std::function<void()> task;
+    while (true) {
+        // read before looking for work: a task pushed after a failed steal
+        // moves posted_ past it and wakes this worker up
+        size_t seen = posted_;
+        if (PopTask(self, task)) {
+            task();
+            task = nullptr;
+            continue;
+        }
+
+        // sleep instead of stealing again, pending_ may still count tasks
+        // other workers are about to pop or that are not pushed yet
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this, seen]() { return stop_ || posted_ != seen; });
+        if (stop_ && pending_ == 0) {
+            return;
+        }
+    }
+}
+
+}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ree {
+namespace image {
+
+/**
+ * @brief a work-stealing thread pool.
+ *
+ * Every worker owns a task deque: it pops its own tasks LIFO and steals from
+ * the other workers FIFO when it runs dry. Tasks submitted from a worker go
+ * to its own deque, others are spread round robin.
+ *
+ * Functions of the library taking a ThreadPool *pool run their parallel
+ * parts on it, or on Shared() when it is null.
+ */
+class ThreadPool {
+public:
+    /// threads == 0 means one thread per hardware thread
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /// the process-wide pool, created on first use
+    static ThreadPool &Shared();
+    /// the process-wide pool for tasks blocking on file I/O, apart from
+    /// Shared() so slow sources do not hold up the processing kernels
+    static ThreadPool &SharedIo();
+
+    size_t Size() const { return workers_.size(); }
+
+    /// task must not throw
+    void Submit(std::function<void()> task);
+
+    /**
+     * @brief run fn(0) ... fn(count - 1) on the pool and wait for all of them.
+     * The calling thread helps running queued tasks while it waits, so it is
+     * safe to call from inside a task. The first exception thrown by fn is
+     * rethrown once every call has finished.
+     */
+    void ParallelFor(size_t count, const std::function<void(size_t)> &fn);
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    /// pop from the own deque of self, or steal from the others
+    bool PopTask(size_t self, std::function<void()> &task);
+    /// run one queued task on the calling thread if there is any
+    bool RunPendingTask();
+    void Run(size_t self);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<size_t> pending_ {0};
+    /// bumped under mutex_ after every push, idle workers sleep until it moves
+    std::atomic<size_t> posted_ {0};
+    std::atomic<size_t> next_ {0};
+    bool stop_ = false;
+};
+
+}
+}
@@ -20,23 +20,17 @@ public:
 
     constexpr ColorSpace(Value value) : value_(value) {}
 
-    uint8_t Components() const {
-        switch (value_) {
-        case RGB:
-        case YCbCr:
-            return 3;
-        case RGBA:
-            return 4;
-        case Gray:
-            return 1;
-        case GrayAlpha:
-            return 2;
-        case Unknown:
-            return 0;
-		default:
-			return 0;
-        }
-    };
+    constexpr uint8_t Components() const {
+        return value_ == RGB || value_ == YCbCr ? 3 :
+            value_ == RGBA ? 4 :
+            value_ == Gray ? 1 :
+            value_ == GrayAlpha ? 2 : 0;
+    }
+    /// the index of the alpha sample in a pixel, -1 without alpha
+    constexpr int AlphaIndex() const {
+        return value_ == RGBA ? 3 : value_ == GrayAlpha ? 1 : -1;
+    }
+    constexpr Value Id() const { return value_; }
 
     std::string ToString() const {
         switch (value_) {
@@ -57,8 +51,8 @@ public:
         }
     };
 
-    bool operator==(ColorSpace a) const { return value_ == a.value_; }
-    bool operator!=(ColorSpace a) const { return value_ != a.value_; }
+    constexpr bool operator==(ColorSpace a) const { return value_ == a.value_; }
+    constexpr bool operator!=(ColorSpace a) const { return value_ != a.value_; }
 
 private:
     Value value_;
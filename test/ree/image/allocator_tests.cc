@@ -0,0 +1,53 @@
+#include <ree/unittest.h>
+
+#include <ree/image/pixel_buffer.hpp>
+#include <ree/image/io/decoder.hpp>
+#include <ree/image/io/ppm.hpp>
+#include <ree/image/test_config.h>
+
+namespace ree {
+namespace image {
+
+R_TEST_F(Allocator, Aligned) {
+    PixelBuffer<uint8_t> buffer;
+    buffer.resize(1001);
+    auto address = reinterpret_cast<uintptr_t>(buffer.data());
+    R_ASSERT_EQ(address % kPixelAlignment, 0u);
+}
+
+R_TEST_F(Allocator, Pool) {
+    PoolPixelAllocator pool;
+    void *ptr = pool.Allocate(4096);
+    pool.Deallocate(ptr, 4096);
+    R_ASSERT_EQ(pool.Allocate(4096) == ptr, true);
+    pool.Deallocate(ptr, 4096);
+
+    io::Ppm ppm;
+    io::Decoder decoder(&ppm);
+    decoder.SetAllocator(&pool);
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.ppm");
+    const uint8_t *data = nullptr;
+    {
+        io::Image img = decoder.Decode(source.get());
+        data = img.Data().data();
+    }
+    io::Image img = decoder.Decode(source.get());
+    R_ASSERT_EQ(img.Data().data() == data, true);
+}
+
+R_TEST_F(Allocator, Arena) {
+    std::vector<uint8_t> memory(58 * 50 * 3 + kPixelAlignment);
+    ArenaPixelAllocator arena(memory.data(), memory.size());
+
+    io::Ppm ppm;
+    io::Decoder decoder(&ppm);
+    decoder.SetAllocator(&arena);
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.ppm");
+    io::Image img = decoder.Decode(source.get());
+    R_ASSERT_EQ(img.Data().data() >= memory.data(), true);
+    R_ASSERT_EQ(img.Data().data() < memory.data() + memory.size(), true);
+    R_ASSERT_EQ(arena.Used() <= memory.size(), true);
+}
+
+}
+}
@@ -0,0 +1,77 @@
+#include <ree/unittest.h>
+
+#include <stdexcept>
+
+#include <ree/image/io/image.hpp>
+#include <ree/image/io/error.hpp>
+#include <ree/image/test_config.h>
+
+namespace ree {
+namespace image {
+namespace io {
+
+R_TEST_F(Async, LoadAndWrite) {
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.ppm");
+    Image img = Image::LoadAsync(source.get()).get();
+    R_ASSERT_EQ(img.Width(), 58);
+    R_ASSERT_EQ(img.Height(), 50);
+
+    auto target = ree::io::Source::SourceByPath(kTestAssetsDir + "async.ppm");
+    WriteOptions options;
+    options["format"] = "ppm";
+    img.WriteToAsync(target.get(), options).get();
+
+    std::promise<Image> reloaded;
+    Image::LoadAsync(target.get(), LoadOptions(),
+        [&reloaded](Image &&image, std::exception_ptr error) {
+        if (error) {
+            reloaded.set_exception(error);
+        } else {
+            reloaded.set_value(std::move(image));
+        }
+    });
+    Image img1 = reloaded.get_future().get();
+    R_ASSERT_EQ(img1.Data() == img.Data(), true);
+
+    // heic is only probed, not decoded
+    auto unknown = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.heic");
+    bool failed = false;
+    try {
+        Image::LoadAsync(unknown.get()).get();
+    } catch (const NotImplementException &) {
+        failed = true;
+    }
+    R_ASSERT_EQ(failed, true);
+}
+
+R_TEST_F(Async, OwnPixelsAndCallbackErrors) {
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.ppm");
+    Image img = Image::Load(source.get());
+    auto data = img.Data();
+
+    // the write keeps its own pixels, so the image may go first
+    auto target = ree::io::Source::SourceByPath(kTestAssetsDir + "async.ppm");
+    WriteOptions options;
+    options["format"] = "ppm";
+    auto written = std::move(img).WriteToAsync(target.get(), options);
+    img = Image();
+    written.get();
+    R_ASSERT_EQ(Image::Load(target.get()).Data() == data, true);
+
+    // what a callback throws comes out of the returned future
+    auto loaded = Image::LoadAsync(source.get(), LoadOptions(),
+        [](Image &&, std::exception_ptr) {
+        throw std::runtime_error("callback failed.");
+    });
+    bool failed = false;
+    try {
+        loaded.get();
+    } catch (const std::runtime_error &) {
+        failed = true;
+    }
+    R_ASSERT_EQ(failed, true);
+}
+
+}
+}
+}
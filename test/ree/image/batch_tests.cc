@@ -0,0 +1,43 @@
+#include <ree/unittest.h>
+
+#include <ree/image/io/batch.hpp>
+#include <ree/image/test_config.h>
+
+namespace ree {
+namespace image {
+namespace io {
+
+R_TEST_F(Batch, LoadBatch) {
+    std::vector<std::string> paths = {
+        "dot1.png", "dot1.ppm", "dot1.heic", "dot1.ppm", "dot1.png",
+    };
+    std::vector<std::unique_ptr<ree::io::Source>> holders;
+    std::vector<ree::io::Source *> sources;
+    for (const auto &path : paths) {
+        holders.push_back(ree::io::Source::SourceByPath(kTestAssetsDir + path));
+        sources.push_back(holders.back().get());
+    }
+
+    ThreadPool pool(3);
+    auto results = LoadBatch(sources, LoadOptions(), &pool);
+    R_ASSERT_EQ(results.size(), paths.size());
+    R_ASSERT_EQ(results[0].Ok(), true);
+    R_ASSERT_EQ(results[0].image.ColorSpace(), ColorSpace::RGBA);
+    R_ASSERT_EQ(results[1].Ok(), true);
+    R_ASSERT_EQ(results[1].image.ColorSpace(), ColorSpace::RGB);
+    R_ASSERT_EQ(results[2].Ok(), false);
+    R_ASSERT_EQ(results[3].image.Data() == results[1].image.Data(), true);
+    R_ASSERT_EQ(results[4].image.Data() == results[0].image.Data(), true);
+
+    // the workers keep their decoders for the next batch
+    auto again = LoadBatch(sources, LoadOptions(), &pool);
+    R_ASSERT_EQ(again[0].image.Data() == results[0].image.Data(), true);
+    R_ASSERT_EQ(again[2].Ok(), false);
+
+    auto shared = LoadBatch(sources);
+    R_ASSERT_EQ(shared[1].image.Data() == results[1].image.Data(), true);
+}
+
+}
+}
+}
@@ -0,0 +1,61 @@
+#include <vector>
+
+#include <ree/unittest.h>
+
+#include <ree/image/color_convert.hpp>
+#include <ree/image/test_util.h>
+
+namespace ree {
+namespace image {
+
+/// every kernel gives what the scalar loops give, including the pixels
+/// past the last whole block
+template <typename ValueT>
+static void CheckKernels(uint8_t depth) {
+    static const ColorSpace kSpaces[] = {
+        ColorSpace::RGB, ColorSpace::RGBA, ColorSpace::Gray,
+        ColorSpace::GrayAlpha, ColorSpace::YCbCr,
+    };
+    const size_t count = 53;
+    std::vector<ValueT> src(count * 4);
+    TestRandom random(12345);
+    for (size_t i = 0; i < src.size(); ++i) {
+        // extreme samples first, they take the clamping paths
+        ValueT maxValue = static_cast<ValueT>((1 << depth) - 1);
+        ValueT v = static_cast<ValueT>(random.Next() & maxValue);
+        src[i] = i < 8 ? (i % 2 ? maxValue : 0) : v;
+    }
+    for (auto from : kSpaces) {
+        for (auto to : kSpaces) {
+            R_ASSERT_EQ(SameAtEverySimdLevel([&]() {
+                std::vector<ValueT> dst(count * to.Components());
+                ConvertPixels(src.data(), from, dst.data(), to, count, depth);
+                return dst;
+            }), true);
+        }
+    }
+}
+
+R_TEST_F(ColorConvert, KernelsMatchScalar) {
+    CheckKernels<uint8_t>(8);
+    CheckKernels<uint16_t>(10);
+    CheckKernels<uint16_t>(16);
+}
+
+R_TEST_F(ColorConvert, KnownValues) {
+    const uint8_t rgb[] = {255, 0, 0, 0, 255, 0, 0, 0, 255};
+    uint8_t gray[3];
+    ConvertPixels(rgb, ColorSpace::RGB, gray, ColorSpace::Gray, 3, 8);
+    R_ASSERT_EQ(gray[0], 76);
+    R_ASSERT_EQ(gray[1], 150);
+    R_ASSERT_EQ(gray[2], 29);
+
+    uint8_t ycc[9];
+    ConvertPixels(rgb, ColorSpace::RGB, ycc, ColorSpace::YCbCr, 3, 8);
+    R_ASSERT_EQ(ycc[0], 76);
+    R_ASSERT_EQ(ycc[1], 85);
+    R_ASSERT_EQ(ycc[2], 255);
+}
+
+}
+}
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include <ree/unittest.h>
+
+#include <ree/image/process/composite.hpp>
+#include <ree/image/process/image.hpp>
+
+#include "test_util.h"
+
+namespace ree {
+namespace image {
+namespace process {
+
+/// premultiplied pixels in runs of transparent, opaque and partly
+/// transparent ones, of lengths that cut across the kernels
+template <typename ValueT>
+static Image<ValueT> Sprite(int w, int h, class ColorSpace cs,
+    uint8_t depth, uint32_t seed) {
+    Image<ValueT> image(w, h, cs, depth);
+    int components = cs.Components();
+    uint32_t maxValue = (uint32_t(1) << depth) - 1;
+    TestRandom random(seed);
+    for (size_t p = 0; p * components < image.Data().size(); ++p) {
+        uint32_t run = p / 11 % 3;
+        uint32_t partial = random.Next() % (maxValue + 1);
+        uint32_t alpha = run == 0 ? 0 : run == 1 ? maxValue : partial;
+        ValueT *pixel = image.Data().data() + p * components;
+        for (int c = 0; c < components; ++c) {
+            uint32_t color = random.Next() % (alpha + 1);
+            pixel[c] = static_cast<ValueT>(c == cs.AlphaIndex() ? alpha :
+                color);
+        }
+    }
+    return image;
+}
+
+template <typename ValueT>
+static Image<ValueT> Composited(const Image<ValueT> &src, Image<ValueT> dst,
+    int x, int y, CompositeOp op, float opacity) {
+    Composite(src.View(), dst.View(), x, y, op, opacity);
+    return dst;
+}
+
+template <typename ValueT>
+static void SetSamples(Image<ValueT> &image,
+    const std::vector<ValueT> &samples) {
+    std::copy(samples.begin(), samples.end(), image.Data().begin());
+}
+
+/// source over, one sample at a time in integers
+static uint32_t NaiveOver(uint32_t s, uint32_t as, uint32_t d,
+    uint32_t opacity) {
+    s = (s * opacity * 2 + 255) / 510;
+    as = (as * opacity * 2 + 255) / 510;
+    return std::min<uint32_t>((s * 255 + d * (255 - as)) * 2 + 255, 510 *
+        255) / 510;
+}
+
+R_TEST_F(Composite, Premultiply) {
+    // colors above alpha too, as straight ones are
+    auto straight = Sprite<uint8_t>(67, 9, ColorSpace::RGBA, 8, 5);
+    for (size_t i = 0; i < straight.Data().size(); ++i) {
+        if (i % 4 != 3) {
+            straight.Data()[i] = static_cast<uint8_t>(i * 37 % 256);
+        }
+    }
+    auto premultiply = [&] {
+        auto copy = ImageFromView(static_cast<const Image<uint8_t> &>(
+            straight).View());
+        Premultiply(copy.View());
+        return copy;
+    };
+    R_ASSERT_EQ(SameAtEverySimdLevel([&] {
+        return premultiply().Data();
+    }), true);
+    auto image = premultiply();
+    for (size_t i = 0; i < straight.Data().size(); ++i) {
+        uint32_t a = straight.Data()[i | 3];
+        uint32_t expected = i % 4 == 3 ? a :
+            (straight.Data()[i] * a * 2 + 255) / 510;
+        R_ASSERT_EQ(image.Data()[i], expected);
+    }
+
+    // dividing back by reciprocals rounds as dividing does
+    auto premultiplied = image;
+    auto unpremultiply = [&] {
+        auto copy = premultiplied;
+        Unpremultiply(copy.View());
+        return copy.Data();
+    };
+    R_ASSERT_EQ(SameAtEverySimdLevel(unpremultiply), true);
+    Unpremultiply(image.View());
+    for (size_t i = 0; i < image.Data().size(); ++i) {
+        uint32_t a = premultiplied.Data()[i | 3];
+        uint32_t c = premultiplied.Data()[i];
+        uint32_t expected = i % 4 == 3 ? a : a == 0 ? 0 :
+            std::min<uint32_t>((2 * 255 * c + a) / (2 * a), 255);
+        R_ASSERT_EQ(image.Data()[i], expected);
+    }
+
+    Image<uint16_t> deep(3, 1, ColorSpace::GrayAlpha, 12);
+    SetSamples(deep, {4095, 4095, 1000, 2048, 4000, 0});
+    Premultiply(deep.View());
+    R_ASSERT_EQ(deep.Data()[0], 4095);
+    R_ASSERT_EQ(deep.Data()[2], (1000 * 2048 * 2 + 4095) / 8190);
+    R_ASSERT_EQ(deep.Data()[4], 0);
+
+    Image<float> floats(1, 1, ColorSpace::RGBA, 16);
+    SetSamples(floats, {0.5f, 1.0f, 0.0f, 0.5f});
+    Premultiply(floats.View());
+    R_ASSERT_EQ(floats.Data()[0], 0.25f);
+    Unpremultiply(floats.View());
+    R_ASSERT_EQ(floats.Data()[1], 1.0f);
+}
+
+R_TEST_F(Composite, SourceOver) {
+    auto sprite = Sprite<uint8_t>(45, 20, ColorSpace::RGBA, 8, 3);
+    for (auto to : {ColorSpace::RGBA, ColorSpace::RGB}) {
+        auto background = Sprite<uint8_t>(60, 30, to, 8, 9);
+        // inside, and cut off by each edge
+        int offsets[][2] = {{7, 4}, {-5, -3}, {30, 15}};
+        for (auto &offset : offsets) {
+            for (float opacity : {1.0f, 0.6f}) {
+                auto over = [&] {
+                    return Composited(sprite, background, offset[0],
+                        offset[1], CompositeOp::SourceOver, opacity);
+                };
+                R_ASSERT_EQ(SameAtEverySimdLevel([&] {
+                    return over().Data();
+                }), true);
+                auto composited = over();
+
+                uint32_t scale = static_cast<uint32_t>(
+                    std::lround(opacity * 255));
+                int components = background.ColorSpace().Components();
+                for (int y = 0; y < 30; ++y) {
+                    for (int x = 0; x < 60; ++x) {
+                        int sx = x - offset[0];
+                        int sy = y - offset[1];
+                        const uint8_t *d = background.View().Pixel(x, y);
+                        const uint8_t *out = composited.View().Pixel(x, y);
+                        if (sx < 0 || sy < 0 || sx >= 45 || sy >= 20) {
+                            R_ASSERT_EQ(std::equal(d, d + components, out),
+                                true);
+                            continue;
+                        }
+                        const uint8_t *s = sprite.View().Pixel(sx, sy);
+                        for (int c = 0; c < components; ++c) {
+                            R_ASSERT_EQ(out[c], NaiveOver(s[c], s[3], d[c],
+                                scale));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+R_TEST_F(Composite, Operators) {
+    Image<float> src(1, 1, ColorSpace::GrayAlpha, 16);
+    SetSamples(src, {0.3f, 0.6f});
+    Image<float> dst(1, 1, ColorSpace::GrayAlpha, 16);
+    struct Expected {
+        CompositeOp op;
+        float fa;
+        float fb;
+    };
+    // the factors of the Porter-Duff operators, for source and destination
+    // alphas 0.6 and 0.5
+    Expected ops[] = {{CompositeOp::SourceOver, 1.0f, 0.4f},
+        {CompositeOp::DestinationOver, 0.5f, 1.0f},
+        {CompositeOp::SourceIn, 0.5f, 0.0f},
+        {CompositeOp::DestinationIn, 0.0f, 0.6f},
+        {CompositeOp::SourceOut, 0.5f, 0.0f},
+        {CompositeOp::DestinationOut, 0.0f, 0.4f},
+        {CompositeOp::SourceAtop, 0.5f, 0.4f},
+        {CompositeOp::DestinationAtop, 0.5f, 0.6f},
+        {CompositeOp::Xor, 0.5f, 0.4f},
+        {CompositeOp::Plus, 1.0f, 1.0f}};
+    for (const auto &e : ops) {
+        SetSamples(dst, {0.2f, 0.5f});
+        Composite(static_cast<const Image<float> &>(src).View(), dst.View(),
+            0, 0, e.op);
+        R_ASSERT_EQ(std::fabs(dst.Data()[0] - (0.3f * e.fa + 0.2f * e.fb)) <
+            1e-6f, true);
+        R_ASSERT_EQ(std::fabs(dst.Data()[1] - (0.6f * e.fa + 0.5f * e.fb)) <
+            1e-6f, true);
+    }
+
+    // integers round to nearest and clamp
+    Image<uint16_t> words(1, 1, ColorSpace::GrayAlpha, 16);
+    SetSamples(words, {40000, 50000});
+    Image<uint16_t> onto(1, 1, ColorSpace::GrayAlpha, 16);
+    SetSamples(onto, {30000, 60000});
+    Composite(static_cast<const Image<uint16_t> &>(words).View(), onto.View(),
+        0, 0, CompositeOp::Plus);
+    R_ASSERT_EQ(onto.Data()[0], 65535);
+    SetSamples(onto, {30000, 60000});
+    Composite(static_cast<const Image<uint16_t> &>(words).View(), onto.View(),
+        0, 0, CompositeOp::SourceIn);
+    R_ASSERT_EQ(onto.Data()[0], (40000ull * 60000 * 2 + 65535) / 131070);
+
+    bool thrown = false;
+    try {
+        Image<uint8_t> rgb(2, 2, ColorSpace::RGB);
+        Image<uint8_t> gray(2, 2, ColorSpace::GrayAlpha);
+        Composite(static_cast<const Image<uint8_t> &>(rgb).View(),
+            gray.View(), 0, 0);
+    } catch (const std::invalid_argument &) {
+        thrown = true;
+    }
+    R_ASSERT_EQ(thrown, true);
+}
+
+}
+}
+}
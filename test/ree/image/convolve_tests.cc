@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include <ree/unittest.h>
+
+#include <ree/image/process/convolve.hpp>
+#include <ree/image/process/image.hpp>
+
+#include "test_util.h"
+
+namespace ree {
+namespace image {
+namespace process {
+
+/// noise over slow waves, so blurs of any size leave some contrast
+template <typename ValueT>
+static Image<ValueT> Waves(int w, int h, class ColorSpace cs, uint8_t depth) {
+    Image<ValueT> image(w, h, cs, depth);
+    int components = cs.Components();
+    double maxValue = (1 << depth) - 1;
+    TestRandom random(11);
+    for (size_t i = 0; i < image.Data().size(); ++i) {
+        int x = static_cast<int>(i / components % w);
+        int y = static_cast<int>(i / components / w);
+        double wave = 0.5 + 0.3 * std::sin(x * 0.05 + (i % components)) *
+            std::cos(y * 0.07) + ((random.Next() >> 8) % 64) / 640.0;
+        image.Data()[i] = static_cast<ValueT>(wave * maxValue + 0.5);
+    }
+    return image;
+}
+
+/// the kernel of size columns in doubles, one pixel at a time
+template <typename ValueT>
+static Image<ValueT> NaiveConvolve(const Image<ValueT> &src,
+    const std::vector<double> &kernel, int size, BorderMode border) {
+    int rows = static_cast<int>(kernel.size()) / size;
+    Image<ValueT> dst(src.Width(), src.Height(), src.ColorSpace(),
+        src.DepthBits());
+    int components = src.ColorSpace().Components();
+    int radius = size / 2;
+    double maxValue = (1 << src.DepthBits()) - 1;
+    auto index = [border](int i, int n) {
+        if (border == BorderMode::Clamp) {
+            return std::min(std::max(i, 0), n - 1);
+        }
+        int period = 2 * (n - 1);
+        i = std::abs(i) % period;
+        return i < n ? i : period - i;
+    };
+    for (int y = 0; y < src.Height(); ++y) {
+        for (int x = 0; x < src.Width(); ++x) {
+            for (int c = 0; c < components; ++c) {
+                double sum = 0;
+                for (int ky = 0; ky < rows; ++ky) {
+                    for (int kx = 0; kx < size; ++kx) {
+                        int sx = index(x + kx - radius, src.Width());
+                        int sy = index(y + ky - rows / 2, src.Height());
+                        sum += kernel[ky * size + kx] * src.Data()[
+                            (sy * src.Width() + sx) * components + c];
+                    }
+                }
+                sum = std::min(std::max(sum, 0.0), maxValue);
+                dst.Data()[(y * src.Width() + x) * components + c] =
+                    static_cast<ValueT>(sum + 0.5);
+            }
+        }
+    }
+    return dst;
+}
+
+template <typename ValueT>
+static int MaxDifference(const Image<ValueT> &a, const Image<ValueT> &b) {
+    int most = 0;
+    for (size_t i = 0; i < a.Data().size(); ++i) {
+        most = std::max(most, std::abs(static_cast<int>(a.Data()[i]) -
+            static_cast<int>(b.Data()[i])));
+    }
+    return most;
+}
+
+static std::vector<double> Outer(const std::vector<float> &horizontal,
+    const std::vector<float> &vertical) {
+    std::vector<double> kernel;
+    for (float v : vertical) {
+        for (float h : horizontal) {
+            kernel.push_back(static_cast<double>(v) * h);
+        }
+    }
+    return kernel;
+}
+
+R_TEST_F(Convolve, MatchesNaive) {
+    // wider than a tile, and narrower than the kernels for the borders
+    std::vector<float> horizontal = {0.1f, 0.2f, 0.4f, 0.2f, 0.1f};
+    std::vector<float> vertical = {-0.25f, 1.5f, -0.25f};
+    for (auto border : {BorderMode::Clamp, BorderMode::Mirror}) {
+        for (int width : {300, 2}) {
+            auto src = Waves<uint8_t>(width, 45, ColorSpace::RGBA, 8);
+            Image<uint8_t> dst(width, 45, ColorSpace::RGBA);
+            ConvolveSeparable(static_cast<const Image<uint8_t> &>(src).View(),
+                dst.View(), horizontal, vertical, border);
+            R_ASSERT_EQ(MaxDifference(dst, NaiveConvolve(src,
+                Outer(horizontal, vertical), 5, border)) <= 1, true);
+        }
+    }
+
+    auto deep = Waves<uint16_t>(40, 33, ColorSpace::RGB, 12);
+    std::vector<float> edges = {0, -1, 0, -1, 5, -1, 0, -1, 0};
+    Image<uint16_t> sharp(40, 33, ColorSpace::RGB, 12);
+    Convolve(static_cast<const Image<uint16_t> &>(deep).View(), sharp.View(),
+        edges, 3, BorderMode::Mirror);
+    R_ASSERT_EQ(MaxDifference(sharp, NaiveConvolve(deep,
+        std::vector<double>(edges.begin(), edges.end()), 3,
+        BorderMode::Mirror)) <= 1, true);
+}
+
+R_TEST_F(Convolve, GaussianBlur) {
+    auto src = Waves<uint8_t>(280, 300, ColorSpace::RGB, 8);
+    auto view = static_cast<const Image<uint8_t> &>(src).View();
+    Image<uint8_t> simd(280, 300, ColorSpace::RGB);
+    Image<uint8_t> scalar(280, 300, ColorSpace::RGB);
+    for (double sigma : {0.8, 2.0, 6.0}) {
+        GaussianBlur(view, simd.View(), sigma);
+        AtSimdLevel(SimdLevel::Scalar, [&] {
+            GaussianBlur(view, scalar.View(), sigma);
+        });
+        R_ASSERT_EQ(MaxDifference(simd, scalar) <= 1, true);
+
+        // box blurs make up large sigmas closely enough
+        auto kernel = GaussianKernel(sigma);
+        int size = static_cast<int>(kernel.size());
+        auto crop = ImageFromView(view.Crop(0, 0, 60, 50));
+        Image<uint8_t> blurred(60, 50, ColorSpace::RGB);
+        GaussianBlur(static_cast<const Image<uint8_t> &>(crop).View(),
+            blurred.View(), sigma);
+        R_ASSERT_EQ(MaxDifference(blurred, NaiveConvolve(crop,
+            Outer(kernel, kernel), size, BorderMode::Clamp)) <=
+            (sigma > 2.0 ? 3 : 1), true);
+    }
+
+    Image<uint16_t> flat(70, 20, ColorSpace::GrayAlpha, 16);
+    std::fill(flat.Data().begin(), flat.Data().end(), 51234);
+    Image<uint16_t> flatBlurred(70, 20, ColorSpace::GrayAlpha, 16);
+    GaussianBlur(static_cast<const Image<uint16_t> &>(flat).View(),
+        flatBlurred.View(), 9.0);
+    R_ASSERT_EQ(flatBlurred.Data() == flat.Data(), true);
+}
+
+R_TEST_F(Convolve, UnsharpMask) {
+    auto src = Waves<uint8_t>(90, 40, ColorSpace::Gray, 8);
+    auto view = static_cast<const Image<uint8_t> &>(src).View();
+    Image<uint8_t> dst(90, 40, ColorSpace::Gray);
+
+    // nothing but differences above the threshold changes
+    UnsharpMask(view, dst.View(), 1.5, 1.0f, 1.0f);
+    R_ASSERT_EQ(dst.Data() == src.Data(), true);
+
+    Image<uint8_t> blurred(90, 40, ColorSpace::Gray);
+    GaussianBlur(view, blurred.View(), 1.5);
+    UnsharpMask(view, dst.View(), 1.5, 0.7f);
+    for (size_t i = 0; i < src.Data().size(); ++i) {
+        double expected = src.Data()[i] + 0.7 * (src.Data()[i] -
+            static_cast<double>(blurred.Data()[i]));
+        expected = std::min(std::max(expected, 0.0), 255.0);
+        R_ASSERT_EQ(std::fabs(dst.Data()[i] - expected) <= 1.5, true);
+    }
+
+    Image<float> floats(20, 10, ColorSpace::RGB, 16);
+    std::fill(floats.Data().begin(), floats.Data().end(), 1.25f);
+    Image<float> sharp(20, 10, ColorSpace::RGB, 16);
+    UnsharpMask(static_cast<const Image<float> &>(floats).View(),
+        sharp.View(), 3.0, 2.0f);
+    for (float v : sharp.Data()) {
+        R_ASSERT_EQ(std::fabs(v - 1.25f) < 1e-5f, true);
+    }
+}
+
+}
+}
+}
@@ -0,0 +1,178 @@
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <ree/unittest.h>
+
+#include <ree/image/depth_convert.hpp>
+#include <ree/image/process/image.hpp>
+
+#include "test_util.h"
+
+namespace ree {
+namespace image {
+
+/// count samples of depth bits, the extremes first then a spread
+template <typename ValueT>
+static std::vector<ValueT> SamplesOf(uint8_t depth, size_t count) {
+    std::vector<ValueT> samples(count);
+    TestRandom random(depth);
+    uint32_t maxValue = (uint32_t(1) << depth) - 1;
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = static_cast<ValueT>(i < 2 ? i * maxValue :
+            random.Next() % (maxValue + 1));
+    }
+    return samples;
+}
+
+static std::vector<float> SamplesOf(size_t count) {
+    std::vector<float> samples(count);
+    TestRandom random(23);
+    for (size_t i = 0; i < count; ++i) {
+        samples[i] = static_cast<float>(random.Next() % 10007) / 8000.0f -
+            0.1f;
+    }
+    samples[0] = std::numeric_limits<float>::quiet_NaN();
+    samples[1] = -0.0f;
+    samples[2] = 1.0f;
+    return samples;
+}
+
+template <typename FromT, typename ToT>
+static std::vector<ToT> Converted(const std::vector<FromT> &src,
+    uint8_t fromDepth, uint8_t toDepth) {
+    std::vector<ToT> dst(src.size());
+    ConvertSamples(src.data(), fromDepth, dst.data(), toDepth, src.size());
+    return dst;
+}
+
+/// converts src into dst, checking every level converts it alike
+template <typename FromT, typename ToT>
+static void CheckedConvert(const std::vector<FromT> &src, uint8_t fromDepth,
+    std::vector<ToT> &dst, uint8_t toDepth) {
+    auto convert = [&] {
+        return Converted<FromT, ToT>(src, fromDepth, toDepth);
+    };
+    R_ASSERT_EQ(SameAtEverySimdLevel(convert), true);
+    dst = convert();
+}
+
+template <typename FromT, typename ToT>
+static void CheckRescale(uint8_t fromDepth, uint8_t toDepth) {
+    // an odd count so the loop takes over past the kernels
+    auto src = SamplesOf<FromT>(fromDepth, 1001);
+    std::vector<ToT> dst;
+    CheckedConvert(src, fromDepth, dst, toDepth);
+    uint64_t fromMax = (uint64_t(1) << fromDepth) - 1;
+    uint64_t toMax = (uint64_t(1) << toDepth) - 1;
+    for (size_t i = 0; i < src.size(); ++i) {
+        R_ASSERT_EQ(dst[i], (src[i] * toMax + fromMax / 2) / fromMax);
+    }
+}
+
+R_TEST_F(DepthConvert, Integers) {
+    CheckRescale<uint8_t, uint16_t>(8, 10);
+    CheckRescale<uint8_t, uint16_t>(8, 16);
+    CheckRescale<uint16_t, uint8_t>(12, 8);
+    CheckRescale<uint16_t, uint8_t>(16, 8);
+    CheckRescale<uint16_t, uint16_t>(10, 16);
+    CheckRescale<uint16_t, uint16_t>(16, 12);
+    CheckRescale<uint8_t, uint8_t>(8, 4);
+
+    uint8_t bytes[] = {0, 128, 255};
+    uint16_t words[3];
+    ConvertSamples(bytes, 8, words, 16, 3);
+    R_ASSERT_EQ(words[1], 32896);
+    R_ASSERT_EQ(words[2], 65535);
+}
+
+R_TEST_F(DepthConvert, Floats) {
+    auto src = SamplesOf<uint16_t>(12, 1001);
+    std::vector<float> floats;
+    CheckedConvert(src, 12, floats, 12);
+    R_ASSERT_EQ(floats[1], 1.0f);
+    // back to the depth they came from without loss
+    std::vector<uint16_t> back;
+    CheckedConvert(floats, 12, back, 12);
+    R_ASSERT_EQ(back == src, true);
+
+    auto values = SamplesOf(1001);
+    for (uint8_t depth : {8, 10, 16}) {
+        if (depth == 8) {
+            std::vector<uint8_t> dst;
+            CheckedConvert(values, 0, dst, depth);
+            // NaN and below 0 give 0, above 1 the largest sample
+            R_ASSERT_EQ(dst[0], 0);
+            R_ASSERT_EQ(dst[2], 255);
+            continue;
+        }
+        std::vector<uint16_t> dst;
+        CheckedConvert(values, 0, dst, depth);
+        for (size_t i = 1; i < values.size(); ++i) {
+            float v = std::min(std::max(values[i], 0.0f), 1.0f);
+            R_ASSERT_EQ(dst[i], static_cast<uint16_t>(
+                std::lround(v * ((1 << depth) - 1))));
+        }
+    }
+}
+
+R_TEST_F(DepthConvert, IOImages) {
+    std::vector<uint8_t> deep(4 * 3 * 2);
+    auto samples = reinterpret_cast<uint16_t *>(deep.data());
+    for (int i = 0; i < 12; ++i) {
+        samples[i] = static_cast<uint16_t>(i * 93);
+    }
+    io::Image deepImg(2, 2, ColorSpace::RGB, 10, std::move(deep));
+
+    // bytes hold the samples scaled to 8 bits
+    process::Image<uint8_t> bytes =
+        process::ImageFromIOImage<uint8_t>(deepImg);
+    R_ASSERT_EQ(bytes.DepthBits(), 8);
+    R_ASSERT_EQ(bytes.Data().size(), 12u);
+    R_ASSERT_EQ(bytes.Data()[11], (1023 * 255 + 511) / 1023);
+    R_ASSERT_EQ(bytes.Data()[1], (93 * 255 + 511) / 1023);
+
+    // floats keep the depth and go back to the same samples
+    process::Image<float> floats =
+        process::ImageFromIOImage<float>(deepImg);
+    R_ASSERT_EQ(floats.DepthBits(), 10);
+    R_ASSERT_EQ(floats.Data()[11], 1.0f);
+    io::Image back = floats.ToIOImage();
+    R_ASSERT_EQ(back.DepthBits(), 10);
+    R_ASSERT_EQ(back.Data() == deepImg.Data(), true);
+
+    // words keep the values of 8 bit samples
+    process::Image<uint16_t> words =
+        process::ImageFromIOImage<uint16_t>(bytes.ToIOImage());
+    R_ASSERT_EQ(words.DepthBits(), 8);
+    R_ASSERT_EQ(words.Data()[11], 255);
+    R_ASSERT_EQ(words.ToIOImage().Data() == bytes.ToIOImage().Data(), true);
+
+    process::Image<uint16_t> wide = process::ConvertDepth<uint16_t, uint8_t>(
+        bytes.View(), 16);
+    R_ASSERT_EQ(wide.DepthBits(), 16);
+    R_ASSERT_EQ(wide.Data()[11], 65535);
+}
+
+R_TEST_F(DepthConvert, FloatImages) {
+    process::Image<float> image(8, 6, ColorSpace::RGB, 16);
+    for (size_t i = 0; i < image.Data().size(); ++i) {
+        image.Data()[i] = i % 3 == 0 ? 1.5f : 0.25f;
+    }
+    // no clamps, values above 1 pass through
+    image.Resize(4, 3, process::ResampleFilter::Bilinear);
+    R_ASSERT_EQ(std::fabs(image.Data()[0] - 1.5f) < 1e-5f, true);
+    R_ASSERT_EQ(std::fabs(image.Data()[1] - 0.25f) < 1e-5f, true);
+
+    process::Image<float> gray = image.ConvertToColor(ColorSpace::Gray);
+    R_ASSERT_EQ(std::fabs(gray.Data()[0] -
+        (0.299f * 1.5f + 0.701f * 0.25f)) < 1e-5f, true);
+    process::Image<float> ycc = image.ConvertToColor(ColorSpace::YCbCr)
+        .ConvertToColor(ColorSpace::RGB);
+    for (size_t i = 0; i < ycc.Data().size(); ++i) {
+        R_ASSERT_EQ(std::fabs(ycc.Data()[i] - image.Data()[i]) < 1e-4f, true);
+    }
+}
+
+}
+}
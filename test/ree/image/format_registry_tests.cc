@@ -0,0 +1,72 @@
+#include <ree/unittest.h>
+
+#include <stdexcept>
+
+#include <ree/image/io/format_registry.hpp>
+#include <ree/image/test_config.h>
+
+namespace ree {
+namespace image {
+namespace io {
+
+R_TEST_F(FormatRegistry, FindFormat) {
+    auto &registry = FormatRegistry::Instance();
+
+    const uint8_t png[] = {0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A};
+    const uint8_t ppm[] = {0x50, 0x36, 0x0A, 0x35, 0x38, 0x20, 0x35, 0x30};
+    const uint8_t heic[] = {0x00, 0x00, 0x00, 0x18, 'f', 't', 'y', 'p',
+        'h', 'e', 'i', 'c'};
+    const uint8_t unknown[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07};
+
+    R_ASSERT_EQ(registry.FindByMagic(png, sizeof(png))->PreferredExtension(),
+        std::string("png"));
+    R_ASSERT_EQ(registry.FindByMagic(ppm, sizeof(ppm))->PreferredExtension(),
+        std::string("ppm"));
+    R_ASSERT_EQ(registry.FindByMagic(heic, sizeof(heic))->PreferredExtension(),
+        std::string("heic"));
+    R_ASSERT_EQ(registry.FindByMagic(png, 4) == nullptr, true);
+    R_ASSERT_EQ(registry.FindByMagic(unknown, sizeof(unknown)) == nullptr, true);
+
+    R_ASSERT_EQ(registry.FindByExtension(".JPEG")->PreferredExtension(),
+        std::string("jpg"));
+    R_ASSERT_EQ(registry.FindByPath("a.b/ret.pnm")->PreferredExtension(),
+        std::string("ppm"));
+    R_ASSERT_EQ(registry.FindByPath("a.b/ret") == nullptr, true);
+    R_ASSERT_EQ(registry.FindByPath("A.PnG")->PreferredExtension(),
+        std::string("png"));
+}
+
+class LongMagic : public FileFormat {
+public:
+    std::vector<std::string> ValidExtensions() override { return {}; }
+    std::string PreferredExtension() override { return "long"; }
+    std::vector<uint8_t> MagicNumber() override {
+        return std::vector<uint8_t>(FormatRegistry::kMaxMagicSize + 1, 'x');
+    }
+    LoadContext *CreateParseContext(ree::io::Source *source,
+        const LoadOptions &options) override {
+        return new LoadContext(source, options);
+    }
+    WriteContext *CreateComposeContext(ree::io::Source *target,
+        const WriteOptions &options) override {
+        return new WriteContext(target, options);
+    }
+    Image LoadImage(LoadContext *) override { return Image(); }
+    void WriteImage(WriteContext *, const Image &) override {}
+};
+
+R_TEST_F(FormatRegistry, RejectLongMagic) {
+    bool thrown = false;
+    try {
+        FormatRegistry::Instance().Register(std::make_shared<LongMagic>());
+    } catch (const std::invalid_argument &) {
+        thrown = true;
+    }
+    R_ASSERT_EQ(thrown, true);
+    R_ASSERT_EQ(FormatRegistry::Instance().FindByExtension("long") == nullptr,
+        true);
+}
+
+}
+}
+}
@@ -0,0 +1,132 @@
+#include <stdexcept>
+#include <vector>
+
+#include <ree/unittest.h>
+
+#include <ree/image/process/geometry.hpp>
+#include <ree/image/process/image.hpp>
+
+#include "test_util.h"
+
+namespace ree {
+namespace image {
+namespace process {
+
+/// every sample different, so any pixel out of place shows
+template <typename ValueT>
+static Image<ValueT> Numbered(int w, int h, class ColorSpace cs) {
+    Image<ValueT> image(w, h, cs, 16);
+    for (size_t i = 0; i < image.Data().size(); ++i) {
+        image.Data()[i] = static_cast<ValueT>(i * 7 + 3);
+    }
+    return image;
+}
+
+static const Transform kTransforms[] = {Transform::FlipHorizontal,
+    Transform::FlipVertical, Transform::Rotate90, Transform::Rotate180,
+    Transform::Rotate270, Transform::Transpose, Transform::Transverse};
+
+/// src transformed one pixel at a time, from where each pixel lands
+template <typename ValueT>
+static Image<ValueT> NaiveTransform(const ImageView<const ValueT> &src,
+    Transform t) {
+    int w = src.Width();
+    int h = src.Height();
+    bool swaps = SwapsDimensions(t);
+    Image<ValueT> dst(swaps ? h : w, swaps ? w : h, src.ColorSpace(),
+        src.DepthBits());
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            int dx = x;
+            int dy = y;
+            switch (t) {
+            case Transform::FlipHorizontal: dx = w - 1 - x; break;
+            case Transform::FlipVertical: dy = h - 1 - y; break;
+            case Transform::Rotate90: dx = h - 1 - y; dy = x; break;
+            case Transform::Rotate180: dx = w - 1 - x; dy = h - 1 - y; break;
+            case Transform::Rotate270: dx = y; dy = w - 1 - x; break;
+            case Transform::Transpose: dx = y; dy = x; break;
+            case Transform::Transverse: dx = h - 1 - y; dy = w - 1 - x; break;
+            }
+            for (int c = 0; c < src.Components(); ++c) {
+                dst.View().Pixel(dx, dy)[c] = src.Pixel(x, y)[c];
+            }
+        }
+    }
+    return dst;
+}
+
+template <typename ValueT>
+static void CheckTransforms(int w, int h, class ColorSpace cs) {
+    auto image = Numbered<ValueT>(w + 3, h + 2, cs);
+    // a crop, so rows are not contiguous
+    auto src = static_cast<const Image<ValueT> &>(image).View().Crop(2, 1, w,
+        h);
+    for (Transform t : kTransforms) {
+        auto expected = NaiveTransform(src, t);
+        auto transformed = [&] {
+            Image<ValueT> dst(expected.Width(), expected.Height(), cs, 16);
+            ApplyTransform(src, dst.View(), t);
+            return dst.Data();
+        };
+        R_ASSERT_EQ(transformed() == expected.Data(), true);
+        R_ASSERT_EQ(SameAtEverySimdLevel(transformed), true);
+
+        if (SwapsDimensions(t) && w != h) {
+            continue;
+        }
+        auto inPlace = [&] {
+            auto copy = ImageFromView(src);
+            ApplyTransformInPlace(copy.View(), t);
+            return copy.Data();
+        };
+        R_ASSERT_EQ(inPlace() == expected.Data(), true);
+        R_ASSERT_EQ(SameAtEverySimdLevel(inPlace), true);
+    }
+}
+
+R_TEST_F(Geometry, MatchesNaive) {
+    // odd sizes cut blocks at the edges, larger ones span several tiles
+    CheckTransforms<uint8_t>(37, 21, ColorSpace::Gray);
+    CheckTransforms<uint8_t>(150, 70, ColorSpace::Gray);
+    CheckTransforms<uint8_t>(33, 33, ColorSpace::GrayAlpha);
+    CheckTransforms<uint8_t>(29, 40, ColorSpace::RGB);
+    CheckTransforms<uint8_t>(130, 67, ColorSpace::RGBA);
+    CheckTransforms<uint8_t>(67, 67, ColorSpace::RGBA);
+    CheckTransforms<uint16_t>(45, 19, ColorSpace::RGB);
+    CheckTransforms<uint16_t>(70, 70, ColorSpace::RGBA);
+    CheckTransforms<float>(35, 35, ColorSpace::RGB);
+    CheckTransforms<float>(41, 70, ColorSpace::RGBA);
+}
+
+R_TEST_F(Geometry, Sizes) {
+    Image<uint8_t> src(4, 3, ColorSpace::RGB);
+    auto view = static_cast<const Image<uint8_t> &>(src).View();
+    Image<uint8_t> same(4, 3, ColorSpace::RGB);
+    ApplyTransform(view, same.View(), Transform::Rotate180);
+
+    bool thrown = false;
+    try {
+        ApplyTransform(view, same.View(), Transform::Rotate90);
+    } catch (const std::invalid_argument &) {
+        thrown = true;
+    }
+    R_ASSERT_EQ(thrown, true);
+
+    thrown = false;
+    try {
+        ApplyTransformInPlace(src.View(), Transform::Transpose);
+    } catch (const std::invalid_argument &) {
+        thrown = true;
+    }
+    R_ASSERT_EQ(thrown, true);
+
+    Image<uint8_t> single(1, 1, ColorSpace::Gray);
+    single.Data()[0] = 9;
+    ApplyTransformInPlace(single.View(), Transform::Rotate90);
+    R_ASSERT_EQ(single.Data()[0], 9);
+}
+
+}
+}
+}
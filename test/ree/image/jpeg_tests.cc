@@ -1,3 +1,4 @@
+#include <cstdlib>
 #include <iostream>
 
 #define _USE_MATH_DEFINES
@@ -8,6 +9,8 @@
 #include <ree/image/test_config.h>
 #include <ree/image/io/jpeg.hpp>
 #include <ree/image/io/ppm.hpp>
+#include <ree/image/io/decoder.hpp>
+#include <ree/image/io/error.hpp>
 #include <ree/image/process/image.hpp>
 
 namespace ree {
@@ -122,6 +125,99 @@ R_TEST_F(Jpeg, ParseJpeg) {
     }
 }
 
+R_TEST_F(Jpeg, ReadRows) {
+    Jpeg jpeg;
+    Decoder decoder(&jpeg);
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.jpg");
+    Image img = decoder.Decode(source.get());
+
+    const ImageInfo &info = decoder.Begin(source.get());
+    R_ASSERT_EQ(info.width, img.Width());
+    R_ASSERT_EQ(info.height, img.Height());
+    R_ASSERT_EQ(info.colorspace == ColorSpace::RGB, true);
+
+    // odd batches to cross the MCU rows
+    size_t rowBytes = info.RowBytes();
+    std::vector<uint8_t> rows(rowBytes * 7);
+    int y = 0;
+    int n;
+    while ((n = decoder.ReadRows(rows.data(), rowBytes, 7)) > 0) {
+        auto expected = img.Data().data() + rowBytes * y;
+        R_ASSERT_EQ(std::equal(rows.begin(), rows.begin() + rowBytes * n,
+            expected), true);
+        y += n;
+    }
+    decoder.End();
+    R_ASSERT_EQ(y, img.Height());
+}
+
+R_TEST_F(Jpeg, LoadIntoGray) {
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.jpg");
+    Image img = Image::Load(source.get());
+
+    std::vector<uint8_t> gray(img.Width() * img.Height());
+    ImageInfo info = Image::LoadInto(source.get(), gray.data(), img.Width(),
+        ColorSpace::Gray);
+    R_ASSERT_EQ(info.colorspace == ColorSpace::Gray, true);
+
+    // luma straight from the decoder, against luma of the decoded colors,
+    // which lose a little where they are clamped
+    process::Image<uint8_t> luma =
+        process::ImageFromIOImage<uint8_t>(img).ConvertToColor(ColorSpace::Gray);
+    for (size_t i = 0; i < gray.size(); ++i) {
+        R_ASSERT_EQ(std::abs(gray[i] - luma.Data()[i]) <= 4, true);
+    }
+}
+
+R_TEST_F(Jpeg, ApplyOrientation) {
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.jpg");
+    Image upright = Image::Load(source.get());
+
+    // the same scan with EXIF orientation 6, to be turned clockwise
+    auto rotated = ree::io::Source::SourceByPath(kTestAssetsDir +
+        "dot1_rot.jpg");
+    Image stored = Image::Load(rotated.get());
+    R_ASSERT_EQ(stored.Width(), upright.Width());
+    R_ASSERT_EQ(stored.Data() == upright.Data(), true);
+
+    Image img = Image::Load(rotated.get(), {{"apply_orientation", "true"}});
+    R_ASSERT_EQ(img.Width(), upright.Height());
+    R_ASSERT_EQ(img.Height(), upright.Width());
+    auto src = upright.View<uint8_t>();
+    auto dst = img.View<uint8_t>();
+    for (int y = 0; y < src.Height(); ++y) {
+        for (int x = 0; x < src.Width(); ++x) {
+            const uint8_t *a = src.Pixel(x, y);
+            const uint8_t *b = dst.Pixel(src.Height() - 1 - y, x);
+            R_ASSERT_EQ(std::equal(a, a + 3, b), true);
+        }
+    }
+}
+
+R_TEST_F(Jpeg, CorruptFiles) {
+    // a DC table with four codes of length 2 and two more of length 3
+    auto baddht = ree::io::Source::SourceByPath(kTestAssetsDir + "baddht.jpg");
+    bool failed = false;
+    try {
+        Image::Load(baddht.get());
+    } catch (const FileCorruptedException &) {
+        failed = true;
+    }
+    R_ASSERT_EQ(failed, true);
+
+    // cut in the middle of the scan
+    Decoder decoder;
+    auto trunc = ree::io::Source::SourceByPath(kTestAssetsDir + "trunc.jpg");
+    failed = false;
+    try {
+        decoder.DecodeRows(trunc.get(), LoadOptions(),
+            [](int, const uint8_t *) {});
+    } catch (const FileCorruptedException &) {
+        failed = true;
+    }
+    R_ASSERT_EQ(failed, true);
+}
+
 }
 }
 }
@@ -0,0 +1,63 @@
+#include <ree/unittest.h>
+
+#include <ree/image/io/image.hpp>
+#include <ree/image/io/error.hpp>
+#include <ree/image/test_config.h>
+
+namespace ree {
+namespace image {
+namespace io {
+
+static Metadata ReadAsset(const std::string &name) {
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + name);
+    return Image::ReadMetadata(source.get());
+}
+
+R_TEST_F(Metadata, PngAndJpeg) {
+    // both files carry the same profile, iCCP inflated and APP2 as is
+    Metadata png = ReadAsset("dot1.png");
+    R_ASSERT_EQ(png.icc.size(), 3996u);
+    R_ASSERT_EQ(png.xmp.size(), 389u);
+    R_ASSERT_EQ(png.xmp.compare(0, 10, "<x:xmpmeta"), 0);
+    R_ASSERT_EQ(static_cast<int>(png.dpiX + 0.5), 144);
+    R_ASSERT_EQ(png.exif.empty(), true);
+    R_ASSERT_EQ(png.orientation, 1);
+
+    Metadata jpg = ReadAsset("dot1.jpg");
+    R_ASSERT_EQ(jpg.icc == png.icc, true);
+    R_ASSERT_EQ(jpg.xmp.size(), 2306u);
+    R_ASSERT_EQ(jpg.dpiX, 144.0);
+    R_ASSERT_EQ(jpg.dpiY, 144.0);
+    R_ASSERT_EQ(jpg.exif.size(), 120u);
+    R_ASSERT_EQ(jpg.orientation, 1);
+
+    Metadata ppm = ReadAsset("dot1.ppm");
+    R_ASSERT_EQ(ppm.icc.empty() && ppm.xmp.empty() && ppm.exif.empty(), true);
+}
+
+R_TEST_F(Metadata, CompressedXmp) {
+    // inflated past the four times its compressed size first tried
+    Metadata png = ReadAsset("zxmp.png");
+    R_ASSERT_EQ(png.xmp.size(), 5023u);
+    R_ASSERT_EQ(png.xmp.compare(0, 11, "<x:xmpmeta>"), 0);
+    R_ASSERT_EQ(png.xmp.compare(5011, 12, "</x:xmpmeta>"), 0);
+}
+
+R_TEST_F(Metadata, Corrupted) {
+    // ending before the first scan or IEND, an eXIf chunk claiming 2 GiB,
+    // and compressed XMP that is empty or inflates past 64 MiB
+    for (auto name : {"trunc.png", "trunc_hdr.jpg", "bigexif.png",
+        "emptyxmp.png", "bombxmp.png"}) {
+        bool failed = false;
+        try {
+            ReadAsset(name);
+        } catch (const FileCorruptedException &) {
+            failed = true;
+        }
+        R_ASSERT_EQ(failed, true);
+    }
+}
+
+}
+}
+}
@@ -0,0 +1,114 @@
+#include <algorithm>
+
+#include <ree/unittest.h>
+
+#include <ree/image/process/image.hpp>
+#include <ree/image/process/pipeline.hpp>
+#include <ree/image/test_util.h>
+
+namespace ree {
+namespace image {
+namespace process {
+
+/// slow ramps of each component under a little noise
+template <typename ValueT>
+static Image<ValueT> Gradient(int w, int h, class ColorSpace cs,
+    uint8_t depth) {
+    Image<ValueT> image(w, h, cs, depth);
+    TestRandom random(3);
+    int max = (1 << depth) - 1;
+    auto view = image.View();
+    for (int y = 0; y < h; ++y) {
+        for (int x = 0; x < w; ++x) {
+            for (int c = 0; c < cs.Components(); ++c) {
+                int noise = (random.Next() >> 8) % 64;
+                view.Pixel(x, y)[c] = static_cast<ValueT>(
+                    std::min(max, (x * 7 + y * 3 + c * 40) % (max - 63) +
+                    noise));
+            }
+        }
+    }
+    return image;
+}
+
+template <typename ValueT>
+static Image<ValueT> Cropped(const Image<ValueT> &image, int x, int y, int w,
+    int h) {
+    return ImageFromView(image.View().Crop(x, y, w, h));
+}
+
+/// the mean of the pixels around, edges repeated
+template <typename ValueT>
+static Image<ValueT> NaiveBoxBlur(const Image<ValueT> &image, int radius) {
+    Image<ValueT> out(image.Width(), image.Height(), image.ColorSpace(),
+        image.DepthBits());
+    int area = (2 * radius + 1) * (2 * radius + 1);
+    for (int y = 0; y < image.Height(); ++y) {
+        for (int x = 0; x < image.Width(); ++x) {
+            for (int c = 0; c < image.ColorSpace().Components(); ++c) {
+                uint64_t sum = 0;
+                for (int j = -radius; j <= radius; ++j) {
+                    for (int i = -radius; i <= radius; ++i) {
+                        int sx = std::min(std::max(x + i, 0),
+                            image.Width() - 1);
+                        int sy = std::min(std::max(y + j, 0),
+                            image.Height() - 1);
+                        sum += image.View().Pixel(sx, sy)[c];
+                    }
+                }
+                out.View().Pixel(x, y)[c] =
+                    static_cast<ValueT>((sum + area / 2) / area);
+            }
+        }
+    }
+    return out;
+}
+
+R_TEST_F(Pipeline, MatchesSteps) {
+    Image<uint8_t> src = Gradient<uint8_t>(123, 77, ColorSpace::RGB, 8);
+    Pipeline<uint8_t> pipeline(
+        static_cast<const Image<uint8_t> &>(src).View());
+    pipeline.ConvertToColor(ColorSpace::RGBA)
+        .Crop(5, 3, 100, 70)
+        .Resize(41, 150, ResampleFilter::Bicubic)
+        .ConvertToColor(ColorSpace::GrayAlpha)
+        .ConvertToColor(ColorSpace::Gray)
+        .Crop(2, 10, 30, 100);
+    R_ASSERT_EQ(pipeline.Width(), 30);
+    R_ASSERT_EQ(pipeline.Height(), 100);
+    R_ASSERT_EQ(pipeline.ColorSpace() == ColorSpace::Gray, true);
+
+    Image<uint8_t> expected = Cropped(src.ConvertToColor(ColorSpace::RGBA),
+        5, 3, 100, 70);
+    expected.Resize(41, 150, ResampleFilter::Bicubic);
+    expected = Cropped(expected.ConvertToColor(ColorSpace::GrayAlpha)
+        .ConvertToColor(ColorSpace::Gray), 2, 10, 30, 100);
+    R_ASSERT_EQ(pipeline.Run().Data() == expected.Data(), true);
+}
+
+R_TEST_F(Pipeline, BlurAndShrink) {
+    Image<uint16_t> src = Gradient<uint16_t>(211, 190, ColorSpace::GrayAlpha,
+        12);
+    Pipeline<uint16_t> pipeline(
+        static_cast<const Image<uint16_t> &>(src).View());
+    pipeline.Crop(1, 2, 200, 180).BoxBlur(3).Resize(60, 45,
+        ResampleFilter::Area).BoxBlur(1);
+
+    Image<uint16_t> expected = NaiveBoxBlur(Cropped(src, 1, 2, 200, 180), 3);
+    expected.Resize(60, 45, ResampleFilter::Area);
+    expected = NaiveBoxBlur(expected, 1);
+    R_ASSERT_EQ(pipeline.Run().Data() == expected.Data(), true);
+
+    // tiles shrink to fit the buffers in the cache, and still give the same
+    int width;
+    int height;
+    pipeline.TileSize(1 << 30, &width, &height);
+    R_ASSERT_EQ(width, 60);
+    R_ASSERT_EQ(height, 45);
+    pipeline.TileSize(8 << 10, &width, &height);
+    R_ASSERT_EQ(width < 60 || height < 45, true);
+}
+
+}
+}
+}
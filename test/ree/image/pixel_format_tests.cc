@@ -0,0 +1,80 @@
+#include <vector>
+
+#include <ree/unittest.h>
+
+#include <ree/image/color_convert.hpp>
+#include <ree/image/pixel_format.hpp>
+
+#include "test_util.h"
+
+namespace ree {
+namespace image {
+
+static_assert(PixelFormat<ColorSpace::RGBA, 8>::kComponents == 4, "");
+static_assert(PixelFormat<ColorSpace::RGBA, 8>::kAlpha == 3, "");
+static_assert(PixelFormat<ColorSpace::GrayAlpha, 16>::kAlpha == 1, "");
+static_assert(PixelFormat<ColorSpace::YCbCr, 8>::kAlpha == -1, "");
+static_assert(PixelFormat<ColorSpace::RGB, 12>::MaxValue(0) == 4095, "");
+static_assert(PixelFormat<ColorSpace::YCbCr, 10>::MidValue(0) == 512, "");
+static_assert(PixelFormat<ColorSpace::Gray, 0>::MaxValue(5) == 31, "");
+
+/// what a dispatch lands on
+struct Landed {
+    ColorSpace::Value colorspace = ColorSpace::Unknown;
+    int components = 0;
+    int depth = -1;
+
+    template <typename Format>
+    void operator()(Format) {
+        colorspace = Format::kColorSpace;
+        components = Format::kComponents;
+        depth = Format::kDepth;
+    }
+};
+
+R_TEST_F(PixelFormat, Dispatch) {
+    Landed landed;
+    DispatchPixelFormat<uint8_t>(ColorSpace::GrayAlpha, 8, landed);
+    R_ASSERT_EQ(landed.colorspace, ColorSpace::GrayAlpha);
+    R_ASSERT_EQ(landed.components, 2);
+    R_ASSERT_EQ(landed.depth, 8);
+
+    // depths without kernels of their own take those of any depth
+    DispatchPixelFormat<uint8_t>(ColorSpace::RGB, 4, landed);
+    R_ASSERT_EQ(landed.depth, 0);
+    DispatchPixelFormat<uint16_t>(ColorSpace::YCbCr, 12, landed);
+    R_ASSERT_EQ(landed.colorspace, ColorSpace::YCbCr);
+    R_ASSERT_EQ(landed.depth, 12);
+    DispatchPixelFormat<uint16_t>(ColorSpace::RGBA, 14, landed);
+    R_ASSERT_EQ(landed.components, 4);
+    R_ASSERT_EQ(landed.depth, 0);
+
+    bool thrown = false;
+    try {
+        DispatchPixelFormat<uint8_t>(ColorSpace::Unknown, 8, landed);
+    } catch (const std::invalid_argument &) {
+        thrown = true;
+    }
+    R_ASSERT_EQ(thrown, true);
+}
+
+/// the converters found once give what ConvertPixels gives, at depths with
+/// kernels of their own and without
+R_TEST_F(PixelFormat, ConverterMatchesConvertPixels) {
+    for (uint8_t depth : {9, 12, 16}) {
+        auto src = RandomImage<uint16_t>(31, 1, ColorSpace::YCbCr, depth, 13)
+            .Release();
+        std::vector<uint16_t> found(31 * 4);
+        std::vector<uint16_t> converted(31 * 4);
+        auto convert = FindConverter<uint16_t>(ColorSpace::YCbCr,
+            ColorSpace::RGBA, depth);
+        convert(src.data(), found.data(), 31, depth);
+        ConvertPixels(src.data(), ColorSpace::YCbCr, converted.data(),
+            ColorSpace::RGBA, 31, depth);
+        R_ASSERT_EQ(found == converted, true);
+        R_ASSERT_EQ(found[3], (1 << depth) - 1);
+    }
+}
+
+}
+}
@@ -0,0 +1,71 @@
+#include <vector>
+
+#include <ree/unittest.h>
+
+#include <ree/image/allocator.hpp>
+#include <ree/image/process/image.hpp>
+#include <ree/image/process/planar.hpp>
+#include <ree/image/test_util.h>
+
+namespace ree {
+namespace image {
+namespace process {
+
+R_TEST_F(Planar, PlanesHoldComponents) {
+    const Image<uint8_t> image = RandomImage<uint8_t>(37, 5, ColorSpace::RGBA,
+        8, 11);
+    auto planar = ToPlanar(image.View());
+    R_ASSERT_EQ(planar.Stride() % kPixelAlignment, size_t(0));
+    for (int c = 0; c < 4; ++c) {
+        auto plane = planar.Plane(c);
+        R_ASSERT_EQ(reinterpret_cast<uintptr_t>(plane.Data()) %
+            kPixelAlignment, uintptr_t(0));
+        for (int y = 0; y < 5; ++y) {
+            for (int x = 0; x < 37; ++x) {
+                R_ASSERT_EQ(plane.Row(y)[x], image.View().Pixel(x, y)[c]);
+            }
+        }
+    }
+}
+
+/// the kernels split and merge as the loops do, tails included
+template <typename ValueT>
+static void CheckRoundTrip(class ColorSpace cs, uint8_t depth, size_t stride) {
+    const Image<ValueT> image = RandomImage<ValueT>(53, 7, cs, depth, 11);
+    R_ASSERT_EQ(SameAtEverySimdLevel([&]() {
+        PlanarImage<ValueT> planar(53, 7, cs, depth, stride);
+        Deinterleave(image.View(), planar);
+        std::vector<ValueT> samples;
+        for (int c = 0; c < cs.Components(); ++c) {
+            for (int y = 0; y < 7; ++y) {
+                auto row = planar.Plane(c).Row(y);
+                samples.insert(samples.end(), row, row + 53);
+            }
+        }
+        return samples;
+    }), true);
+
+    PlanarImage<ValueT> planar(53, 7, cs, depth, stride);
+    Deinterleave(image.View(), planar);
+    for (auto level : {SimdLevel::Scalar, SimdLevel::Ssse3, SimdLevel::Avx2}) {
+        R_ASSERT_EQ(AtSimdLevel(level, [&]() {
+            Image<ValueT> back(53, 7, cs, depth);
+            Interleave(planar, back.View());
+            return back.Release();
+        }) == image.Data(), true);
+    }
+}
+
+R_TEST_F(Planar, RoundTrip) {
+    for (auto cs : {ColorSpace::GrayAlpha, ColorSpace::RGB, ColorSpace::RGBA,
+        ColorSpace::Gray}) {
+        CheckRoundTrip<uint8_t>(cs, 8, 0);
+        CheckRoundTrip<uint8_t>(cs, 8, 61);
+        CheckRoundTrip<uint16_t>(cs, 16, 0);
+        CheckRoundTrip<uint16_t>(cs, 12, 110);
+    }
+}
+
+}
+}
+}
@@ -1,7 +1,11 @@
 #include <ree/image/io/png.hpp>
 #include <ree/image/io/ppm.hpp>
+#include <ree/image/io/decoder.hpp>
+#include <ree/image/io/error.hpp>
 
 
+#include <algorithm>
+#include <stdexcept>
 #include <iostream>
 
 #include <ree/unittest.h>
@@ -78,6 +82,98 @@ R_TEST_F(Png, ParsePng) {
     }
 }
 
+R_TEST_F(Png, DecoderReuse) {
+    Png png;
+    Decoder decoder(&png);
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.png");
+    Image img = decoder.Decode(source.get());
+    Image img1 = decoder.Decode(source.get());
+    R_ASSERT_EQ(img1.Width(), img.Width());
+    R_ASSERT_EQ(img1.Height(), img.Height());
+    R_ASSERT_EQ(img1.Data() == img.Data(), true);
+}
+
+R_TEST_F(Png, DecodeRows) {
+    Decoder decoder;
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.png");
+    Image img = decoder.Decode(source.get());
+
+    int rows = 0;
+    ImageInfo info = decoder.DecodeRows(source.get(), LoadOptions(),
+        [&](int y, const uint8_t *row) {
+            auto expected = img.Data().data() + img.Data().size() /
+                img.Height() * y;
+            R_ASSERT_EQ(std::equal(row, row + img.Data().size() / img.Height(),
+                expected), true);
+            rows++;
+        });
+    R_ASSERT_EQ(info.width, img.Width());
+    R_ASSERT_EQ(rows, img.Height());
+}
+
+R_TEST_F(Png, LoadInto) {
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.png");
+    Image img = Image::Load(source.get());
+    process::Image<uint8_t> expected =
+        process::ImageFromIOImage<uint8_t>(img).ConvertToColor(ColorSpace::RGB);
+
+    // rows padded out, as in a slot of an atlas
+    size_t stride = img.Width() * 3 + 13;
+    std::vector<uint8_t> atlas(stride * img.Height(), 0xee);
+    ImageInfo info = Image::LoadInto(source.get(), atlas.data(), stride,
+        ColorSpace::RGB);
+    R_ASSERT_EQ(info.colorspace == ColorSpace::RGB, true);
+    R_ASSERT_EQ(info.width, img.Width());
+    for (int y = 0; y < img.Height(); ++y) {
+        auto row = atlas.begin() + stride * y;
+        R_ASSERT_EQ(std::equal(row, row + img.Width() * 3,
+            expected.View().Row(y)), true);
+        R_ASSERT_EQ(row[img.Width() * 3], 0xee);
+    }
+
+    bool failed = false;
+    try {
+        Image::LoadInto(source.get(), atlas.data(), img.Width() * 3 - 1,
+            ColorSpace::RGB);
+    } catch (const std::invalid_argument &) {
+        failed = true;
+    }
+    R_ASSERT_EQ(failed, true);
+}
+
+R_TEST_F(Png, Truncated) {
+    // cut inside the iCCP chunk, long before the first IDAT
+    Decoder decoder;
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "trunc.png");
+    bool failed = false;
+    try {
+        decoder.DecodeRows(source.get(), LoadOptions(),
+            [](int, const uint8_t *) {});
+    } catch (const FileCorruptedException &) {
+        failed = true;
+    }
+    R_ASSERT_EQ(failed, true);
+}
+
+R_TEST_F(Png, BadHeaders) {
+    // image data before IHDR, a short IHDR, and 4 bit RGB, each read after a
+    // good file so nothing of its header is left over in the decoder
+    Decoder decoder;
+    for (auto name : {"noihdr.png", "shortihdr.png", "baddepth.png"}) {
+        auto good = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.png");
+        R_ASSERT_EQ(decoder.Decode(good.get()).Width() > 0, true);
+
+        auto source = ree::io::Source::SourceByPath(kTestAssetsDir + name);
+        bool failed = false;
+        try {
+            decoder.Decode(source.get());
+        } catch (const FileCorruptedException &) {
+            failed = true;
+        }
+        R_ASSERT_EQ(failed, true);
+    }
+}
+
 }
 }
 }
@@ -1,6 +1,7 @@
 #include <ree/unittest.h>
 
 #include <ree/image/io/ppm.hpp>
+#include <ree/image/io/encoder.hpp>
 #include <ree/image/test_config.h>
 
 namespace ree {
@@ -54,6 +55,28 @@ R_TEST_F(Ppm, ParsePpm) {
     }
 }
 
+R_TEST_F(Ppm, WriteCrop) {
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.ppm");
+    Image img = Image::Load(source.get());
+    auto crop = img.View<uint8_t>().Crop(10, 5, 20, 10);
+    R_ASSERT_EQ(crop.Contiguous(), false);
+
+    Ppm ppm;
+    Encoder encoder(&ppm);
+    auto target = ree::io::Source::SourceByPath(kTestAssetsDir + "crop.ppm");
+    encoder.Encode(crop, target.get());
+
+    Image cropped = Image::Load(target.get());
+    R_ASSERT_EQ(cropped.Width(), 20);
+    R_ASSERT_EQ(cropped.Height(), 10);
+    auto view = cropped.View<uint8_t>();
+    for (int row = 0; row < view.Height(); ++row) {
+        for (size_t i = 0; i < view.RowValues(); ++i) {
+            R_ASSERT_EQ(view.Row(row)[i], crop.Row(row)[i]);
+        }
+    }
+}
+
 }
 }
 }
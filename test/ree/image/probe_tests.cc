@@ -0,0 +1,61 @@
+#include <ree/unittest.h>
+
+#include <ree/image/io/image.hpp>
+#include <ree/image/io/error.hpp>
+#include <ree/image/test_config.h>
+
+namespace ree {
+namespace image {
+namespace io {
+
+static ProbeInfo ProbeAsset(const std::string &name) {
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + name);
+    return Image::Probe(source.get());
+}
+
+R_TEST_F(Probe, Headers) {
+    ProbeInfo png = ProbeAsset("dot1.png");
+    R_ASSERT_EQ(png.format, std::string("png"));
+    R_ASSERT_EQ(png.width, 58);
+    R_ASSERT_EQ(png.height, 50);
+    R_ASSERT_EQ(png.colorspace, ColorSpace::RGBA);
+    R_ASSERT_EQ(png.depth, 8);
+    R_ASSERT_EQ(png.frames, 1);
+
+    ProbeInfo jpg = ProbeAsset("dot1.jpg");
+    R_ASSERT_EQ(jpg.format, std::string("jpg"));
+    R_ASSERT_EQ(jpg.width, 58);
+    R_ASSERT_EQ(jpg.height, 50);
+    R_ASSERT_EQ(jpg.colorspace, ColorSpace::RGB);
+
+    ProbeInfo ppm = ProbeAsset("dot1.ppm");
+    R_ASSERT_EQ(ppm.format, std::string("ppm"));
+    R_ASSERT_EQ(ppm.width, 58);
+    R_ASSERT_EQ(ppm.colorspace, ColorSpace::RGB);
+
+    // the primary item is described by its ispe and pixi properties
+    ProbeInfo heic = ProbeAsset("dot1.heic");
+    R_ASSERT_EQ(heic.format, std::string("heic"));
+    R_ASSERT_EQ(heic.width, 58);
+    R_ASSERT_EQ(heic.height, 50);
+    R_ASSERT_EQ(heic.colorspace, ColorSpace::RGB);
+    R_ASSERT_EQ(heic.depth, 8);
+    R_ASSERT_EQ(heic.frames, 1);
+}
+
+R_TEST_F(Probe, Truncated) {
+    // each ends before the header describing the image
+    for (auto name : {"trunc.png", "trunc.jpg", "trunc_hdr.jpg", "trunc.heic"}) {
+        bool failed = false;
+        try {
+            ProbeAsset(name);
+        } catch (const FileCorruptedException &) {
+            failed = true;
+        }
+        R_ASSERT_EQ(failed, std::string(name) != "trunc.jpg");
+    }
+}
+
+}
+}
+}
@@ -0,0 +1,42 @@
+#include <ree/unittest.h>
+
+#include <ree/image/io/image.hpp>
+#include <ree/image/process/image.hpp>
+#include <ree/image/test_config.h>
+
+namespace ree {
+namespace image {
+namespace process {
+
+R_TEST_F(Process, MoveHandoff) {
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.ppm");
+    io::Image img = io::Image::Load(source.get());
+    const uint8_t *pixels = img.Data().data();
+
+    Image<uint8_t> pImg = ImageFromIOImage<uint8_t>(std::move(img));
+    R_ASSERT_EQ(img.Data().empty(), true);
+    R_ASSERT_EQ(pImg.Data().data() == pixels, true);
+    R_ASSERT_EQ(pImg.Width(), 58);
+
+    io::Image back = std::move(pImg).ToIOImage();
+    R_ASSERT_EQ(back.Data().data() == pixels, true);
+    R_ASSERT_EQ(back.Height(), 50);
+
+    // 16-bit samples are reinterpreted in place
+    std::vector<uint8_t> deep(back.Data().size() * 2);
+    for (size_t i = 0; i < back.Data().size(); ++i) {
+        reinterpret_cast<uint16_t *>(deep.data())[i] = back.Data()[i] << 2;
+    }
+    io::Image deepImg(back.Width(), back.Height(), back.ColorSpace(), 10,
+        std::move(deep));
+    const uint8_t *deepPixels = deepImg.Data().data();
+    Image<uint16_t> pDeep = ImageFromIOImage<uint16_t>(std::move(deepImg));
+    R_ASSERT_EQ(reinterpret_cast<const uint8_t *>(pDeep.Data().data()) ==
+        deepPixels, true);
+    R_ASSERT_EQ(pDeep.Data().size(), back.Data().size());
+    R_ASSERT_EQ(pDeep.Data()[7], back.Data()[7] << 2);
+}
+
+}
+}
+}
@@ -0,0 +1,66 @@
+#include <algorithm>
+#include <vector>
+
+#include <ree/unittest.h>
+
+#include <ree/image/process/image.hpp>
+#include <ree/image/process/resample.hpp>
+#include <ree/image/test_util.h>
+
+namespace ree {
+namespace image {
+namespace process {
+
+static const ResampleFilter kFilters[] = {
+    ResampleFilter::Area, ResampleFilter::Bilinear, ResampleFilter::Bicubic,
+    ResampleFilter::Lanczos,
+};
+
+R_TEST_F(Resample, FlatStaysFlat) {
+    for (auto filter : kFilters) {
+        Image<uint16_t> image(37, 29, ColorSpace::GrayAlpha, 12);
+        std::fill(image.Data().begin(), image.Data().end(), 4000);
+        image.Resize(101, 9, filter);
+        R_ASSERT_EQ(image.Width(), 101);
+        R_ASSERT_EQ(image.Height(), 9);
+        R_ASSERT_EQ(image.Data().size(), size_t(101 * 9 * 2));
+        for (auto v : image.Data()) {
+            R_ASSERT_EQ(v, 4000);
+        }
+    }
+}
+
+/// the kernels give what the loops give, at the edges too
+R_TEST_F(Resample, KernelsMatchScalar) {
+    for (auto cs : {ColorSpace::RGB, ColorSpace::RGBA, ColorSpace::Gray}) {
+        const Image<uint8_t> src = RandomImage<uint8_t>(123, 77, cs, 8, 7);
+        for (auto filter : kFilters) {
+            R_ASSERT_EQ(SameAtEverySimdLevel([&]() {
+                Image<uint8_t> dst(50, 160, cs);
+                Resample(src.View(), dst.View(), filter);
+                return dst.Release();
+            }), true);
+        }
+    }
+}
+
+/// the whole image and the streaming resampler agree
+R_TEST_F(Resample, MatchesRowResampler) {
+    const Image<uint8_t> src = RandomImage<uint8_t>(64, 48, ColorSpace::RGB,
+        8, 7);
+    Image<uint8_t> whole(20, 15, ColorSpace::RGB);
+    Resample(src.View(), whole.View(), ResampleFilter::Bicubic);
+
+    RowResampler<uint8_t> rows(64, 48, 20, 15, 3, 8, ResampleFilter::Bicubic);
+    std::vector<uint8_t> streamed;
+    rows.PushRows(src.Data().data(), 64 * 3, 48,
+        [&streamed](int, const uint8_t *row) {
+        streamed.insert(streamed.end(), row, row + 20 * 3);
+    });
+    R_ASSERT_EQ(std::equal(streamed.begin(), streamed.end(),
+        whole.Data().begin()), true);
+}
+
+}
+}
+}
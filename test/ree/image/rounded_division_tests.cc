@@ -0,0 +1,46 @@
+#include <cstdint>
+
+#include <ree/unittest.h>
+
+#include <ree/image/rounded_division.hpp>
+
+#include "test_util.h"
+
+namespace ree {
+namespace image {
+
+static uint64_t Rounded(uint64_t n, uint64_t divisor) {
+    return (n + divisor / 2) / divisor;
+}
+
+/// n / d at small numerators, then at whole quotients and those just short
+/// of them up to the largest numerator, for count random quotients
+static void CheckDivisor(uint64_t d, int count, TestRandom &random) {
+    RoundedDivision divide(static_cast<double>(d));
+    for (uint64_t n = 0; n < 4 * d + 4 && n < 10000; ++n) {
+        R_ASSERT_EQ(divide(static_cast<double>(n)), Rounded(n, d));
+    }
+    uint64_t last = ((uint64_t(1) << 39) - 2 * d) / d;
+    for (int i = 0; i < count; ++i) {
+        uint64_t q = i < 2 ? last - i :
+            (uint64_t(random.Next()) << 16 | random.Next()) % last + 1;
+        for (uint64_t n : {q * d - d / 2, q * d - d / 2 - 1,
+            q * d + (d - 1) / 2, q * d + (d - 1) / 2 + 1}) {
+            R_ASSERT_EQ(divide(static_cast<double>(n)), Rounded(n, d));
+        }
+    }
+}
+
+R_TEST_F(RoundedDivision, MatchesIntegers) {
+    TestRandom random(29);
+    for (uint64_t d = 1; d <= 1100; ++d) {
+        CheckDivisor(d, 100, random);
+    }
+    // the sample maxima and box areas of the callers past those
+    for (uint64_t d : {4095, 65535, 40401, 1 << 20, 999983}) {
+        CheckDivisor(d, 2000, random);
+    }
+}
+
+}
+}
@@ -0,0 +1,162 @@
+#include <cmath>
+#include <vector>
+
+#include <ree/unittest.h>
+
+#include <ree/image/process/image.hpp>
+#include <ree/image/process/statistics.hpp>
+
+#include "test_util.h"
+
+namespace ree {
+namespace image {
+namespace process {
+
+template <typename ValueT>
+static ImageView<const ValueT> ConstView(const Image<ValueT> &image) {
+    return image.View();
+}
+
+/// whether IsOpaque and IsGrayscale give expected at every SIMD level
+template <typename ValueT>
+static bool Detects(const Image<ValueT> &image, bool opaque, bool gray) {
+    auto detect = [&] {
+        return IsOpaque(ConstView(image)) == opaque &&
+            IsGrayscale(ConstView(image)) == gray;
+    };
+    return detect() && SameAtEverySimdLevel(detect);
+}
+
+R_TEST_F(Statistics, Histograms) {
+    auto image = RandomImage<uint8_t>(301, 50, ColorSpace::RGB, 8, 17);
+    auto view = ConstView(image).Crop(1, 2, 299, 47);
+    auto histograms = ComputeHistograms(view);
+    R_ASSERT_EQ(histograms.size(), 3u);
+    std::vector<uint64_t> expected(3 * 256);
+    for (int y = 0; y < view.Height(); ++y) {
+        for (int x = 0; x < view.Width(); ++x) {
+            for (int c = 0; c < 3; ++c) {
+                ++expected[c * 256 + view.Pixel(x, y)[c]];
+            }
+        }
+    }
+    for (int c = 0; c < 3; ++c) {
+        R_ASSERT_EQ(std::equal(histograms[c].begin(), histograms[c].end(),
+            expected.begin() + c * 256), true);
+    }
+
+    // bins spread over the depth, floats past [0, 1] in the end ones
+    auto deep = RandomImage<uint16_t>(40, 20, ColorSpace::Gray, 12, 17);
+    auto binned = ComputeHistograms(ConstView(deep), 16);
+    std::vector<uint64_t> deepExpected(16);
+    for (uint16_t v : deep.Data()) {
+        ++deepExpected[v >> 8];
+    }
+    R_ASSERT_EQ(binned[0] == deepExpected, true);
+
+    Image<float> floats(4, 1, ColorSpace::Gray, 16);
+    floats.Data()[0] = -0.5f;
+    floats.Data()[1] = 0.3f;
+    floats.Data()[2] = 1.0f;
+    floats.Data()[3] = 7.0f;
+    auto floatBins = ComputeHistograms(ConstView(floats), 4)[0];
+    R_ASSERT_EQ((floatBins == std::vector<uint64_t>{1, 1, 0, 2}), true);
+}
+
+R_TEST_F(Statistics, Moments) {
+    auto bytes = RandomImage<uint8_t>(130, 70, ColorSpace::RGBA, 8, 17);
+    auto words = RandomImage<uint16_t>(130, 70, ColorSpace::RGBA, 16, 17);
+    auto byteStatistics = ComputeStatistics(ConstView(bytes));
+    auto wordStatistics = ComputeStatistics(ConstView(words));
+    for (int c = 0; c < 4; ++c) {
+        double sum[2] = {0, 0};
+        double squares[2] = {0, 0};
+        double low[2] = {1e9, 1e9};
+        double high[2] = {0, 0};
+        for (size_t i = c; i < bytes.Data().size(); i += 4) {
+            double values[2] = {static_cast<double>(bytes.Data()[i]),
+                static_cast<double>(words.Data()[i])};
+            for (int k = 0; k < 2; ++k) {
+                sum[k] += values[k];
+                squares[k] += values[k] * values[k];
+                low[k] = std::min(low[k], values[k]);
+                high[k] = std::max(high[k], values[k]);
+            }
+        }
+        const ChannelStatistics *statistics[2] = {&byteStatistics[c],
+            &wordStatistics[c]};
+        for (int k = 0; k < 2; ++k) {
+            double mean = sum[k] / (130 * 70);
+            double variance = squares[k] / (130 * 70) - mean * mean;
+            R_ASSERT_EQ(statistics[k]->min, low[k]);
+            R_ASSERT_EQ(statistics[k]->max, high[k]);
+            R_ASSERT_EQ(std::fabs(statistics[k]->mean - mean) < 1e-6 * mean,
+                true);
+            R_ASSERT_EQ(std::fabs(statistics[k]->variance - variance) <
+                1e-6 * variance, true);
+        }
+    }
+
+    Image<float> flat(30, 20, ColorSpace::Gray, 16);
+    std::fill(flat.Data().begin(), flat.Data().end(), 0.25f);
+    auto flatStatistics = ComputeStatistics(ConstView(flat))[0];
+    R_ASSERT_EQ(flatStatistics.max, 0.25);
+    R_ASSERT_EQ(flatStatistics.mean, 0.25);
+    R_ASSERT_EQ(flatStatistics.variance < 1e-12, true);
+}
+
+R_TEST_F(Statistics, Opaque) {
+    Image<uint8_t> rgba(301, 40, ColorSpace::RGBA);
+    std::fill(rgba.Data().begin(), rgba.Data().end(), 255);
+    R_ASSERT_EQ(Detects(rgba, true, true), true);
+    // in the last register of a row and past the registers
+    for (int x : {260, 299, 300}) {
+        rgba.View().Pixel(x, 33)[3] = 254;
+        R_ASSERT_EQ(Detects(rgba, false, true), true);
+        rgba.View().Pixel(x, 33)[3] = 255;
+    }
+
+    Image<uint8_t> grayAlpha(200, 20, ColorSpace::GrayAlpha);
+    std::fill(grayAlpha.Data().begin(), grayAlpha.Data().end(), 255);
+    grayAlpha.View().Pixel(77, 19)[1] = 0;
+    R_ASSERT_EQ(Detects(grayAlpha, false, true), true);
+
+    Image<float> floats(10, 10, ColorSpace::RGBA, 16);
+    std::fill(floats.Data().begin(), floats.Data().end(), 1.0f);
+    R_ASSERT_EQ(Detects(floats, true, true), true);
+    floats.View().Pixel(3, 3)[3] = 0.99f;
+    R_ASSERT_EQ(Detects(floats, false, true), true);
+}
+
+R_TEST_F(Statistics, Grayscale) {
+    auto gray = RandomImage<uint8_t>(200, 40, ColorSpace::Gray, 8, 17);
+    Image<uint8_t> rgb = gray.ConvertToColor(ColorSpace::RGB);
+    R_ASSERT_EQ(Detects(rgb, true, true), true);
+    // each sample of a pixel, where each falls in turn within a register
+    for (int x : {0, 10, 21, 31, 32, 170, 199}) {
+        for (int c = 0; c < 3; ++c) {
+            uint8_t &sample = rgb.View().Pixel(x, 17)[c];
+            sample ^= 1;
+            R_ASSERT_EQ(Detects(rgb, true, false), true);
+            sample ^= 1;
+        }
+    }
+
+    Image<uint8_t> rgba = gray.ConvertToColor(ColorSpace::RGBA);
+    R_ASSERT_EQ(Detects(rgba, true, true), true);
+    rgba.View().Pixel(55, 39)[2] ^= 4;
+    R_ASSERT_EQ(Detects(rgba, true, false), true);
+
+    Image<uint16_t> ycc(20, 20, ColorSpace::YCbCr, 10);
+    for (size_t i = 0; i < ycc.Data().size(); ++i) {
+        ycc.Data()[i] = static_cast<uint16_t>(i % 3 == 0 ? i : 512);
+    }
+    R_ASSERT_EQ(Detects(ycc, true, true), true);
+    ycc.Data()[100] = 513;
+    R_ASSERT_EQ(Detects(ycc, true, false), true);
+    R_ASSERT_EQ(Detects(gray, true, true), true);
+}
+
+}
+}
+}
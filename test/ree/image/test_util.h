@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+#include <ree/image/simd.hpp>
+#include <ree/image/process/image.hpp>
+
+namespace ree {
+namespace image {
+
+/// the same pseudo-random sequence on every platform, for a given seed
+class TestRandom {
+public:
+    explicit TestRandom(uint32_t seed) : state_(seed) {}
+
+    /// the next 24 random bits
+    uint32_t Next() {
+        state_ = state_ * 1103515245 + 12345;
+        return state_ >> 8;
+    }
+
+private:
+    uint32_t state_;
+};
+
+/// samples of depth bits, each drawn from a TestRandom of seed
+template <typename ValueT>
+process::Image<ValueT> RandomImage(int w, int h, class ColorSpace cs,
+    uint8_t depth, uint32_t seed) {
+    process::Image<ValueT> image(w, h, cs, depth);
+    TestRandom random(seed);
+    uint32_t mask = (uint32_t(1) << depth) - 1;
+    for (auto &v : image.Data()) {
+        v = static_cast<ValueT>(random.Next() & mask);
+    }
+    return image;
+}
+
+/// fn() with the kernels capped at level, lifting the cap afterwards
+template <typename Fn>
+auto AtSimdLevel(SimdLevel level, const Fn &fn) -> decltype(fn()) {
+    struct Uncap {
+        ~Uncap() { SetMaxSimdLevel(SimdLevel::Avx2); }
+    } uncap;
+    SetMaxSimdLevel(level);
+    return fn();
+}
+
+/// whether fn() gives at every level what it gives with the scalar kernels
+template <typename Fn>
+bool SameAtEverySimdLevel(const Fn &fn) {
+    auto expected = AtSimdLevel(SimdLevel::Scalar, fn);
+    return AtSimdLevel(SimdLevel::Ssse3, fn) == expected &&
+        AtSimdLevel(SimdLevel::Avx2, fn) == expected;
+}
+
+}
+}
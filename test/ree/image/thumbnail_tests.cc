@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <ree/unittest.h>
+
+#include <ree/image/io/error.hpp>
+#include <ree/image/io/image.hpp>
+#include <ree/image/process/resample.hpp>
+#include <ree/image/process/thumbnail.hpp>
+#include <ree/image/test_config.h>
+
+namespace ree {
+namespace image {
+namespace process {
+
+R_TEST_F(Thumbnail, ResampleKeepsFlatRows) {
+    // the weights of every destination sample add up to one
+    RowResampler<uint8_t> resampler(37, 29, 11, 8, 3);
+    std::vector<uint8_t> rows(37 * 3 * 29, 200);
+    int emitted = 0;
+    resampler.PushRows(rows.data(), 37 * 3, 29,
+        [&emitted](int y, const uint8_t *row) {
+        R_ASSERT_EQ(y, emitted);
+        for (int i = 0; i < 11 * 3; ++i) {
+            R_ASSERT_EQ(row[i], 200);
+        }
+        emitted++;
+    });
+    R_ASSERT_EQ(emitted, 8);
+}
+
+R_TEST_F(Thumbnail, ScaledJpeg) {
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.jpg");
+    io::LoadOptions options;
+    options["scale_denom"] = "4";
+    io::Image scaled = io::Image::Load(source.get(), options);
+    R_ASSERT_EQ(scaled.Width(), 15);
+    R_ASSERT_EQ(scaled.Height(), 13);
+
+    auto target = ree::io::Source::SourceByPath(kTestAssetsDir + "thumb.ppm");
+    io::WriteOptions writeOptions;
+    writeOptions["format"] = "ppm";
+    io::ImageInfo info = Thumbnail(source.get(), target.get(), 20, 20, 85,
+        writeOptions);
+    R_ASSERT_EQ(info.width, 20);
+    R_ASSERT_EQ(info.height, 17);
+
+    io::Image thumb = io::Image::Load(target.get());
+    R_ASSERT_EQ(thumb.Width(), 20);
+    R_ASSERT_EQ(thumb.Height(), 17);
+    R_ASSERT_EQ(thumb.ColorSpace(), ColorSpace::RGB);
+}
+
+R_TEST_F(Thumbnail, WritesOrRefuses) {
+    // every format either writes the thumbnail or throws, never an empty file
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.jpg");
+    for (std::string format : {"ppm", "png", "jpg", "bmp"}) {
+        std::string path = kTestAssetsDir + "thumb_out." + format;
+        std::remove(path.c_str());
+        auto target = ree::io::Source::SourceByPath(path);
+        io::WriteOptions options;
+        options["format"] = format;
+        bool refused = false;
+        try {
+            Thumbnail(source.get(), target.get(), 16, 16, 85, options);
+        } catch (const io::NotImplementException &) {
+            refused = true;
+        }
+        R_ASSERT_EQ(refused, format != "ppm");
+
+        uint8_t byte = 0;
+        size_t read = 0;
+        if (target->OpenToRead() == 0) {
+            read = target->Read(&byte, 1);
+            target->Close();
+        }
+        R_ASSERT_EQ(read, refused ? 0u : 1u);
+    }
+}
+
+}
+}
+}
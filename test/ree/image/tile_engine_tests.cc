@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include <ree/unittest.h>
+
+#include <ree/image/io/image.hpp>
+#include <ree/image/process/image.hpp>
+#include <ree/image/process/tile_engine.hpp>
+#include <ree/image/test_config.h>
+
+namespace ree {
+namespace image {
+namespace process {
+
+/// 3x3 box blur, clamped to the pixels src holds
+static void BoxBlur(const ImageView<const uint8_t> &src,
+    const ImageView<uint8_t> &dst, int x, int y) {
+    int comps = src.Components();
+    for (int row = 0; row < dst.Height(); ++row) {
+        for (int col = 0; col < dst.Width(); ++col) {
+            for (int c = 0; c < comps; ++c) {
+                int sum = 0;
+                int count = 0;
+                for (int dy = -1; dy <= 1; ++dy) {
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        int sy = y + row + dy;
+                        int sx = x + col + dx;
+                        if (sx < 0 || sy < 0 || sx >= src.Width() ||
+                            sy >= src.Height()) {
+                            continue;
+                        }
+                        sum += src.Pixel(sx, sy)[c];
+                        count++;
+                    }
+                }
+                dst.Pixel(col, row)[c] = static_cast<uint8_t>(sum / count);
+            }
+        }
+    }
+}
+
+static void Invert(const ImageView<const uint8_t> &src,
+    const ImageView<uint8_t> &dst, int x, int y) {
+    for (int row = 0; row < dst.Height(); ++row) {
+        const uint8_t *in = src.Pixel(x, y + row);
+        uint8_t *out = dst.Row(row);
+        for (size_t i = 0; i < dst.RowValues(); ++i) {
+            out[i] = 255 - in[i];
+        }
+    }
+}
+
+R_TEST_F(TileEngine, MatchesWholeImage) {
+    auto source = ree::io::Source::SourceByPath(kTestAssetsDir + "dot1.ppm");
+    io::Image img = io::Image::Load(source.get());
+    auto view = img.View<uint8_t>();
+
+    // a single tile covering the image
+    TileOptions whole;
+    whole.tileWidth = img.Width();
+    whole.tileHeight = img.Height();
+    TileEngine<uint8_t> reference(whole);
+    reference.AddKernel(BoxBlur, 1);
+    reference.AddKernel(Invert);
+    reference.AddKernel(BoxBlur, 1);
+    Image<uint8_t> expected(img.Width(), img.Height(), ColorSpace::RGB);
+    reference.Run(view, expected.View());
+
+    // small tiles, streamed from the file under a tight budget
+    TileOptions tiled;
+    tiled.tileWidth = 16;
+    tiled.tileHeight = 8;
+    tiled.memoryBudget = 16 * 1024;
+    tiled.threads = 3;
+    TileEngine<uint8_t> engine(tiled);
+    engine.AddKernel(BoxBlur, 1);
+    engine.AddKernel(Invert);
+    engine.AddKernel(BoxBlur, 1);
+    io::ImageInfo info;
+    info.width = img.Width();
+    info.height = img.Height();
+    info.colorspace = ColorSpace::RGB;
+    auto plan = engine.Plan(info, true, false);
+    R_ASSERT_EQ(plan.bytes <= tiled.memoryBudget, true);
+
+    // an encoder holding the whole output leaves the tiles the rest, and
+    // one holding more than the budget is refused
+    size_t held = info.RowBytes() * info.height;
+    auto heldPlan = engine.Plan(info, true, true, held / 2);
+    R_ASSERT_EQ(heldPlan.bytes <= tiled.memoryBudget, true);
+    R_ASSERT_EQ(heldPlan.bytes >= held / 2, true);
+    bool refused = false;
+    try {
+        engine.Plan(info, true, true, tiled.memoryBudget + 1);
+    } catch (const std::invalid_argument &) {
+        refused = true;
+    }
+    R_ASSERT_EQ(refused, true);
+
+    Image<uint8_t> result(img.Width(), img.Height(), ColorSpace::RGB);
+    engine.Run(source.get(), result.View());
+    R_ASSERT_EQ(result.Data() == expected.Data(), true);
+
+    // and straight into an encoder
+    auto target = ree::io::Source::SourceByPath(kTestAssetsDir + "tiled.ppm");
+    engine.Run(source.get(), target.get(), {{"format", "ppm"}});
+    io::Image written = io::Image::Load(target.get());
+    R_ASSERT_EQ(std::equal(written.Data().begin(), written.Data().end(),
+        expected.Data().begin()), true);
+}
+
+}
+}
+}
@@ -0,0 +1,470 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <ree/image/color_convert.hpp>
+#include <ree/image/thread_pool.hpp>
+#include <ree/image/io/decoder.hpp>
+#include <ree/image/io/encoder.hpp>
+#include <ree/image/io/error.hpp>
+#include <ree/image/io/format_registry.hpp>
+#include <ree/image/io/image.hpp>
+#include <ree/image/process/thumbnail.hpp>
+
+using ree::image::ColorSpace;
+using ree::image::ThreadPool;
+namespace io = ree::image::io;
+
+static const char *kUsage =
+    "usage: ree_image_convert [options] <file|directory|@list>...\n"
+    "  -o <dir>       directory the converted images are written to, files\n"
+    "                 found in a directory keep their path below it\n"
+    "  -f <format>    extension of a format with an encoder, default ppm\n"
+    "  -q <quality>   encoder quality, default 85\n"
+    "  -s <denom>     decode scaled down by 2, 4 or 8 where possible\n"
+    "  -r <W>x<H>     fit into W x H with Lanczos-3, never enlarging\n"
+    "  -c <space>     color space written: gray, grayalpha, rgb or rgba,\n"
+    "                 not with -r which keeps the color space\n"
+    "  -t <threads>   worker threads, default one per hardware thread\n"
+    "  -m <MiB>       memory the images in flight may take, default 512\n"
+    "  -u             turn JPEG images upright as EXIF tells\n";
+
+struct Options {
+    std::string outputDir;
+    std::string format = "ppm";
+    int quality = 85;
+    int scaleDenom = 1;
+    int fitWidth = 0;
+    int fitHeight = 0;
+    ColorSpace colorspace { ColorSpace::Unknown };
+    size_t threads = 0;
+    size_t memoryBudget = size_t(512) << 20;
+    bool upright = false;
+};
+
+/// a file to convert and where its output goes below the output directory
+struct Input {
+    std::string path;
+    std::string relative;
+};
+
+struct Job {
+    std::string input;
+    std::string output;
+
+    io::ImageInfo in;
+    io::ImageInfo out;
+    size_t inputBytes = 0;
+    double seconds = 0;
+    std::string error;
+};
+
+/**
+ * @brief bytes the images in flight may take together. A job larger than the
+ * whole budget waits until it runs alone.
+ */
+class MemoryBudget {
+public:
+    explicit MemoryBudget(size_t bytes) : available_(bytes), total_(bytes) {}
+
+    size_t Acquire(size_t bytes) {
+        bytes = std::min(bytes, total_);
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this, bytes]() { return available_ >= bytes; });
+        available_ -= bytes;
+        return bytes;
+    }
+    void Release(size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            available_ += bytes;
+        }
+        cv_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t available_;
+    size_t total_;
+};
+
+static bool ParseColorSpace(const std::string &name, ColorSpace *colorspace) {
+    static const std::pair<const char *, ColorSpace::Value> kNames[] = {
+        {"gray", ColorSpace::Gray}, {"grayalpha", ColorSpace::GrayAlpha},
+        {"rgb", ColorSpace::RGB}, {"rgba", ColorSpace::RGBA},
+    };
+    for (const auto &entry : kNames) {
+        if (name == entry.first) {
+            *colorspace = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ParseArguments(int argc, char const *argv[], Options *options,
+    std::vector<std::string> *inputs) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.size() != 2 || arg[0] != '-') {
+            inputs->push_back(arg);
+            continue;
+        }
+        if (arg == "-u") {
+            options->upright = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        switch (arg[1]) {
+        case 'o': options->outputDir = value; break;
+        case 'f': options->format = value; break;
+        case 'q': options->quality = std::atoi(value.c_str()); break;
+        case 's': options->scaleDenom = std::atoi(value.c_str()); break;
+        case 't': options->threads = std::strtoul(value.c_str(), nullptr, 10);
+            break;
+        case 'm':
+            options->memoryBudget = std::strtoul(value.c_str(), nullptr, 10)
+                << 20;
+            break;
+        case 'r':
+            if (std::sscanf(value.c_str(), "%dx%d", &options->fitWidth,
+                &options->fitHeight) != 2 || options->fitWidth <= 0 ||
+                options->fitHeight <= 0) {
+                return false;
+            }
+            break;
+        case 'c':
+            if (!ParseColorSpace(value, &options->colorspace)) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    return !options->outputDir.empty() && !inputs->empty();
+}
+
+static size_t FileSize(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+}
+
+static bool IsDirectory(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/// the files below directory of a format the registry knows, recursively,
+/// each relative to the directory given with prefix before it
+static void ListDirectory(const std::string &directory,
+    const std::string &prefix, std::vector<Input> *files) {
+    DIR *dir = opendir(directory.c_str());
+    if (!dir) {
+        std::cerr << "can not open " << directory << std::endl;
+        return;
+    }
+    std::vector<std::string> names;
+    while (struct dirent *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..") {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+
+    std::sort(names.begin(), names.end());
+    for (const auto &name : names) {
+        std::string path = directory + "/" + name;
+        if (IsDirectory(path)) {
+            ListDirectory(path, prefix + name + "/", files);
+        } else if (io::FormatRegistry::Instance().FindByPath(path)) {
+            files->push_back({path, prefix + name});
+        }
+    }
+}
+
+static std::string BaseName(const std::string &path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+/// files named or listed go right into the output directory, those found in
+/// a directory keep their path below it
+static std::vector<Input> ExpandInputs(
+    const std::vector<std::string> &inputs) {
+    std::vector<Input> files;
+    for (const auto &input : inputs) {
+        if (input[0] == '@') {
+            std::ifstream list(input.substr(1));
+            std::string line;
+            while (std::getline(list, line)) {
+                if (!line.empty()) {
+                    files.push_back({line, BaseName(line)});
+                }
+            }
+        } else if (IsDirectory(input)) {
+            ListDirectory(input, "", &files);
+        } else {
+            files.push_back({input, BaseName(input)});
+        }
+    }
+    return files;
+}
+
+static std::string OutputPath(const Options &options,
+    const std::string &relative) {
+    std::string name = relative;
+    size_t dot = name.find_last_of('.');
+    size_t slash = name.find_last_of('/');
+    if (dot != std::string::npos &&
+        (slash == std::string::npos ? dot > 0 : dot > slash + 1)) {
+        name.resize(dot);
+    }
+    return options.outputDir + "/" + name + "." + options.format;
+}
+
+/// whether the registry knows format and has an encoder for it
+static bool CanEncode(const std::string &format) {
+    io::FileFormat *found =
+        io::FormatRegistry::Instance().FindByExtension(format);
+    if (!found) {
+        return false;
+    }
+    // formats without an encoder give no compose context
+    std::unique_ptr<io::WriteContext> ctx(
+        found->CreateComposeContext(nullptr, io::WriteOptions()));
+    return ctx != nullptr;
+}
+
+/// create the directories leading to path, returns false if one can not be
+static bool MakeParents(const std::string &path) {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos;
+        slash = path.find('/', slash + 1)) {
+        std::string directory = path.substr(0, slash);
+        if (mkdir(directory.c_str(), 0755) != 0 && !IsDirectory(directory)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// what decoding and encoding info takes at most, the whole image for
+/// formats that can not stream their rows
+static size_t EstimateBytes(const Options &options, const io::ImageInfo &info) {
+    static constexpr size_t kStripRows = 64;
+    if (options.fitWidth > 0) {
+        return info.RowBytes() * kStripRows;
+    }
+    size_t denom = static_cast<size_t>(options.scaleDenom);
+    return info.RowBytes() / denom * ((info.height + denom - 1) / denom) * 2;
+}
+
+/// decode into the wanted color space strip by strip, handing every strip to
+/// the encoder before decoding the next
+static void Transcode(const Options &options, Job &job) {
+    static constexpr int kStripRows = 16;
+    thread_local io::Decoder decoder;
+    thread_local io::Encoder encoder;
+
+    auto source = ree::io::Source::SourceByPath(job.input);
+    auto target = ree::io::Source::SourceByPath(job.output);
+    io::WriteOptions writeOptions;
+    writeOptions["format"] = options.format;
+
+    if (options.fitWidth > 0) {
+        job.in = io::Image::Probe(source.get());
+        job.out = ree::image::process::Thumbnail(source.get(), target.get(),
+            options.fitWidth, options.fitHeight, options.quality,
+            writeOptions);
+        return;
+    }
+
+    io::LoadOptions loadOptions;
+    loadOptions["scale_denom"] = std::to_string(options.scaleDenom);
+    if (options.upright) {
+        loadOptions["apply_orientation"] = "true";
+    }
+    writeOptions["quality"] = std::to_string(options.quality);
+
+    io::ImageInfo info = decoder.Begin(source.get(), loadOptions,
+        options.colorspace);
+    job.in = info;
+    job.out = info;
+    if (options.colorspace != ColorSpace::Unknown) {
+        job.out.colorspace = options.colorspace;
+    }
+    try {
+        if (!ree::image::CanConvert(info.colorspace, job.out.colorspace)) {
+            throw std::invalid_argument("can not convert from " +
+                info.colorspace.ToString() + ".");
+        }
+        std::vector<uint8_t> strip(info.RowBytes() * kStripRows);
+        std::vector<uint8_t> converted(job.out.RowBytes() * kStripRows);
+        bool direct = info.colorspace == job.out.colorspace;
+        encoder.Begin(target.get(), job.out, writeOptions);
+        int y = 0;
+        while (y < info.height) {
+            int n = decoder.ReadRows(strip.data(), info.RowBytes(),
+                kStripRows);
+            if (n <= 0) {
+                throw io::FileCorruptedException(
+                    "image ends before its last row.");
+            }
+            size_t count = static_cast<size_t>(info.width) * n;
+            if (direct) {
+                encoder.WriteRows(strip.data(), info.RowBytes(), n);
+            } else if (info.depth > 8) {
+                ree::image::ConvertPixels(
+                    reinterpret_cast<const uint16_t *>(strip.data()),
+                    info.colorspace,
+                    reinterpret_cast<uint16_t *>(converted.data()),
+                    job.out.colorspace, count, info.depth);
+                encoder.WriteRows(converted.data(), job.out.RowBytes(), n);
+            } else {
+                ree::image::ConvertPixels(strip.data(), info.colorspace,
+                    converted.data(), job.out.colorspace, count, info.depth);
+                encoder.WriteRows(converted.data(), job.out.RowBytes(), n);
+            }
+            y += n;
+        }
+        encoder.End();
+    } catch (...) {
+        decoder.End();
+        encoder.Reset();
+        throw;
+    }
+    decoder.End();
+}
+
+static double Megapixels(const io::ImageInfo &info) {
+    return static_cast<double>(info.width) * info.height / 1e6;
+}
+
+static void Report(const std::vector<Job> &jobs, double wallSeconds) {
+    double pixels = 0;
+    double busySeconds = 0;
+    size_t inputBytes = 0;
+    size_t failed = 0;
+    for (const auto &job : jobs) {
+        if (!job.error.empty()) {
+            failed++;
+            std::printf("FAIL %s: %s\n", job.input.c_str(), job.error.c_str());
+            continue;
+        }
+        double mp = Megapixels(job.in);
+        std::printf("%s %dx%d -> %dx%d %.1f KiB %.2f ms %.1f MP/s\n",
+            job.input.c_str(), job.in.width, job.in.height, job.out.width,
+            job.out.height, job.inputBytes / 1024.0, job.seconds * 1e3,
+            job.seconds > 0 ? mp / job.seconds : 0.0);
+        pixels += mp;
+        busySeconds += job.seconds;
+        inputBytes += job.inputBytes;
+    }
+    std::printf("%zu files, %zu failed, %.3f s wall, %.3f s busy\n",
+        jobs.size(), failed, wallSeconds, busySeconds);
+    if (wallSeconds > 0) {
+        std::printf("%.1f MP/s, %.1f MiB/s read, %.1f files/s\n",
+            pixels / wallSeconds, inputBytes / 1048576.0 / wallSeconds,
+            (jobs.size() - failed) / wallSeconds);
+    }
+}
+
+int main(int argc, char const *argv[]) {
+    Options options;
+    std::vector<std::string> inputs;
+    if (!ParseArguments(argc, argv, &options, &inputs) ||
+        (options.scaleDenom != 1 && options.scaleDenom != 2 &&
+        options.scaleDenom != 4 && options.scaleDenom != 8) ||
+        (options.fitWidth > 0 && options.colorspace != ColorSpace::Unknown)) {
+        std::cerr << kUsage;
+        return 2;
+    }
+    if (!CanEncode(options.format)) {
+        std::cerr << "can not write " << options.format << " images"
+            << std::endl;
+        return 2;
+    }
+
+    std::vector<Job> jobs;
+    std::vector<std::string> outputs;
+    for (const auto &input : ExpandInputs(inputs)) {
+        Job job;
+        job.input = input.path;
+        job.output = OutputPath(options, input.relative);
+        job.inputBytes = FileSize(input.path);
+        jobs.push_back(job);
+        outputs.push_back(job.output);
+    }
+    // two jobs writing one file would overwrite each other
+    std::sort(outputs.begin(), outputs.end());
+    auto duplicate = std::adjacent_find(outputs.begin(), outputs.end());
+    if (duplicate != outputs.end()) {
+        std::cerr << "more than one input converts to " << *duplicate
+            << std::endl;
+        return 2;
+    }
+    for (const auto &job : jobs) {
+        if (!MakeParents(job.output)) {
+            std::cerr << "can not create the directory of " << job.output
+                << std::endl;
+            return 2;
+        }
+    }
+
+    ThreadPool pool(options.threads);
+    MemoryBudget budget(options.memoryBudget);
+    auto start = std::chrono::steady_clock::now();
+    pool.ParallelFor(jobs.size(), [&](size_t i) {
+        Job &job = jobs[i];
+        size_t reserved = 0;
+        auto begin = std::chrono::steady_clock::now();
+        try {
+            auto source = ree::io::Source::SourceByPath(job.input);
+            reserved = budget.Acquire(
+                EstimateBytes(options, io::Image::Probe(source.get())));
+            begin = std::chrono::steady_clock::now();
+            Transcode(options, job);
+            if (FileSize(job.output) == 0) {
+                job.error = "nothing written";
+            }
+        } catch (const std::exception &e) {
+            job.error = e.what();
+            // some of the messages end in a line break
+            while (!job.error.empty() && job.error.back() == '\n') {
+                job.error.pop_back();
+            }
+        } catch (...) {
+            job.error = "unknown error";
+        }
+        job.seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+        budget.Release(reserved);
+    });
+    double wallSeconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    Report(jobs, wallSeconds);
+    for (const auto &job : jobs) {
+        if (!job.error.empty()) {
+            return 1;
+        }
+    }
+    return 0;
+}